@@ -0,0 +1,14 @@
+/*
+ * cmsis_os.h
+ *
+ *  Host replacement for the CMSIS-RTOS wrapper used by the SIL build.
+ *  The real header pulls in the FreeRTOS port; the firmware only needs the
+ *  CMSIS-RTOS2 API, which sil_os.c implements on POSIX threads.
+ */
+
+#ifndef SIL_CMSIS_OS_H_
+#define SIL_CMSIS_OS_H_
+
+#include "cmsis_os2.h"
+
+#endif /* SIL_CMSIS_OS_H_ */
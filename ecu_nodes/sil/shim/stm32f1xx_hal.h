@@ -0,0 +1,695 @@
+/*
+ * stm32f1xx_hal.h
+ *
+ *  Host replacement for the STM32F1 HAL used by the SIL build.
+ *  Only the types, registers and functions the firmware uses are provided;
+ *  names and values follow the ST headers so Core/ compiles unmodified.
+ */
+
+#ifndef SIL_STM32F1XX_HAL_H_
+#define SIL_STM32F1XX_HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Common ---------------------------------------------------------------------*/
+typedef enum {
+  HAL_OK      = 0x00U,
+  HAL_ERROR   = 0x01U,
+  HAL_BUSY    = 0x02U,
+  HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum { RESET = 0U, SET = !RESET } FlagStatus, ITStatus;
+typedef enum { DISABLE = 0U, ENABLE = !DISABLE } FunctionalState;
+
+#define __IO volatile
+#define UNUSED(X) (void)(X)
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+#define __HAL_LINKDMA(__HANDLE__, __PPP_DMA_FIELD__, __DMA_HANDLE__) \
+  do {                                                               \
+    (__HANDLE__)->__PPP_DMA_FIELD__ = &(__DMA_HANDLE__);             \
+    (__DMA_HANDLE__).Parent = (__HANDLE__);                          \
+  } while (0U)
+
+/* Interrupts -----------------------------------------------------------------*/
+typedef enum {
+  PendSV_IRQn             = -2,
+  SysTick_IRQn            = -1,
+  EXTI0_IRQn              = 6,
+  EXTI1_IRQn              = 7,
+  EXTI2_IRQn              = 8,
+  EXTI3_IRQn              = 9,
+  EXTI4_IRQn              = 10,
+  DMA1_Channel1_IRQn      = 11,
+  DMA1_Channel2_IRQn      = 12,
+  DMA1_Channel3_IRQn      = 13,
+  DMA1_Channel4_IRQn      = 14,
+  DMA1_Channel5_IRQn      = 15,
+  DMA1_Channel6_IRQn      = 16,
+  DMA1_Channel7_IRQn      = 17,
+  ADC1_2_IRQn             = 18,
+  USB_HP_CAN1_TX_IRQn     = 19,
+  USB_LP_CAN1_RX0_IRQn    = 20,
+  CAN1_RX1_IRQn           = 21,
+  CAN1_SCE_IRQn           = 22,
+  EXTI9_5_IRQn            = 23,
+  TIM1_BRK_IRQn           = 24,
+  TIM1_UP_IRQn            = 25,
+  TIM1_TRG_COM_IRQn       = 26,
+  TIM1_CC_IRQn            = 27,
+  TIM2_IRQn               = 28,
+  TIM3_IRQn               = 29,
+  TIM4_IRQn               = 30,
+  EXTI15_10_IRQn          = 40,
+  SIL_IRQn_COUNT          = 43
+} IRQn_Type;
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_SetPendingIRQ(IRQn_Type IRQn);
+
+/* PRIMASK: held by the calling thread until __enable_irq(), interrupt handlers wait */
+void __disable_irq(void);
+void __enable_irq(void);
+
+/* Core -----------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_Init(void);
+void HAL_MspInit(void);
+void HAL_IncTick(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+/* RCC ------------------------------------------------------------------------*/
+#define RCC_OSCILLATORTYPE_HSE    0x00000001U
+#define RCC_OSCILLATORTYPE_HSI    0x00000002U
+#define RCC_HSE_ON                0x00010000U
+#define RCC_HSE_PREDIV_DIV1       0x00000000U
+#define RCC_HSI_ON                0x00000001U
+#define RCC_PLL_ON                0x00000002U
+#define RCC_PLLSOURCE_HSE         0x00010000U
+#define RCC_PLL_MUL9              0x001C0000U
+#define RCC_CLOCKTYPE_SYSCLK      0x00000001U
+#define RCC_CLOCKTYPE_HCLK        0x00000002U
+#define RCC_CLOCKTYPE_PCLK1       0x00000004U
+#define RCC_CLOCKTYPE_PCLK2       0x00000008U
+#define RCC_SYSCLKSOURCE_PLLCLK   0x00000002U
+#define RCC_SYSCLK_DIV1           0x00000000U
+#define RCC_HCLK_DIV1             0x00000000U
+#define RCC_HCLK_DIV2             0x00000400U
+#define FLASH_LATENCY_2           0x00000002U
+#define RCC_PERIPHCLK_ADC         0x00000002U
+#define RCC_ADCPCLK2_DIV6         0x00008000U
+
+typedef struct {
+  uint32_t PLLState;
+  uint32_t PLLSource;
+  uint32_t PLLMUL;
+} RCC_PLLInitTypeDef;
+
+typedef struct {
+  uint32_t OscillatorType;
+  uint32_t HSEState;
+  uint32_t HSEPredivValue;
+  uint32_t LSEState;
+  uint32_t HSIState;
+  uint32_t HSICalibrationValue;
+  uint32_t LSIState;
+  RCC_PLLInitTypeDef PLL;
+} RCC_OscInitTypeDef;
+
+typedef struct {
+  uint32_t ClockType;
+  uint32_t SYSCLKSource;
+  uint32_t AHBCLKDivider;
+  uint32_t APB1CLKDivider;
+  uint32_t APB2CLKDivider;
+} RCC_ClkInitTypeDef;
+
+typedef struct {
+  uint32_t PeriphClockSelection;
+  uint32_t RTCClockSelection;
+  uint32_t AdcClockSelection;
+} RCC_PeriphCLKInitTypeDef;
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct);
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency);
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+
+extern uint32_t SystemCoreClock;
+
+/* Clocks are always on in the SIL */
+#define SIL_NOP() do { } while (0U)
+#define __HAL_RCC_GPIOA_CLK_ENABLE()    SIL_NOP()
+#define __HAL_RCC_GPIOB_CLK_ENABLE()    SIL_NOP()
+#define __HAL_RCC_GPIOC_CLK_ENABLE()    SIL_NOP()
+#define __HAL_RCC_GPIOD_CLK_ENABLE()    SIL_NOP()
+#define __HAL_RCC_AFIO_CLK_ENABLE()     SIL_NOP()
+#define __HAL_RCC_PWR_CLK_ENABLE()      SIL_NOP()
+#define __HAL_RCC_DMA1_CLK_ENABLE()     SIL_NOP()
+#define __HAL_RCC_ADC1_CLK_ENABLE()     SIL_NOP()
+#define __HAL_RCC_ADC1_CLK_DISABLE()    SIL_NOP()
+#define __HAL_RCC_CAN1_CLK_ENABLE()     SIL_NOP()
+#define __HAL_RCC_CAN1_CLK_DISABLE()    SIL_NOP()
+#define __HAL_RCC_TIM1_CLK_ENABLE()     SIL_NOP()
+#define __HAL_RCC_TIM1_CLK_DISABLE()    SIL_NOP()
+#define __HAL_RCC_TIM2_CLK_ENABLE()     SIL_NOP()
+#define __HAL_RCC_TIM2_CLK_DISABLE()    SIL_NOP()
+#define __HAL_RCC_TIM3_CLK_ENABLE()     SIL_NOP()
+#define __HAL_RCC_TIM3_CLK_DISABLE()    SIL_NOP()
+#define __HAL_RCC_TIM4_CLK_ENABLE()     SIL_NOP()
+#define __HAL_RCC_TIM4_CLK_DISABLE()    SIL_NOP()
+#define __HAL_AFIO_REMAP_SWJ_NOJTAG()   SIL_NOP()
+#define __HAL_AFIO_REMAP_CAN1_2()       SIL_NOP()
+
+/* GPIO / EXTI ----------------------------------------------------------------*/
+typedef struct {
+  __IO uint32_t CRL;
+  __IO uint32_t CRH;
+  __IO uint32_t IDR;
+  __IO uint32_t ODR;
+  __IO uint32_t BSRR;
+  __IO uint32_t BRR;
+  __IO uint32_t LCKR;
+} GPIO_TypeDef;
+
+typedef struct {
+  __IO uint32_t IMR;
+  __IO uint32_t EMR;
+  __IO uint32_t RTSR;
+  __IO uint32_t FTSR;
+  __IO uint32_t SWIER;
+  __IO uint32_t PR;
+} EXTI_TypeDef;
+
+extern GPIO_TypeDef sil_gpioa, sil_gpiob, sil_gpioc, sil_gpiod;
+extern EXTI_TypeDef sil_exti;
+#define GPIOA (&sil_gpioa)
+#define GPIOB (&sil_gpiob)
+#define GPIOC (&sil_gpioc)
+#define GPIOD (&sil_gpiod)
+#define EXTI  (&sil_exti)
+
+typedef enum { GPIO_PIN_RESET = 0U, GPIO_PIN_SET } GPIO_PinState;
+
+#define GPIO_PIN_0    ((uint16_t)0x0001)
+#define GPIO_PIN_1    ((uint16_t)0x0002)
+#define GPIO_PIN_2    ((uint16_t)0x0004)
+#define GPIO_PIN_3    ((uint16_t)0x0008)
+#define GPIO_PIN_4    ((uint16_t)0x0010)
+#define GPIO_PIN_5    ((uint16_t)0x0020)
+#define GPIO_PIN_6    ((uint16_t)0x0040)
+#define GPIO_PIN_7    ((uint16_t)0x0080)
+#define GPIO_PIN_8    ((uint16_t)0x0100)
+#define GPIO_PIN_9    ((uint16_t)0x0200)
+#define GPIO_PIN_10   ((uint16_t)0x0400)
+#define GPIO_PIN_11   ((uint16_t)0x0800)
+#define GPIO_PIN_12   ((uint16_t)0x1000)
+#define GPIO_PIN_13   ((uint16_t)0x2000)
+#define GPIO_PIN_14   ((uint16_t)0x4000)
+#define GPIO_PIN_15   ((uint16_t)0x8000)
+#define GPIO_PIN_All  ((uint16_t)0xFFFF)
+
+#define GPIO_MODE_INPUT                 0x00000000U
+#define GPIO_MODE_OUTPUT_PP             0x00000001U
+#define GPIO_MODE_OUTPUT_OD             0x00000011U
+#define GPIO_MODE_AF_PP                 0x00000002U
+#define GPIO_MODE_AF_OD                 0x00000012U
+#define GPIO_MODE_AF_INPUT              GPIO_MODE_INPUT
+#define GPIO_MODE_ANALOG                0x00000003U
+#define GPIO_MODE_IT_RISING             0x10110000U
+#define GPIO_MODE_IT_FALLING            0x10210000U
+#define GPIO_MODE_IT_RISING_FALLING     0x10310000U
+
+#define GPIO_NOPULL                     0x00000000U
+#define GPIO_PULLUP                     0x00000001U
+#define GPIO_PULLDOWN                   0x00000002U
+
+#define GPIO_SPEED_FREQ_LOW             0x00000002U
+#define GPIO_SPEED_FREQ_MEDIUM          0x00000001U
+#define GPIO_SPEED_FREQ_HIGH            0x00000003U
+
+typedef struct {
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+} GPIO_InitTypeDef;
+
+#define __HAL_GPIO_EXTI_GET_IT(__EXTI_LINE__)   (EXTI->PR & (__EXTI_LINE__))
+#define __HAL_GPIO_EXTI_CLEAR_IT(__EXTI_LINE__) __atomic_and_fetch(&EXTI->PR, ~(uint32_t)(__EXTI_LINE__), __ATOMIC_SEQ_CST)
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_IRQHandler(uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+
+/* DMA ------------------------------------------------------------------------*/
+typedef struct {
+  __IO uint32_t CCR;
+  __IO uint32_t CNDTR;
+  __IO uint32_t CPAR;
+  __IO uint32_t CMAR;
+} DMA_Channel_TypeDef;
+
+extern DMA_Channel_TypeDef sil_dma1_channel[7];
+#define DMA1_Channel1 (&sil_dma1_channel[0])
+#define DMA1_Channel2 (&sil_dma1_channel[1])
+#define DMA1_Channel3 (&sil_dma1_channel[2])
+#define DMA1_Channel4 (&sil_dma1_channel[3])
+#define DMA1_Channel5 (&sil_dma1_channel[4])
+#define DMA1_Channel6 (&sil_dma1_channel[5])
+#define DMA1_Channel7 (&sil_dma1_channel[6])
+
+#define DMA_PERIPH_TO_MEMORY      0x00000000U
+#define DMA_MEMORY_TO_PERIPH      0x00000010U
+#define DMA_PINC_ENABLE           0x00000040U
+#define DMA_PINC_DISABLE          0x00000000U
+#define DMA_MINC_ENABLE           0x00000080U
+#define DMA_MINC_DISABLE          0x00000000U
+#define DMA_PDATAALIGN_BYTE       0x00000000U
+#define DMA_PDATAALIGN_HALFWORD   0x00000100U
+#define DMA_PDATAALIGN_WORD       0x00000200U
+#define DMA_MDATAALIGN_BYTE       0x00000000U
+#define DMA_MDATAALIGN_HALFWORD   0x00000400U
+#define DMA_MDATAALIGN_WORD       0x00000800U
+#define DMA_NORMAL                0x00000000U
+#define DMA_CIRCULAR              0x00000020U
+#define DMA_PRIORITY_LOW          0x00000000U
+#define DMA_PRIORITY_MEDIUM       0x00001000U
+#define DMA_PRIORITY_HIGH         0x00002000U
+#define DMA_PRIORITY_VERY_HIGH    0x00003000U
+
+typedef struct {
+  uint32_t Direction;
+  uint32_t PeriphInc;
+  uint32_t MemInc;
+  uint32_t PeriphDataAlignment;
+  uint32_t MemDataAlignment;
+  uint32_t Mode;
+  uint32_t Priority;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef {
+  DMA_Channel_TypeDef *Instance;
+  DMA_InitTypeDef Init;
+  void *Parent;
+  void (*XferCpltCallback)(struct __DMA_HandleTypeDef *hdma);
+  void (*XferHalfCpltCallback)(struct __DMA_HandleTypeDef *hdma);
+  void (*XferErrorCallback)(struct __DMA_HandleTypeDef *hdma);
+  __IO uint32_t ErrorCode;
+  __IO uint32_t SilFlags;        /* SIL: pending HT/TC events for HAL_DMA_IRQHandler */
+} DMA_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+
+/* ADC ------------------------------------------------------------------------*/
+typedef struct {
+  __IO uint32_t SR;
+  __IO uint32_t CR1;
+  __IO uint32_t CR2;
+  __IO uint32_t DR;
+} ADC_TypeDef;
+
+extern ADC_TypeDef sil_adc1;
+#define ADC1 (&sil_adc1)
+
+#define ADC_SCAN_DISABLE              0x00000000U
+#define ADC_SCAN_ENABLE               0x00000100U
+#define ADC_EXTERNALTRIGCONV_T1_CC1   0x00000000U
+#define ADC_EXTERNALTRIGCONV_T1_CC2   0x00020000U
+#define ADC_EXTERNALTRIGCONV_T1_CC3   0x00040000U
+#define ADC_EXTERNALTRIGCONV_T2_CC2   0x00060000U
+#define ADC_EXTERNALTRIGCONV_T3_TRGO  0x00080000U
+#define ADC_EXTERNALTRIGCONV_T4_CC4   0x000A0000U
+#define ADC_EXTERNALTRIGCONV_EXT_IT11 0x000C0000U
+#define ADC_SOFTWARE_START            0x000E0000U
+#define ADC_DATAALIGN_RIGHT           0x00000000U
+#define ADC_DATAALIGN_LEFT            0x00000800U
+
+#define ADC_CHANNEL_0                 0x00000000U
+#define ADC_CHANNEL_1                 0x00000001U
+#define ADC_CHANNEL_2                 0x00000002U
+#define ADC_CHANNEL_3                 0x00000003U
+#define ADC_CHANNEL_4                 0x00000004U
+#define ADC_CHANNEL_5                 0x00000005U
+#define ADC_CHANNEL_6                 0x00000006U
+#define ADC_CHANNEL_7                 0x00000007U
+#define ADC_CHANNEL_8                 0x00000008U
+#define ADC_CHANNEL_9                 0x00000009U
+#define ADC_CHANNEL_TEMPSENSOR        0x00000010U
+#define ADC_CHANNEL_VREFINT           0x00000011U
+#define SIL_ADC_CHANNELS              18U
+
+#define ADC_REGULAR_RANK_1            0x00000001U
+#define ADC_REGULAR_RANK_2            0x00000002U
+#define ADC_REGULAR_RANK_3            0x00000003U
+#define ADC_REGULAR_RANK_4            0x00000004U
+#define ADC_REGULAR_RANK_5            0x00000005U
+#define ADC_REGULAR_RANK_6            0x00000006U
+#define ADC_REGULAR_RANK_7            0x00000007U
+#define ADC_REGULAR_RANK_8            0x00000008U
+#define SIL_ADC_RANKS                 16U
+
+#define ADC_SAMPLETIME_1CYCLE_5       0x00000000U
+#define ADC_SAMPLETIME_7CYCLES_5      0x00000001U
+#define ADC_SAMPLETIME_13CYCLES_5     0x00000002U
+#define ADC_SAMPLETIME_28CYCLES_5     0x00000003U
+#define ADC_SAMPLETIME_41CYCLES_5     0x00000004U
+#define ADC_SAMPLETIME_55CYCLES_5     0x00000005U
+#define ADC_SAMPLETIME_71CYCLES_5     0x00000006U
+#define ADC_SAMPLETIME_239CYCLES_5    0x00000007U
+
+typedef struct {
+  uint32_t DataAlign;
+  uint32_t ScanConvMode;
+  FunctionalState ContinuousConvMode;
+  uint32_t NbrOfConversion;
+  FunctionalState DiscontinuousConvMode;
+  uint32_t NbrOfDiscConversion;
+  uint32_t ExternalTrigConv;
+} ADC_InitTypeDef;
+
+typedef struct {
+  uint32_t Channel;
+  uint32_t Rank;
+  uint32_t SamplingTime;
+} ADC_ChannelConfTypeDef;
+
+typedef struct __ADC_HandleTypeDef {
+  ADC_TypeDef *Instance;
+  ADC_InitTypeDef Init;
+  DMA_HandleTypeDef *DMA_Handle;
+  __IO uint32_t State;
+  __IO uint32_t ErrorCode;
+} ADC_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *hadc, ADC_ChannelConfTypeDef *sConfig);
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length);
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc);
+void HAL_ADC_MspInit(ADC_HandleTypeDef *hadc);
+void HAL_ADC_MspDeInit(ADC_HandleTypeDef *hadc);
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc);
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc);
+
+/* TIM ------------------------------------------------------------------------*/
+typedef struct {
+  __IO uint32_t CR1;
+  __IO uint32_t CR2;
+  __IO uint32_t SMCR;
+  __IO uint32_t DIER;
+  __IO uint32_t SR;
+  __IO uint32_t EGR;
+  __IO uint32_t CCMR1;
+  __IO uint32_t CCMR2;
+  __IO uint32_t CCER;
+  __IO uint32_t CNT;
+  __IO uint32_t PSC;
+  __IO uint32_t ARR;
+  __IO uint32_t RCR;
+  __IO uint32_t CCR1;
+  __IO uint32_t CCR2;
+  __IO uint32_t CCR3;
+  __IO uint32_t CCR4;
+  __IO uint32_t BDTR;
+  __IO uint32_t DCR;
+  __IO uint32_t DMAR;
+} TIM_TypeDef;
+
+extern TIM_TypeDef sil_tim1, sil_tim2, sil_tim3, sil_tim4;
+#define TIM1 (&sil_tim1)
+#define TIM2 (&sil_tim2)
+#define TIM3 (&sil_tim3)
+#define TIM4 (&sil_tim4)
+
+#define TIM_CR1_CEN                   0x00000001U
+#define TIM_DIER_UIE                  0x00000001U
+#define TIM_DIER_UDE                  0x00000100U
+#define TIM_SR_UIF                    0x00000001U
+#define TIM_CCER_CC1E                 0x00000001U
+#define TIM_BDTR_MOE                  0x00008000U
+#define TIM_DCR_DBA                   0x0000001FU
+#define TIM_DCR_DBL                   0x00001F00U
+
+#define TIM_CHANNEL_1                 0x00000000U
+#define TIM_CHANNEL_2                 0x00000004U
+#define TIM_CHANNEL_3                 0x00000008U
+#define TIM_CHANNEL_4                 0x0000000CU
+#define TIM_CHANNEL_ALL               0x0000003CU
+
+#define TIM_DMA_UPDATE                TIM_DIER_UDE
+#define TIM_DMA_ID_UPDATE             0U
+#define TIM_DMABASE_CCR1              0x0000000DU
+#define TIM_DMABURSTLENGTH_1TRANSFER  0x00000000U
+#define TIM_DMABURSTLENGTH_4TRANSFERS 0x00000300U
+
+#define TIM_COUNTERMODE_UP            0x00000000U
+#define TIM_CLOCKDIVISION_DIV1        0x00000000U
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0x00000000U
+#define TIM_AUTORELOAD_PRELOAD_ENABLE 0x00000080U
+#define TIM_CLOCKSOURCE_INTERNAL      0x00001000U
+#define TIM_TRGO_RESET                0x00000000U
+#define TIM_TRGO_UPDATE               0x00000020U
+#define TIM_MASTERSLAVEMODE_DISABLE   0x00000000U
+#define TIM_OCMODE_PWM1               0x00000060U
+#define TIM_OCPOLARITY_HIGH           0x00000000U
+#define TIM_OCNPOLARITY_HIGH          0x00000000U
+#define TIM_OCFAST_DISABLE            0x00000000U
+#define TIM_OCIDLESTATE_RESET         0x00000000U
+#define TIM_OCNIDLESTATE_RESET        0x00000000U
+#define TIM_OSSR_DISABLE              0x00000000U
+#define TIM_OSSI_DISABLE              0x00000000U
+#define TIM_LOCKLEVEL_OFF             0x00000000U
+#define TIM_BREAK_DISABLE             0x00000000U
+#define TIM_BREAKPOLARITY_HIGH        0x00002000U
+#define TIM_AUTOMATICOUTPUT_DISABLE   0x00000000U
+
+typedef struct {
+  uint32_t Prescaler;
+  uint32_t CounterMode;
+  uint32_t Period;
+  uint32_t ClockDivision;
+  uint32_t RepetitionCounter;
+  uint32_t AutoReloadPreload;
+} TIM_Base_InitTypeDef;
+
+typedef struct {
+  uint32_t ClockSource;
+  uint32_t ClockPolarity;
+  uint32_t ClockPrescaler;
+  uint32_t ClockFilter;
+} TIM_ClockConfigTypeDef;
+
+typedef struct {
+  uint32_t MasterOutputTrigger;
+  uint32_t MasterSlaveMode;
+} TIM_MasterConfigTypeDef;
+
+typedef struct {
+  uint32_t OCMode;
+  uint32_t Pulse;
+  uint32_t OCPolarity;
+  uint32_t OCNPolarity;
+  uint32_t OCFastMode;
+  uint32_t OCIdleState;
+  uint32_t OCNIdleState;
+} TIM_OC_InitTypeDef;
+
+typedef struct {
+  uint32_t OffStateRunMode;
+  uint32_t OffStateIDLEMode;
+  uint32_t LockLevel;
+  uint32_t DeadTime;
+  uint32_t BreakState;
+  uint32_t BreakPolarity;
+  uint32_t AutomaticOutput;
+} TIM_BreakDeadTimeConfigTypeDef;
+
+typedef struct {
+  TIM_TypeDef *Instance;
+  TIM_Base_InitTypeDef Init;
+  DMA_HandleTypeDef *hdma[7];
+  __IO uint32_t State;
+} TIM_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim, TIM_ClockConfigTypeDef *sClockSourceConfig);
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef *htim, TIM_OC_InitTypeDef *sConfig, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim, TIM_MasterConfigTypeDef *sMasterConfig);
+HAL_StatusTypeDef HAL_TIMEx_ConfigBreakDeadTime(TIM_HandleTypeDef *htim, TIM_BreakDeadTimeConfigTypeDef *sBreakDeadTimeConfig);
+HAL_StatusTypeDef HAL_TIM_DMABurst_WriteStart(TIM_HandleTypeDef *htim, uint32_t BurstBaseAddress,
+                                              uint32_t BurstRequestSrc, const uint32_t *BurstBuffer,
+                                              uint32_t BurstLength);
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef *htim);
+void HAL_TIM_Base_MspInit(TIM_HandleTypeDef *htim);
+void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef *htim);
+void HAL_TIM_PWM_MspInit(TIM_HandleTypeDef *htim);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
+
+/* CAN ------------------------------------------------------------------------*/
+typedef struct {
+  uint32_t SilUnused;
+} CAN_TypeDef;
+
+extern CAN_TypeDef sil_can1;
+#define CAN1 (&sil_can1)
+
+#define CAN_MODE_NORMAL               0x00000000U
+#define CAN_MODE_LOOPBACK             0x40000000U
+#define CAN_MODE_SILENT               0x80000000U
+#define CAN_SJW_1TQ                   0x00000000U
+#define CAN_BS1_1TQ                   0x00000000U
+#define CAN_BS1_TQ(n)                 ((uint32_t)((n) - 1U) << 16U)
+#define CAN_BS1_5TQ                   CAN_BS1_TQ(5U)
+#define CAN_BS1_6TQ                   CAN_BS1_TQ(6U)
+#define CAN_BS1_13TQ                  CAN_BS1_TQ(13U)
+#define CAN_BS2_1TQ                   0x00000000U
+#define CAN_BS2_TQ(n)                 ((uint32_t)((n) - 1U) << 20U)
+#define CAN_BS2_2TQ                   CAN_BS2_TQ(2U)
+#define CAN_BS2_3TQ                   CAN_BS2_TQ(3U)
+
+#define CAN_FILTERMODE_IDMASK         0x00000000U
+#define CAN_FILTERMODE_IDLIST         0x00000001U
+#define CAN_FILTERSCALE_16BIT         0x00000000U
+#define CAN_FILTERSCALE_32BIT         0x00000001U
+#define CAN_FILTER_DISABLE            0x00000000U
+#define CAN_FILTER_ENABLE             0x00000001U
+#define CAN_FILTER_FIFO0              0x00000000U
+#define CAN_FILTER_FIFO1              0x00000001U
+#define SIL_CAN_FILTER_BANKS          28U
+
+#define CAN_ID_STD                    0x00000000U
+#define CAN_ID_EXT                    0x00000004U
+#define CAN_RTR_DATA                  0x00000000U
+#define CAN_RTR_REMOTE                0x00000002U
+#define CAN_RX_FIFO0                  0x00000000U
+#define CAN_RX_FIFO1                  0x00000001U
+#define CAN_TX_MAILBOX0               0x00000001U
+#define CAN_TX_MAILBOX1               0x00000002U
+#define CAN_TX_MAILBOX2               0x00000004U
+
+#define CAN_IT_TX_MAILBOX_EMPTY       0x00000001U
+#define CAN_IT_RX_FIFO0_MSG_PENDING   0x00000002U
+#define CAN_IT_RX_FIFO0_FULL          0x00000004U
+#define CAN_IT_RX_FIFO0_OVERRUN       0x00000008U
+#define CAN_IT_RX_FIFO1_MSG_PENDING   0x00000010U
+#define CAN_IT_RX_FIFO1_FULL          0x00000020U
+#define CAN_IT_RX_FIFO1_OVERRUN       0x00000040U
+
+#define HAL_CAN_ERROR_NONE            0x00000000U
+#define HAL_CAN_ERROR_RX_FOV0         0x00000200U
+#define HAL_CAN_ERROR_RX_FOV1         0x00000400U
+#define HAL_CAN_ERROR_NOT_INITIALIZED 0x00040000U
+#define HAL_CAN_ERROR_NOT_STARTED     0x00100000U
+#define HAL_CAN_ERROR_PARAM           0x00200000U
+
+typedef enum {
+  HAL_CAN_STATE_RESET     = 0x00U,
+  HAL_CAN_STATE_READY     = 0x01U,
+  HAL_CAN_STATE_LISTENING = 0x02U,
+  HAL_CAN_STATE_ERROR     = 0x05U
+} HAL_CAN_StateTypeDef;
+
+typedef struct {
+  uint32_t Prescaler;
+  uint32_t Mode;
+  uint32_t SyncJumpWidth;
+  uint32_t TimeSeg1;
+  uint32_t TimeSeg2;
+  FunctionalState TimeTriggeredMode;
+  FunctionalState AutoBusOff;
+  FunctionalState AutoWakeUp;
+  FunctionalState AutoRetransmission;
+  FunctionalState ReceiveFifoLocked;
+  FunctionalState TransmitFifoPriority;
+} CAN_InitTypeDef;
+
+typedef struct {
+  uint32_t FilterIdHigh;
+  uint32_t FilterIdLow;
+  uint32_t FilterMaskIdHigh;
+  uint32_t FilterMaskIdLow;
+  uint32_t FilterFIFOAssignment;
+  uint32_t FilterBank;
+  uint32_t FilterMode;
+  uint32_t FilterScale;
+  uint32_t FilterActivation;
+  uint32_t SlaveStartFilterBank;
+} CAN_FilterTypeDef;
+
+typedef struct {
+  uint32_t StdId;
+  uint32_t ExtId;
+  uint32_t IDE;
+  uint32_t RTR;
+  uint32_t DLC;
+  FunctionalState TransmitGlobalTime;
+} CAN_TxHeaderTypeDef;
+
+typedef struct {
+  uint32_t StdId;
+  uint32_t ExtId;
+  uint32_t IDE;
+  uint32_t RTR;
+  uint32_t DLC;
+  uint32_t Timestamp;
+  uint32_t FilterMatchIndex;
+} CAN_RxHeaderTypeDef;
+
+typedef struct __CAN_HandleTypeDef {
+  CAN_TypeDef *Instance;
+  CAN_InitTypeDef Init;
+  __IO HAL_CAN_StateTypeDef State;
+  __IO uint32_t ErrorCode;
+} CAN_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_CAN_Init(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, CAN_FilterTypeDef *sFilterConfig);
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs);
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef *hcan, uint32_t InactiveITs);
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, CAN_TxHeaderTypeDef *pHeader, uint8_t aData[], uint32_t *pTxMailbox);
+HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes);
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef *hcan);
+uint32_t HAL_CAN_IsTxMessagePending(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes);
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo, CAN_RxHeaderTypeDef *pHeader, uint8_t aData[]);
+uint32_t HAL_CAN_GetRxFifoFillLevel(CAN_HandleTypeDef *hcan, uint32_t RxFifo);
+uint32_t HAL_CAN_GetError(CAN_HandleTypeDef *hcan);
+void HAL_CAN_IRQHandler(CAN_HandleTypeDef *hcan);
+void HAL_CAN_MspInit(CAN_HandleTypeDef *hcan);
+void HAL_CAN_MspDeInit(CAN_HandleTypeDef *hcan);
+void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo0FullCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo1FullCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIL_STM32F1XX_HAL_H_ */
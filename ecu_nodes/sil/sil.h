@@ -0,0 +1,103 @@
+/*
+ * sil.h
+ *
+ *  Internal interface of the software-in-the-loop runtime: the interrupt
+ *  model shared by the HAL, RTOS and board modules, and the board model.
+ */
+
+#ifndef SIL_SIL_H_
+#define SIL_SIL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "stm32f1xx_hal.h"
+
+#define SIL_TICK_RATE_HZ      1000U     // FreeRTOS and HAL tick, as configured in FreeRTOSConfig.h
+#define SIL_PCLK1_HZ          36000000U // APB1 clock of SystemClock_Config(), clocks bxCAN
+#define SIL_ADC_CLOCK_HZ      12000000U // PCLK2 / 6
+#define SIL_TIM_CLOCK_HZ      72000000U // Timer clock of APB1 (PCLK1 x 2) and APB2
+#define SIL_ADC_MAX           4095U
+
+/*
+ * @brief Runtime options, filled in by sil_main.c before the firmware starts
+ */
+typedef struct {
+  const char *canInterface;   // SocketCAN interface bxCAN is attached to
+  bool busTiming;             // Hold TX mailboxes for the frame time at the configured bit rate
+  bool quiet;                 // Do not log output changes
+  const char *name;           // Prefix of log lines, to tell instances apart
+} SilConfig;
+
+extern SilConfig sil_config;
+
+/*
+ * @brief Monotonic time in microseconds (CLOCK_MONOTONIC, comparable across processes)
+ */
+uint64_t sil_time_us(void);
+
+/*
+ * @brief Microseconds since the SIL started
+ */
+uint64_t sil_uptime_us(void);
+
+/*
+ * @brief Print a timestamped log line prefixed with the instance name
+ */
+void sil_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/*
+ * @brief Interrupt model. Handlers run one at a time on the thread that raised
+ *        them, holding the interrupt lock; __disable_irq() takes the same lock,
+ *        so a masked task section excludes every handler.
+ */
+void sil_irq_lock(void);
+void sil_irq_unlock(void);
+
+/*
+ * @brief True while the calling thread runs an interrupt handler
+ */
+bool sil_in_isr(void);
+
+/*
+ * @brief Microseconds interrupts have been masked by __disable_irq(), 0 if not masked
+ */
+uint64_t sil_irq_masked_us(void);
+
+/*
+ * @brief Set an interrupt pending and run the handlers of all pending, enabled
+ *        interrupts in NVIC priority order.
+ */
+void sil_nvic_raise(IRQn_Type irq);
+
+/*
+ * @brief Bring up / take down the SocketCAN side of bxCAN (sil_can.c)
+ */
+bool sil_can_open(void);
+void sil_can_close(void);
+
+/*
+ * @brief Peripheral models advanced by the board thread (sil_hal.c)
+ */
+void sil_gpio_update_inputs(GPIO_TypeDef *port, uint16_t pullDownMask);
+void sil_adc_step(uint64_t nowUs);
+void sil_tim_step(uint64_t nowUs);
+void sil_adc_set_input(uint32_t channel, uint32_t value);
+uint32_t sil_adc_get_input(uint32_t channel);
+
+/*
+ * @brief Effective duty cycle of a timer channel in percent, or -1 when the
+ *        channel output is disabled.
+ */
+float sil_tim_duty(const TIM_TypeDef *tim, uint32_t channel);
+
+/*
+ * @brief Board model (sil_board.c): button matrix, potentiometer and output
+ *        monitor, advanced by a background thread.
+ */
+void sil_board_start(void);
+void sil_board_press(uint8_t row, uint8_t col, bool pressed);
+void sil_board_tap(uint8_t row, uint8_t col, uint32_t ms);
+void sil_board_sweep(uint32_t channel, uint32_t periodMs);
+void sil_board_print_outputs(void);
+
+#endif /* SIL_SIL_H_ */
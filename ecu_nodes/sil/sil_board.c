@@ -0,0 +1,197 @@
+/*
+ * sil_board.c
+ *
+ *  Model of the ECU node board around the MCU: the 4x4 button matrix on
+ *  PB4-7 (rows, pulled up) and PB12-15 (columns), the potentiometer on
+ *  ADC1_IN5 and the PWM outputs of the I/O connection table. A background
+ *  thread advances the pins and the ADC and logs output changes.
+ */
+
+#define _GNU_SOURCE
+#include "sil.h"
+#include "main.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SIL_BOARD_STEP_US       100U      // Pin and ADC update period
+#define SIL_BOARD_ROWS          4U
+#define SIL_BOARD_COLS          4U
+#define SIL_POT_CHANNEL         ADC_CHANNEL_5
+#define SIL_IRQ_MASK_LIMIT_US   1000000U  // Masked longer than this: the node is considered dead
+
+typedef struct {
+  const TIM_TypeDef *tim;
+  uint32_t channel;
+  const char *timer;
+  const char *pin;
+  const char *signal;
+} SilPwmOutput;
+
+static const SilPwmOutput pwmOutputs[] = {
+  { TIM1, TIM_CHANNEL_4, "TIM1_CH4", "PA11", "DIGITAL_OUT_1" },
+  { TIM1, TIM_CHANNEL_3, "TIM1_CH3", "PA10", "DIGITAL_OUT_10" },
+  { TIM1, TIM_CHANNEL_2, "TIM1_CH2", "PA9",  "DIGITAL_OUT_19" },
+  { TIM1, TIM_CHANNEL_1, "TIM1_CH1", "PA8",  "DIGITAL_OUT_28" },
+  { TIM3, TIM_CHANNEL_1, "TIM3_CH1", "PA6",  "DIGITAL_OUT_8" },
+  { TIM3, TIM_CHANNEL_2, "TIM3_CH2", "PA7",  "DIGITAL_OUT_12" },
+  { TIM3, TIM_CHANNEL_3, "TIM3_CH3", "PB0",  "DIGITAL_OUT_22" },
+  { TIM3, TIM_CHANNEL_4, "TIM3_CH4", "PB1",  "DIGITAL_OUT_32" },
+};
+#define SIL_PWM_OUTPUTS (sizeof(pwmOutputs) / sizeof(pwmOutputs[0]))
+
+static const uint16_t rowPins[SIL_BOARD_ROWS] = { BTN_ROW0_Pin, BTN_ROW1_Pin, BTN_ROW2_Pin, BTN_ROW3_Pin };
+static const uint16_t colPins[SIL_BOARD_COLS] = { BTN_COL0_Pin, BTN_COL1_Pin, BTN_COL2_Pin, BTN_COL3_Pin };
+
+static pthread_mutex_t boardMutex = PTHREAD_MUTEX_INITIALIZER;
+static bool pressed[SIL_BOARD_ROWS][SIL_BOARD_COLS];
+static uint64_t releaseAtUs[SIL_BOARD_ROWS][SIL_BOARD_COLS];
+static uint32_t sweepChannel = SIL_POT_CHANNEL;
+static uint32_t sweepPeriodMs;
+static uint64_t sweepStartUs;
+static float lastDuty[SIL_PWM_OUTPUTS];
+static uint32_t lastLed;
+
+void sil_board_press(uint8_t row, uint8_t col, bool down) {
+  if (row >= SIL_BOARD_ROWS || col >= SIL_BOARD_COLS) return;
+  pthread_mutex_lock(&boardMutex);
+  pressed[row][col] = down;
+  releaseAtUs[row][col] = 0U;
+  pthread_mutex_unlock(&boardMutex);
+}
+
+void sil_board_tap(uint8_t row, uint8_t col, uint32_t ms) {
+  if (row >= SIL_BOARD_ROWS || col >= SIL_BOARD_COLS) return;
+  pthread_mutex_lock(&boardMutex);
+  pressed[row][col] = true;
+  releaseAtUs[row][col] = sil_uptime_us() + (uint64_t)ms * 1000U;
+  pthread_mutex_unlock(&boardMutex);
+}
+
+void sil_board_sweep(uint32_t channel, uint32_t periodMs) {
+  pthread_mutex_lock(&boardMutex);
+  sweepChannel = channel;
+  sweepPeriodMs = periodMs;
+  sweepStartUs = sil_uptime_us();
+  pthread_mutex_unlock(&boardMutex);
+}
+
+static const char *duty_text(float duty, char *buf, size_t size) {
+  if (duty < 0.0f) return "disabled";
+  snprintf(buf, size, "%.1f%%", duty);
+  return buf;
+}
+
+void sil_board_print_outputs(void) {
+  char buf[16];
+  for (size_t i = 0; i < SIL_PWM_OUTPUTS; i++) {
+    const SilPwmOutput *out = &pwmOutputs[i];
+    sil_log("%-14s %s/%-4s %s", out->signal, out->timer, out->pin,
+            duty_text(sil_tim_duty(out->tim, out->channel), buf, sizeof(buf)));
+  }
+  sil_log("LED PC13 %s, potentiometer %u", (GPIOC->ODR & GPIO_PIN_13) ? "off" : "on",
+          sil_adc_get_input(SIL_POT_CHANNEL));
+}
+
+/*
+ * @brief A closed switch connects its row to its column; a row reads low
+ *        while any of its switches is closed onto a column driven low
+ */
+static uint16_t matrix_pull_down(uint64_t nowUs) {
+  const uint32_t odr = GPIOB->ODR;
+  uint16_t mask = 0U;
+
+  pthread_mutex_lock(&boardMutex);
+  for (uint32_t row = 0; row < SIL_BOARD_ROWS; row++) {
+    for (uint32_t col = 0; col < SIL_BOARD_COLS; col++) {
+      if (releaseAtUs[row][col] && nowUs >= releaseAtUs[row][col]) {
+        pressed[row][col] = false;
+        releaseAtUs[row][col] = 0U;
+      }
+      if (pressed[row][col] && !(odr & colPins[col])) {
+        mask |= rowPins[row];
+      }
+    }
+  }
+  pthread_mutex_unlock(&boardMutex);
+  return mask;
+}
+
+static void sweep_step(uint64_t nowUs) {
+  pthread_mutex_lock(&boardMutex);
+  if (sweepPeriodMs) {
+    const uint64_t periodUs = (uint64_t)sweepPeriodMs * 1000U;
+    const uint64_t phase = (nowUs - sweepStartUs) % periodUs;
+    const uint64_t half = periodUs / 2U;
+    const uint64_t ramp = phase < half ? phase : periodUs - phase;
+    sil_adc_set_input(sweepChannel, (uint32_t)(ramp * SIL_ADC_MAX / (half ? half : 1U)));
+  }
+  pthread_mutex_unlock(&boardMutex);
+}
+
+static void monitor_outputs(void) {
+  char buf[16];
+
+  for (size_t i = 0; i < SIL_PWM_OUTPUTS; i++) {
+    const float duty = sil_tim_duty(pwmOutputs[i].tim, pwmOutputs[i].channel);
+    if (duty != lastDuty[i]) {
+      lastDuty[i] = duty;
+      if (!sil_config.quiet) {
+        sil_log("%s %s", pwmOutputs[i].signal, duty_text(duty, buf, sizeof(buf)));
+      }
+    }
+  }
+
+  const uint32_t led = GPIOC->ODR & GPIO_PIN_13;
+  if (led != lastLed) {
+    lastLed = led;
+    if (!sil_config.quiet) {
+      sil_log("LED PC13 %s", led ? "off" : "on");
+    }
+  }
+}
+
+static void *board_thread(void *arg) {
+  struct timespec next;
+  UNUSED(arg);
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (;;) {
+    next.tv_nsec += SIL_BOARD_STEP_US * 1000L;
+    if (next.tv_nsec >= 1000000000L) {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+    const uint64_t now = sil_uptime_us();
+    sil_gpio_update_inputs(GPIOA, 0U);
+    sil_gpio_update_inputs(GPIOB, matrix_pull_down(now));
+    sil_gpio_update_inputs(GPIOC, 0U);
+    sweep_step(now);
+    sil_tim_step(now);
+    sil_adc_step(now);
+    monitor_outputs();
+
+    // On the MCU masked interrupts with no way back (Error_Handler) stop the node
+    if (sil_irq_masked_us() > SIL_IRQ_MASK_LIMIT_US) {
+      sil_log("interrupts masked for more than %u ms, node halted", SIL_IRQ_MASK_LIMIT_US / 1000U);
+      exit(2);
+    }
+  }
+  return NULL;
+}
+
+void sil_board_start(void) {
+  pthread_t thread;
+
+  for (size_t i = 0; i < SIL_PWM_OUTPUTS; i++) {
+    lastDuty[i] = -1.0f;
+  }
+  lastLed = GPIOC->ODR & GPIO_PIN_13;
+
+  pthread_create(&thread, NULL, board_thread, NULL);
+  pthread_setname_np(thread, "sil-board");
+  pthread_detach(thread);
+}
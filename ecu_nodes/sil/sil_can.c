@@ -0,0 +1,564 @@
+/*
+ * sil_can.c
+ *
+ *  bxCAN model on SocketCAN: three TX mailboxes sent in identifier priority
+ *  order at the configured bit rate, acceptance filter banks, two 3-deep RX
+ *  FIFOs with overrun, and the CAN interrupt lines.
+ */
+
+#define _GNU_SOURCE
+#include "sil.h"
+#include <errno.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIL_CAN_TX_MAILBOXES      3U
+#define SIL_CAN_RX_FIFO_DEPTH     3U
+#define SIL_CAN_RETRY_US          100U
+
+typedef struct {
+  CAN_RxHeaderTypeDef header;
+  uint8_t data[8];
+} SilCanRxMessage;
+
+typedef struct {
+  SilCanRxMessage message[SIL_CAN_RX_FIFO_DEPTH];
+  uint32_t head;
+  uint32_t level;
+  bool full;            // FULL flag, set when the third message arrives
+  bool overrun;         // FOVR flag, a message was lost
+} SilCanRxFifo;
+
+typedef struct {
+  bool pending;
+  uint32_t sequence;
+  struct can_frame frame;
+} SilCanMailbox;
+
+typedef struct {
+  bool active;
+  uint32_t mode;
+  uint32_t scale;
+  uint32_t fifo;
+  uint32_t fr1;
+  uint32_t fr2;
+} SilCanFilterBank;
+
+static int canSocket = -1;
+static CAN_HandleTypeDef *canHandle;
+static uint32_t canBitRate;
+static uint32_t slaveStartFilterBank = 14U;
+static bool canStarted;
+
+static pthread_mutex_t canMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t txCond = PTHREAD_COND_INITIALIZER;
+static volatile uint32_t canIER;
+static SilCanRxFifo rxFifo[2];
+static SilCanMailbox txMailbox[SIL_CAN_TX_MAILBOXES];
+static int txActive = -1;               // Mailbox on the bus, cannot be aborted
+static uint32_t txSequence;
+static volatile uint32_t txComplete;    // RQCPx flags
+static SilCanFilterBank filterBank[SIL_CAN_FILTER_BANKS];
+
+bool sil_can_open(void) {
+  struct sockaddr_can addr;
+  struct ifreq ifr;
+
+  canSocket = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  if (canSocket < 0) {
+    perror("socket");
+    return false;
+  }
+
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, sil_config.canInterface, IFNAMSIZ - 1);
+  if (ioctl(canSocket, SIOCGIFINDEX, &ifr) < 0) {
+    fprintf(stderr, "%s: %s\n", sil_config.canInterface, strerror(errno));
+    close(canSocket);
+    canSocket = -1;
+    return false;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  if (bind(canSocket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("bind");
+    close(canSocket);
+    canSocket = -1;
+    return false;
+  }
+  return true;
+}
+
+void sil_can_close(void) {
+  if (canSocket >= 0) {
+    close(canSocket);
+    canSocket = -1;
+  }
+}
+
+/* Filters --------------------------------------------------------------------*/
+
+/*
+ * @brief Filter numbers per bank as counted for the filter match index
+ */
+static uint32_t filter_numbers(const SilCanFilterBank *bank) {
+  if (bank->scale == CAN_FILTERSCALE_32BIT) {
+    return bank->mode == CAN_FILTERMODE_IDLIST ? 2U : 1U;
+  }
+  return bank->mode == CAN_FILTERMODE_IDLIST ? 4U : 2U;
+}
+
+/*
+ * @brief Run a received identifier through the filter banks like bxCAN does
+ * @param fifo: Set to the FIFO of the matching filter
+ * @param fmi: Set to the filter match index
+ * @retval true if a filter accepted the message
+ */
+static bool filter_match(const CAN_RxHeaderTypeDef *header, uint32_t *fifo, uint32_t *fmi) {
+  uint32_t id32;
+  uint16_t id16;
+  uint32_t number[2] = { 0U, 0U };
+
+  if (header->IDE == CAN_ID_EXT) {
+    id32 = (header->ExtId << 3U) | CAN_ID_EXT | header->RTR;
+    id16 = (uint16_t)(((header->ExtId >> 18U) << 5U) | (header->RTR << 3U) | (1U << 3U) |
+                      ((header->ExtId >> 15U) & 0x7U));
+  } else {
+    id32 = (header->StdId << 21U) | header->RTR;
+    id16 = (uint16_t)((header->StdId << 5U) | (header->RTR << 3U));
+  }
+
+  for (uint32_t i = 0; i < slaveStartFilterBank && i < SIL_CAN_FILTER_BANKS; i++) {
+    const SilCanFilterBank *bank = &filterBank[i];
+    int hit = -1;
+
+    if (bank->active) {
+      if (bank->scale == CAN_FILTERSCALE_32BIT) {
+        if (bank->mode == CAN_FILTERMODE_IDMASK) {
+          if (((id32 ^ bank->fr1) & bank->fr2) == 0U) hit = 0;
+        } else if (id32 == bank->fr1) {
+          hit = 0;
+        } else if (id32 == bank->fr2) {
+          hit = 1;
+        }
+      } else {
+        const uint16_t lo1 = (uint16_t)bank->fr1, hi1 = (uint16_t)(bank->fr1 >> 16U);
+        const uint16_t lo2 = (uint16_t)bank->fr2, hi2 = (uint16_t)(bank->fr2 >> 16U);
+        if (bank->mode == CAN_FILTERMODE_IDMASK) {
+          if (((id16 ^ lo1) & hi1) == 0U) hit = 0;
+          else if (((id16 ^ lo2) & hi2) == 0U) hit = 1;
+        } else {
+          if (id16 == lo1) hit = 0;
+          else if (id16 == hi1) hit = 1;
+          else if (id16 == lo2) hit = 2;
+          else if (id16 == hi2) hit = 3;
+        }
+      }
+    }
+
+    if (hit >= 0) {
+      *fifo = bank->fifo;
+      *fmi = number[bank->fifo] + (uint32_t)hit;
+      return true;
+    }
+    number[bank->fifo & 1U] += filter_numbers(bank);
+  }
+  return false;
+}
+
+/* RX -------------------------------------------------------------------------*/
+static IRQn_Type rx_irq(uint32_t fifo) {
+  return fifo == CAN_RX_FIFO0 ? USB_LP_CAN1_RX0_IRQn : CAN1_RX1_IRQn;
+}
+
+static void rx_deliver(const struct can_frame *frame) {
+  SilCanRxMessage message;
+  uint32_t fifo, fmi;
+
+  memset(&message, 0, sizeof(message));
+  if (frame->can_id & CAN_EFF_FLAG) {
+    message.header.IDE = CAN_ID_EXT;
+    message.header.ExtId = frame->can_id & CAN_EFF_MASK;
+  } else {
+    message.header.IDE = CAN_ID_STD;
+    message.header.StdId = frame->can_id & CAN_SFF_MASK;
+  }
+  message.header.RTR = (frame->can_id & CAN_RTR_FLAG) ? CAN_RTR_REMOTE : CAN_RTR_DATA;
+  message.header.DLC = frame->can_dlc > 8U ? 8U : frame->can_dlc;
+  message.header.Timestamp = (uint32_t)sil_uptime_us() & 0xFFFFU;
+  memcpy(message.data, frame->data, message.header.DLC);
+
+  if (!filter_match(&message.header, &fifo, &fmi)) return;
+  message.header.FilterMatchIndex = fmi;
+
+  pthread_mutex_lock(&canMutex);
+  SilCanRxFifo *rx = &rxFifo[fifo];
+  if (rx->level == SIL_CAN_RX_FIFO_DEPTH) {
+    rx->overrun = true;
+    if (canHandle->Init.ReceiveFifoLocked != ENABLE) {
+      // Not locked: the newest message overwrites the last one
+      rx->message[(rx->head + SIL_CAN_RX_FIFO_DEPTH - 1U) % SIL_CAN_RX_FIFO_DEPTH] = message;
+    }
+  } else {
+    rx->message[(rx->head + rx->level) % SIL_CAN_RX_FIFO_DEPTH] = message;
+    rx->level++;
+    rx->full = rx->level == SIL_CAN_RX_FIFO_DEPTH;
+  }
+  pthread_mutex_unlock(&canMutex);
+
+  const uint32_t shift = fifo == CAN_RX_FIFO0 ? 0U : 3U;
+  if (canIER & ((CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO0_FULL | CAN_IT_RX_FIFO0_OVERRUN) << shift)) {
+    sil_nvic_raise(rx_irq(fifo));
+  }
+}
+
+static void *rx_thread(void *arg) {
+  struct can_frame frame;
+  UNUSED(arg);
+
+  for (;;) {
+    const ssize_t n = read(canSocket, &frame, sizeof(frame));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      perror("can read");
+      break;
+    }
+    if (n == (ssize_t)sizeof(frame) && canStarted) {
+      rx_deliver(&frame);
+    }
+  }
+  return NULL;
+}
+
+/* TX -------------------------------------------------------------------------*/
+
+/*
+ * @brief Nominal frame length in bits including interframe space, without stuffing
+ */
+static uint32_t frame_bits(const struct can_frame *frame) {
+  const uint32_t dlc = (frame->can_id & CAN_RTR_FLAG) ? 0U : frame->can_dlc;
+  return ((frame->can_id & CAN_EFF_FLAG) ? 67U : 47U) + 8U * dlc;
+}
+
+/*
+ * @brief Arbitration order: lower identifier wins, a standard frame wins
+ *        against an extended frame with the same base identifier
+ */
+static uint32_t arbitration_key(const struct can_frame *frame) {
+  if (frame->can_id & CAN_EFF_FLAG) {
+    return ((frame->can_id & CAN_EFF_MASK) << 1U) | 1U;
+  }
+  return (frame->can_id & CAN_SFF_MASK) << 19U;
+}
+
+static void sleep_until_us(uint64_t deadlineUs) {
+  const struct timespec ts = { (time_t)(deadlineUs / 1000000ULL), (long)(deadlineUs % 1000000ULL) * 1000L };
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+static void *tx_thread(void *arg) {
+  uint64_t busFreeUs = 0U;
+  UNUSED(arg);
+
+  for (;;) {
+    struct can_frame frame;
+    int next = -1;
+
+    pthread_mutex_lock(&canMutex);
+    while (next < 0) {
+      for (int i = 0; i < (int)SIL_CAN_TX_MAILBOXES; i++) {
+        if (!txMailbox[i].pending) continue;
+        if (next < 0) {
+          next = i;
+        } else if (canHandle->Init.TransmitFifoPriority == ENABLE) {
+          if ((int32_t)(txMailbox[i].sequence - txMailbox[next].sequence) < 0) next = i;
+        } else if (arbitration_key(&txMailbox[i].frame) < arbitration_key(&txMailbox[next].frame)) {
+          next = i;
+        }
+      }
+      if (next < 0) pthread_cond_wait(&txCond, &canMutex);
+    }
+    txActive = next;
+    frame = txMailbox[next].frame;
+    pthread_mutex_unlock(&canMutex);
+
+    // The mailbox stays occupied for the time the frame takes on the bus
+    if (sil_config.busTiming && canBitRate) {
+      const uint64_t now = sil_time_us();
+      const uint64_t start = busFreeUs > now ? busFreeUs : now;
+      busFreeUs = start + (frame_bits(&frame) * 1000000ULL + canBitRate - 1U) / canBitRate;
+      sleep_until_us(busFreeUs);
+    }
+
+    if (canHandle->Init.Mode != CAN_MODE_LOOPBACK) {
+      while (write(canSocket, &frame, sizeof(frame)) != (ssize_t)sizeof(frame)) {
+        if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR) {
+          perror("can write");
+          break;
+        }
+        // Interface queue full: the controller keeps retrying like on a busy bus
+        sleep_until_us(sil_time_us() + SIL_CAN_RETRY_US);
+      }
+    } else {
+      rx_deliver(&frame);
+    }
+
+    pthread_mutex_lock(&canMutex);
+    txMailbox[next].pending = false;
+    txActive = -1;
+    pthread_mutex_unlock(&canMutex);
+    __atomic_or_fetch(&txComplete, 1U << next, __ATOMIC_SEQ_CST);
+
+    if (canIER & CAN_IT_TX_MAILBOX_EMPTY) {
+      sil_nvic_raise(USB_HP_CAN1_TX_IRQn);
+    }
+  }
+  return NULL;
+}
+
+/* HAL ------------------------------------------------------------------------*/
+__attribute__((weak)) void HAL_CAN_MspInit(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+__attribute__((weak)) void HAL_CAN_MspDeInit(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+__attribute__((weak)) void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+__attribute__((weak)) void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+__attribute__((weak)) void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+__attribute__((weak)) void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+__attribute__((weak)) void HAL_CAN_RxFifo0FullCallback(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+__attribute__((weak)) void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+__attribute__((weak)) void HAL_CAN_RxFifo1FullCallback(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+__attribute__((weak)) void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan) { UNUSED(hcan); }
+
+HAL_StatusTypeDef HAL_CAN_Init(CAN_HandleTypeDef *hcan) {
+  const uint32_t bs1 = ((hcan->Init.TimeSeg1 >> 16U) & 0xFU) + 1U;
+  const uint32_t bs2 = ((hcan->Init.TimeSeg2 >> 20U) & 0x7U) + 1U;
+
+  if (!hcan->Init.Prescaler) return HAL_ERROR;
+  HAL_CAN_MspInit(hcan);
+  canHandle = hcan;
+  canBitRate = SIL_PCLK1_HZ / (hcan->Init.Prescaler * (1U + bs1 + bs2));
+  hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+  hcan->State = HAL_CAN_STATE_READY;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, CAN_FilterTypeDef *sFilterConfig) {
+  if (hcan->State == HAL_CAN_STATE_RESET || sFilterConfig->FilterBank >= SIL_CAN_FILTER_BANKS) {
+    hcan->ErrorCode |= HAL_CAN_ERROR_NOT_INITIALIZED;
+    return HAL_ERROR;
+  }
+
+  SilCanFilterBank bank;
+  bank.active = sFilterConfig->FilterActivation == CAN_FILTER_ENABLE;
+  bank.mode = sFilterConfig->FilterMode;
+  bank.scale = sFilterConfig->FilterScale;
+  bank.fifo = sFilterConfig->FilterFIFOAssignment & 1U;
+  if (bank.scale == CAN_FILTERSCALE_32BIT) {
+    bank.fr1 = ((sFilterConfig->FilterIdHigh & 0xFFFFU) << 16U) | (sFilterConfig->FilterIdLow & 0xFFFFU);
+    bank.fr2 = ((sFilterConfig->FilterMaskIdHigh & 0xFFFFU) << 16U) | (sFilterConfig->FilterMaskIdLow & 0xFFFFU);
+  } else {
+    bank.fr1 = ((sFilterConfig->FilterMaskIdLow & 0xFFFFU) << 16U) | (sFilterConfig->FilterIdLow & 0xFFFFU);
+    bank.fr2 = ((sFilterConfig->FilterMaskIdHigh & 0xFFFFU) << 16U) | (sFilterConfig->FilterIdHigh & 0xFFFFU);
+  }
+
+  pthread_mutex_lock(&canMutex);
+  slaveStartFilterBank = sFilterConfig->SlaveStartFilterBank;
+  filterBank[sFilterConfig->FilterBank] = bank;
+  pthread_mutex_unlock(&canMutex);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan) {
+  static bool threadsRunning;
+  pthread_t thread;
+
+  if (hcan->State != HAL_CAN_STATE_READY || canSocket < 0) {
+    hcan->ErrorCode |= HAL_CAN_ERROR_NOT_INITIALIZED;
+    return HAL_ERROR;
+  }
+
+  if (!threadsRunning) {
+    pthread_create(&thread, NULL, rx_thread, NULL);
+    pthread_setname_np(thread, "sil-can-rx");
+    pthread_detach(thread);
+    pthread_create(&thread, NULL, tx_thread, NULL);
+    pthread_setname_np(thread, "sil-can-tx");
+    pthread_detach(thread);
+    threadsRunning = true;
+  }
+
+  hcan->State = HAL_CAN_STATE_LISTENING;
+  canStarted = true;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan) {
+  if (hcan->State != HAL_CAN_STATE_LISTENING) return HAL_ERROR;
+  canStarted = false;
+  hcan->State = HAL_CAN_STATE_READY;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs) {
+  UNUSED(hcan);
+  __atomic_or_fetch(&canIER, ActiveITs, __ATOMIC_SEQ_CST);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef *hcan, uint32_t InactiveITs) {
+  UNUSED(hcan);
+  __atomic_and_fetch(&canIER, ~InactiveITs, __ATOMIC_SEQ_CST);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, CAN_TxHeaderTypeDef *pHeader, uint8_t aData[], uint32_t *pTxMailbox) {
+  if (hcan->State != HAL_CAN_STATE_LISTENING) {
+    hcan->ErrorCode |= HAL_CAN_ERROR_NOT_STARTED;
+    return HAL_ERROR;
+  }
+
+  pthread_mutex_lock(&canMutex);
+  int free = -1;
+  for (int i = 0; i < (int)SIL_CAN_TX_MAILBOXES; i++) {
+    if (!txMailbox[i].pending) {
+      free = i;
+      break;
+    }
+  }
+  if (free < 0) {
+    pthread_mutex_unlock(&canMutex);
+    hcan->ErrorCode |= HAL_CAN_ERROR_PARAM;
+    return HAL_ERROR;
+  }
+
+  SilCanMailbox *mailbox = &txMailbox[free];
+  memset(&mailbox->frame, 0, sizeof(mailbox->frame));
+  if (pHeader->IDE == CAN_ID_EXT) {
+    mailbox->frame.can_id = (pHeader->ExtId & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  } else {
+    mailbox->frame.can_id = pHeader->StdId & CAN_SFF_MASK;
+  }
+  if (pHeader->RTR == CAN_RTR_REMOTE) mailbox->frame.can_id |= CAN_RTR_FLAG;
+  mailbox->frame.can_dlc = (uint8_t)(pHeader->DLC > 8U ? 8U : pHeader->DLC);
+  memcpy(mailbox->frame.data, aData, mailbox->frame.can_dlc);
+  mailbox->sequence = txSequence++;
+  mailbox->pending = true;
+  *pTxMailbox = 1U << free;
+  pthread_cond_signal(&txCond);
+  pthread_mutex_unlock(&canMutex);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_AbortTxRequest(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes) {
+  UNUSED(hcan);
+  pthread_mutex_lock(&canMutex);
+  for (int i = 0; i < (int)SIL_CAN_TX_MAILBOXES; i++) {
+    if ((TxMailboxes & (1U << i)) && txMailbox[i].pending && txActive != i) {
+      txMailbox[i].pending = false;
+    }
+  }
+  pthread_mutex_unlock(&canMutex);
+  return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef *hcan) {
+  uint32_t level = 0U;
+  UNUSED(hcan);
+  pthread_mutex_lock(&canMutex);
+  for (uint32_t i = 0; i < SIL_CAN_TX_MAILBOXES; i++) {
+    if (!txMailbox[i].pending) level++;
+  }
+  pthread_mutex_unlock(&canMutex);
+  return level;
+}
+
+uint32_t HAL_CAN_IsTxMessagePending(CAN_HandleTypeDef *hcan, uint32_t TxMailboxes) {
+  uint32_t pending = 0U;
+  UNUSED(hcan);
+  pthread_mutex_lock(&canMutex);
+  for (uint32_t i = 0; i < SIL_CAN_TX_MAILBOXES; i++) {
+    if ((TxMailboxes & (1U << i)) && txMailbox[i].pending) pending = 1U;
+  }
+  pthread_mutex_unlock(&canMutex);
+  return pending;
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo, CAN_RxHeaderTypeDef *pHeader, uint8_t aData[]) {
+  pthread_mutex_lock(&canMutex);
+  SilCanRxFifo *rx = &rxFifo[RxFifo & 1U];
+  if (rx->level == 0U) {
+    pthread_mutex_unlock(&canMutex);
+    hcan->ErrorCode |= HAL_CAN_ERROR_PARAM;
+    return HAL_ERROR;
+  }
+  *pHeader = rx->message[rx->head].header;
+  memcpy(aData, rx->message[rx->head].data, 8U);
+  rx->head = (rx->head + 1U) % SIL_CAN_RX_FIFO_DEPTH;
+  rx->level--;
+  pthread_mutex_unlock(&canMutex);
+  return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetRxFifoFillLevel(CAN_HandleTypeDef *hcan, uint32_t RxFifo) {
+  UNUSED(hcan);
+  pthread_mutex_lock(&canMutex);
+  const uint32_t level = rxFifo[RxFifo & 1U].level;
+  pthread_mutex_unlock(&canMutex);
+  return level;
+}
+
+uint32_t HAL_CAN_GetError(CAN_HandleTypeDef *hcan) {
+  return hcan->ErrorCode;
+}
+
+static void irq_handle_fifo(CAN_HandleTypeDef *hcan, uint32_t fifo) {
+  const uint32_t shift = fifo == CAN_RX_FIFO0 ? 0U : 3U;
+  bool overrun, full;
+  uint32_t before, after;
+
+  pthread_mutex_lock(&canMutex);
+  overrun = rxFifo[fifo].overrun && (canIER & (CAN_IT_RX_FIFO0_OVERRUN << shift));
+  full = rxFifo[fifo].full && (canIER & (CAN_IT_RX_FIFO0_FULL << shift));
+  if (overrun) rxFifo[fifo].overrun = false;
+  if (full) rxFifo[fifo].full = false;
+  before = rxFifo[fifo].level;
+  pthread_mutex_unlock(&canMutex);
+
+  if (overrun) {
+    hcan->ErrorCode |= fifo == CAN_RX_FIFO0 ? HAL_CAN_ERROR_RX_FOV0 : HAL_CAN_ERROR_RX_FOV1;
+    HAL_CAN_ErrorCallback(hcan);
+  }
+  if (full) {
+    if (fifo == CAN_RX_FIFO0) HAL_CAN_RxFifo0FullCallback(hcan);
+    else HAL_CAN_RxFifo1FullCallback(hcan);
+  }
+  if (before && (canIER & (CAN_IT_RX_FIFO0_MSG_PENDING << shift))) {
+    if (fifo == CAN_RX_FIFO0) HAL_CAN_RxFifo0MsgPendingCallback(hcan);
+    else HAL_CAN_RxFifo1MsgPendingCallback(hcan);
+
+    // The pending line stays asserted while messages are left; re-enter if the callback read any
+    after = HAL_CAN_GetRxFifoFillLevel(hcan, fifo);
+    if (after && after < before) sil_nvic_raise(rx_irq(fifo));
+  }
+}
+
+void HAL_CAN_IRQHandler(CAN_HandleTypeDef *hcan) {
+  if (canIER & CAN_IT_TX_MAILBOX_EMPTY) {
+    const uint32_t done = __atomic_exchange_n(&txComplete, 0U, __ATOMIC_SEQ_CST);
+    if (done & CAN_TX_MAILBOX0) HAL_CAN_TxMailbox0CompleteCallback(hcan);
+    if (done & CAN_TX_MAILBOX1) HAL_CAN_TxMailbox1CompleteCallback(hcan);
+    if (done & CAN_TX_MAILBOX2) HAL_CAN_TxMailbox2CompleteCallback(hcan);
+  }
+  irq_handle_fifo(hcan, CAN_RX_FIFO0);
+  irq_handle_fifo(hcan, CAN_RX_FIFO1);
+}
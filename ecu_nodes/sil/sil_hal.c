@@ -0,0 +1,850 @@
+/*
+ * sil_hal.c
+ *
+ *  Host implementation of the HAL used by the firmware: interrupt model,
+ *  clocks, GPIO/EXTI, DMA, ADC and timers. bxCAN lives in sil_can.c.
+ */
+
+#define _GNU_SOURCE
+#include "sil.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIL_NVIC_WORDS            ((SIL_IRQn_COUNT + 31) / 32)
+#define SIL_DMA_FLAG_HT           0x1U
+#define SIL_DMA_FLAG_TC           0x2U
+#define SIL_ADC_CATCH_UP_NS       10000000ULL // Conversions further behind than this are skipped
+
+GPIO_TypeDef sil_gpioa, sil_gpiob, sil_gpioc, sil_gpiod;
+EXTI_TypeDef sil_exti;
+DMA_Channel_TypeDef sil_dma1_channel[7];
+ADC_TypeDef sil_adc1;
+TIM_TypeDef sil_tim1, sil_tim2, sil_tim3, sil_tim4;
+CAN_TypeDef sil_can1;
+uint32_t SystemCoreClock = 8000000U;
+
+/* HAL timebase handle, normally defined by stm32f1xx_hal_timebase_tim.c */
+TIM_HandleTypeDef htim4;
+
+SilConfig sil_config = {
+  .canInterface = "vcan0",
+  .busTiming = true,
+  .quiet = false,
+  .name = "ecu",
+};
+
+/* Time -----------------------------------------------------------------------*/
+static uint64_t silStartUs;
+
+uint64_t sil_time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+uint64_t sil_uptime_us(void) {
+  return sil_time_us() - silStartUs;
+}
+
+__attribute__((constructor)) static void sil_time_init(void) {
+  silStartUs = sil_time_us();
+}
+
+void sil_log(const char *fmt, ...) {
+  char line[256];
+  va_list args;
+  const uint64_t now = sil_time_us();
+
+  va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  printf("(%llu.%06llu) %s: %s\n", (unsigned long long)(now / 1000000ULL),
+         (unsigned long long)(now % 1000000ULL), sil_config.name, line);
+  fflush(stdout);
+}
+
+/* Interrupt model ------------------------------------------------------------*/
+static pthread_mutex_t irqMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread int isrDepth;
+static __thread bool primaskHeld;
+static volatile uint64_t maskedSinceUs;
+static bool dispatching;
+
+static uint32_t nvicEnabled[SIL_NVIC_WORDS];
+static uint32_t nvicPending[SIL_NVIC_WORDS];
+static uint8_t nvicPriority[SIL_IRQn_COUNT];
+
+void sil_default_handler(void) {
+  sil_log("unexpected interrupt, no handler installed");
+  exit(3);
+}
+
+/* Vector table: handlers the firmware does not define end up in sil_default_handler, as in the startup file */
+#define SIL_WEAK_HANDLER(name) void name(void) __attribute__((weak, alias("sil_default_handler")))
+SIL_WEAK_HANDLER(EXTI0_IRQHandler);
+SIL_WEAK_HANDLER(EXTI1_IRQHandler);
+SIL_WEAK_HANDLER(EXTI2_IRQHandler);
+SIL_WEAK_HANDLER(EXTI3_IRQHandler);
+SIL_WEAK_HANDLER(EXTI4_IRQHandler);
+SIL_WEAK_HANDLER(DMA1_Channel1_IRQHandler);
+SIL_WEAK_HANDLER(DMA1_Channel2_IRQHandler);
+SIL_WEAK_HANDLER(DMA1_Channel3_IRQHandler);
+SIL_WEAK_HANDLER(DMA1_Channel4_IRQHandler);
+SIL_WEAK_HANDLER(DMA1_Channel5_IRQHandler);
+SIL_WEAK_HANDLER(DMA1_Channel6_IRQHandler);
+SIL_WEAK_HANDLER(DMA1_Channel7_IRQHandler);
+SIL_WEAK_HANDLER(ADC1_2_IRQHandler);
+SIL_WEAK_HANDLER(USB_HP_CAN1_TX_IRQHandler);
+SIL_WEAK_HANDLER(USB_LP_CAN1_RX0_IRQHandler);
+SIL_WEAK_HANDLER(CAN1_RX1_IRQHandler);
+SIL_WEAK_HANDLER(CAN1_SCE_IRQHandler);
+SIL_WEAK_HANDLER(EXTI9_5_IRQHandler);
+SIL_WEAK_HANDLER(TIM1_UP_IRQHandler);
+SIL_WEAK_HANDLER(TIM1_CC_IRQHandler);
+SIL_WEAK_HANDLER(TIM2_IRQHandler);
+SIL_WEAK_HANDLER(TIM3_IRQHandler);
+SIL_WEAK_HANDLER(TIM4_IRQHandler);
+SIL_WEAK_HANDLER(EXTI15_10_IRQHandler);
+
+static void (*const vectors[SIL_IRQn_COUNT])(void) = {
+  [EXTI0_IRQn] = EXTI0_IRQHandler,
+  [EXTI1_IRQn] = EXTI1_IRQHandler,
+  [EXTI2_IRQn] = EXTI2_IRQHandler,
+  [EXTI3_IRQn] = EXTI3_IRQHandler,
+  [EXTI4_IRQn] = EXTI4_IRQHandler,
+  [DMA1_Channel1_IRQn] = DMA1_Channel1_IRQHandler,
+  [DMA1_Channel2_IRQn] = DMA1_Channel2_IRQHandler,
+  [DMA1_Channel3_IRQn] = DMA1_Channel3_IRQHandler,
+  [DMA1_Channel4_IRQn] = DMA1_Channel4_IRQHandler,
+  [DMA1_Channel5_IRQn] = DMA1_Channel5_IRQHandler,
+  [DMA1_Channel6_IRQn] = DMA1_Channel6_IRQHandler,
+  [DMA1_Channel7_IRQn] = DMA1_Channel7_IRQHandler,
+  [ADC1_2_IRQn] = ADC1_2_IRQHandler,
+  [USB_HP_CAN1_TX_IRQn] = USB_HP_CAN1_TX_IRQHandler,
+  [USB_LP_CAN1_RX0_IRQn] = USB_LP_CAN1_RX0_IRQHandler,
+  [CAN1_RX1_IRQn] = CAN1_RX1_IRQHandler,
+  [CAN1_SCE_IRQn] = CAN1_SCE_IRQHandler,
+  [EXTI9_5_IRQn] = EXTI9_5_IRQHandler,
+  [TIM1_UP_IRQn] = TIM1_UP_IRQHandler,
+  [TIM1_CC_IRQn] = TIM1_CC_IRQHandler,
+  [TIM2_IRQn] = TIM2_IRQHandler,
+  [TIM3_IRQn] = TIM3_IRQHandler,
+  [TIM4_IRQn] = TIM4_IRQHandler,
+  [EXTI15_10_IRQn] = EXTI15_10_IRQHandler,
+};
+
+void sil_irq_lock(void) {
+  pthread_mutex_lock(&irqMutex);
+}
+
+void sil_irq_unlock(void) {
+  pthread_mutex_unlock(&irqMutex);
+}
+
+bool sil_in_isr(void) {
+  return isrDepth > 0;
+}
+
+uint64_t sil_irq_masked_us(void) {
+  const uint64_t since = maskedSinceUs;
+  return since ? sil_time_us() - since : 0U;
+}
+
+static bool nvic_test(const uint32_t *bits, int irq) {
+  return (__atomic_load_n(&bits[irq / 32], __ATOMIC_SEQ_CST) >> (irq % 32)) & 1U;
+}
+
+static void nvic_set(uint32_t *bits, int irq) {
+  __atomic_or_fetch(&bits[irq / 32], 1U << (irq % 32), __ATOMIC_SEQ_CST);
+}
+
+static void nvic_clear(uint32_t *bits, int irq) {
+  __atomic_and_fetch(&bits[irq / 32], ~(1U << (irq % 32)), __ATOMIC_SEQ_CST);
+}
+
+/*
+ * @brief Run pending, enabled handlers, lowest priority value first. Nothing
+ *        runs while the calling thread masks interrupts; a handler raised from
+ *        another handler runs after it returns (no nesting).
+ */
+static void nvic_dispatch(void) {
+  sil_irq_lock();
+  if (dispatching || primaskHeld) {
+    sil_irq_unlock();
+    return;
+  }
+  dispatching = true;
+  for (;;) {
+    int next = -1;
+    for (int irq = 0; irq < SIL_IRQn_COUNT; irq++) {
+      if (nvic_test(nvicPending, irq) && nvic_test(nvicEnabled, irq) &&
+          (next < 0 || nvicPriority[irq] < nvicPriority[next])) {
+        next = irq;
+      }
+    }
+    if (next < 0) break;
+
+    nvic_clear(nvicPending, next);
+    isrDepth++;
+    vectors[next]();
+    isrDepth--;
+  }
+  dispatching = false;
+  sil_irq_unlock();
+}
+
+void sil_nvic_raise(IRQn_Type irq) {
+  if (irq < 0 || irq >= SIL_IRQn_COUNT || !vectors[irq]) return;
+  nvic_set(nvicPending, irq);
+  nvic_dispatch();
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+  if (IRQn < 0 || IRQn >= SIL_IRQn_COUNT) return;
+  nvicPriority[IRQn] = (uint8_t)((PreemptPriority << 4U) | (SubPriority & 0x0FU));
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+  if (IRQn < 0 || IRQn >= SIL_IRQn_COUNT) return;
+  nvic_set(nvicEnabled, IRQn);
+  // An interrupt that became pending while disabled is taken now
+  nvic_dispatch();
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+  if (IRQn < 0 || IRQn >= SIL_IRQn_COUNT) return;
+  nvic_clear(nvicEnabled, IRQn);
+}
+
+void HAL_NVIC_SetPendingIRQ(IRQn_Type IRQn) {
+  sil_nvic_raise(IRQn);
+}
+
+void __disable_irq(void) {
+  if (primaskHeld) return;
+  sil_irq_lock();
+  primaskHeld = true;
+  maskedSinceUs = sil_time_us();
+}
+
+void __enable_irq(void) {
+  if (!primaskHeld) return;
+  primaskHeld = false;
+  maskedSinceUs = 0U;
+  sil_irq_unlock();
+  nvic_dispatch();
+}
+
+/* Core / RCC -----------------------------------------------------------------*/
+__attribute__((weak)) void HAL_MspInit(void) {
+}
+
+HAL_StatusTypeDef HAL_Init(void) {
+  HAL_MspInit();
+  return HAL_OK;
+}
+
+void HAL_IncTick(void) {
+  // The tick is derived from the host clock, see HAL_GetTick()
+}
+
+uint32_t HAL_GetTick(void) {
+  return (uint32_t)(sil_uptime_us() / (1000000U / SIL_TICK_RATE_HZ));
+}
+
+void HAL_Delay(uint32_t Delay) {
+  const struct timespec ts = { Delay / 1000U, (long)(Delay % 1000U) * 1000000L };
+  nanosleep(&ts, NULL);
+}
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct) {
+  UNUSED(RCC_OscInitStruct);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency) {
+  UNUSED(RCC_ClkInitStruct);
+  UNUSED(FLatency);
+  SystemCoreClock = 72000000U;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit) {
+  UNUSED(PeriphClkInit);
+  return HAL_OK;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void) {
+  return SIL_PCLK1_HZ;
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void) {
+  return SystemCoreClock;
+}
+
+/* GPIO / EXTI ----------------------------------------------------------------*/
+typedef struct {
+  uint32_t mode[16];
+  uint32_t pull[16];
+} SilGpioConfig;
+
+static SilGpioConfig gpioConfig[4];
+
+static SilGpioConfig *gpio_config(GPIO_TypeDef *port) {
+  if (port == GPIOA) return &gpioConfig[0];
+  if (port == GPIOB) return &gpioConfig[1];
+  if (port == GPIOC) return &gpioConfig[2];
+  return &gpioConfig[3];
+}
+
+static IRQn_Type exti_irq(uint32_t line) {
+  if (line <= 4U) return (IRQn_Type)(EXTI0_IRQn + (int)line);
+  if (line <= 9U) return EXTI9_5_IRQn;
+  return EXTI15_10_IRQn;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init) {
+  SilGpioConfig *config = gpio_config(GPIOx);
+
+  for (uint32_t pin = 0; pin < 16U; pin++) {
+    const uint32_t bit = 1U << pin;
+    if (!(GPIO_Init->Pin & bit)) continue;
+
+    config->mode[pin] = GPIO_Init->Mode;
+    config->pull[pin] = GPIO_Init->Pull;
+    if (GPIO_Init->Pull == GPIO_PULLUP) {
+      __atomic_or_fetch(&GPIOx->IDR, bit, __ATOMIC_SEQ_CST);
+    }
+
+    if (GPIO_Init->Mode & 0x10000000U) {
+      __atomic_or_fetch(&EXTI->IMR, bit, __ATOMIC_SEQ_CST);
+      if (GPIO_Init->Mode & 0x00100000U) __atomic_or_fetch(&EXTI->RTSR, bit, __ATOMIC_SEQ_CST);
+      if (GPIO_Init->Mode & 0x00200000U) __atomic_or_fetch(&EXTI->FTSR, bit, __ATOMIC_SEQ_CST);
+    }
+  }
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin) {
+  SilGpioConfig *config = gpio_config(GPIOx);
+
+  for (uint32_t pin = 0; pin < 16U; pin++) {
+    if (GPIO_Pin & (1U << pin)) {
+      config->mode[pin] = GPIO_MODE_INPUT;
+      config->pull[pin] = GPIO_NOPULL;
+    }
+  }
+  __atomic_and_fetch(&EXTI->IMR, ~GPIO_Pin, __ATOMIC_SEQ_CST);
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+  if (PinState != GPIO_PIN_RESET) {
+    __atomic_or_fetch(&GPIOx->ODR, GPIO_Pin, __ATOMIC_SEQ_CST);
+  } else {
+    __atomic_and_fetch(&GPIOx->ODR, ~(uint32_t)GPIO_Pin, __ATOMIC_SEQ_CST);
+  }
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  __atomic_xor_fetch(&GPIOx->ODR, GPIO_Pin, __ATOMIC_SEQ_CST);
+}
+
+__attribute__((weak)) void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
+  UNUSED(GPIO_Pin);
+}
+
+void HAL_GPIO_EXTI_IRQHandler(uint16_t GPIO_Pin) {
+  if (__HAL_GPIO_EXTI_GET_IT(GPIO_Pin) != 0U) {
+    __HAL_GPIO_EXTI_CLEAR_IT(GPIO_Pin);
+    HAL_GPIO_EXTI_Callback(GPIO_Pin);
+  }
+}
+
+/*
+ * @brief Recompute the input data register of a port from its pin modes and
+ *        the external circuit, and latch EXTI edges.
+ * @param pullDownMask: Input pins driven low from outside (e.g. a closed switch)
+ */
+void sil_gpio_update_inputs(GPIO_TypeDef *port, uint16_t pullDownMask) {
+  const SilGpioConfig *config = gpio_config(port);
+  const uint32_t odr = port->ODR;
+  const uint32_t previous = port->IDR;
+  uint32_t idr = 0U;
+
+  for (uint32_t pin = 0; pin < 16U; pin++) {
+    const uint32_t bit = 1U << pin;
+    const uint32_t mode = config->mode[pin] & 0x00000013U;
+    if ((mode == GPIO_MODE_OUTPUT_PP) || (mode == GPIO_MODE_OUTPUT_OD)) {
+      idr |= odr & bit;
+    } else if ((config->mode[pin] != GPIO_MODE_ANALOG) && !(pullDownMask & bit) &&
+               (config->pull[pin] == GPIO_PULLUP)) {
+      idr |= bit;
+    }
+  }
+  port->IDR = idr;
+
+  // EXTI lines 0..15 are shared between ports, AFIO selects GPIOB for every line the firmware uses
+  const uint32_t falling = previous & ~idr;
+  const uint32_t rising = ~previous & idr;
+  const uint32_t edges = ((falling & EXTI->FTSR) | (rising & EXTI->RTSR)) & EXTI->IMR & 0xFFFFU;
+  if (!edges || port != GPIOB) return;
+
+  __atomic_or_fetch(&EXTI->PR, edges, __ATOMIC_SEQ_CST);
+  for (uint32_t line = 0; line < 16U; line++) {
+    if (edges & (1U << line)) {
+      sil_nvic_raise(exti_irq(line));
+    }
+  }
+}
+
+/* DMA ------------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma) {
+  hdma->ErrorCode = 0U;
+  hdma->SilFlags = 0U;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma) {
+  hdma->XferCpltCallback = NULL;
+  hdma->XferHalfCpltCallback = NULL;
+  return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) {
+  const uint32_t flags = __atomic_exchange_n(&hdma->SilFlags, 0U, __ATOMIC_SEQ_CST);
+
+  if ((flags & SIL_DMA_FLAG_HT) && hdma->XferHalfCpltCallback) {
+    hdma->XferHalfCpltCallback(hdma);
+  }
+  if ((flags & SIL_DMA_FLAG_TC) && hdma->XferCpltCallback) {
+    hdma->XferCpltCallback(hdma);
+  }
+}
+
+static void dma_raise(DMA_HandleTypeDef *hdma, uint32_t flag) {
+  __atomic_or_fetch(&hdma->SilFlags, flag, __ATOMIC_SEQ_CST);
+  sil_nvic_raise((IRQn_Type)(DMA1_Channel1_IRQn + (int)(hdma->Instance - sil_dma1_channel)));
+}
+
+/* ADC ------------------------------------------------------------------------*/
+typedef struct {
+  ADC_HandleTypeDef *hadc;
+  uint32_t rankChannel[SIL_ADC_RANKS];
+  uint32_t rankSampling[SIL_ADC_RANKS];
+  void *buffer;
+  uint32_t length;
+  uint32_t pos;
+  uint32_t rank;
+  bool running;
+  uint64_t nextNs;
+  uint64_t triggerNs;             // Last external trigger
+} SilAdc;
+
+static SilAdc adc;
+static uint32_t adcInput[SIL_ADC_CHANNELS] = {
+  [ADC_CHANNEL_TEMPSENSOR] = 1750U,
+  [ADC_CHANNEL_VREFINT] = 1490U,
+};
+
+/* Sampling time + 12.5 cycles of conversion, in ADC clock half-cycles */
+static const uint32_t adcConvHalfCycles[8] = { 28U, 40U, 52U, 82U, 108U, 136U, 168U, 504U };
+
+void sil_adc_set_input(uint32_t channel, uint32_t value) {
+  if (channel < SIL_ADC_CHANNELS) {
+    __atomic_store_n(&adcInput[channel], value > SIL_ADC_MAX ? SIL_ADC_MAX : value, __ATOMIC_RELAXED);
+  }
+}
+
+uint32_t sil_adc_get_input(uint32_t channel) {
+  return channel < SIL_ADC_CHANNELS ? __atomic_load_n(&adcInput[channel], __ATOMIC_RELAXED) : 0U;
+}
+
+__attribute__((weak)) void HAL_ADC_MspInit(ADC_HandleTypeDef *hadc) {
+  UNUSED(hadc);
+}
+
+__attribute__((weak)) void HAL_ADC_MspDeInit(ADC_HandleTypeDef *hadc) {
+  UNUSED(hadc);
+}
+
+__attribute__((weak)) void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc) {
+  UNUSED(hadc);
+}
+
+__attribute__((weak)) void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc) {
+  UNUSED(hadc);
+}
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc) {
+  adc.hadc = hadc;
+  HAL_ADC_MspInit(hadc);
+  hadc->ErrorCode = 0U;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *hadc, ADC_ChannelConfTypeDef *sConfig) {
+  UNUSED(hadc);
+  if (sConfig->Rank < 1U || sConfig->Rank > SIL_ADC_RANKS || sConfig->Channel >= SIL_ADC_CHANNELS) {
+    return HAL_ERROR;
+  }
+  adc.rankChannel[sConfig->Rank - 1U] = sConfig->Channel;
+  adc.rankSampling[sConfig->Rank - 1U] = sConfig->SamplingTime & 0x7U;
+  return HAL_OK;
+}
+
+static void adc_dma_half_complete(DMA_HandleTypeDef *hdma) {
+  HAL_ADC_ConvHalfCpltCallback((ADC_HandleTypeDef *)hdma->Parent);
+}
+
+static void adc_dma_complete(DMA_HandleTypeDef *hdma) {
+  HAL_ADC_ConvCpltCallback((ADC_HandleTypeDef *)hdma->Parent);
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length) {
+  if (!hadc->DMA_Handle || !Length) return HAL_ERROR;
+
+  hadc->DMA_Handle->XferHalfCpltCallback = adc_dma_half_complete;
+  hadc->DMA_Handle->XferCpltCallback = adc_dma_complete;
+
+  sil_irq_lock();
+  adc.hadc = hadc;
+  adc.buffer = pData;
+  adc.length = Length;
+  adc.pos = 0U;
+  adc.rank = 0U;
+  adc.nextNs = sil_uptime_us() * 1000ULL;
+  adc.triggerNs = adc.nextNs;
+  adc.running = true;
+  sil_irq_unlock();
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc) {
+  UNUSED(hadc);
+  sil_irq_lock();
+  adc.running = false;
+  sil_irq_unlock();
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc) {
+  UNUSED(hadc);
+  return HAL_OK;
+}
+
+/*
+ * @brief Period of the external trigger of the regular group in ns, 0 while
+ *        the trigger timer or channel is off. T2_CC2 and T3_TRGO (update) only.
+ */
+static uint64_t adc_trigger_period_ns(uint32_t trigger) {
+  const TIM_TypeDef *tim;
+
+  switch (trigger) {
+    case ADC_EXTERNALTRIGCONV_T2_CC2:
+      tim = TIM2;
+      if (!(tim->CCER & (TIM_CCER_CC1E << TIM_CHANNEL_2))) return 0U;
+      break;
+    case ADC_EXTERNALTRIGCONV_T3_TRGO:
+      tim = TIM3;
+      if (tim->CR2 != TIM_TRGO_UPDATE) return 0U;
+      break;
+    default:
+      return 0U;
+  }
+  if (!(tim->CR1 & TIM_CR1_CEN)) return 0U;
+
+  return (uint64_t)(tim->PSC + 1U) * (tim->ARR + 1U) * 1000000000ULL / SIL_TIM_CLOCK_HZ;
+}
+
+/*
+ * @brief Run the conversions due by nowUs and move them to memory as DMA would
+ */
+void sil_adc_step(uint64_t nowUs) {
+  sil_irq_lock();
+  if (!adc.running) {
+    sil_irq_unlock();
+    return;
+  }
+
+  ADC_HandleTypeDef *hadc = adc.hadc;
+  DMA_HandleTypeDef *hdma = hadc->DMA_Handle;
+  const uint32_t sequenceLength = (hadc->Init.ScanConvMode == ADC_SCAN_DISABLE) ? 1U :
+                                  (hadc->Init.NbrOfConversion ? hadc->Init.NbrOfConversion : 1U);
+  const uint64_t nowNs = nowUs * 1000ULL;
+  if (nowNs > adc.nextNs + SIL_ADC_CATCH_UP_NS) {
+    adc.nextNs = nowNs - SIL_ADC_CATCH_UP_NS;
+  }
+
+  const bool triggered = hadc->Init.ExternalTrigConv != ADC_SOFTWARE_START;
+  uint32_t events = 0U;
+  while (adc.running && adc.nextNs <= nowNs) {
+    const uint32_t channel = adc.rankChannel[adc.rank];
+    const uint32_t value = sil_adc_get_input(channel);
+    hadc->Instance->DR = value;
+
+    if (hdma->Init.MemDataAlignment == DMA_MDATAALIGN_WORD) {
+      ((uint32_t *)adc.buffer)[adc.pos] = value;
+    } else {
+      ((uint16_t *)adc.buffer)[adc.pos] = (uint16_t)value;
+    }
+    adc.pos++;
+    if (adc.pos == adc.length / 2U) {
+      events |= SIL_DMA_FLAG_HT;
+    }
+    if (adc.pos == adc.length) {
+      events |= SIL_DMA_FLAG_TC;
+      adc.pos = 0U;
+      if (hdma->Init.Mode != DMA_CIRCULAR) adc.running = false;
+    }
+
+    adc.nextNs += adcConvHalfCycles[adc.rankSampling[adc.rank]] * 1000000000ULL / (2ULL * SIL_ADC_CLOCK_HZ);
+    adc.rank++;
+    if (adc.rank == sequenceLength) {
+      adc.rank = 0U;
+      if (triggered) {
+        // The next sequence starts with the next trigger; triggers during
+        // a conversion are lost, as on the device
+        const uint64_t period = adc_trigger_period_ns(hadc->Init.ExternalTrigConv);
+        if (period) {
+          adc.triggerNs += period;
+          if (adc.triggerNs < adc.nextNs) {
+            adc.triggerNs += ((adc.nextNs - adc.triggerNs) / period + 1U) * period;
+          }
+        } else {
+          adc.triggerNs = adc.nextNs + 1000000ULL; // Trigger off, look again in 1 ms
+        }
+        adc.nextNs = adc.triggerNs;
+      } else if (hadc->Init.ContinuousConvMode != ENABLE) {
+        adc.running = false;
+      }
+    }
+  }
+  sil_irq_unlock();
+
+  if (events) dma_raise(hdma, events);
+}
+
+/* TIM ------------------------------------------------------------------------*/
+__attribute__((weak)) void HAL_TIM_Base_MspInit(TIM_HandleTypeDef *htim) {
+  UNUSED(htim);
+}
+
+__attribute__((weak)) void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef *htim) {
+  UNUSED(htim);
+}
+
+__attribute__((weak)) void HAL_TIM_PWM_MspInit(TIM_HandleTypeDef *htim) {
+  UNUSED(htim);
+}
+
+__attribute__((weak)) void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
+  UNUSED(htim);
+}
+
+static volatile uint32_t *tim_ccr(TIM_TypeDef *tim, uint32_t channel) {
+  switch (channel) {
+    case TIM_CHANNEL_1: return &tim->CCR1;
+    case TIM_CHANNEL_2: return &tim->CCR2;
+    case TIM_CHANNEL_3: return &tim->CCR3;
+    default:            return &tim->CCR4;
+  }
+}
+
+static void tim_set_time_base(TIM_HandleTypeDef *htim) {
+  htim->Instance->PSC = htim->Init.Prescaler;
+  htim->Instance->ARR = htim->Init.Period;
+  htim->Instance->RCR = htim->Init.RepetitionCounter;
+  htim->Instance->CR1 = htim->Init.AutoReloadPreload;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim) {
+  HAL_TIM_Base_MspInit(htim);
+  tim_set_time_base(htim);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim) {
+  htim->Instance->CR1 |= TIM_CR1_CEN;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim) {
+  htim->Instance->DIER |= TIM_DIER_UIE;
+  htim->Instance->CR1 |= TIM_CR1_CEN;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim, TIM_ClockConfigTypeDef *sClockSourceConfig) {
+  UNUSED(htim);
+  UNUSED(sClockSourceConfig);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef *htim) {
+  HAL_TIM_PWM_MspInit(htim);
+  tim_set_time_base(htim);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef *htim, TIM_OC_InitTypeDef *sConfig, uint32_t Channel) {
+  *tim_ccr(htim->Instance, Channel) = sConfig->Pulse;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel) {
+  htim->Instance->CCER |= TIM_CCER_CC1E << Channel;
+  if (htim->Instance == TIM1) htim->Instance->BDTR |= TIM_BDTR_MOE;
+  htim->Instance->CR1 |= TIM_CR1_CEN;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t Channel) {
+  htim->Instance->CCER &= ~(TIM_CCER_CC1E << Channel);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim, TIM_MasterConfigTypeDef *sMasterConfig) {
+  htim->Instance->CR2 = sMasterConfig->MasterOutputTrigger;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_ConfigBreakDeadTime(TIM_HandleTypeDef *htim, TIM_BreakDeadTimeConfigTypeDef *sBreakDeadTimeConfig) {
+  UNUSED(htim);
+  UNUSED(sBreakDeadTimeConfig);
+  return HAL_OK;
+}
+
+/*
+ * @brief DMA burst of a timer (TIM1..TIM3), one per update event
+ */
+typedef struct {
+  TIM_HandleTypeDef *htim;
+  const uint32_t *buffer;
+  uint32_t length;                // Words per DMA cycle
+  uint32_t pos;
+} SilTimBurst;
+
+static SilTimBurst timBurst[3];
+
+static SilTimBurst *tim_burst(const TIM_TypeDef *tim) {
+  if (tim == TIM1) return &timBurst[0];
+  if (tim == TIM2) return &timBurst[1];
+  if (tim == TIM3) return &timBurst[2];
+  return NULL;
+}
+
+static void tim_dma_period_elapsed_cplt(DMA_HandleTypeDef *hdma) {
+  HAL_TIM_PeriodElapsedCallback((TIM_HandleTypeDef *)hdma->Parent);
+}
+
+HAL_StatusTypeDef HAL_TIM_DMABurst_WriteStart(TIM_HandleTypeDef *htim, uint32_t BurstBaseAddress,
+                                              uint32_t BurstRequestSrc, const uint32_t *BurstBuffer,
+                                              uint32_t BurstLength) {
+  SilTimBurst *burst = tim_burst(htim->Instance);
+  DMA_HandleTypeDef *hdma = htim->hdma[TIM_DMA_ID_UPDATE];
+  // Update requests only, as used by the firmware
+  if (!burst || BurstRequestSrc != TIM_DMA_UPDATE || !hdma || !BurstBuffer) return HAL_ERROR;
+
+  hdma->XferCpltCallback = tim_dma_period_elapsed_cplt;
+  hdma->XferHalfCpltCallback = NULL;
+  sil_irq_lock();
+  burst->htim = htim;
+  burst->buffer = BurstBuffer;
+  burst->length = (BurstLength >> 8U) + 1U;
+  burst->pos = 0U;
+  htim->Instance->DCR = BurstBaseAddress | BurstLength;
+  htim->Instance->DIER |= TIM_DIER_UDE;
+  sil_irq_unlock();
+  return HAL_OK;
+}
+
+/*
+ * @brief Move one burst to the timer registers at DCR.DBA, as the update DMA
+ *        request would. Caller holds the IRQ lock.
+ * @return DMA events to raise
+ */
+static uint32_t tim_burst_transfer(TIM_TypeDef *tim) {
+  SilTimBurst *burst = tim_burst(tim);
+  if (!burst || !burst->buffer || !(tim->DIER & TIM_DIER_UDE)) return 0U;
+
+  volatile uint32_t *regs = (volatile uint32_t *)tim;
+  const uint32_t base = tim->DCR & TIM_DCR_DBA;
+  const uint32_t count = ((tim->DCR & TIM_DCR_DBL) >> 8U) + 1U;
+  uint32_t events = 0U;
+  for (uint32_t i = 0; i < count && base + i < sizeof(TIM_TypeDef) / sizeof(uint32_t); i++) {
+    regs[base + i] = burst->buffer[burst->pos++];
+    if (burst->pos == burst->length / 2U) {
+      events |= SIL_DMA_FLAG_HT;
+    }
+    if (burst->pos == burst->length) {
+      events |= SIL_DMA_FLAG_TC;
+      burst->pos = 0U;
+      if (burst->htim->hdma[TIM_DMA_ID_UPDATE]->Init.Mode != DMA_CIRCULAR) {
+        burst->buffer = NULL;
+        break;
+      }
+    }
+  }
+  return events;
+}
+
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef *htim) {
+  if ((htim->Instance->SR & TIM_SR_UIF) && (htim->Instance->DIER & TIM_DIER_UIE)) {
+    htim->Instance->SR &= ~TIM_SR_UIF;
+    HAL_TIM_PeriodElapsedCallback(htim);
+  }
+}
+
+/*
+ * @brief Update events of TIM1..TIM3 with their update interrupt and DMA
+ *        burst; TIM4, the HAL time base, is not modelled. Updates missed by
+ *        the board thread collapse into one, as the flag would on the MCU.
+ */
+void sil_tim_step(uint64_t nowUs) {
+  static TIM_TypeDef *const timers[] = { TIM1, TIM2, TIM3 };
+  static const IRQn_Type updateIrq[] = { TIM1_UP_IRQn, TIM2_IRQn, TIM3_IRQn };
+  static uint64_t nextNs[3];
+  const uint64_t nowNs = nowUs * 1000ULL;
+
+  for (uint32_t i = 0; i < 3U; i++) {
+    TIM_TypeDef *tim = timers[i];
+    if (!(tim->CR1 & TIM_CR1_CEN)) {
+      nextNs[i] = 0U;
+      continue;
+    }
+
+    const uint64_t periodNs = (uint64_t)(tim->PSC + 1U) * (tim->ARR + 1U) * 1000000000ULL / SIL_TIM_CLOCK_HZ;
+    if (nextNs[i] == 0U) {
+      nextNs[i] = nowNs + periodNs;
+      continue;
+    }
+    if (nowNs < nextNs[i]) continue;
+    while (nextNs[i] <= nowNs) nextNs[i] += periodNs;
+
+    sil_irq_lock();
+    tim->SR |= TIM_SR_UIF;
+    const bool raise = (tim->DIER & TIM_DIER_UIE) != 0U;
+    const uint32_t dmaEvents = tim_burst_transfer(tim);
+    DMA_HandleTypeDef *hdma = tim_burst(tim)->htim ? tim_burst(tim)->htim->hdma[TIM_DMA_ID_UPDATE] : NULL;
+    sil_irq_unlock();
+    if (dmaEvents && hdma) dma_raise(hdma, dmaEvents);
+    if (raise) sil_nvic_raise(updateIrq[i]);
+  }
+}
+
+float sil_tim_duty(const TIM_TypeDef *tim, uint32_t channel) {
+  if (!(tim->CR1 & TIM_CR1_CEN) || !(tim->CCER & (TIM_CCER_CC1E << channel))) return -1.0f;
+  if ((tim == TIM1) && !(tim->BDTR & TIM_BDTR_MOE)) return -1.0f;
+
+  const uint32_t period = tim->ARR + 1U;
+  uint32_t ccr = *tim_ccr((TIM_TypeDef *)tim, channel);
+  if (ccr > period) ccr = period;
+  return 100.0f * (float)ccr / (float)period;
+}
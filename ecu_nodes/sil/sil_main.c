@@ -0,0 +1,152 @@
+/*
+ * sil_main.c
+ *
+ *  Entry point of the SIL build: parses options, attaches bxCAN to a
+ *  SocketCAN interface, starts the board model and the console, then runs
+ *  the unmodified firmware main() (compiled as ecu_main()).
+ */
+
+#define _GNU_SOURCE
+#include "sil.h"
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIL_TAP_DEFAULT_MS    100U
+#define SIL_INPUTS_PER_ROW    9U    // btn_signal_map in button.c
+
+int ecu_main(void);
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -i, --interface IF   SocketCAN interface (default vcan0)\n"
+          "  -n, --name NAME      Instance name printed on every log line (default ecu)\n"
+          "  -p, --pot VALUE      Initial potentiometer reading, 0..4095\n"
+          "  -s, --sweep MS       Sweep the potentiometer over 0..4095 and back every MS\n"
+          "  -q, --quiet          Do not log output changes\n"
+          "      --no-bus-timing  Do not hold TX mailboxes for the frame time on the bus\n"
+          "\n"
+          "Console commands (stdin):\n"
+          "  press SWITCH        close a matrix switch, SWITCH is ROW:COL or a digital\n"
+          "                      input number as in io_config.json (row * 9 + col)\n"
+          "  release SWITCH      open it again\n"
+          "  tap SWITCH [MS]     press for MS milliseconds (default %u)\n"
+          "  pot VALUE           set the potentiometer\n"
+          "  adc CHANNEL VALUE   set any ADC1 input\n"
+          "  sweep MS | off      sweep the potentiometer\n"
+          "  status              print all outputs\n"
+          "  quit\n",
+          prog, SIL_TAP_DEFAULT_MS);
+}
+
+/*
+ * @brief Resolve "ROW:COL" or a digital input number to a matrix switch
+ */
+static bool parse_switch(const char *text, uint8_t *row, uint8_t *col) {
+  int r, c;
+
+  if (sscanf(text, "%d:%d", &r, &c) != 2) {
+    const int input = atoi(text);
+    r = input / (int)SIL_INPUTS_PER_ROW;
+    c = input % (int)SIL_INPUTS_PER_ROW;
+  }
+  if (r < 0 || r >= 4 || c < 0 || c >= 4) return false;
+  *row = (uint8_t)r;
+  *col = (uint8_t)c;
+  return true;
+}
+
+static void console_command(char *line) {
+  char *argv[8];
+  int argc = 0;
+
+  for (char *token = strtok(line, " \t\r\n"); token && argc < 8; token = strtok(NULL, " \t\r\n")) {
+    argv[argc++] = token;
+  }
+  if (argc == 0 || argv[0][0] == '#') return;
+
+  const char *cmd = argv[0];
+  uint8_t row, col;
+
+  if ((!strcmp(cmd, "press") || !strcmp(cmd, "release")) && argc == 2) {
+    if (!parse_switch(argv[1], &row, &col)) goto bad;
+    sil_board_press(row, col, !strcmp(cmd, "press"));
+  } else if (!strcmp(cmd, "tap") && (argc == 2 || argc == 3)) {
+    if (!parse_switch(argv[1], &row, &col)) goto bad;
+    const int ms = argc == 3 ? atoi(argv[2]) : (int)SIL_TAP_DEFAULT_MS;
+    sil_board_tap(row, col, (uint32_t)(ms > 0 ? ms : 1));
+  } else if (!strcmp(cmd, "pot") && argc == 2) {
+    sil_adc_set_input(ADC_CHANNEL_5, (uint32_t)atoi(argv[1]));
+  } else if (!strcmp(cmd, "adc") && argc == 3) {
+    sil_adc_set_input((uint32_t)atoi(argv[1]), (uint32_t)atoi(argv[2]));
+  } else if (!strcmp(cmd, "sweep") && argc == 2) {
+    sil_board_sweep(ADC_CHANNEL_5, strcmp(argv[1], "off") ? (uint32_t)atoi(argv[1]) : 0U);
+  } else if (!strcmp(cmd, "status")) {
+    sil_board_print_outputs();
+  } else if (!strcmp(cmd, "quit")) {
+    exit(0);
+  } else {
+    goto bad;
+  }
+  return;
+
+bad:
+  sil_log("bad command: %s", cmd);
+}
+
+static void *console_thread(void *arg) {
+  char line[256];
+  UNUSED(arg);
+
+  while (fgets(line, sizeof(line), stdin)) {
+    console_command(line);
+  }
+  // Input closed (e.g. a script ended): keep the node running
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  static const struct option options[] = {
+    { "interface",     required_argument, NULL, 'i' },
+    { "name",          required_argument, NULL, 'n' },
+    { "pot",           required_argument, NULL, 'p' },
+    { "sweep",         required_argument, NULL, 's' },
+    { "quiet",         no_argument,       NULL, 'q' },
+    { "no-bus-timing", no_argument,       NULL, 'T' },
+    { "help",          no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "i:n:p:s:qh", options, NULL)) != -1) {
+    switch (opt) {
+      case 'i': sil_config.canInterface = optarg; break;
+      case 'n': sil_config.name = optarg; break;
+      case 'p': sil_adc_set_input(ADC_CHANNEL_5, (uint32_t)atoi(optarg)); break;
+      case 's': sil_board_sweep(ADC_CHANNEL_5, (uint32_t)atoi(optarg)); break;
+      case 'q': sil_config.quiet = true; break;
+      case 'T': sil_config.busTiming = false; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!sil_can_open()) {
+    fprintf(stderr, "cannot attach to %s (create it with: ip link add dev %s type vcan && ip link set up %s)\n",
+            sil_config.canInterface, sil_config.canInterface, sil_config.canInterface);
+    return 1;
+  }
+  sil_log("firmware starting on %s", sil_config.canInterface);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, console_thread, NULL);
+  pthread_setname_np(thread, "sil-console");
+  pthread_detach(thread);
+
+  sil_board_start();
+  return ecu_main();
+}
@@ -0,0 +1,398 @@
+/*
+ * sil_os.c
+ *
+ *  CMSIS-RTOS2 on POSIX threads for the SIL build. Threads are created
+ *  suspended and released by osKernelStart(); delays are aligned to the
+ *  1 kHz kernel tick like vTaskDelay(). Priorities are recorded but not
+ *  enforced, every thread runs on the host scheduler. Each software timer
+ *  has a thread that runs its callback, as the FreeRTOS timer task would.
+ */
+
+#define _GNU_SOURCE
+#include "cmsis_os2.h"
+#include "sil.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIL_THREAD_NAME_LEN   32U
+
+typedef struct {
+  pthread_t thread;
+  char name[SIL_THREAD_NAME_LEN];
+  osThreadFunc_t func;
+  void *argument;
+  osPriority_t priority;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint32_t flags;
+} SilThread;
+
+typedef struct {
+  pthread_t thread;
+  char name[SIL_THREAD_NAME_LEN];
+  osTimerFunc_t func;
+  void *argument;
+  osTimerType_t type;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool running;
+  uint32_t period;
+  uint32_t expiry;      // Tick of the next expiry
+  uint32_t generation;  // Changed by every start and stop
+} SilTimer;
+
+static pthread_mutex_t kernelMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t kernelCond = PTHREAD_COND_INITIALIZER;
+static osKernelState_t kernelState = osKernelInactive;
+static __thread SilThread *currentThread;
+
+/*
+ * @brief Absolute CLOCK_MONOTONIC time of a kernel tick
+ */
+static struct timespec tick_time(uint32_t tick) {
+  const uint64_t us = (sil_time_us() - sil_uptime_us()) + (uint64_t)tick * (1000000U / SIL_TICK_RATE_HZ);
+  const struct timespec ts = { (time_t)(us / 1000000ULL), (long)(us % 1000000ULL) * 1000L };
+  return ts;
+}
+
+/*
+ * @brief Initialize a condition variable whose timed waits take CLOCK_MONOTONIC
+ *        deadlines, as tick_time() returns
+ */
+static void cond_init_monotonic(pthread_cond_t *cond) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+/*
+ * @brief Block the calling thread until osKernelStart()
+ */
+static void wait_kernel_running(void) {
+  pthread_mutex_lock(&kernelMutex);
+  while (kernelState != osKernelRunning) {
+    pthread_cond_wait(&kernelCond, &kernelMutex);
+  }
+  pthread_mutex_unlock(&kernelMutex);
+}
+
+/* Kernel ---------------------------------------------------------------------*/
+osStatus_t osKernelInitialize(void) {
+  pthread_mutex_lock(&kernelMutex);
+  if (kernelState == osKernelInactive) kernelState = osKernelReady;
+  pthread_mutex_unlock(&kernelMutex);
+  return osOK;
+}
+
+osStatus_t osKernelGetInfo(osVersion_t *version, char *id_buf, uint32_t id_size) {
+  if (version) {
+    version->api = 20010003U;
+    version->kernel = 20010003U;
+  }
+  if (id_buf && id_size) {
+    strncpy(id_buf, "SIL pthreads", id_size - 1U);
+    id_buf[id_size - 1U] = '\0';
+  }
+  return osOK;
+}
+
+osKernelState_t osKernelGetState(void) {
+  return kernelState;
+}
+
+osStatus_t osKernelStart(void) {
+  if (sil_in_isr()) return osErrorISR;
+
+  pthread_mutex_lock(&kernelMutex);
+  if (kernelState != osKernelReady) {
+    pthread_mutex_unlock(&kernelMutex);
+    return osError;
+  }
+  kernelState = osKernelRunning;
+  pthread_cond_broadcast(&kernelCond);
+  pthread_mutex_unlock(&kernelMutex);
+
+  // Like the FreeRTOS scheduler, never return to main()
+  for (;;) {
+    pause();
+  }
+}
+
+uint32_t osKernelGetTickCount(void) {
+  return HAL_GetTick();
+}
+
+uint32_t osKernelGetTickFreq(void) {
+  return SIL_TICK_RATE_HZ;
+}
+
+uint32_t osKernelGetSysTimerCount(void) {
+  return (uint32_t)(sil_uptime_us() * (SystemCoreClock / 1000000U));
+}
+
+uint32_t osKernelGetSysTimerFreq(void) {
+  return SystemCoreClock;
+}
+
+/* Threads --------------------------------------------------------------------*/
+static void *thread_entry(void *arg) {
+  SilThread *thread = arg;
+  currentThread = thread;
+
+  wait_kernel_running();
+  thread->func(thread->argument);
+  return NULL;
+}
+
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument, const osThreadAttr_t *attr) {
+  if (!func || sil_in_isr()) return NULL;
+
+  SilThread *thread = calloc(1, sizeof(SilThread));
+  if (!thread) return NULL;
+
+  thread->func = func;
+  thread->argument = argument;
+  thread->priority = (attr && attr->priority != osPriorityNone) ? attr->priority : osPriorityNormal;
+  strncpy(thread->name, (attr && attr->name) ? attr->name : "thread", SIL_THREAD_NAME_LEN - 1U);
+  pthread_mutex_init(&thread->lock, NULL);
+  cond_init_monotonic(&thread->cond);
+
+  if (pthread_create(&thread->thread, NULL, thread_entry, thread) != 0) {
+    free(thread);
+    return NULL;
+  }
+  pthread_detach(thread->thread);
+
+  char shortName[16];
+  strncpy(shortName, thread->name, sizeof(shortName) - 1U);
+  shortName[sizeof(shortName) - 1U] = '\0';
+  pthread_setname_np(thread->thread, shortName);
+  return thread;
+}
+
+const char *osThreadGetName(osThreadId_t thread_id) {
+  return thread_id ? ((SilThread *)thread_id)->name : NULL;
+}
+
+osThreadId_t osThreadGetId(void) {
+  return currentThread;
+}
+
+osPriority_t osThreadGetPriority(osThreadId_t thread_id) {
+  return thread_id ? ((SilThread *)thread_id)->priority : osPriorityError;
+}
+
+osStatus_t osThreadSetPriority(osThreadId_t thread_id, osPriority_t priority) {
+  if (!thread_id) return osErrorParameter;
+  ((SilThread *)thread_id)->priority = priority;
+  return osOK;
+}
+
+osStatus_t osThreadYield(void) {
+  if (sil_in_isr()) return osErrorISR;
+  sched_yield();
+  return osOK;
+}
+
+/* Thread flags ---------------------------------------------------------------*/
+uint32_t osThreadFlagsSet(osThreadId_t thread_id, uint32_t flags) {
+  SilThread *thread = thread_id;
+  if (!thread || (flags & osFlagsError)) return osFlagsErrorParameter;
+
+  pthread_mutex_lock(&thread->lock);
+  thread->flags |= flags;
+  const uint32_t result = thread->flags;
+  pthread_cond_broadcast(&thread->cond);
+  pthread_mutex_unlock(&thread->lock);
+  return result;
+}
+
+uint32_t osThreadFlagsClear(uint32_t flags) {
+  SilThread *thread = currentThread;
+  if (!thread) return osFlagsErrorUnknown;
+  if (sil_in_isr()) return osFlagsErrorISR;
+
+  pthread_mutex_lock(&thread->lock);
+  const uint32_t result = thread->flags;
+  thread->flags &= ~flags;
+  pthread_mutex_unlock(&thread->lock);
+  return result;
+}
+
+uint32_t osThreadFlagsGet(void) {
+  SilThread *thread = currentThread;
+  if (!thread) return 0U;
+  pthread_mutex_lock(&thread->lock);
+  const uint32_t result = thread->flags;
+  pthread_mutex_unlock(&thread->lock);
+  return result;
+}
+
+uint32_t osThreadFlagsWait(uint32_t flags, uint32_t options, uint32_t timeout) {
+  SilThread *thread = currentThread;
+  if (sil_in_isr()) return osFlagsErrorISR;
+  if (!thread || (flags & osFlagsError)) return osFlagsErrorParameter;
+
+  const struct timespec deadline = tick_time(osKernelGetTickCount() + timeout);
+  uint32_t result;
+
+  pthread_mutex_lock(&thread->lock);
+  for (;;) {
+    const uint32_t matched = thread->flags & flags;
+    const bool done = (options & osFlagsWaitAll) ? (matched == flags) : (matched != 0U);
+    if (done) {
+      result = thread->flags;
+      if (!(options & osFlagsNoClear)) thread->flags &= ~flags;
+      break;
+    }
+    if (timeout == 0U) {
+      result = osFlagsErrorResource;
+      break;
+    }
+    if (timeout == osWaitForever) {
+      pthread_cond_wait(&thread->cond, &thread->lock);
+    } else if (pthread_cond_timedwait(&thread->cond, &thread->lock, &deadline) == ETIMEDOUT) {
+      result = osFlagsErrorTimeout;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&thread->lock);
+  return result;
+}
+
+/* Timers ---------------------------------------------------------------------*/
+static void *timer_entry(void *arg) {
+  SilTimer *timer = arg;
+
+  wait_kernel_running();
+  pthread_mutex_lock(&timer->lock);
+  for (;;) {
+    if (!timer->running) {
+      pthread_cond_wait(&timer->cond, &timer->lock);
+      continue;
+    }
+
+    // Restarted or stopped while waiting: start over with the new expiry
+    const uint32_t generation = timer->generation;
+    const struct timespec deadline = tick_time(timer->expiry);
+    if (pthread_cond_timedwait(&timer->cond, &timer->lock, &deadline) != ETIMEDOUT ||
+        generation != timer->generation) {
+      continue;
+    }
+
+    if (timer->type == osTimerPeriodic) {
+      timer->expiry += timer->period;
+    } else {
+      timer->running = false;
+    }
+    pthread_mutex_unlock(&timer->lock);
+    timer->func(timer->argument);
+    pthread_mutex_lock(&timer->lock);
+  }
+  return NULL;
+}
+
+osTimerId_t osTimerNew(osTimerFunc_t func, osTimerType_t type, void *argument, const osTimerAttr_t *attr) {
+  if (!func || sil_in_isr()) return NULL;
+
+  SilTimer *timer = calloc(1, sizeof(SilTimer));
+  if (!timer) return NULL;
+
+  timer->func = func;
+  timer->argument = argument;
+  timer->type = type;
+  strncpy(timer->name, (attr && attr->name) ? attr->name : "timer", SIL_THREAD_NAME_LEN - 1U);
+  pthread_mutex_init(&timer->lock, NULL);
+  cond_init_monotonic(&timer->cond);
+
+  if (pthread_create(&timer->thread, NULL, timer_entry, timer) != 0) {
+    free(timer);
+    return NULL;
+  }
+  pthread_detach(timer->thread);
+
+  char shortName[16];
+  strncpy(shortName, timer->name, sizeof(shortName) - 1U);
+  shortName[sizeof(shortName) - 1U] = '\0';
+  pthread_setname_np(timer->thread, shortName);
+  return timer;
+}
+
+const char *osTimerGetName(osTimerId_t timer_id) {
+  return timer_id ? ((SilTimer *)timer_id)->name : NULL;
+}
+
+osStatus_t osTimerStart(osTimerId_t timer_id, uint32_t ticks) {
+  SilTimer *timer = timer_id;
+  if (sil_in_isr()) return osErrorISR;
+  if (!timer || ticks == 0U) return osErrorParameter;
+
+  pthread_mutex_lock(&timer->lock);
+  timer->period = ticks;
+  timer->expiry = osKernelGetTickCount() + ticks;
+  timer->running = true;
+  timer->generation++;
+  pthread_cond_broadcast(&timer->cond);
+  pthread_mutex_unlock(&timer->lock);
+  return osOK;
+}
+
+osStatus_t osTimerStop(osTimerId_t timer_id) {
+  SilTimer *timer = timer_id;
+  osStatus_t status = osOK;
+  if (sil_in_isr()) return osErrorISR;
+  if (!timer) return osErrorParameter;
+
+  pthread_mutex_lock(&timer->lock);
+  if (timer->running) {
+    timer->running = false;
+    timer->generation++;
+    pthread_cond_broadcast(&timer->cond);
+  } else {
+    status = osErrorResource;
+  }
+  pthread_mutex_unlock(&timer->lock);
+  return status;
+}
+
+uint32_t osTimerIsRunning(osTimerId_t timer_id) {
+  SilTimer *timer = timer_id;
+  if (!timer || sil_in_isr()) return 0U;
+
+  pthread_mutex_lock(&timer->lock);
+  const uint32_t running = timer->running ? 1U : 0U;
+  pthread_mutex_unlock(&timer->lock);
+  return running;
+}
+
+/* Delays ---------------------------------------------------------------------*/
+static void sleep_until_tick(uint32_t tick) {
+  const struct timespec deadline = tick_time(tick);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+  }
+}
+
+osStatus_t osDelay(uint32_t ticks) {
+  if (sil_in_isr()) return osErrorISR;
+  if (ticks != 0U) {
+    sleep_until_tick(osKernelGetTickCount() + ticks);
+  }
+  return osOK;
+}
+
+osStatus_t osDelayUntil(uint32_t ticks) {
+  if (sil_in_isr()) return osErrorISR;
+  const uint32_t delay = ticks - osKernelGetTickCount();
+  // A deadline already passed returns at once, like vTaskDelayUntil()
+  if (delay != 0U && delay <= 0x7FFFFFFFU) {
+    sleep_until_tick(ticks);
+  }
+  return osOK;
+}
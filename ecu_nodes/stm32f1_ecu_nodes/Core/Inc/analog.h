@@ -0,0 +1,29 @@
+/*
+ * analog.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Tdieney
+ */
+
+#ifndef INC_ANALOG_H_
+#define INC_ANALOG_H_
+
+#include "main.h"
+#include "can.h"
+
+#define NUMBER_OF_ADC_CHANNELS  8U    // Scan sequence length, Analog Input 1..8
+#define ADC_RESOLUTION_BITS     12U
+#define ADC_OVERSAMPLING_BITS   (ANALOG_VALUE_BITS - ADC_RESOLUTION_BITS)
+#define ADC_OVERSAMPLING        (1U << (2U * ADC_OVERSAMPLING_BITS))  // 4^n samples per n extra bits
+#define ADC_DMA_BUFFER_SIZE     (2U * ADC_OVERSAMPLING * NUMBER_OF_ADC_CHANNELS)
+
+/*
+ * @brief  Decimate one half of the ADC DMA buffer into the Analog Input
+ *         Response Frames. Called from the DMA half and full transfer callbacks.
+ * @param  samples: ADC_OVERSAMPLING scan sequences of NUMBER_OF_ADC_CHANNELS samples
+ * @param  analog_input_data: Pointer to the Analog Input Response Frames
+ *                            to update
+ */
+void analog_input_process(const uint16_t *samples, volatile AnalogInput_Resp_Frame *analog_input_data);
+
+#endif /* INC_ANALOG_H_ */
@@ -10,13 +10,16 @@
 
 #include "main.h"
 #include <stdbool.h>
-#include "cmsis_os2.h"
 #include "can.h"
 
-#define DEBOUNCE_BTN_MS         20U
 #define NUMBER_OF_BUTTONS       16U
 #define NUMBER_OF_BTN_COLUMNS   4U
 #define NUMBER_OF_BTN_ROWS      4U
+#define BTN_LOCKOUT_SAMPLES     3U  // Samples of a key ignored after it changed (2-bit vertical counter)
+
+// Bit of a key in the 16-bit key bitmaps, and the keys of column 0
+#define BTN_KEY(row, col)       ((row) * NUMBER_OF_BTN_COLUMNS + (col))
+#define BTN_COLUMN_KEYS         0x1111U
 
 /*
  * @brief  Initialize the button matrix
@@ -24,39 +27,15 @@
 void btn_matrix_init(void);
 
 /*
- * @brief  Check if a button is still pressed
- * @param  row: The row of the button
- * @param  col: The column of the button
- * @retval true if the button is still pressed, false otherwise
- */
-bool is_btn_still_pressed(uint8_t row, uint8_t col);
-
-/*
- * @brief  Turn on a specific column in the button matrix
- * @param  col: The column to turn on
- */
-void turn_btn_matrix_col(uint8_t col);
-
-/*
- * @brief  Process button press
- * @param  btn_state: Pointer to the button state array
- * @param  digital_input_data: Pointer to the Digital Input Response Frame
- *                              to update input states
- */
-void process_btn_pressed(uint8_t *btn_state, DigitalInput_Resp_Frame *digital_input_data);
-
-/*
- * @brief  Scan the button matrix
- * @param  digital_input_data: Pointer to the Digital Input Response Frame
- *                              to update input states
- */
-void scan_btn_matrix(DigitalInput_Resp_Frame *digital_input_data);
-
-/*
- * @brief  Process the button matrix
- * @param  digital_input_data: Pointer to the Digital Input Response Frame
+ * @brief  Scan one column of the button matrix, called from the scan timer
+ *         interrupt. The keys of the column are debounced right away: a key
+ *         changes on its first differing sample, then ignores its next
+ *         BTN_LOCKOUT_SAMPLES samples while the contacts bounce. Each newly
+ *         pressed key toggles its input state.
+ * @param  digital_input_data: Pointer to the Digital Input Response Frames
  *                              to update input states
+ * @retval true if the input states changed, false otherwise
  */
-void btn_matrix_process(DigitalInput_Resp_Frame *digital_input_data);
+bool btn_matrix_scan(volatile DigitalInput_Resp_Frame *digital_input_data);
 
 #endif /* INC_BUTTON_H_ */
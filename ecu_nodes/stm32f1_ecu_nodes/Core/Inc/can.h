@@ -13,15 +13,19 @@
 #include "main.h"
 
 // CAN IDs
-#define DIGITAL_OUTPUT_CMD_ID(n)          (0x94FF0000UL + ((n) * 0x20UL))
-#define DIGITAL_OUTPUT_RES_ID(n)          (0x94FF0800UL + ((n) * 0x20UL))
-#define DIGITAL_INPUT_RES_ID(n)           (0x94FF0A00UL + ((n) * 0x20UL))
-#define ANALOG_INPUT_RES_ID(n)            (0x94FF0D00UL + ((n) * 0x20UL))
+#define CAN_ID_STEP                       0x20UL
+#define DIGITAL_OUTPUT_CMD_ID(n)          (0x94FF0000UL + ((n) * CAN_ID_STEP))
+#define DIGITAL_OUTPUT_RES_ID(n)          (0x94FF0800UL + ((n) * CAN_ID_STEP))
+#define DIGITAL_INPUT_RES_ID(n)           (0x94FF0A00UL + ((n) * CAN_ID_STEP))
+#define ANALOG_INPUT_RES_ID(n)            (0x94FF0D00UL + ((n) * CAN_ID_STEP))
+// Placeholder until the diagnostic service is specified
+#define DIAGNOSTIC_REQ_ID(n)              (0x94FF0F00UL + ((n) * CAN_ID_STEP))
 
 #define NUMBER_OF_DIG_OUT_CMD_FRAME       4U
 #define NUMBER_OF_DIG_OUT_RES_FRAME       8U
 #define NUMBER_OF_DIG_IN_RES_FRAME        4U
 #define NUMBER_OF_ANALOG_IN_RES_FRAME     8U
+#define NUMBER_OF_DIAG_REQ_FRAME          2U
 
 // CAN Frame Signal Per Frame
 #define DIGITAL_OUT_CMD_SIGNAL_PER_FRAME  8U
@@ -50,7 +54,23 @@
 #define DIGITAL_OUT_CMD_SWITCH_ON         0x01U
 #define DIGITAL_OUT_CMD_SWITCH_OFF        0x00U
 
-#define CAN_TX_QUEUE_SIZE                 16U
+// Received frames waiting for the handler task, power of two
+#define CAN_RX_QUEUE_SIZE                 16U
+
+// bxCAN acceptance filter banks (0..13 on the STM32F103). Every bank holds two IDs
+// in 32-bit identifier list mode; commands are received through FIFO0, diagnostic
+// requests through FIFO1 from CAN_FILTER_BANK_DIAG on.
+#define CAN_FILTER_BANK_COMMAND           0U
+#define CAN_FILTER_BANK_DIAG              7U
+#define CAN_FILTER_BANK_COUNT             14U
+
+// TX slot table: one slot per response frame, in ascending CAN ID order,
+// so a lower slot index wins arbitration
+#define CAN_TX_SLOT_DIG_OUT_RES(n)        (n)
+#define CAN_TX_SLOT_DIG_IN_RES(n)         (NUMBER_OF_DIG_OUT_RES_FRAME + (n))
+#define CAN_TX_SLOT_ANALOG_IN_RES(n)      (NUMBER_OF_DIG_OUT_RES_FRAME + NUMBER_OF_DIG_IN_RES_FRAME + (n))
+#define CAN_TX_SLOT_COUNT                 (NUMBER_OF_DIG_OUT_RES_FRAME + NUMBER_OF_DIG_IN_RES_FRAME + \
+                                           NUMBER_OF_ANALOG_IN_RES_FRAME)
 
 /**
  * @brief CAN Frame structure
@@ -133,33 +153,93 @@ typedef union {
 } AnalogInput_Resp_Frame;
 
 /*
- * @brief Enqueue a CAN transmission frame
- * @param header: Pointer to the CAN header
- * @param data: Pointer to the data buffer
- * @retval true if successful, false if full
+ * @brief Store the latest payload of a response frame and mark it pending.
+ *        A payload not sent yet is replaced, so each frame is queued at most once.
+ *        Lock-free; call from one task only (the TX interrupt is the consumer).
+ * @param slot: CAN_TX_SLOT_* index of the frame
+ * @param sdu: Frame payload
+ */
+void CAN_UpdateTxFrame(uint8_t slot, uint64_t sdu);
+
+/*
+ * @brief Start sending the pending frames and return at once. The CAN TX
+ *        interrupt hands them to the mailboxes, lowest CAN ID first.
+ */
+void CAN_send(void);
+
+/*
+ * @brief Fill the free TX mailboxes from the pending slots. Called from the
+ *        CAN TX interrupt only.
+ * @param hcan: Pointer to CAN handle
+ */
+void CAN_TxIRQHandler(CAN_HandleTypeDef *hcan);
+
+/*
+ * @brief Configure the acceptance filters: the command IDs
+ *        DIGITAL_OUTPUT_CMD_ID(0..NUMBER_OF_DIG_OUT_CMD_FRAME - 1) go to FIFO0,
+ *        the diagnostic requests DIAGNOSTIC_REQ_ID(0..NUMBER_OF_DIAG_REQ_FRAME - 1)
+ *        to FIFO1, every other frame on the bus is dropped by the hardware.
+ * @param hcan: Pointer to CAN handle
+ * @retval HAL_OK, or HAL_ERROR if a filter bank could not be configured
+ */
+HAL_StatusTypeDef CAN_ConfigRxFilters(CAN_HandleTypeDef *hcan);
+
+/*
+ * @brief Count the RX FIFO overruns reported by the HAL and clear them.
+ *        Called from HAL_CAN_ErrorCallback().
+ * @param hcan: Pointer to CAN handle
+ */
+void CAN_ErrorIRQHandler(CAN_HandleTypeDef *hcan);
+
+/*
+ * @brief Number of frames lost because an RX FIFO was full
+ * @param fifo: CAN_RX_FIFO0 or CAN_RX_FIFO1
+ * @retval Overrun count since reset
  */
-bool CAN_EnqueueTxFrame(CAN_Frame *frame, CAN_Frame *canTxQueue);
+uint32_t CAN_GetRxOverrunCount(uint32_t fifo);
 
 /*
- * @brief Dequeue a CAN transmission frame
- * @param header: Pointer to the CAN header to fill
- * @param data: Pointer to the data buffer to fill
- * @retval true if successful, false if empty
+ * @brief Copy the frames of an RX FIFO into the receive queue. Called from the
+ *        RX interrupt; decoding is left to the handler task.
+ * @param hcan: Pointer to CAN handle
+ * @param fifo: CAN_RX_FIFO0 or CAN_RX_FIFO1
+ * @retval Number of frames queued
  */
-bool CAN_DequeueTxFrame(CAN_Frame *frame, CAN_Frame *canTxQueue);
+uint32_t CAN_RxIRQHandler(CAN_HandleTypeDef *hcan, uint32_t fifo);
 
 /*
- * @brief Dequeue and send CAN transmission frames
+ * @brief Release the diagnostic requests waiting in FIFO1. There is no
+ *        diagnostic service yet, so they are only counted. Called from the
+ *        RX1 interrupt.
  * @param hcan: Pointer to CAN handle
- * @param canTxQueue: Pointer to the CAN transmission queue
  */
-void CAN_send(CAN_HandleTypeDef *hcan, CAN_Frame *canTxQueue);
+void CAN_DiagRxIRQHandler(CAN_HandleTypeDef *hcan);
+
+/*
+ * @brief Number of diagnostic requests received
+ * @retval Request count since reset
+ */
+uint32_t CAN_GetDiagRequestCount(void);
+
+/*
+ * @brief Number of received frames dropped because the receive queue was full
+ * @retval Drop count since reset
+ */
+uint32_t CAN_GetRxDropCount(void);
+
+/*
+ * @brief Apply the queued command frames. They are written to the inactive
+ *        copy of the command frames, which then becomes the active one.
+ *        Call from one task only.
+ * @retval Bit n set if command frame n changed
+ */
+uint32_t CAN_process_commands(void);
 
 /*
- * @brief Process received CAN command
- * @param frame: Pointer to CAN frame
- * @param cmd_frame: Pointer to command frames
+ * @brief Active copy of the command frames. Valid until the next call of
+ *        CAN_process_commands(); other tasks should copy the frames they need.
+ * @retval Pointer to NUMBER_OF_DIG_OUT_CMD_FRAME frames
  */
-void CAN_process_command(CAN_RxFrame *frame, DigitalOutput_Cmd_Frame *cmd_frame);
+const DigitalOutput_Cmd_Frame *CAN_GetCommandFrames(void);
 
 #endif /* INC_CAN_H_ */
@@ -86,16 +86,12 @@ void Error_Handler(void);
 #define DIGITAL_OUT_1_GPIO_Port GPIOA
 #define BTN_ROW0_Pin GPIO_PIN_4
 #define BTN_ROW0_GPIO_Port GPIOB
-#define BTN_ROW0_EXTI_IRQn EXTI4_IRQn
 #define BTN_ROW1_Pin GPIO_PIN_5
 #define BTN_ROW1_GPIO_Port GPIOB
-#define BTN_ROW1_EXTI_IRQn EXTI9_5_IRQn
 #define BTN_ROW2_Pin GPIO_PIN_6
 #define BTN_ROW2_GPIO_Port GPIOB
-#define BTN_ROW2_EXTI_IRQn EXTI9_5_IRQn
 #define BTN_ROW3_Pin GPIO_PIN_7
 #define BTN_ROW3_GPIO_Port GPIOB
-#define BTN_ROW3_EXTI_IRQn EXTI9_5_IRQn
 /* USER CODE BEGIN Private defines */
 #define ZERO                    0U
 #define ONE                     1U
@@ -0,0 +1,42 @@
+/*
+ * analog.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: Tdieney
+ */
+
+#include "analog.h"
+
+_Static_assert(NUMBER_OF_ADC_CHANNELS % ANALOG_IN_RESP_SIGNAL_PER_FRAME == 0U,
+               "ADC channels are expected to fill whole analog frames");
+_Static_assert(NUMBER_OF_ADC_CHANNELS <= MAX_ANALOG_IN_RESP_SIGNALS,
+               "more ADC channels than analog signals");
+
+/*
+ * @brief  Decimate one half of the ADC DMA buffer into the Analog Input
+ *         Response Frames. Called from the DMA half and full transfer callbacks.
+ * @param  samples: ADC_OVERSAMPLING scan sequences of NUMBER_OF_ADC_CHANNELS samples
+ * @param  analog_input_data: Pointer to the Analog Input Response Frames
+ *                            to update
+ */
+void analog_input_process(const uint16_t *samples, volatile AnalogInput_Resp_Frame *analog_input_data) {
+  uint32_t sum[NUMBER_OF_ADC_CHANNELS] = {0};
+
+  // Accumulate 4^n samples per channel; the noise spreads them over n more bits
+  for (uint32_t i = 0; i < ADC_OVERSAMPLING; i++) {
+    for (uint32_t ch = 0; ch < NUMBER_OF_ADC_CHANNELS; ch++) {
+      sum[ch] += *samples++;
+    }
+  }
+
+  // Whole frames are written at once, so CANTxHandler never sees half of one
+  for (uint8_t i = 0; i < NUMBER_OF_ADC_CHANNELS / ANALOG_IN_RESP_SIGNAL_PER_FRAME; i++) {
+    AnalogInput_Resp_Frame data = {0};
+
+    for (uint8_t j = 0; j < ANALOG_IN_RESP_SIGNAL_PER_FRAME; j++) {
+      data.signal[j].analogValue = sum[i * ANALOG_IN_RESP_SIGNAL_PER_FRAME + j] >> ADC_OVERSAMPLING_BITS;
+      data.signal[j].elDiagnosis = 0; // OK
+    }
+    analog_input_data[i].sdu = data.sdu;
+  }
+}
@@ -7,82 +7,36 @@
 
 #include "button.h"
 
+_Static_assert(NUMBER_OF_BUTTONS <= 16U, "keys are kept in 16-bit bitmaps");
+_Static_assert(BTN_LOCKOUT_SAMPLES == 3U, "the vertical counter has 2 bits");
+_Static_assert(BTN_COLUMN_KEYS == 0x1111U && NUMBER_OF_BTN_COLUMNS == 4U, "BTN_COLUMN_KEYS holds one key per row");
+
 GPIO_TypeDef* row_ports[NUMBER_OF_BTN_ROWS] = {BTN_ROW0_GPIO_Port, BTN_ROW1_GPIO_Port, BTN_ROW2_GPIO_Port, BTN_ROW3_GPIO_Port};
 uint16_t row_pins[NUMBER_OF_BTN_ROWS]       = {BTN_ROW0_Pin, BTN_ROW1_Pin, BTN_ROW2_Pin, BTN_ROW3_Pin};
 
 GPIO_TypeDef* col_ports[NUMBER_OF_BTN_COLUMNS] = {BTN_COL0_GPIO_Port, BTN_COL1_GPIO_Port, BTN_COL2_GPIO_Port, BTN_COL3_GPIO_Port};
 uint16_t col_pins[NUMBER_OF_BTN_COLUMNS]       = {BTN_COL0_Pin, BTN_COL1_Pin, BTN_COL2_Pin, BTN_COL3_Pin};
 
-volatile uint8_t is_debouncing = 0;
-volatile uint8_t btn_still_pressed = 0;
-volatile uint32_t debounce_tick = 0;
-volatile uint8_t last_row = 0;
-volatile uint8_t last_col = 0;
-volatile uint8_t btn_state[MAX_DIG_IN_RESP_SIGNALS] = {0};
-
-/*
- * @brief  EXTI line detection callback
- * @param  GPIO_Pin: Specifies the pin connected to the EXTI line
- */
-void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
-  if (is_debouncing) return;
-
-  for (int row = 0; row < NUMBER_OF_BTN_ROWS; row++) {
-    if (GPIO_Pin == row_pins[row]) {
-      is_debouncing = true;
-      debounce_tick = HAL_GetTick();
-      last_row = row;
-
-      // Disable EXTI line temporarily
-      switch (row) {
-        case 0:
-          HAL_NVIC_DisableIRQ(EXTI4_IRQn);
-          break;
-        case 1:
-        case 2:
-        case 3:
-          HAL_NVIC_DisableIRQ(EXTI9_5_IRQn);
-          break;
-      }
-      break;
-    }
-  }
-}
-
-/*
- * @brief  Initialize the button matrix
- */
-void btn_matrix_init(void) {
-  // Set all COLs to HIGH
-  for (int i = 0; i < NUMBER_OF_BTN_COLUMNS; i++) {
-    col_ports[i]->ODR |= col_pins[i];
-  }
-}
-
-/*
- * @brief  Check if a button is still pressed
- * @param  row: The row of the button
- * @param  col: The column of the button
- * @retval true if the button is still pressed, false otherwise
- */
-bool is_btn_still_pressed(uint8_t row, uint8_t col) {
-  // Set all COLs to HIGH
-  for (int i = 0; i < NUMBER_OF_BTN_COLUMNS; i++) {
-    col_ports[i]->ODR |= col_pins[i];
-  }
-
-  // Set the specific COL to LOW
-  col_ports[col]->ODR &= ~col_pins[col];
-  osDelay(1);
-
-  return ((row_ports[row]->IDR & row_pins[row]) == GPIO_PIN_RESET);
-}
+// Digital input signal of each key, numbered as in io_config.json
+// (frame * DIGITAL_IN_RESP_SIGNAL_PER_FRAME + signal)
+static const uint8_t btn_signal_map[NUMBER_OF_BUTTONS] = {
+   0,  1,  2,  3,   // Row 0
+   9, 10, 11, 12,   // Row 1
+  18, 19, 20, 21,   // Row 2
+  27, 28, 29, 30,   // Row 3
+};
+
+static uint8_t scan_col = 0;
+static uint16_t debounced_keys = 0;
+static uint16_t vc_bit0 = 0;         // Vertical lockout counter, one 2-bit counter per key
+static uint16_t vc_bit1 = 0;
+static uint16_t input_states = 0;    // Toggled by each press
 
 /*
  * @brief  Turn on a specific column in the button matrix
  * @param  col: The column to turn on
  */
-void turn_btn_matrix_col(uint8_t col) {
+static void turn_btn_matrix_col(uint8_t col) {
   // Set all COLs to HIGH
   for (int i = 0; i < NUMBER_OF_BTN_COLUMNS; i++) {
     col_ports[i]->ODR |= col_pins[i];
@@ -90,89 +44,79 @@ void turn_btn_matrix_col(uint8_t col) {
 
   // Set the specific COL to LOW
   col_ports[col]->ODR &= ~col_pins[col];
-  osDelay(1);
 }
 
 /*
- * @brief  Process button press
- * @param  btn_state: Pointer to the button state array
- * @param  digital_input_data: Pointer to the Digital Input Response Frame
- *                              to update input states
+ * @brief  Pack the input states into the Digital Input Response Frames.
+ *         Runs in the scan interrupt; CANTxHandler reads the frames with
+ *         interrupts masked, so it never sees half of a 64-bit store.
+ * @param  states: Input state bitmap, bit BTN_KEY(row, col)
+ * @param  digital_input_data: Pointer to the Digital Input Response Frames
  */
-void process_btn_pressed(uint8_t *btn_state, DigitalInput_Resp_Frame *digital_input_data) {
-  GPIOC->ODR ^= GPIO_PIN_13; // Toggle PC13 LED
+static void pack_input_states(uint16_t states, volatile DigitalInput_Resp_Frame *digital_input_data) {
+  uint64_t sdu[NUMBER_OF_DIG_IN_RES_FRAME] = {0};
+
+  // inputStatus is bit 0 of each signal byte
+  for (uint8_t key = 0; key < NUMBER_OF_BUTTONS; key++) {
+    const uint8_t signal = btn_signal_map[key];
+    sdu[signal / DIGITAL_IN_RESP_SIGNAL_PER_FRAME] |=
+        (uint64_t)((states >> key) & 1U) << ((signal % DIGITAL_IN_RESP_SIGNAL_PER_FRAME) * 8U);
+  }
 
   for (uint8_t i = 0; i < NUMBER_OF_DIG_IN_RES_FRAME; i++) {
-    for (uint8_t j = 0; j < DIGITAL_IN_RESP_SIGNAL_PER_FRAME; j++) {
-      digital_input_data[i].signal[j].inputStatus = btn_state[i * DIGITAL_IN_RESP_SIGNAL_PER_FRAME + j] & 0x01;
-    }
+    digital_input_data[i].sdu = sdu[i];
   }
 }
 
 /*
- * @brief  Scan the button matrix
- * @param  digital_input_data: Pointer to the Digital Input Response Frame
- *                              to update input states
+ * @brief  Initialize the button matrix
  */
-void scan_btn_matrix(DigitalInput_Resp_Frame *digital_input_data) {
-  static uint8_t btn_idx = 0;
-  for (int col = 0; col < NUMBER_OF_BTN_COLUMNS; col++) {
-    // Set all COLs to HIGH
-    for (int i = 0; i < NUMBER_OF_BTN_COLUMNS; i++) {
-      col_ports[i]->ODR |= col_pins[i];
-    }
-
-    // Set the specific COL to LOW
-    col_ports[col]->ODR &= ~col_pins[col];
-    osDelay(1);
-
-    for (int row = 0; row < NUMBER_OF_BTN_ROWS; row++) {
-      if ((row_ports[row]->IDR & row_pins[row]) == GPIO_PIN_RESET) {
-        // Detected a button press
-        last_col = col;
-        btn_idx = row * 9U + col;
-        // Toggle button state
-        btn_state[btn_idx] = !btn_state[btn_idx];
-        process_btn_pressed(btn_state, digital_input_data);
-        return;
-      }
-    }
-  }
+void btn_matrix_init(void) {
+  scan_col = 0;
+  turn_btn_matrix_col(scan_col);
 }
 
 /*
- * @brief  Process the button matrix
- * @param  digital_input_data: Pointer to the Digital Input Response Frame
+ * @brief  Scan one column of the button matrix, called from the scan timer
+ *         interrupt. The keys of the column are debounced right away: a key
+ *         changes on its first differing sample, then ignores its next
+ *         BTN_LOCKOUT_SAMPLES samples while the contacts bounce. Each newly
+ *         pressed key toggles its input state.
+ * @param  digital_input_data: Pointer to the Digital Input Response Frames
  *                              to update input states
+ * @retval true if the input states changed, false otherwise
  */
-void btn_matrix_process(DigitalInput_Resp_Frame *digital_input_data) {
-  static uint8_t current_scan_col = 0;
-  turn_btn_matrix_col(current_scan_col);
-  current_scan_col = (current_scan_col + 1) % NUMBER_OF_BTN_COLUMNS;
-
-  if (is_debouncing && (HAL_GetTick() - debounce_tick >= DEBOUNCE_BTN_MS)) {
-    scan_btn_matrix(digital_input_data);
-    is_debouncing = false;
-    btn_still_pressed = true;
-  }
-
-  if (btn_still_pressed) {
-    if (!is_btn_still_pressed(last_row, last_col)) {
-      btn_still_pressed = false;
-
-      // Re-enable EXTI
-      switch (last_row) {
-        case 0: 
-          HAL_NVIC_EnableIRQ(EXTI4_IRQn);
-          break;
-        case 1:
-        case 2:
-        case 3:
-          HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
-          break;
-      }
+bool btn_matrix_scan(volatile DigitalInput_Resp_Frame *digital_input_data) {
+  const uint16_t column = (uint16_t)(BTN_COLUMN_KEYS << scan_col);
+  uint16_t sample = 0;
+
+  // The column has been driven since the last call, the rows have settled
+  for (uint8_t row = 0; row < NUMBER_OF_BTN_ROWS; row++) {
+    if ((row_ports[row]->IDR & row_pins[row]) == GPIO_PIN_RESET) {
+      sample |= (uint16_t)(1U << BTN_KEY(row, scan_col));
     }
   }
-}
 
+  scan_col = (scan_col + 1U) % NUMBER_OF_BTN_COLUMNS;
+  turn_btn_matrix_col(scan_col);
+
+  // Vertical counter: the locked keys of the column count down, an unlocked
+  // key that differs from its debounced state changes and starts its lockout
+  const uint16_t locked = (vc_bit0 | vc_bit1) & column;
+  vc_bit1 ^= ~vc_bit0 & locked;
+  vc_bit0 ^= locked;
+  const uint16_t changed = (sample ^ debounced_keys) & column & ~locked;
+  vc_bit0 |= changed;
+  vc_bit1 |= changed;
+  debounced_keys ^= changed;
+
+  const uint16_t pressed = changed & debounced_keys;
+  if (pressed == 0U) {
+    return false;
+  }
 
+  GPIOC->ODR ^= GPIO_PIN_13; // Toggle PC13 LED
+  input_states ^= pressed;
+  pack_input_states(input_states, digital_input_data);
+  return true;
+}
@@ -13,94 +13,338 @@
 #define EXTENDED_ID_MASK  0x1FFFFFFFUL
 #define STANDARD_ID_MASK  0x7FFUL
 
-static uint8_t canTxHead = 0, canTxTail = 0;
+_Static_assert(CAN_TX_SLOT_COUNT <= 32U, "TX slots are tracked in a 32-bit pending mask");
+
+// Latest payload of each response frame, indexed by CAN_TX_SLOT_*. Each slot has
+// two buffers; bit n of canTxFront selects the one published to the TX interrupt,
+// the producer writes the other and then flips the bit.
+static uint64_t canTxData[2][CAN_TX_SLOT_COUNT];
+static volatile uint32_t canTxFront = 0;
+// Bit n set: slot n holds a payload not handed to a mailbox yet
+static volatile uint32_t canTxPending = 0;
+
+// Frames lost to a full RX FIFO, per FIFO
+static volatile uint32_t canRxOverrun[2] = {0};
+
+// Received frames, written by the RX interrupt and read by the handler task
+static CAN_Frame canRxQueue[CAN_RX_QUEUE_SIZE];
+static volatile uint32_t canRxHead = 0, canRxTail = 0;
+static volatile uint32_t canRxDropped = 0;
+
+// Diagnostic requests released from FIFO1
+static volatile uint32_t canDiagRequests = 0;
+
+// Command frames, double buffered: the handler task writes the inactive copy
+// and then switches canCmdActive, so readers never see a half-written frame
+static DigitalOutput_Cmd_Frame canCmdFrames[2][NUMBER_OF_DIG_OUT_CMD_FRAME];
+static volatile uint32_t canCmdActive = 0;
 
 /*
- * @brief Enqueue a CAN transmission frame
- * @param frame: Pointer to the CAN frame
- * @param canTxQueue: Pointer to the CAN transmission queue
- * @retval true if successful, false if full
+ * @brief CAN ID of a TX slot
+ * @param slot: CAN_TX_SLOT_* index
+ * @retval CAN ID with the IDE bit
  */
-bool CAN_EnqueueTxFrame(CAN_Frame *frame, CAN_Frame *canTxQueue) {
-  uint8_t next = (canTxHead + 1) % CAN_TX_QUEUE_SIZE;
-  if (next == canTxTail) return false; // Queue full
-  memcpy(&canTxQueue[canTxHead], frame, sizeof(CAN_Frame));
-  canTxHead = next;
-  return true;
+static uint32_t CAN_TxSlotId(uint8_t slot) {
+  if (slot < CAN_TX_SLOT_DIG_IN_RES(0)) {
+    return DIGITAL_OUTPUT_RES_ID(slot);
+  }
+  if (slot < CAN_TX_SLOT_ANALOG_IN_RES(0)) {
+    return DIGITAL_INPUT_RES_ID(slot - CAN_TX_SLOT_DIG_IN_RES(0));
+  }
+  return ANALOG_INPUT_RES_ID(slot - CAN_TX_SLOT_ANALOG_IN_RES(0));
 }
 
 /*
- * @brief Dequeue a CAN transmission frame
- * @param frame: Pointer to the CAN frame to fill
- * @param canTxQueue: Pointer to the CAN transmission queue
- * @retval true if successful, false if empty
+ * @brief Fill a TX header for a CAN ID
+ * @param id: CAN ID, bit 31 selects the extended format
+ * @param header: Pointer to the header to fill
  */
-bool CAN_DequeueTxFrame(CAN_Frame *frame, CAN_Frame *canTxQueue) {
-  if (canTxHead == canTxTail) return false; // Queue empty
-  memcpy(frame, &canTxQueue[canTxTail], sizeof(CAN_Frame));
-  canTxTail = (canTxTail + 1) % CAN_TX_QUEUE_SIZE;
-  return true;
+static void CAN_FillTxHeader(uint32_t id, CAN_TxHeaderTypeDef *header) {
+  if (id >> IDE_BIT_POSITION) {
+    // Extended ID
+    header->IDE = CAN_ID_EXT;
+    header->ExtId = id & EXTENDED_ID_MASK; // Mask to 29 bits
+    header->StdId = 0;
+  } else {
+    // Standard ID
+    header->IDE = CAN_ID_STD;
+    header->StdId = id & STANDARD_ID_MASK; // Mask to 11 bits
+    header->ExtId = 0; // Not using extended ID
+  }
+  header->RTR = CAN_RTR_DATA; // Data frame
+  header->DLC = BYTES_PER_FRAME; // Data length code
+  header->TransmitGlobalTime = DISABLE;
 }
 
 /*
- * @brief Dequeue and send CAN transmission frames
+ * @brief Store the latest payload of a response frame and mark it pending.
+ *        A payload not sent yet is replaced, so each frame is queued at most once.
+ *        Lock-free; call from one task only (the TX interrupt is the consumer).
+ * @param slot: CAN_TX_SLOT_* index of the frame
+ * @param sdu: Frame payload
+ */
+void CAN_UpdateTxFrame(uint8_t slot, uint64_t sdu) {
+  if (slot >= CAN_TX_SLOT_COUNT) return;
+
+  const uint32_t bit = 1UL << slot;
+  const uint32_t front = canTxFront;
+  // The interrupt only reads the published buffer, so this write cannot tear
+  canTxData[(front & bit) ? 0U : 1U][slot] = sdu;
+  __atomic_store_n(&canTxFront, front ^ bit, __ATOMIC_RELEASE);
+  __atomic_fetch_or(&canTxPending, bit, __ATOMIC_RELEASE);
+}
+
+/*
+ * @brief Start sending the pending frames and return at once. The CAN TX
+ *        interrupt hands them to the mailboxes, lowest CAN ID first.
+ */
+void CAN_send(void) {
+  if (canTxPending != 0U) {
+    HAL_NVIC_SetPendingIRQ(USB_HP_CAN1_TX_IRQn);
+  }
+}
+
+/*
+ * @brief Fill the free TX mailboxes from the pending slots. Called from the
+ *        CAN TX interrupt only.
  * @param hcan: Pointer to CAN handle
- * @param canTxQueue: Pointer to the CAN transmission queue
  */
-void CAN_send(CAN_HandleTypeDef *hcan, CAN_Frame *canTxQueue) {
-  CAN_Frame tx_frame;
+void CAN_TxIRQHandler(CAN_HandleTypeDef *hcan) {
   CAN_TxHeaderTypeDef tx_header;
+  uint32_t txMailbox;
+  uint32_t pending = __atomic_load_n(&canTxPending, __ATOMIC_ACQUIRE);
 
-  while (CAN_DequeueTxFrame(&tx_frame, canTxQueue)) {
-    uint32_t txMailbox;
-    HAL_StatusTypeDef status = HAL_BUSY;
-
-    do {
-      if (tx_frame.id >> IDE_BIT_POSITION) {
-        // Extended ID
-        tx_header.IDE = CAN_ID_EXT;
-        tx_header.ExtId = tx_frame.id & EXTENDED_ID_MASK; // Mask to 29 bits
-      } else {
-        // Standard ID
-        tx_header.IDE = CAN_ID_STD;
-        tx_header.StdId = tx_frame.id & STANDARD_ID_MASK; // Mask to 11 bits
-        tx_header.ExtId = 0; // Not using extended ID
-      }
-      tx_header.RTR = CAN_RTR_DATA; // Data frame
-      tx_header.DLC = BYTES_PER_FRAME; // Data length code
-
-      status = HAL_CAN_AddTxMessage(hcan, &tx_header, tx_frame.data, &txMailbox);
-    } while (status != HAL_OK);
-
-    if (status != HAL_OK) {
-      // Handle error
-      Error_Handler();
+  // bxCAN sends the mailboxes in identifier order (TransmitFifoPriority disabled),
+  // so the three lowest pending IDs are always the ones offered to the bus
+  while (pending != 0U && HAL_CAN_GetTxMailboxesFreeLevel(hcan) > 0U) {
+    const uint8_t slot = (uint8_t)__builtin_ctz(pending);
+    const uint32_t bit = 1UL << slot;
+    uint64_t sdu = canTxData[(canTxFront & bit) ? 1U : 0U][slot];
+
+    CAN_FillTxHeader(CAN_TxSlotId(slot), &tx_header);
+    if (HAL_CAN_AddTxMessage(hcan, &tx_header, (uint8_t *)&sdu, &txMailbox) != HAL_OK) {
+      break;
     }
+    __atomic_fetch_and(&canTxPending, ~bit, __ATOMIC_RELAXED);
+    pending &= ~bit;
   }
 }
 
 /*
- * @brief Process received CAN command
- * @param frame: Pointer to CAN frame
- * @param cmd_frame: Pointer to command frames
+ * @brief Filter register value matching a data frame with the given ID
+ * @param id: CAN ID, bit 31 selects the extended format
+ * @retval FR1/FR2 layout of a 32-bit filter: STID/EXID, IDE, RTR
  */
-void CAN_process_command(CAN_RxFrame *frame, DigitalOutput_Cmd_Frame *cmd_frame) {
-  // Buffer to hold received data
-  uint8_t data[BYTES_PER_FRAME];
-  // Check if the received frame is a Digital Output Command
-  if (frame->header.IDE == CAN_ID_EXT) {
-    // Extract command data from the received frame
-    for (uint8_t i = 0; i < NUMBER_OF_DIG_OUT_CMD_FRAME; i++) {
-      if ((DIGITAL_OUTPUT_CMD_ID(i) & EXTENDED_ID_MASK) == frame->header.ExtId) {
-        // Copy data to buffer
-        for (uint8_t j = 0; j < BYTES_PER_FRAME; j++) {
-          data[j] = frame->data[j];
-        }
-        cmd_frame[i].sdu = *((uint64_t *)data);
-        break;
-      }
+static uint32_t CAN_FilterValue(uint32_t id) {
+  if (id >> IDE_BIT_POSITION) {
+    return ((id & EXTENDED_ID_MASK) << 3U) | CAN_ID_EXT;
+  }
+  return (id & STANDARD_ID_MASK) << 21U;
+}
+
+/*
+ * @brief Configure 32-bit identifier list banks accepting exactly the given IDs
+ * @param hcan: Pointer to CAN handle
+ * @param bank: First filter bank, two IDs per bank
+ * @param ids: CAN IDs, bit 31 selects the extended format
+ * @param count: Number of IDs
+ * @param fifo: CAN_FILTER_FIFO0 or CAN_FILTER_FIFO1
+ * @retval HAL_OK, or HAL_ERROR if the banks do not fit or the HAL rejects one
+ */
+static HAL_StatusTypeDef CAN_ConfigIdList(CAN_HandleTypeDef *hcan, uint32_t bank, const uint32_t *ids,
+                                          uint8_t count, uint32_t fifo) {
+  CAN_FilterTypeDef filter;
+
+  if (bank + (count + 1U) / 2U > CAN_FILTER_BANK_COUNT) return HAL_ERROR;
+
+  filter.FilterMode = CAN_FILTERMODE_IDLIST;
+  filter.FilterScale = CAN_FILTERSCALE_32BIT;
+  filter.FilterFIFOAssignment = fifo;
+  filter.FilterActivation = CAN_FILTER_ENABLE;
+  filter.SlaveStartFilterBank = CAN_FILTER_BANK_COUNT; // Single CAN, all banks belong to CAN1
+
+  for (uint8_t i = 0; i < count; i += 2U, bank++) {
+    const uint32_t first = CAN_FilterValue(ids[i]);
+    // An odd last ID fills both entries of its bank
+    const uint32_t second = (i + 1U < count) ? CAN_FilterValue(ids[i + 1U]) : first;
+
+    filter.FilterBank = bank;
+    filter.FilterIdHigh = first >> 16U;
+    filter.FilterIdLow = first & 0xFFFFU;
+    filter.FilterMaskIdHigh = second >> 16U;
+    filter.FilterMaskIdLow = second & 0xFFFFU;
+    if (HAL_CAN_ConfigFilter(hcan, &filter) != HAL_OK) return HAL_ERROR;
+  }
+  return HAL_OK;
+}
+
+/*
+ * @brief Configure the acceptance filters: the command IDs
+ *        DIGITAL_OUTPUT_CMD_ID(0..NUMBER_OF_DIG_OUT_CMD_FRAME - 1) go to FIFO0,
+ *        the diagnostic requests DIAGNOSTIC_REQ_ID(0..NUMBER_OF_DIAG_REQ_FRAME - 1)
+ *        to FIFO1, every other frame on the bus is dropped by the hardware.
+ * @param hcan: Pointer to CAN handle
+ * @retval HAL_OK, or HAL_ERROR if a filter bank could not be configured
+ */
+HAL_StatusTypeDef CAN_ConfigRxFilters(CAN_HandleTypeDef *hcan) {
+  uint32_t commandIds[NUMBER_OF_DIG_OUT_CMD_FRAME];
+  uint32_t diagIds[NUMBER_OF_DIAG_REQ_FRAME];
+
+  for (uint8_t i = 0; i < NUMBER_OF_DIG_OUT_CMD_FRAME; i++) {
+    commandIds[i] = DIGITAL_OUTPUT_CMD_ID(i);
+  }
+  if (CAN_ConfigIdList(hcan, CAN_FILTER_BANK_COMMAND, commandIds, NUMBER_OF_DIG_OUT_CMD_FRAME,
+                       CAN_FILTER_FIFO0) != HAL_OK) {
+    return HAL_ERROR;
+  }
+
+  // Diagnostic requests have their own FIFO, so they never hold up a command waiting in FIFO0
+  for (uint8_t i = 0; i < NUMBER_OF_DIAG_REQ_FRAME; i++) {
+    diagIds[i] = DIAGNOSTIC_REQ_ID(i);
+  }
+  return CAN_ConfigIdList(hcan, CAN_FILTER_BANK_DIAG, diagIds, NUMBER_OF_DIAG_REQ_FRAME,
+                          CAN_FILTER_FIFO1);
+}
+
+/*
+ * @brief Count the RX FIFO overruns reported by the HAL and clear them.
+ *        Called from HAL_CAN_ErrorCallback().
+ * @param hcan: Pointer to CAN handle
+ */
+void CAN_ErrorIRQHandler(CAN_HandleTypeDef *hcan) {
+  if (hcan->ErrorCode & HAL_CAN_ERROR_RX_FOV0) canRxOverrun[CAN_RX_FIFO0]++;
+  if (hcan->ErrorCode & HAL_CAN_ERROR_RX_FOV1) canRxOverrun[CAN_RX_FIFO1]++;
+  hcan->ErrorCode &= ~(HAL_CAN_ERROR_RX_FOV0 | HAL_CAN_ERROR_RX_FOV1);
+}
+
+/*
+ * @brief Number of frames lost because an RX FIFO was full
+ * @param fifo: CAN_RX_FIFO0 or CAN_RX_FIFO1
+ * @retval Overrun count since reset
+ */
+uint32_t CAN_GetRxOverrunCount(uint32_t fifo) {
+  return canRxOverrun[fifo & 1U];
+}
+
+/*
+ * @brief Copy the frames of an RX FIFO into the receive queue. Called from the
+ *        RX interrupt; decoding is left to the handler task.
+ * @param hcan: Pointer to CAN handle
+ * @param fifo: CAN_RX_FIFO0 or CAN_RX_FIFO1
+ * @retval Number of frames queued
+ */
+uint32_t CAN_RxIRQHandler(CAN_HandleTypeDef *hcan, uint32_t fifo) {
+  CAN_RxHeaderTypeDef rx_header;
+  uint32_t head = canRxHead;
+  uint32_t queued = 0;
+
+  while (HAL_CAN_GetRxFifoFillLevel(hcan, fifo) > 0U) {
+    if (head - __atomic_load_n(&canRxTail, __ATOMIC_ACQUIRE) >= CAN_RX_QUEUE_SIZE) {
+      // Queue full: release the FIFO entry anyway, or the FIFO overruns as well
+      uint8_t discard[BYTES_PER_FRAME];
+      if (HAL_CAN_GetRxMessage(hcan, fifo, &rx_header, discard) != HAL_OK) break;
+      canRxDropped++;
+      continue;
     }
+
+    CAN_Frame *frame = &canRxQueue[head % CAN_RX_QUEUE_SIZE];
+    if (HAL_CAN_GetRxMessage(hcan, fifo, &rx_header, frame->data) != HAL_OK) break;
+    frame->id = (rx_header.IDE == CAN_ID_EXT) ? ((1UL << IDE_BIT_POSITION) | rx_header.ExtId) : rx_header.StdId;
+    head++;
+    queued++;
   }
+  __atomic_store_n(&canRxHead, head, __ATOMIC_RELEASE);
+  return queued;
+}
+
+/*
+ * @brief Release the diagnostic requests waiting in FIFO1. There is no
+ *        diagnostic service yet, so they are only counted. Called from the
+ *        RX1 interrupt.
+ * @param hcan: Pointer to CAN handle
+ */
+void CAN_DiagRxIRQHandler(CAN_HandleTypeDef *hcan) {
+  CAN_RxHeaderTypeDef rx_header;
+  uint8_t data[BYTES_PER_FRAME];
+
+  while (HAL_CAN_GetRxFifoFillLevel(hcan, CAN_RX_FIFO1) > 0U) {
+    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO1, &rx_header, data) != HAL_OK) break;
+    canDiagRequests++;
+  }
+}
+
+/*
+ * @brief Number of diagnostic requests received
+ * @retval Request count since reset
+ */
+uint32_t CAN_GetDiagRequestCount(void) {
+  return canDiagRequests;
 }
 
+/*
+ * @brief Number of received frames dropped because the receive queue was full
+ * @retval Drop count since reset
+ */
+uint32_t CAN_GetRxDropCount(void) {
+  return canRxDropped;
+}
+
+/*
+ * @brief Index of a command frame
+ * @param id: CAN ID with the IDE bit
+ * @retval n for DIGITAL_OUTPUT_CMD_ID(n), -1 for any other ID
+ */
+static int8_t CAN_CommandIndex(uint32_t id) {
+  // IDs below the first command wrap around to large offsets
+  const uint32_t offset = id - DIGITAL_OUTPUT_CMD_ID(0);
+  const uint32_t index = offset / CAN_ID_STEP;
+
+  if ((offset % CAN_ID_STEP) != 0U || index >= NUMBER_OF_DIG_OUT_CMD_FRAME) return -1;
+  return (int8_t)index;
+}
+
+/*
+ * @brief Apply the queued command frames. They are written to the inactive
+ *        copy of the command frames, which then becomes the active one.
+ *        Call from one task only.
+ * @retval Bit n set if command frame n changed
+ */
+uint32_t CAN_process_commands(void) {
+  const uint32_t head = __atomic_load_n(&canRxHead, __ATOMIC_ACQUIRE);
+  uint32_t tail = canRxTail;
+  uint32_t changed = 0;
+
+  if (head == tail) return 0;
 
+  const uint32_t active = canCmdActive;
+  DigitalOutput_Cmd_Frame *next = canCmdFrames[active ^ 1U];
+  memcpy(next, canCmdFrames[active], sizeof(canCmdFrames[0]));
+
+  for (; tail != head; tail++) {
+    const CAN_Frame *frame = &canRxQueue[tail % CAN_RX_QUEUE_SIZE];
+    const int8_t index = CAN_CommandIndex(frame->id);
+    uint64_t sdu;
+
+    if (index < 0) continue;
+    memcpy(&sdu, frame->data, BYTES_PER_FRAME);
+    if (next[index].sdu != sdu) {
+      next[index].sdu = sdu;
+      changed |= 1UL << index;
+    }
+  }
+  __atomic_store_n(&canRxTail, tail, __ATOMIC_RELEASE);
+
+  if (changed) {
+    __atomic_store_n(&canCmdActive, active ^ 1U, __ATOMIC_RELEASE);
+  }
+  return changed;
+}
+
+/*
+ * @brief Active copy of the command frames. Valid until the next call of
+ *        CAN_process_commands(); other tasks should copy the frames they need.
+ * @retval Pointer to NUMBER_OF_DIG_OUT_CMD_FRAME frames
+ */
+const DigitalOutput_Cmd_Frame *CAN_GetCommandFrames(void) {
+  return canCmdFrames[__atomic_load_n(&canCmdActive, __ATOMIC_ACQUIRE)];
+}
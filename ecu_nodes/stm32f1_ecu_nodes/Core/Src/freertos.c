@@ -35,7 +35,8 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-
+// Run time counter: CPU cycles / 1024, 70 kHz at 72 MHz, wraps after 17 hours
+#define RUN_TIME_COUNTER_SHIFT  10U
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -45,7 +46,8 @@
 
 /* Private variables ---------------------------------------------------------*/
 /* USER CODE BEGIN Variables */
-
+static uint32_t runTimeLastCycles = 0;
+static uint64_t runTimeCycles = 0;
 /* USER CODE END Variables */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -54,8 +56,36 @@
 /* USER CODE END FunctionPrototypes */
 
 /* Hook prototypes */
+void configureTimerForRunTimeStats(void);
+unsigned long getRunTimeCounterValue(void);
 void vApplicationMallocFailedHook(void);
 
+/* USER CODE BEGIN 1 */
+/* Functions needed when configGENERATE_RUN_TIME_STATS is on */
+void configureTimerForRunTimeStats(void)
+{
+  // DWT cycle counter
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  runTimeLastCycles = 0;
+  runTimeCycles = 0;
+}
+
+unsigned long getRunTimeCounterValue(void)
+{
+  // The cycle counter wraps every 60 s; extend it on every read. The kernel
+  // reads it at each context switch, which the transmit schedule guarantees.
+  const UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+  const uint32_t cycles = DWT->CYCCNT;
+  runTimeCycles += cycles - runTimeLastCycles;
+  runTimeLastCycles = cycles;
+  const unsigned long value = (unsigned long)(runTimeCycles >> RUN_TIME_COUNTER_SHIFT);
+  taskEXIT_CRITICAL_FROM_ISR(mask);
+  return value;
+}
+/* USER CODE END 1 */
+
 /* USER CODE BEGIN 5 */
 void vApplicationMallocFailedHook(void)
 {
@@ -23,6 +23,7 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "analog.h"
 #include "button.h"
 #include "can.h"
 #include <stdbool.h>
@@ -31,12 +32,58 @@
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
+/**
+  * @brief  Transmit schedule of one response frame
+  */
+typedef struct {
+  uint8_t slot;                   // CAN_TX_SLOT_...
+  volatile const uint64_t *sdu;   // Frame data
+  uint16_t period;                // Cycle time in ms
+  uint16_t phase;                 // First frame after start in ms
+  uint16_t min_gap;               // On change: minimum gap in ms, 0 = cyclic only
+  bool freshness;                 // Digital input frame, insert the freshness counter
+} CAN_TxSchedule;
+
+/**
+  * @brief  Transmit state of one response frame, owned by CANTxHandler
+  */
+typedef struct {
+  uint32_t next;                  // Tick of the next cyclic frame
+  uint32_t last_change;           // Tick of the last on-change frame
+  uint64_t sent;                  // Frame data as last handed to CAN
+  uint8_t freshness;
+} CAN_TxState;
 
+/**
+  * @brief  PWM channel of one digital output command signal
+  */
+typedef struct {
+  uint8_t signal;                 // frame * DIGITAL_OUT_CMD_SIGNAL_PER_FRAME + signal
+  uint8_t timer;                  // PWM_TIM1, PWM_TIM3
+  uint8_t channel;                // 0..3 = CCR1..CCR4
+  uint8_t scale;                  // CCR counts per percent of dutyCycle
+  bool active_low;                // Load on while the pin is low
+} DigitalOutput_Channel;
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+// Thread flags of CANRxHandlerTask
+#define CAN_RX_FLAG     0x0001U // Frames in the receive queue
+
+// Thread flags of CANTxHandlerTask
+#define CAN_TX_CHANGED_FLAG 0x0001U // Response data changed
+
+#define CAN_TX_SCHEDULE_SIZE  (sizeof(can_tx_schedule) / sizeof(can_tx_schedule[0]))
+
+// PWM timers written by DMA burst, CCR1..CCR4 each
+#define PWM_TIM1                0U
+#define PWM_TIM3                1U
+#define NUMBER_OF_PWM_TIMERS    2U
+#define PWM_CHANNELS            4U
+#define PWM_DUTY_MAX            100U  // dutyCycle in percent
 
+#define DIGITAL_OUTPUT_MAP_SIZE (sizeof(digital_output_map) / sizeof(digital_output_map[0]))
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -51,7 +98,10 @@ DMA_HandleTypeDef hdma_adc1;
 CAN_HandleTypeDef hcan;
 
 TIM_HandleTypeDef htim1;
+TIM_HandleTypeDef htim2;
 TIM_HandleTypeDef htim3;
+DMA_HandleTypeDef hdma_tim1_up;
+DMA_HandleTypeDef hdma_tim3_up;
 
 /* Definitions for CANRxHandlerTask */
 osThreadId_t CANRxHandlerTaskHandle;
@@ -68,16 +118,68 @@ const osThreadAttr_t CANTxHandlerTask_attributes = {
   .priority = (osPriority_t) osPriorityNormal,
 };
 /* USER CODE BEGIN PV */
-uint16_t potentiometer[TEN] = {0};
-
-CAN_Frame canTxQueue[CAN_TX_QUEUE_SIZE];
+// Circular ADC DMA buffer, two halves of ADC_OVERSAMPLING scan sequences
+uint16_t adc_samples[ADC_DMA_BUFFER_SIZE] = {0};
 
 volatile DigitalOutput_Resp_Frame digital_output_data[NUMBER_OF_DIG_OUT_RES_FRAME] = {0};
 volatile DigitalInput_Resp_Frame digital_input_data[NUMBER_OF_DIG_IN_RES_FRAME] = {0};
-volatile DigitalOutput_Cmd_Frame digital_output_cmd_data[NUMBER_OF_DIG_OUT_CMD_FRAME] = {0};
 volatile AnalogInput_Resp_Frame analog_input_data[NUMBER_OF_ANALOG_IN_RES_FRAME] = {0};
 
-CAN_RxFrame can_rx_frame;
+// Response frames in CAN ID order. Phases spread the frames over the cycle;
+// frames without live data only go out as a slow heartbeat.
+static const CAN_TxSchedule can_tx_schedule[] = {
+  { CAN_TX_SLOT_DIG_OUT_RES(0),    &digital_output_data[0].sdu, 500U,   5U,  0U, false },
+  { CAN_TX_SLOT_DIG_OUT_RES(1),    &digital_output_data[1].sdu, 500U, 130U,  0U, false },
+  { CAN_TX_SLOT_DIG_OUT_RES(2),    &digital_output_data[2].sdu, 500U, 255U,  0U, false },
+  { CAN_TX_SLOT_DIG_OUT_RES(3),    &digital_output_data[3].sdu, 500U, 380U,  0U, false },
+  { CAN_TX_SLOT_DIG_OUT_RES(4),    &digital_output_data[4].sdu, 500U,  70U,  0U, false },
+  { CAN_TX_SLOT_DIG_OUT_RES(5),    &digital_output_data[5].sdu, 500U, 195U,  0U, false },
+  { CAN_TX_SLOT_DIG_OUT_RES(6),    &digital_output_data[6].sdu, 500U, 320U,  0U, false },
+  { CAN_TX_SLOT_DIG_OUT_RES(7),    &digital_output_data[7].sdu, 500U, 445U,  0U, false },
+  { CAN_TX_SLOT_DIG_IN_RES(0),     &digital_input_data[0].sdu,   50U,   0U, 10U, true  },
+  { CAN_TX_SLOT_DIG_IN_RES(1),     &digital_input_data[1].sdu,   50U,  10U, 10U, true  },
+  { CAN_TX_SLOT_DIG_IN_RES(2),     &digital_input_data[2].sdu,   50U,  20U, 10U, true  },
+  { CAN_TX_SLOT_DIG_IN_RES(3),     &digital_input_data[3].sdu,   50U,  30U, 10U, true  },
+  { CAN_TX_SLOT_ANALOG_IN_RES(0),  &analog_input_data[0].sdu,    50U,  25U,  0U, false },
+  { CAN_TX_SLOT_ANALOG_IN_RES(1),  &analog_input_data[1].sdu,   100U,  35U,  0U, false },
+  { CAN_TX_SLOT_ANALOG_IN_RES(2),  &analog_input_data[2].sdu,  1000U, 190U,  0U, false },
+  { CAN_TX_SLOT_ANALOG_IN_RES(3),  &analog_input_data[3].sdu,  1000U, 315U,  0U, false },
+  { CAN_TX_SLOT_ANALOG_IN_RES(4),  &analog_input_data[4].sdu,  1000U, 440U,  0U, false },
+  { CAN_TX_SLOT_ANALOG_IN_RES(5),  &analog_input_data[5].sdu,  1000U, 565U,  0U, false },
+  { CAN_TX_SLOT_ANALOG_IN_RES(6),  &analog_input_data[6].sdu,  1000U, 690U,  0U, false },
+  { CAN_TX_SLOT_ANALOG_IN_RES(7),  &analog_input_data[7].sdu,  1000U, 815U,  0U, false },
+};
+
+// Every response frame of the protocol stays on the bus
+_Static_assert(CAN_TX_SCHEDULE_SIZE == CAN_TX_SLOT_COUNT, "can_tx_schedule must list every TX slot");
+
+static CAN_TxState can_tx_state[CAN_TX_SCHEDULE_SIZE];
+
+// Command signals with a PWM output on this board; the other digital output
+// signals have no pin
+static const DigitalOutput_Channel digital_output_map[] = {
+  {  0U, PWM_TIM1, 3U, 10U, false },  // Digital Output 1,  TIM1 CH4
+  {  9U, PWM_TIM1, 2U, 10U, false },  // Digital Output 10, TIM1 CH3
+  { 18U, PWM_TIM1, 1U, 10U, false },  // Digital Output 19, TIM1 CH2
+  { 27U, PWM_TIM1, 0U, 10U, false },  // Digital Output 28, TIM1 CH1
+  { 11U, PWM_TIM3, 1U, 10U, false },  // Digital Output 12, TIM3 CH2
+  { 21U, PWM_TIM3, 2U, 10U, false },  // Digital Output 22, TIM3 CH3
+  { 31U, PWM_TIM3, 3U, 10U, false },  // Digital Output 32, TIM3 CH4
+};
+
+// CCR values of channels without a command. Digital Output 8 (TIM3 CH1,
+// buzzer) is not commanded and keeps its fixed duty cycle.
+static const uint32_t pwm_idle[NUMBER_OF_PWM_TIMERS][PWM_CHANNELS] = {
+  {   0U, 0U, 0U, 0U },
+  { 999U, 0U, 0U, 0U },
+};
+
+// Source of the DMA bursts, written to CCR1..CCR4 at each update event
+static uint32_t pwm_burst[NUMBER_OF_PWM_TIMERS][PWM_CHANNELS];
+
+// Next CCR values from CANRxHandler, taken over between two bursts
+static volatile uint32_t pwm_next[NUMBER_OF_PWM_TIMERS][PWM_CHANNELS];
+static volatile bool pwm_next_ready[NUMBER_OF_PWM_TIMERS];
 
 /* USER CODE END PV */
 
@@ -89,6 +191,7 @@ static void MX_CAN_Init(void);
 static void MX_ADC1_Init(void);
 static void MX_TIM1_Init(void);
 static void MX_TIM3_Init(void);
+static void MX_TIM2_Init(void);
 void CANRxHandler(void *argument);
 void CANTxHandler(void *argument);
 
@@ -99,16 +202,56 @@ void CANTxHandler(void *argument);
   *                                   containing the commands to process
   * @retval None
   */
-void digital_output_process(DigitalOutput_Cmd_Frame *cmd_data);
+void digital_output_process(const DigitalOutput_Cmd_Frame *cmd_data);
+
+/**
+  * @brief  Hand a scheduled response frame to CAN
+  * @param  entry: Index in can_tx_schedule
+  * @param  sdu: Frame data
+  * @retval None
+  */
+static void can_tx_update(uint8_t entry, uint64_t sdu);
+
+/**
+  * @brief  Read the data of a response frame written by an interrupt
+  * @param  sdu: Frame data
+  * @retval Frame data, never half old and half new
+  */
+static uint64_t can_tx_snapshot(volatile const uint64_t *sdu);
+
+/**
+  * @brief  Take over the next CCR values of a PWM timer after its DMA burst
+  * @param  timer: PWM_TIM1 or PWM_TIM3
+  * @retval None
+  */
+static void pwm_burst_complete(uint8_t timer);
 
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
 void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan) {
-  HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &can_rx_frame.header, can_rx_frame.data);
-  // Process received CAN message
-  CAN_process_command(&can_rx_frame, digital_output_cmd_data);
+  // Queue the frames only, CANRxHandler decodes them
+  if (CAN_RxIRQHandler(hcan, CAN_RX_FIFO0) > 0U) {
+    osThreadFlagsSet(CANRxHandlerTaskHandle, CAN_RX_FLAG);
+  }
+}
+
+void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan) {
+  CAN_DiagRxIRQHandler(hcan);
+}
+
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan) {
+  CAN_ErrorIRQHandler(hcan);
+}
+
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc) {
+  // First half complete, DMA goes on with the second
+  analog_input_process(&adc_samples[0], analog_input_data);
+}
+
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc) {
+  analog_input_process(&adc_samples[ADC_DMA_BUFFER_SIZE / 2U], analog_input_data);
 }
 
 /* USER CODE END 0 */
@@ -146,7 +289,15 @@ int main(void)
   MX_ADC1_Init();
   MX_TIM1_Init();
   MX_TIM3_Init();
+  MX_TIM2_Init();
   /* USER CODE BEGIN 2 */
+  // Each update event of TIM1 and TIM3 reloads CCR1..CCR4 by a DMA burst,
+  // the new duty cycles of all channels start with the same PWM period
+  memcpy(pwm_burst, pwm_idle, sizeof(pwm_burst));
+  HAL_TIM_DMABurst_WriteStart(&htim1, TIM_DMABASE_CCR1, TIM_DMA_UPDATE,
+                              pwm_burst[PWM_TIM1], TIM_DMABURSTLENGTH_4TRANSFERS);
+  HAL_TIM_DMABurst_WriteStart(&htim3, TIM_DMABASE_CCR1, TIM_DMA_UPDATE,
+                              pwm_burst[PWM_TIM3], TIM_DMABURSTLENGTH_4TRANSFERS);
   HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_1);
   HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_2);
   HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_3);
@@ -157,9 +308,17 @@ int main(void)
   HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_4);
 
   HAL_CAN_Start(&hcan);
-  HAL_CAN_ActivateNotification(&hcan, CAN_IT_RX_FIFO0_MSG_PENDING);
-
-  HAL_ADC_Start_DMA(&hadc1, (uint32_t *)potentiometer, TEN);
+  HAL_CAN_ActivateNotification(&hcan, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING |
+                                     CAN_IT_TX_MAILBOX_EMPTY |
+                                     CAN_IT_RX_FIFO0_OVERRUN | CAN_IT_RX_FIFO1_OVERRUN);
+
+  // TIM2 CC2 starts a scan of all ADC channels every millisecond, the
+  // TIM2 update interrupt scans one column of the button matrix
+  HAL_ADCEx_Calibration_Start(&hadc1);
+  HAL_ADC_Start_DMA(&hadc1, (uint32_t *)adc_samples, ADC_DMA_BUFFER_SIZE);
+  btn_matrix_init();
+  HAL_TIM_PWM_Start(&htim2, TIM_CHANNEL_2);
+  HAL_TIM_Base_Start_IT(&htim2);
 
   /* USER CODE END 2 */
 
@@ -277,12 +436,12 @@ static void MX_ADC1_Init(void)
   /** Common config
   */
   hadc1.Instance = ADC1;
-  hadc1.Init.ScanConvMode = ADC_SCAN_DISABLE;
-  hadc1.Init.ContinuousConvMode = ENABLE;
+  hadc1.Init.ScanConvMode = ADC_SCAN_ENABLE;
+  hadc1.Init.ContinuousConvMode = DISABLE;
   hadc1.Init.DiscontinuousConvMode = DISABLE;
-  hadc1.Init.ExternalTrigConv = ADC_SOFTWARE_START;
+  hadc1.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_CC2;
   hadc1.Init.DataAlign = ADC_DATAALIGN_RIGHT;
-  hadc1.Init.NbrOfConversion = 1;
+  hadc1.Init.NbrOfConversion = 8;
   if (HAL_ADC_Init(&hadc1) != HAL_OK)
   {
     Error_Handler();
@@ -296,6 +455,62 @@ static void MX_ADC1_Init(void)
   {
     Error_Handler();
   }
+  /** Configure Regular Channel
+  */
+  sConfig.Channel = ADC_CHANNEL_0;
+  sConfig.Rank = ADC_REGULAR_RANK_2;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /** Configure Regular Channel
+  */
+  sConfig.Channel = ADC_CHANNEL_1;
+  sConfig.Rank = ADC_REGULAR_RANK_3;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /** Configure Regular Channel
+  */
+  sConfig.Channel = ADC_CHANNEL_2;
+  sConfig.Rank = ADC_REGULAR_RANK_4;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /** Configure Regular Channel
+  */
+  sConfig.Channel = ADC_CHANNEL_3;
+  sConfig.Rank = ADC_REGULAR_RANK_5;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /** Configure Regular Channel
+  */
+  sConfig.Channel = ADC_CHANNEL_4;
+  sConfig.Rank = ADC_REGULAR_RANK_6;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /** Configure Regular Channel
+  */
+  sConfig.Channel = ADC_CHANNEL_TEMPSENSOR;
+  sConfig.Rank = ADC_REGULAR_RANK_7;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /** Configure Regular Channel
+  */
+  sConfig.Channel = ADC_CHANNEL_VREFINT;
+  sConfig.Rank = ADC_REGULAR_RANK_8;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
   /* USER CODE BEGIN ADC1_Init 2 */
 
   /* USER CODE END ADC1_Init 2 */
@@ -334,20 +549,11 @@ static void MX_CAN_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN CAN_Init 2 */
-  CAN_FilterTypeDef canfilterconfig;
-
-  canfilterconfig.FilterActivation = CAN_FILTER_ENABLE;
-  canfilterconfig.FilterBank = 10;  // anything between 0 to SlaveStartFilterBank
-  canfilterconfig.FilterFIFOAssignment = CAN_FILTER_FIFO0;
-  canfilterconfig.FilterIdHigh = 0;
-  canfilterconfig.FilterIdLow = 0x0000;
-  canfilterconfig.FilterMaskIdHigh = 0;
-  canfilterconfig.FilterMaskIdLow = 0x0000;
-  canfilterconfig.FilterMode = CAN_FILTERMODE_IDMASK;
-  canfilterconfig.FilterScale = CAN_FILTERSCALE_32BIT;
-  canfilterconfig.SlaveStartFilterBank = 13;  // 13 to 27 are assigned to slave CAN (CAN 2) OR 0 to 12 are assgned to CAN1
-
-  HAL_CAN_ConfigFilter(&hcan, &canfilterconfig);
+  // Accept only this node's command frames, in hardware
+  if (CAN_ConfigRxFilters(&hcan) != HAL_OK)
+  {
+    Error_Handler();
+  }
   /* USER CODE END CAN_Init 2 */
 
 }
@@ -439,6 +645,64 @@ static void MX_TIM1_Init(void)
 
 }
 
+/**
+  * @brief TIM2 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_TIM2_Init(void)
+{
+
+  /* USER CODE BEGIN TIM2_Init 0 */
+
+  /* USER CODE END TIM2_Init 0 */
+
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_MasterConfigTypeDef sMasterConfig = {0};
+  TIM_OC_InitTypeDef sConfigOC = {0};
+
+  /* USER CODE BEGIN TIM2_Init 1 */
+
+  /* USER CODE END TIM2_Init 1 */
+  htim2.Instance = TIM2;
+  htim2.Init.Prescaler = 71;
+  htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim2.Init.Period = 999;
+  htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  if (HAL_TIM_ConfigClockSource(&htim2, &sClockSourceConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if (HAL_TIM_PWM_Init(&htim2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+  sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  if (HAL_TIMEx_MasterConfigSynchronization(&htim2, &sMasterConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sConfigOC.OCMode = TIM_OCMODE_PWM1;
+  sConfigOC.Pulse = 500;
+  sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+  sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+  if (HAL_TIM_PWM_ConfigChannel(&htim2, &sConfigOC, TIM_CHANNEL_2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN TIM2_Init 2 */
+
+  /* USER CODE END TIM2_Init 2 */
+
+}
+
 /**
   * @brief TIM3 Initialization Function
   * @param None
@@ -523,6 +787,12 @@ static void MX_DMA_Init(void)
   /* DMA1_Channel1_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 5, 0);
   HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+  /* DMA1_Channel3_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+  /* DMA1_Channel5_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
 
 }
 
@@ -563,17 +833,10 @@ static void MX_GPIO_Init(void)
 
   /*Configure GPIO pins : BTN_ROW0_Pin BTN_ROW1_Pin BTN_ROW2_Pin BTN_ROW3_Pin */
   GPIO_InitStruct.Pin = BTN_ROW0_Pin|BTN_ROW1_Pin|BTN_ROW2_Pin|BTN_ROW3_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
   GPIO_InitStruct.Pull = GPIO_PULLUP;
   HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
-  /* EXTI interrupt init*/
-  HAL_NVIC_SetPriority(EXTI4_IRQn, 5, 0);
-  HAL_NVIC_EnableIRQ(EXTI4_IRQn);
-
-  HAL_NVIC_SetPriority(EXTI9_5_IRQn, 5, 0);
-  HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
-
 }
 
 /* USER CODE BEGIN 4 */
@@ -583,62 +846,86 @@ static void MX_GPIO_Init(void)
   *                                   containing the commands to process
   * @retval None
   */
-void digital_output_process(DigitalOutput_Cmd_Frame *cmd_data) {
-  // Digital Output 1
-  if (cmd_data[0].signal[0].switchCmd == 1) {
-    TIM1->CCR4 = (cmd_data[0].signal[0].dutyCycle * 10U) - 1U;
-  } else {
-    TIM1->CCR4 = 0;
-  }
-
-  // Digital Output 10
-  if (cmd_data[1].signal[1].switchCmd == 1) {
-    TIM1->CCR3 = (cmd_data[1].signal[1].dutyCycle * 10U) - 1U;
-  } else {
-    TIM1->CCR3 = 0;
+void digital_output_process(const DigitalOutput_Cmd_Frame *cmd_data) {
+  uint32_t ccr[NUMBER_OF_PWM_TIMERS][PWM_CHANNELS];
+  memcpy(ccr, pwm_idle, sizeof(ccr));
+
+  for (uint8_t i = 0; i < DIGITAL_OUTPUT_MAP_SIZE; i++) {
+    const DigitalOutput_Channel *out = &digital_output_map[i];
+    const DigitalOutput_Cmd cmd = cmd_data[out->signal / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME]
+                                      .signal[out->signal % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME];
+    uint32_t duty = (cmd.switchCmd == 1) ? cmd.dutyCycle : 0U;
+    if (duty > PWM_DUTY_MAX) {
+      duty = PWM_DUTY_MAX;
+    }
+    if (out->active_low) {
+      duty = PWM_DUTY_MAX - duty;
+    }
+    ccr[out->timer][out->channel] = duty * out->scale;
   }
 
-  // Digital Output 19
-  if (cmd_data[2].signal[2].switchCmd == 1) {
-    TIM1->CCR2 = (cmd_data[2].signal[2].dutyCycle * 10U) - 1U;
-  } else {
-    TIM1->CCR2 = 0;
+  // Hand over whole timers only, the burst never mixes old and new values
+  for (uint8_t t = 0; t < NUMBER_OF_PWM_TIMERS; t++) {
+    pwm_next_ready[t] = false;
+    for (uint8_t ch = 0; ch < PWM_CHANNELS; ch++) {
+      pwm_next[t][ch] = ccr[t][ch];
+    }
+    pwm_next_ready[t] = true;
   }
+}
 
-  // Digital Output 28
-  if (cmd_data[3].signal[3].switchCmd == 1) {
-    TIM1->CCR1 = (cmd_data[3].signal[3].dutyCycle * 10U) - 1U;
-  } else {
-    TIM1->CCR1 = 0;
+/**
+  * @brief  Take over the next CCR values of a PWM timer after its DMA burst
+  * @param  timer: PWM_TIM1 or PWM_TIM3
+  * @retval None
+  */
+static void pwm_burst_complete(uint8_t timer) {
+  // The next burst is a whole PWM period away
+  if (pwm_next_ready[timer]) {
+    for (uint8_t ch = 0; ch < PWM_CHANNELS; ch++) {
+      pwm_burst[timer][ch] = pwm_next[timer][ch];
+    }
+    pwm_next_ready[timer] = false;
   }
+}
 
-  // Digital Output 8
-  // if (cmd_data[0].signal[7].switchCmd == 1) {
-  //   TIM3->CCR1 = (cmd_data[0].signal[7].dutyCycle * 10U) - 1U;
-  // } else {
-  //   TIM3->CCR1 = 0;
-  // }
+/**
+  * @brief  Hand a scheduled response frame to CAN
+  * @param  entry: Index in can_tx_schedule
+  * @param  sdu: Frame data
+  * @retval None
+  */
+static void can_tx_update(uint8_t entry, uint64_t sdu) {
+  CAN_TxState *state = &can_tx_state[entry];
 
-  // Digital Output 12
-  if (cmd_data[1].signal[3].switchCmd == 1) {
-    TIM3->CCR2 = (cmd_data[1].signal[3].dutyCycle * 10U) - 1U;
-  } else {
-    TIM3->CCR2 = 0;
-  }
+  state->sent = sdu;
+  if (can_tx_schedule[entry].freshness) {
+    DigitalInput_Resp_Frame data;
 
-  // Digital Output 22
-  if (cmd_data[2].signal[5].switchCmd == 1) {
-    TIM3->CCR3 = (cmd_data[2].signal[5].dutyCycle * 10U) - 1U;
-  } else {
-    TIM3->CCR3 = 0;
+    // The button code writes the input states only, the freshness counter
+    // is kept here so that both tasks never write the same bytes
+    data.sdu = sdu;
+    state->freshness++;
+    for (uint8_t j = 0; j < DIGITAL_IN_RESP_SIGNAL_PER_FRAME; j++) {
+      data.signal[j].freshness = state->freshness;
+    }
+    sdu = data.sdu;
   }
+  CAN_UpdateTxFrame(can_tx_schedule[entry].slot, sdu);
+}
 
-  // Digital Output 32
-  if (cmd_data[3].signal[7].switchCmd == 1) {
-    TIM3->CCR4 = (cmd_data[3].signal[7].dutyCycle * 10U) - 1U;
-  } else {
-    TIM3->CCR4 = 0;
-  }
+/**
+  * @brief  Read the data of a response frame written by an interrupt
+  * @param  sdu: Frame data
+  * @retval Frame data, never half old and half new
+  */
+static uint64_t can_tx_snapshot(volatile const uint64_t *sdu) {
+  // A 64-bit load is two accesses on the Cortex-M3; the ADC callbacks and
+  // the button matrix scan (TIM2) rewrite the frames in between
+  __disable_irq();
+  const uint64_t value = *sdu;
+  __enable_irq();
+  return value;
 }
 /* USER CODE END 4 */
 
@@ -653,16 +940,19 @@ void CANRxHandler(void *argument)
 {
   /* USER CODE BEGIN 5 */
   
-  btn_matrix_init();
-  TIM3->CCR1 = 999; // Initialize PWM duty cycle to 999
   /* Infinite loop */
   for(;;)
   {
-    // Process button matrix input
-    btn_matrix_process(digital_input_data);
-    // Process Digital Output Commands immediately
-    digital_output_process(digital_output_cmd_data);
+    // Sleep until a command frame arrives
+    const uint32_t flags = osThreadFlagsWait(CAN_RX_FLAG, osFlagsWaitAny, osWaitForever);
+    if (flags & osFlagsError) {
+      continue;
+    }
 
+    // Rewrite the PWM outputs only when a command frame changed
+    if (CAN_process_commands() != 0U) {
+      digital_output_process(CAN_GetCommandFrames());
+    }
   }
   /* USER CODE END 5 */
 }
@@ -687,55 +977,56 @@ void CANTxHandler(void *argument)
     }
   }
 
-  // Initialize Digital Input Response Frame
-  for (uint8_t i = 0; i < NUMBER_OF_DIG_IN_RES_FRAME; i++) {
-    for (uint8_t j = 0; j < DIGITAL_IN_RESP_SIGNAL_PER_FRAME; j++) {
-      digital_input_data[i].signal[j].inputStatus = 0; // Off
-      digital_input_data[i].signal[j].freshness = 0;
-      digital_input_data[i].signal[j].elDiagnosis = 0; // OK
-    }
+  const uint32_t start = osKernelGetTickCount();
+  for (uint8_t i = 0; i < CAN_TX_SCHEDULE_SIZE; i++) {
+    can_tx_state[i].next = start + can_tx_schedule[i].phase;
+    can_tx_state[i].last_change = start - can_tx_schedule[i].min_gap;
   }
 
   /* Infinite loop */
   for(;;)
   {
-    CAN_Frame tx_frame;
-    uint32_t potentiometer_value = 0;
-
-    // Prepare Digital Output Response Frame
-    for (uint8_t i = 0; i < NUMBER_OF_DIG_OUT_RES_FRAME; i++) {
-      tx_frame.id = DIGITAL_OUTPUT_RES_ID(i);
-      memcpy(tx_frame.data, &digital_output_data[i].sdu, sizeof(digital_output_data[i].sdu));
-      CAN_EnqueueTxFrame(&tx_frame, canTxQueue);
-    }
+    const uint32_t now = osKernelGetTickCount();
+    uint32_t timeout = osWaitForever;
+    bool send = false;
+
+    for (uint8_t i = 0; i < CAN_TX_SCHEDULE_SIZE; i++) {
+      const CAN_TxSchedule *schedule = &can_tx_schedule[i];
+      CAN_TxState *state = &can_tx_state[i];
+      const uint64_t sdu = can_tx_snapshot(schedule->sdu);
+
+      if ((int32_t)(now - state->next) >= 0) {
+        // Cyclic frame; deadlines are absolute, so the period does not drift
+        can_tx_update(i, sdu);
+        send = true;
+        state->next += schedule->period;
+        if ((int32_t)(now - state->next) >= 0) {
+          state->next = now + schedule->period; // Fell behind, skip the missed cycles
+        }
+      } else if (schedule->min_gap != 0U && sdu != state->sent) {
+        // Changed data between the cycles, at most one frame per min_gap;
+        // the cyclic frames do not count
+        const uint32_t elapsed = now - state->last_change;
+        if (elapsed >= schedule->min_gap) {
+          can_tx_update(i, sdu);
+          state->last_change = now;
+          send = true;
+        } else if (schedule->min_gap - elapsed < timeout) {
+          timeout = schedule->min_gap - elapsed;
+        }
+      }
 
-    // Prepare Digital Input Response Frame
-    for (uint8_t i = 0; i < NUMBER_OF_DIG_IN_RES_FRAME; i++) {
-      for (uint8_t j = 0; j < DIGITAL_IN_RESP_SIGNAL_PER_FRAME; j++) {
-        digital_input_data[i].signal[j].freshness++;
+      if (state->next - now < timeout) {
+        timeout = state->next - now;
       }
     }
-    for (uint8_t i = 0; i < NUMBER_OF_DIG_IN_RES_FRAME; i++){
-      tx_frame.id = DIGITAL_INPUT_RES_ID(i);
-      memcpy(tx_frame.data, &digital_input_data[i].sdu, sizeof(digital_input_data[i].sdu));
-      CAN_EnqueueTxFrame(&tx_frame, canTxQueue);
-    }
 
-    // Prepare Analog Input Response Frame
-    for (uint8_t i = 0; i < TEN; i++) {
-      potentiometer_value += potentiometer[i];
-    }
-    potentiometer_value /= TEN;
-    analog_input_data[0].signal[0].analogValue = potentiometer_value;
-    for (uint8_t i = 0; i < NUMBER_OF_ANALOG_IN_RES_FRAME; i++) {
-      tx_frame.id = ANALOG_INPUT_RES_ID(i);
-      memcpy(tx_frame.data, &analog_input_data[i].sdu, sizeof(analog_input_data[i].sdu));
-      CAN_EnqueueTxFrame(&tx_frame, canTxQueue);
+    if (send) {
+      CAN_send();
     }
 
-    CAN_send(&hcan, canTxQueue);
-
-    osDelay(50);
+    // Sleep until the next frame is due or the response data changed
+    osThreadFlagsWait(CAN_TX_CHANGED_FLAG, osFlagsWaitAny, timeout);
   }
   /* USER CODE END CANTxHandler */
 }
@@ -757,7 +1048,18 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
     HAL_IncTick();
   }
   /* USER CODE BEGIN Callback 1 */
+  // Button matrix, one column per millisecond. A changed input is sent
+  // right away instead of with the next cycle.
+  if (htim->Instance == TIM2 && btn_matrix_scan(digital_input_data)) {
+    osThreadFlagsSet(CANTxHandlerTaskHandle, CAN_TX_CHANGED_FLAG);
+  }
 
+  // DMA burst to the PWM timers done (circular DMA complete)
+  if (htim->Instance == TIM1) {
+    pwm_burst_complete(PWM_TIM1);
+  } else if (htim->Instance == TIM3) {
+    pwm_burst_complete(PWM_TIM3);
+  }
   /* USER CODE END Callback 1 */
 }
 
@@ -0,0 +1,193 @@
+#include "canprotocol.h"
+#include <benchmark/benchmark.h>
+#include <cstring>
+
+#define ANALOG_MAX  16383U  // 14-bit oversampled ADC value of the ECU
+
+namespace {
+
+// Positions from io_configs/io_config.json
+CanSignalMap defaultMap() {
+    CanSignalMap map;
+    map.digInputs = {
+        { CAN_SIGNAL_HAZARD, 27 },
+        { CAN_SIGNAL_HIGH_BEAM, 1 },
+        { CAN_SIGNAL_IGNITION, 0 },
+        { CAN_SIGNAL_LOW_BEAM, 10 },
+        { CAN_SIGNAL_PARKING_LIGHTS, 19 },
+        { CAN_SIGNAL_TURN_LEFT, 9 },
+        { CAN_SIGNAL_TURN_RIGHT, 18 },
+    };
+    map.analogInputs = { { CAN_SIGNAL_SPEED, 0 } };
+    return map;
+}
+
+// 32 digital inputs: the default ones plus spare inputs the cluster does not use
+CanSignalMap wideMap() {
+    CanSignalMap map = defaultMap();
+    for (uint8_t pos = 0; map.digInputs.size() < 32; pos++) {
+        bool used = false;
+        for (const CanSignalEntry &entry : map.digInputs) {
+            used |= entry.pos == pos;
+        }
+        if (!used) map.digInputs.push_back({ CAN_SIGNAL_UNKNOWN, pos });
+    }
+    return map;
+}
+
+struct can_frame digitalFrame(uint8_t frameIdx, uint8_t bits) {
+    struct can_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = DIGITAL_INPUT_RES_ID(frameIdx);
+    frame.can_dlc = BYTES_PER_CAN_FRAME;
+    for (uint8_t i = 0; i < DIGITAL_IN_RESP_SIGNAL_PER_FRAME; i++) {
+        frame.data[i] = (bits >> i) & 0x01;
+    }
+    return frame;
+}
+
+struct can_frame analogFrame(uint8_t frameIdx, uint16_t value) {
+    struct can_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = ANALOG_INPUT_RES_ID(frameIdx);
+    frame.can_dlc = BYTES_PER_CAN_FRAME;
+    for (uint8_t i = 0; i < ANALOG_IN_RESP_SIGNAL_PER_FRAME; i++) {
+        frame.data[i * 2] = value & 0xFF;
+        frame.data[i * 2 + 1] = (value >> 8) & 0x3F;
+    }
+    return frame;
+}
+
+/*
+ * @brief One ECU transmission cycle: every digital and analog response frame,
+ *        ignition on, switches steady.
+ */
+std::vector<struct can_frame> steadyCycle() {
+    std::vector<struct can_frame> frames;
+    for (uint8_t i = 0; i < NUMBER_OF_DIG_IN_RES_FRAME; i++) {
+        frames.push_back(digitalFrame(i, i == 0 ? 0x01 : 0x00));
+    }
+    for (uint8_t i = 0; i < NUMBER_OF_ANALOG_IN_RES_FRAME; i++) {
+        frames.push_back(analogFrame(i, 2000));
+    }
+    return frames;
+}
+
+/*
+ * @brief Decode frames the way CanRxThread does: decode, then lighting edges.
+ */
+void decodeFrames(benchmark::State &state, const CanSignalMap &map, const std::vector<struct can_frame> &frames) {
+    digInSignal input;
+    digInSignal prevInput;
+    analogInSignal analog;
+    digOutSignal output;
+    size_t i = 0;
+
+    for (auto _ : state) {
+        const uint32_t changed = canDecodeFrame(map, frames[i], input, analog);
+        const bool restart = canUpdateLighting(input, prevInput, output);
+        benchmark::DoNotOptimize(changed);
+        benchmark::DoNotOptimize(restart);
+        prevInput = input;
+        if (++i == frames.size()) i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_DecodeSteadyState(benchmark::State &state) {
+    decodeFrames(state, defaultMap(), steadyCycle());
+}
+BENCHMARK(BM_DecodeSteadyState);
+
+// Every frame flips all the switches it carries (ignition stays on) or the speed
+void BM_DecodeSwitchStorm(benchmark::State &state) {
+    std::vector<struct can_frame> frames;
+    for (int i = 0; i < 16; i++) {
+        for (uint8_t f = 0; f < NUMBER_OF_DIG_IN_RES_FRAME; f++) {
+            frames.push_back(digitalFrame(f, (i & 1) ? 0xFF : (f == 0 ? 0x01 : 0x00)));
+        }
+        frames.push_back(analogFrame(0, (i & 1) ? ANALOG_MAX : 0));
+    }
+    decodeFrames(state, defaultMap(), frames);
+}
+BENCHMARK(BM_DecodeSwitchStorm);
+
+// Traffic of other nodes on the same bus, none of it for the cluster
+void BM_DecodeIrrelevantIds(benchmark::State &state) {
+    std::vector<struct can_frame> frames;
+    for (uint32_t i = 0; i < 64; i++) {
+        struct can_frame frame = analogFrame(0, 1234);
+        frame.can_id = (0x18FE0000UL + i) | CAN_EFF_FLAG;
+        frames.push_back(frame);
+    }
+    decodeFrames(state, defaultMap(), frames);
+}
+BENCHMARK(BM_DecodeIrrelevantIds);
+
+void BM_Decode32Signals(benchmark::State &state) {
+    decodeFrames(state, wideMap(), steadyCycle());
+}
+BENCHMARK(BM_Decode32Signals);
+
+void BM_SignalMapBuild(benchmark::State &state) {
+    static const char *const names[] = {
+        "hazard_switch", "high_beam_switch", "ignition", "low_beam_switch",
+        "parking_lights_switch", "turn_left_switch", "turn_right_switch", "speed",
+    };
+    for (auto _ : state) {
+        CanSignalMap map;
+        for (uint8_t i = 0; i < 7; i++) {
+            map.digInputs.push_back({ canSignalFromName(names[i]), i });
+        }
+        map.analogInputs.push_back({ canSignalFromName(names[7]), 0 });
+        benchmark::DoNotOptimize(map.digInputs.data());
+    }
+}
+BENCHMARK(BM_SignalMapBuild);
+
+// Hazard, left, right, off: the four lamp patterns in turn
+void BM_LightingUpdate(benchmark::State &state) {
+    digInSignal inputs[4];
+    inputs[0].hazard_switch = true;
+    inputs[1].turn_left_switch = true;
+    inputs[2].turn_right_switch = true;
+    digOutSignal output;
+    size_t i = 0;
+
+    for (auto _ : state) {
+        const bool restart = canUpdateLighting(inputs[i], inputs[(i + 3) % 4], output);
+        benchmark::DoNotOptimize(restart);
+        benchmark::DoNotOptimize(output);
+        i = (i + 1) % 4;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LightingUpdate);
+
+// Lamp command frames of one blink phase; arg 0: all lamps off, 1: hazard blinking
+void BM_EncodeLampFrames(benchmark::State &state) {
+    digOutSignal output;
+    output.left_front_light_pos = 0;
+    output.left_rear_light_pos = 1;
+    output.right_front_light_pos = 2;
+    output.right_rear_light_pos = 3;
+    if (state.range(0)) {
+        output.left_front_light = output.left_rear_light = true;
+        output.right_front_light = output.right_rear_light = true;
+    }
+    struct can_frame frames[LAMP_FRAMES_MAX];
+    bool on = false;
+
+    for (auto _ : state) {
+        const int count = canEncodeLampFrames(output, on, frames);
+        benchmark::DoNotOptimize(count);
+        benchmark::DoNotOptimize(frames);
+        on = !on;
+    }
+    state.SetItemsProcessed(state.iterations() * LAMP_FRAMES_MAX);
+}
+BENCHMARK(BM_EncodeLampFrames)->Arg(0)->Arg(1);
+
+} // namespace
+
+BENCHMARK_MAIN();
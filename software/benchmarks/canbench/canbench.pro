@@ -0,0 +1,17 @@
+# Google Benchmark suite for the Qt-free CAN protocol code of the cluster.
+#   ./canbench --benchmark_out=canbench.json --benchmark_out_format=json
+TEMPLATE = app
+TARGET = canbench
+CONFIG += console c++17
+CONFIG -= qt app_bundle
+
+APP_DIR = $$PWD/../../qtapp/files
+INCLUDEPATH += $$APP_DIR/communication
+
+SOURCES += \
+        canbench.cpp \
+        $$APP_DIR/communication/canprotocol.cpp
+
+HEADERS += $$APP_DIR/communication/canprotocol.h
+
+LIBS += -lbenchmark -lpthread
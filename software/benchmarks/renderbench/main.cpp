@@ -0,0 +1,225 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QQmlComponent>
+#include <QQmlContext>
+#include <QQmlEngine>
+#include <QQuickItem>
+#include <QQuickRenderControl>
+#include <QQuickWindow>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QDebug>
+#include <qqml.h>
+#include <algorithm>
+#include "communication/canhandler.h"
+#include "state/vehiclestate.h"
+#include "ui/gaugeitem.h"
+#include "vehiclestream.h"
+#include "notifycounter.h"
+
+struct FrameSample {
+    qint64 syncNs;      // polishItems() + sync()
+    qint64 renderNs;    // render(), until the GPU is done
+    quint64 notifications;
+    quint64 handlers;
+};
+
+static double percentileMs(QVector<qint64> values, double p) {
+    if (values.isEmpty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[qMin(values.size() - 1, int(values.size() * p))] / 1e6;
+}
+
+static void printRow(QTextStream &out, const char *name, const QVector<qint64> &values) {
+    qint64 sum = 0;
+    for (qint64 v : values) sum += v;
+    out << QString::asprintf("%-12s %8.3f %8.3f %8.3f %8.3f\n", name,
+                             values.isEmpty() ? 0.0 : sum / 1e6 / values.size(),
+                             percentileMs(values, 0.5), percentileMs(values, 0.99), percentileMs(values, 1.0));
+}
+
+int main(int argc, char *argv[])
+{
+    // No display needed; an explicit QT_QPA_PLATFORM still wins
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders main.qml offscreen and reports per-frame cost.");
+    parser.addHelpOption();
+    parser.addOption({ "backend", "Scene graph backend: software or opengl.", "name", "software" });
+    parser.addOption({ "frames", "Frames to measure.", "count", "600" });
+    parser.addOption({ "warmup", "Frames rendered before measuring.", "count", "30" });
+    parser.addOption({ "interval", "Simulated time per frame in ms.", "ms", "16.667" });
+    parser.addOption({ "replay", "Drive from a candump or .clog log instead of the synthetic drive.", "file" });
+    parser.addOption({ "io-config", "IO configuration used to decode --replay.", "file", "io_configs/io_config.json" });
+    parser.addOption({ "csv", "Write per-frame samples to a CSV file.", "file" });
+    parser.process(app);
+
+    const bool software = parser.value("backend") != QLatin1String("opengl");
+    const int frames = parser.value("frames").toInt();
+    const int warmup = parser.value("warmup").toInt();
+    const double interval = parser.value("interval").toDouble();
+
+    if (software) {
+        QQuickWindow::setSceneGraphBackend(QSGRendererInterface::Software);
+    }
+
+    VehicleStream stream;
+    if (parser.isSet("replay")) {
+        const IOConfig config = loadIOConfig(parser.value("io-config"));
+        if (!stream.openReplay(parser.value("replay"), buildSignalMap(config))) return 1;
+    }
+
+    // Empty state file, so every run starts from the same defaults
+    QTemporaryDir stateDir;
+    VehicleStateStore vehicleState(stateDir.filePath("vehicle_state.bin"));
+    vehicleState.open();
+
+    qmlRegisterType<GaugeItem>("Cluster", 1, 0, "Gauge");
+
+    QQmlEngine engine;
+    engine.rootContext()->setContextProperty("canHandler", &stream);
+    engine.rootContext()->setContextProperty("vehicleState", &vehicleState);
+    engine.rootContext()->setContextProperty("perfHudEnabled", false);
+    engine.rootContext()->setContextProperty("perfMonitor", nullptr);
+    engine.rootContext()->setContextProperty("assetExt", QStringLiteral("png"));
+    // Secondary widgets are loaded synchronously, so every frame shows the whole UI
+    engine.rootContext()->setContextProperty("fastBoot", false);
+
+    // main.qml is an ApplicationWindow; it is created hidden and its items are
+    // moved into a window driven by QQuickRenderControl
+    QQmlComponent component(&engine, QUrl(QStringLiteral("qrc:/main.qml")));
+    QObject *root = component.beginCreate(engine.rootContext());
+    QQuickWindow *appWindow = qobject_cast<QQuickWindow *>(root);
+    if (!appWindow) {
+        qWarning() << component.errors();
+        return 1;
+    }
+    appWindow->setProperty("visibility", QWindow::Hidden);
+    appWindow->setProperty("visible", false);
+    component.completeCreate();
+
+    QQuickRenderControl renderControl;
+    QQuickWindow window(&renderControl);
+    window.resize(appWindow->size());
+    window.setColor(appWindow->color());
+    const QList<QQuickItem *> items = appWindow->contentItem()->childItems();
+    for (QQuickItem *item : items) {
+        item->setParentItem(window.contentItem());
+    }
+
+    QOpenGLContext context;
+    QOffscreenSurface surface;
+    QScopedPointer<QOpenGLFramebufferObject> fbo;
+    if (software) {
+        renderControl.initialize(nullptr);
+    } else {
+        QSurfaceFormat format;
+        format.setDepthBufferSize(16);
+        format.setStencilBufferSize(8);
+        context.setFormat(format);
+        if (!context.create()) {
+            qWarning() << "Cannot create an OpenGL context";
+            return 1;
+        }
+        surface.setFormat(context.format());
+        surface.create();
+        context.makeCurrent(&surface);
+        renderControl.initialize(&context);
+        fbo.reset(new QOpenGLFramebufferObject(window.size(), QOpenGLFramebufferObject::CombinedDepthStencil));
+        window.setRenderTarget(fbo.data());
+    }
+
+    NotifyCounter counter;
+    const int watched = counter.watchProperties(root);
+    const char *const streamSignals[] = {
+        "leftLightChanged(bool)", "rightLightChanged(bool)", "hazardLightsChanged(bool)",
+        "highBeamChanged(bool)", "lowBeamChanged(bool)", "parkingLightsChanged(bool)", "speedChanged()",
+    };
+    for (const char *signal : streamSignals) {
+        counter.watchHandler(&stream, signal);
+    }
+    for (QObject *obj : root->findChildren<QObject *>()) {
+        if (obj->inherits("QQmlTimer")) counter.watchHandler(obj, "triggered()");
+    }
+
+    QVector<FrameSample> samples;
+    samples.reserve(frames);
+    QElapsedTimer timer;
+
+    for (int frame = 0; frame < warmup + frames; frame++) {
+        const quint64 notifications = counter.notifications();
+        const quint64 handlers = counter.handlers();
+
+        // Vehicle data and QML timers of this frame
+        stream.advanceTo(qint64(frame * interval));
+        QCoreApplication::processEvents();
+
+        timer.start();
+        renderControl.polishItems();
+        renderControl.sync();
+        const qint64 syncNs = timer.nsecsElapsed();
+
+        if (software) {
+            // The software renderer draws into the grabbed image, always a full frame
+            renderControl.grab();
+        } else {
+            renderControl.render();
+            context.functions()->glFinish();
+        }
+        const qint64 renderNs = timer.nsecsElapsed() - syncNs;
+
+        // The gauge keeps animating on frameSwapped, as with the real render loop
+        emit window.frameSwapped();
+
+        if (frame >= warmup) {
+            samples.append({ syncNs, renderNs, counter.notifications() - notifications, counter.handlers() - handlers });
+        }
+    }
+
+    QVector<qint64> sync, render, total;
+    quint64 notifications = 0, handlers = 0;
+    for (const FrameSample &s : samples) {
+        sync.append(s.syncNs);
+        render.append(s.renderNs);
+        total.append(s.syncNs + s.renderNs);
+        notifications += s.notifications;
+        handlers += s.handlers;
+    }
+
+    QTextStream out(stdout);
+    out << "renderbench: " << samples.size() << " frames, " << (software ? "software" : "opengl") << " backend, "
+        << window.width() << "x" << window.height() << ", " << (parser.isSet("replay") ? parser.value("replay") : "synthetic drive")
+        << ", " << warmup << " warm-up frames\n";
+    out << QString::asprintf("%-12s %8s %8s %8s %8s\n", "ms", "avg", "p50", "p99", "max");
+    printRow(out, "sync", sync);
+    printRow(out, "render", render);
+    printRow(out, "total", total);
+    out << QString::asprintf("per frame: %.1f property notifications, %.2f handler calls (%d properties watched)\n",
+                             samples.isEmpty() ? 0.0 : double(notifications) / samples.size(),
+                             samples.isEmpty() ? 0.0 : double(handlers) / samples.size(), watched);
+
+    if (parser.isSet("csv")) {
+        QFile csv(parser.value("csv"));
+        if (csv.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QTextStream csvOut(&csv);
+            csvOut << "frame,sync_ns,render_ns,notifications,handlers\n";
+            for (int i = 0; i < samples.size(); i++) {
+                csvOut << i << ',' << samples[i].syncNs << ',' << samples[i].renderNs << ','
+                       << samples[i].notifications << ',' << samples[i].handlers << '\n';
+            }
+        }
+    }
+
+    delete root;
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "notifycounter.h"
+#include <QMetaProperty>
+
+// Fake slots following QObject's methods
+#define NOTIFY_SLOT     0
+#define HANDLER_SLOT    1
+#define SLOT_COUNT      2
+
+int NotifyCounter::watchProperties(QObject *object) {
+    int watched = 0;
+    const QList<QObject *> objects = QList<QObject *>() << object << object->findChildren<QObject *>();
+    for (QObject *obj : objects) {
+        const QMetaObject *meta = obj->metaObject();
+        for (int i = 0; i < meta->propertyCount(); i++) {
+            const QMetaProperty property = meta->property(i);
+            if (!property.hasNotifySignal()) continue;
+            if (QMetaObject::connect(obj, property.notifySignalIndex(),
+                                     this, QObject::staticMetaObject.methodCount() + NOTIFY_SLOT,
+                                     Qt::DirectConnection)) {
+                watched++;
+            }
+        }
+    }
+    return watched;
+}
+
+bool NotifyCounter::watchHandler(QObject *object, const char *signal) {
+    const int index = object->metaObject()->indexOfSignal(QMetaObject::normalizedSignature(signal));
+    if (index < 0) return false;
+    return QMetaObject::connect(object, index,
+                                this, QObject::staticMetaObject.methodCount() + HANDLER_SLOT,
+                                Qt::DirectConnection);
+}
+
+int NotifyCounter::qt_metacall(QMetaObject::Call call, int id, void **args) {
+    id = QObject::qt_metacall(call, id, args);
+    if (id < 0) return id;
+
+    if (call == QMetaObject::InvokeMetaMethod) {
+        if (id == NOTIFY_SLOT) {
+            m_notifications++;
+        } else if (id == HANDLER_SLOT) {
+            m_handlers++;
+        }
+        id -= SLOT_COUNT;
+    }
+    return id;
+}
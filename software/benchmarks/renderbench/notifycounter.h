@@ -0,0 +1,40 @@
+#ifndef NOTIFYCOUNTER_H
+#define NOTIFYCOUNTER_H
+
+#include <QObject>
+
+/*
+ * @brief Counts signal emissions of arbitrary objects without knowing their
+ *        signatures, the way QSignalSpy does: every watched signal is connected
+ *        to a slot index past QObject's own methods and handled in qt_metacall().
+ *
+ * Property notifications stand for binding re-evaluations (each one re-runs
+ * the bindings that depend on the property); handler signals stand for the
+ * JavaScript signal handlers attached to them.
+ */
+class NotifyCounter : public QObject {
+public:
+    explicit NotifyCounter(QObject *parent = nullptr) : QObject(parent) {}
+
+    /*
+     * @brief Count the notify signals of every property of object and its children.
+     * @return Number of signals watched.
+     */
+    int watchProperties(QObject *object);
+
+    /*
+     * @brief Count one signal as a handler invocation.
+     */
+    bool watchHandler(QObject *object, const char *signal);
+
+    quint64 notifications() const { return m_notifications; }
+    quint64 handlers() const { return m_handlers; }
+
+    int qt_metacall(QMetaObject::Call call, int id, void **args) override;
+
+private:
+    quint64 m_notifications = 0;
+    quint64 m_handlers = 0;
+};
+
+#endif // NOTIFYCOUNTER_H
@@ -0,0 +1,62 @@
+# Headless render benchmark: renders the cluster's main.qml offscreen through
+# QQuickRenderControl, driven by a synthetic or replayed vehicle-state stream.
+#   QT_QPA_PLATFORM=offscreen ./renderbench --frames 600 --backend software
+QT += quick
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+APP_DIR = $$PWD/../../qtapp/files
+INCLUDEPATH += $$APP_DIR
+
+SOURCES += \
+        main.cpp \
+        vehiclestream.cpp \
+        notifycounter.cpp \
+        $$APP_DIR/communication/canblackbox.cpp \
+        $$APP_DIR/communication/canhandler.cpp \
+        $$APP_DIR/communication/canlog.cpp \
+        $$APP_DIR/communication/canprotocol.cpp \
+        $$APP_DIR/diagnostics/boottrace.cpp \
+        $$APP_DIR/diagnostics/log.cpp \
+        $$APP_DIR/diagnostics/metrics.cpp \
+        $$APP_DIR/diagnostics/trace.cpp \
+        $$APP_DIR/state/vehiclestate.cpp \
+        $$APP_DIR/ui/gaugeitem.cpp
+
+HEADERS += \
+        vehiclestream.h \
+        notifycounter.h \
+        $$APP_DIR/communication/canblackbox.h \
+        $$APP_DIR/communication/canhandler.h \
+        $$APP_DIR/communication/canlog.h \
+        $$APP_DIR/communication/canprotocol.h \
+        $$APP_DIR/diagnostics/boottrace.h \
+        $$APP_DIR/diagnostics/log.h \
+        $$APP_DIR/diagnostics/metrics.h \
+        $$APP_DIR/diagnostics/trace.h \
+        $$APP_DIR/state/vehiclestate.h \
+        $$APP_DIR/ui/gaugeitem.h
+
+LIBS += -lz
+
+# Same QML, fonts and generated assets as the application
+RESOURCES += $$APP_DIR/qml.qrc \
+    $$APP_DIR/Fonts.qrc
+
+# Generated by the same make rule as in qtapp.pro
+DISPLAY_WIDTH = 1024
+DISPLAY_HEIGHT = 600
+ASSETS_OUT = $$OUT_PWD/generated
+ASSET_IMAGES = $$files($$APP_DIR/images/*.png)
+qtPrepareTool(ASSETS_RCC, rcc)
+
+assets.name = ASSETS
+assets.input = ASSET_IMAGES
+assets.output = $$ASSETS_OUT/qrc_assets.cpp
+assets.commands = sh $$shell_quote($$APP_DIR/tools/build_assets.sh) $$shell_quote($$APP_DIR/images) $$shell_quote($$ASSETS_OUT) $$DISPLAY_WIDTH $$DISPLAY_HEIGHT \
+    && $$ASSETS_RCC -name assets $$shell_quote($$ASSETS_OUT/assets.qrc) -o ${QMAKE_FILE_OUT}
+assets.depends = $$APP_DIR/tools/build_assets.sh
+assets.variable_out = SOURCES
+assets.CONFIG += combine target_predeps
+QMAKE_EXTRA_COMPILERS += assets
@@ -0,0 +1,126 @@
+#include "vehiclestream.h"
+#include <QDebug>
+
+// ECU analog sample period and blink half-period, as on the bus
+#define STREAM_ANALOG_PERIOD_MS   50
+#define STREAM_BLINK_PERIOD_MS    500
+
+VehicleStream::VehicleStream(QObject *parent)
+    : QObject(parent) {
+    m_clock.start();
+}
+
+bool VehicleStream::openReplay(const QString &logPath, const CanSignalMap &map) {
+    if (!m_reader.open(logPath.toStdString())) {
+        qWarning() << "Replay:" << QString::fromStdString(m_reader.error());
+        return false;
+    }
+    m_map = map;
+    m_replay = true;
+    m_hasPending = m_reader.next(m_pending);
+    m_firstTimestampUs = m_pending.timestampUs;
+    return true;
+}
+
+void VehicleStream::advanceTo(qint64 ms) {
+    if (m_replay) {
+        advanceReplay(ms);
+    } else {
+        advanceSynthetic(ms);
+    }
+    updateBlink(ms);
+    m_lastMs = ms;
+}
+
+/*
+ * @brief A 20 s drive: speed ramps up and down every 50 ms, the beams change
+ *        every few seconds, left turn from 4 s, hazard from 12 s.
+ */
+void VehicleStream::advanceSynthetic(qint64 ms) {
+    for (qint64 t = (m_lastMs / STREAM_ANALOG_PERIOD_MS + 1) * STREAM_ANALOG_PERIOD_MS; t <= ms; t += STREAM_ANALOG_PERIOD_MS) {
+        const qint64 cycle = t % 20000;
+        const int speed = int((cycle < 10000 ? cycle : 20000 - cycle) * SPEED_ANALOG_FULL_SCALE / 10000);
+        if (speed != m_analog.speed) {
+            m_analog.speed = speed;
+            sampleSpeed(speed);
+        }
+
+        digInSignal input = m_input;
+        input.ignition = true;
+        input.low_beam_switch = cycle >= 1000;
+        input.high_beam_switch = (cycle / 3000) % 2 == 1;
+        input.parking_lights_switch = cycle >= 2000 && cycle < 18000;
+        input.turn_left_switch = cycle >= 4000 && cycle < 8000;
+        input.hazard_switch = cycle >= 12000 && cycle < 16000;
+
+        if (input.high_beam_switch != m_input.high_beam_switch) emit highBeamChanged(input.high_beam_switch);
+        if (input.low_beam_switch != m_input.low_beam_switch) emit lowBeamChanged(input.low_beam_switch);
+        if (input.parking_lights_switch != m_input.parking_lights_switch) emit parkingLightsChanged(input.parking_lights_switch);
+
+        if (canUpdateLighting(input, m_input, m_output)) {
+            m_blinkStartMs = t;
+            m_lastBlinkPhase = -1;
+        }
+        m_input = input;
+    }
+}
+
+void VehicleStream::advanceReplay(qint64 ms) {
+    while (m_hasPending && qint64((m_pending.timestampUs - m_firstTimestampUs) / 1000) <= ms) {
+        const digInSignal prevInput = m_input;
+        const uint32_t changed = canDecodeFrame(m_map, m_pending.frame, m_input, m_analog);
+
+        if (changed & CAN_SIGNAL_BIT(CAN_SIGNAL_HIGH_BEAM)) emit highBeamChanged(m_input.high_beam_switch);
+        if (changed & CAN_SIGNAL_BIT(CAN_SIGNAL_LOW_BEAM)) emit lowBeamChanged(m_input.low_beam_switch);
+        if (changed & CAN_SIGNAL_BIT(CAN_SIGNAL_PARKING_LIGHTS)) emit parkingLightsChanged(m_input.parking_lights_switch);
+        if (changed & CAN_SIGNAL_BIT(CAN_SIGNAL_SPEED)) sampleSpeed(m_analog.speed);
+
+        if (canUpdateLighting(m_input, prevInput, m_output)) {
+            m_blinkStartMs = ms;
+            m_lastBlinkPhase = -1;
+        }
+        m_hasPending = m_reader.next(m_pending);
+    }
+}
+
+/*
+ * @brief Smooth and scale a speed sample the way CanHandler does, stamped
+ *        with the wall time it was emitted at.
+ */
+void VehicleStream::sampleSpeed(int analogVal) {
+    m_speed = canFilterSpeed(m_speedFilter, analogVal);
+    m_speedTimestamp = m_clock.msecsSinceReference() + m_clock.nsecsElapsed() / 1e6;
+    emit speedChanged();
+}
+
+/*
+ * @brief Blink the turn and hazard telltales the way CanTxThread does.
+ */
+void VehicleStream::updateBlink(qint64 ms) {
+    const qint64 phase = (ms - m_blinkStartMs) / STREAM_BLINK_PERIOD_MS;
+    if (phase == m_lastBlinkPhase) return;
+    m_lastBlinkPhase = phase;
+
+    const bool on = phase % 2 == 0;
+    if (m_output.left_front_light && m_output.left_rear_light) {
+        if (m_input.hazard_switch) {
+            emit hazardLightsChanged(on);
+        } else if (m_input.turn_left_switch) {
+            emit leftLightChanged(on);
+        }
+    } else if (!m_output.left_front_light && !m_output.left_rear_light) {
+        emit hazardLightsChanged(false);
+        emit leftLightChanged(false);
+    }
+
+    if (m_output.right_front_light && m_output.right_rear_light) {
+        if (m_input.hazard_switch) {
+            emit hazardLightsChanged(on);
+        } else if (m_input.turn_right_switch) {
+            emit rightLightChanged(on);
+        }
+    } else if (!m_output.right_front_light && !m_output.right_rear_light) {
+        emit hazardLightsChanged(false);
+        emit rightLightChanged(false);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef VEHICLESTREAM_H
+#define VEHICLESTREAM_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include "communication/canlog.h"
+#include "communication/canprotocol.h"
+
+/*
+ * @brief Stand-in for CanHandler in the render benchmark. Exposes the same
+ *        signals and speed properties to main.qml and emits them from
+ *        simulated time, either from a synthetic drive or from a recorded CAN
+ *        log decoded with canprotocol.
+ */
+class VehicleStream : public QObject {
+    Q_OBJECT
+    Q_PROPERTY(qreal speed READ speed NOTIFY speedChanged)
+    Q_PROPERTY(qreal speedTimestamp READ speedTimestamp NOTIFY speedChanged)
+public:
+    explicit VehicleStream(QObject *parent = nullptr);
+
+    /*
+     * @brief Replay a candump or .clog log instead of the synthetic drive.
+     * @param logPath: The log file.
+     * @param map: The resolved IO configuration used to decode it.
+     */
+    bool openReplay(const QString &logPath, const CanSignalMap &map);
+
+    /*
+     * @brief Emit everything that happens up to simulated time ms.
+     */
+    void advanceTo(qint64 ms);
+
+    qreal speed() const { return m_speed; }
+    qreal speedTimestamp() const { return m_speedTimestamp; }
+
+signals:
+    void leftLightChanged(bool leftLight);
+    void rightLightChanged(bool rightLight);
+    void hazardLightsChanged(bool hazardLights);
+    void highBeamChanged(bool highBeam);
+    void lowBeamChanged(bool lowBeam);
+    void parkingLightsChanged(bool parkingLights);
+    void speedChanged();
+
+private:
+    void advanceSynthetic(qint64 ms);
+    void advanceReplay(qint64 ms);
+    void updateBlink(qint64 ms);
+    void sampleSpeed(int analogVal);
+
+    bool m_replay = false;
+    CanLogReader m_reader;
+    CanSignalMap m_map;
+    CanLogRecord m_pending;
+    bool m_hasPending = false;
+    uint64_t m_firstTimestampUs = 0;
+
+    digInSignal m_input;
+    analogInSignal m_analog;
+    digOutSignal m_output;
+    qint64 m_lastMs = -1;
+    qint64 m_blinkStartMs = 0;
+    qint64 m_lastBlinkPhase = -1;
+    SpeedFilter m_speedFilter;
+    qreal m_speed = 0;
+    qreal m_speedTimestamp = 0;
+    QElapsedTimer m_clock;
+};
+
+#endif // VEHICLESTREAM_H
@@ -0,0 +1,57 @@
+import QtQuick 2.15
+import Cluster 1.0
+
+// Performance overlay, only loaded when QTAPP_PERF_HUD=1 or --perf-hud is given
+Rectangle {
+    width: 260
+    height: 190
+    color: "#B0000000"
+    radius: 4
+
+    Column {
+        anchors.fill: parent
+        anchors.margins: 6
+        spacing: 2
+
+        FrameTimeGraph {
+            width: parent.width
+            height: 50
+            monitor: perfMonitor
+            color: "#36c75b"
+        }
+
+        Text {
+            color: "white"
+            font.pixelSize: 13
+            text: perfMonitor.fps.toFixed(1) + " frames/s  render " +
+                  perfMonitor.frameTimeMs.toFixed(2) + " ms avg  " +
+                  perfMonitor.maxFrameTimeMs.toFixed(1) + " ms max"
+        }
+        Text {
+            color: "white"
+            font.pixelSize: 13
+            text: "Missed vsyncs while animating: " + perfMonitor.missedFrames
+        }
+        Text {
+            color: "white"
+            font.pixelSize: 13
+            text: perfMonitor.busName + " RX " + perfMonitor.rxRate.toFixed(0) + " fr/s  " +
+                  "TX " + perfMonitor.txRate.toFixed(0) + " fr/s"
+        }
+        Text {
+            color: "white"
+            font.pixelSize: 13
+            text: "RX decode " + perfMonitor.rxDecodeUs.toFixed(2) + " us/frame"
+        }
+        Text {
+            color: "white"
+            font.pixelSize: 13
+            text: "TX queue " + perfMonitor.txQueueDepth + "  TX errors " + perfMonitor.txErrors
+        }
+        Text {
+            color: perfMonitor.rxOverflows > 0 ? "#f70e02" : "white"
+            font.pixelSize: 13
+            text: "RX overflows " + perfMonitor.rxOverflows
+        }
+    }
+}
@@ -0,0 +1,22 @@
+import QtQuick 2.15
+
+// One telltale icon cut out of the atlas built by tools/build_assets.sh.
+// Atlas indices: 0 high beam, 1 low beam, 2 parking lights, 3 hazard,
+// 4 left arrow, 5 right arrow.
+Item {
+    id: telltale
+
+    property int index: 0
+
+    width: 40
+    height: 40
+    clip: true
+    visible: false
+
+    Image {
+        x: -telltale.index * telltale.width
+        width: sourceSize.width
+        height: telltale.height
+        source: "qrc:/assets/telltales." + assetExt
+    }
+}
@@ -0,0 +1,55 @@
+import QtQuick 2.15
+
+// Telltale icons, driven by the light state properties of main.qml.
+// Loaded asynchronously from main.qml after the first frame.
+Item {
+    anchors.fill: parent
+
+    Telltale {
+        id: highBeamImage
+        visible: window.highBeamOn
+        index: 0
+        x: 293
+        y: 6
+    }
+
+    Telltale {
+        id: lowBeamImage
+        visible: window.lowBeamOn
+        index: 1
+        x: 376
+        y: 9
+    }
+
+    Telltale {
+        id: parkingLightsImage
+        visible: window.parkingLightsOn
+        index: 2
+        x: 612
+        y: 7
+    }
+
+    Telltale {
+        id: hazardLightsImage
+        visible: window.hazardLightsOn
+        index: 3
+        x: 692
+        y: 7
+    }
+
+    Telltale {
+        id: turnLeftImage
+        visible: window.turnLeftOn
+        index: 4
+        x: 39
+        y: 77
+    }
+
+    Telltale {
+        id: turnRightImage
+        visible: window.turnRightOn
+        index: 5
+        x: 945
+        y: 77
+    }
+}
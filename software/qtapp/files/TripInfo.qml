@@ -0,0 +1,188 @@
+import QtQuick 2.15
+import QtQuick.Layouts 1.15
+
+// Trip, range, battery, clock, odometer and gear widgets. Loaded
+// asynchronously from main.qml after the first frame.
+Item {
+    anchors.fill: parent
+
+    Text {
+        id: tripText
+        text: "Trip"
+        x: 775
+        y: 190
+        color: "#EF4D7D"
+        font.family: myFont.name
+        font.pixelSize: 28
+        horizontalAlignment: Text.AlignLeft
+    }
+
+    Text {
+        text: window.trip.toFixed(1) + " KM"
+        x: 775
+        y: tripText.y + 38
+        color: "white"
+        font.family: myFont.name
+        font.pixelSize: 28
+        horizontalAlignment: Text.AlignLeft
+    }
+
+    Text {
+        id: distanceText
+        text: "Distance"
+        x: 775
+        y: 270
+        color: "#EF4D7D"
+        font.family: myFont.name
+        font.pixelSize: 28
+        horizontalAlignment: Text.AlignLeft
+    }
+
+    Text {
+        text: window.dte_km.toFixed(1) + " KM"
+        x: 775
+        y: distanceText.y + 38
+        color: "white"
+        font.family: myFont.name
+        font.pixelSize: 28
+        horizontalAlignment: Text.AlignLeft
+    }
+
+    Text {
+        id: tempText
+        text: "Temperature"
+        x: 775
+        y: 350
+        color: "#EF4D7D"
+        font.family: myFont.name
+        font.pixelSize: 28
+        horizontalAlignment: Text.AlignLeft
+    }
+
+    Text {
+        text: window.temp
+        x: 775
+        y: tempText.y + 38
+        color: "white"
+        font.family: myFont.name
+        font.pixelSize: 28
+        horizontalAlignment: Text.AlignLeft
+    }
+
+    Rectangle {
+        id: batRec
+        width: 64 * (window.battery / 100)
+        height: 24
+        x: 773
+        y: 557
+        radius: 3
+
+        color: {
+            if (window.battery > 50) return "#36c75b"
+            else if (window.battery > 20) return "#fbca0a"
+            else return "#f70e02"
+        }
+
+        Behavior on color {
+            ColorAnimation {
+                duration: 500
+            }
+        }
+    }
+
+    Rectangle {
+        id: batTextRec
+        width: 100
+        height: 45
+        x: 850
+        y: 556
+        color: "transparent"
+
+        Text {
+            id: batText
+            text: window.battery + "%"
+            color: "white"
+            font.family: myFont.name
+            font.pixelSize: 32
+            anchors.right: parent.right
+            horizontalAlignment: Text.AlignLeft
+        }
+    }
+
+    Text {
+        id: timeText
+        text: window.time
+        x: (window.width - timeText.width) / 2
+        y: 15
+        color: "white"
+        font.family: myFont.name
+        font.pixelSize: 32
+        horizontalAlignment: Text.AlignHCenter
+    }
+
+    Text {
+        id: dateText
+        text: window.date
+        x: 780
+        y: 21
+        color: "white"
+        font.family: myFont.name
+        font.pixelSize: 32
+        horizontalAlignment: Text.AlignHCenter
+    }
+
+    Text {
+        text: "ODO:"
+        x: 37
+        y: 21
+        color: "white"
+        font.family: myFont.name
+        font.pixelSize: 32
+        horizontalAlignment: Text.AlignHCenter
+    }
+
+    Rectangle {
+        id: odometerRec
+        width: 115
+        height: 50
+        x: 128
+        y: 21
+        color: "transparent"
+
+        Text {
+            id: odometerText
+            text: window.odometer.toFixed(0)
+            color: "white"
+            font.family: myFont.name
+            font.pixelSize: 32
+            anchors.right: parent.right
+            horizontalAlignment: Text.AlignRight
+        }
+    }
+
+    Rectangle {
+        id: gearRec
+        width: 202
+        height: 50
+        x: 65
+        y: 547
+        color: "transparent"
+
+        // Gear selector
+        RowLayout {
+            anchors.centerIn: parent
+            spacing: 20
+
+            Repeater {
+                model: ["P", "R", "N", "D"]
+                delegate: Text {
+                    text: modelData
+                    font.pixelSize: 32
+                    font.family: myFont.name
+                    color: window.gear === modelData ? "white" : "#AAAAAA"
+                    horizontalAlignment: Text.AlignRight
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,569 @@
+#include "canblackbox.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+#define CAN_BB_WRITER_NICE          19
+#define CAN_BB_POLL_MS              50
+
+CanBlackBox *signalTarget = nullptr;
+
+void onMarkSignal(int) {
+    if (signalTarget) signalTarget->mark();
+}
+
+int64_t realtimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+int64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void putU32(uint8_t *p, uint32_t v) { memcpy(p, &v, 4); }
+void putU64(uint8_t *p, uint64_t v) { memcpy(p, &v, 8); }
+uint32_t getU32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+uint64_t getU64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+size_t padded(size_t size) { return (size + 7U) & ~size_t(7U); }
+
+void writeFileHeader(uint8_t *header, uint32_t sequence, uint64_t fileSize, int64_t markerNs, uint32_t flags) {
+    memset(header, 0, CAN_BB_HEADER_SIZE);
+    memcpy(header, CAN_BB_MAGIC, CAN_BB_MAGIC_SIZE);
+    putU32(header + 8, CAN_BB_HEADER_SIZE);
+    putU32(header + 12, sequence);
+    putU64(header + 16, fileSize);
+    putU64(header + 24, uint64_t(realtimeNs()));
+    putU64(header + 32, uint64_t(markerNs));
+    putU32(header + 40, flags);
+}
+
+/*
+ * @brief Read and check the header of a black box file.
+ * @return false if fd does not hold one.
+ */
+bool readFileHeader(int fd, uint32_t &sequence, uint64_t &fileSize) {
+    uint8_t header[CAN_BB_HEADER_SIZE];
+    if (pread(fd, header, sizeof(header), 0) != ssize_t(sizeof(header))) return false;
+    if (memcmp(header, CAN_BB_MAGIC, CAN_BB_MAGIC_SIZE) != 0 || getU32(header + 8) != CAN_BB_HEADER_SIZE) return false;
+    sequence = getU32(header + 12);
+    fileSize = getU64(header + 16);
+    return true;
+}
+
+/*
+ * @brief A complete block found in a rotating file.
+ */
+struct BlockRef {
+    int fd;
+    uint64_t offset;
+    uint32_t size;              // Header and payload, padded
+    int64_t firstNs;
+};
+
+/*
+ * @brief List the blocks of a file that belong to its current sequence.
+ */
+void scanBlocks(int fd, std::vector<BlockRef> &blocks) {
+    uint32_t sequence;
+    uint64_t fileSize;
+    struct stat st;
+    if (!readFileHeader(fd, sequence, fileSize) || fstat(fd, &st) < 0) return;
+    fileSize = std::min<uint64_t>(fileSize, uint64_t(st.st_size));
+
+    uint64_t offset = CAN_BB_HEADER_SIZE;
+    uint8_t header[CAN_BB_BLOCK_HEADER_SIZE];
+    while (offset + CAN_BB_BLOCK_HEADER_SIZE <= fileSize &&
+           pread(fd, header, sizeof(header), off_t(offset)) == ssize_t(sizeof(header))) {
+        if (getU32(header) != CAN_BB_BLOCK_MAGIC || getU32(header + 4) != sequence) break;
+        const size_t size = padded(CAN_BB_BLOCK_HEADER_SIZE + getU32(header + 8));
+        if (offset + size > fileSize) break;
+        blocks.push_back({ fd, offset, uint32_t(size), int64_t(getU64(header + 24)) });
+        offset += size;
+    }
+}
+
+size_t putVarint(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = uint8_t(v) | 0x80;
+        v >>= 7;
+    }
+    p[n++] = uint8_t(v);
+    return n;
+}
+
+} // namespace
+
+CanBlackBoxEncoder::CanBlackBoxEncoder() {
+    m_records.reserve(CAN_BB_RAW_MAX);
+    m_raw.reserve(CAN_BB_RAW_MAX);
+}
+
+bool CanBlackBoxEncoder::add(const struct can_frame &frame, int64_t timestampNs) {
+    if (m_frames == CAN_BB_BLOCK_FRAMES) return false;
+    if (m_frames == 0) {
+        m_firstNs = timestampNs;
+        m_lastNs = timestampNs;
+    }
+
+    uint32_t index = 0;
+    while (index < m_idCount && m_ids[index] != frame.can_id) index++;
+    if (index == m_idCount && m_idCount < CAN_BB_ID_ESCAPE) {
+        m_ids[m_idCount++] = frame.can_id;
+    }
+
+    // Zigzag, so a clock stepped back costs bytes instead of corrupting the deltas
+    const int64_t delta = timestampNs - m_lastNs;
+    const uint64_t zigzag = (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+    m_lastNs = timestampNs;
+
+    uint8_t record[10 + 1 + 4 + 1 + CAN_MAX_DLEN];
+    size_t n = putVarint(record, zigzag);
+    if (index < m_idCount) {
+        record[n++] = uint8_t(index);
+    } else {
+        record[n++] = CAN_BB_ID_ESCAPE;
+        putU32(record + n, frame.can_id);
+        n += 4;
+    }
+    const uint8_t dlc = std::min<uint8_t>(frame.can_dlc, CAN_MAX_DLEN);
+    record[n++] = dlc;
+    memcpy(record + n, frame.data, dlc);
+    n += dlc;
+
+    m_records.insert(m_records.end(), record, record + n);
+    m_frames++;
+    return true;
+}
+
+bool CanBlackBoxEncoder::flush(uint32_t sequence, std::vector<uint8_t> &out) {
+    if (m_frames == 0) return false;
+
+    m_raw.clear();
+    m_raw.push_back(uint8_t(m_idCount));
+    for (uint32_t i = 0; i < m_idCount; i++) {
+        uint8_t id[4];
+        putU32(id, m_ids[i]);
+        m_raw.insert(m_raw.end(), id, id + 4);
+    }
+    m_raw.insert(m_raw.end(), m_records.begin(), m_records.end());
+
+    uLongf payload = compressBound(uLong(m_raw.size()));
+    out.resize(CAN_BB_BLOCK_HEADER_SIZE + payload);
+    const bool ok = compress2(out.data() + CAN_BB_BLOCK_HEADER_SIZE, &payload,
+                              m_raw.data(), uLong(m_raw.size()), Z_BEST_SPEED) == Z_OK;
+    if (ok) {
+        out.resize(padded(CAN_BB_BLOCK_HEADER_SIZE + payload), 0);
+        uint8_t *header = out.data();
+        putU32(header, CAN_BB_BLOCK_MAGIC);
+        putU32(header + 4, sequence);
+        putU32(header + 8, uint32_t(payload));
+        putU32(header + 12, uint32_t(m_raw.size()));
+        putU32(header + 16, m_frames);
+        putU32(header + 20, 0);
+        putU64(header + 24, uint64_t(m_firstNs));
+    }
+
+    m_records.clear();
+    m_idCount = 0;
+    m_frames = 0;
+    return ok;
+}
+
+CanBlackBoxReader::~CanBlackBoxReader() { close(); }
+
+bool CanBlackBoxReader::open(const std::string &path) {
+    close();
+    m_file = fopen(path.c_str(), "rb");
+    if (!m_file) {
+        m_error = path + ": " + strerror(errno);
+        return false;
+    }
+
+    uint8_t header[CAN_BB_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), m_file) != sizeof(header) ||
+        memcmp(header, CAN_BB_MAGIC, CAN_BB_MAGIC_SIZE) != 0 || getU32(header + 8) != CAN_BB_HEADER_SIZE) {
+        m_error = path + ": not a black box file";
+        close();
+        return false;
+    }
+    m_sequence = getU32(header + 12);
+    m_fileSize = getU64(header + 16);
+    m_markerNs = int64_t(getU64(header + 32));
+    m_flags = getU32(header + 40);
+    rewind();
+    return true;
+}
+
+void CanBlackBoxReader::close() {
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+void CanBlackBoxReader::rewind() {
+    if (!m_file) return;
+    fseek(m_file, CAN_BB_HEADER_SIZE, SEEK_SET);
+    m_frames.clear();
+    m_index = 0;
+}
+
+size_t CanBlackBoxReader::decodeBlock(const uint8_t *block, size_t available, uint32_t sequence,
+                                      std::vector<uint8_t> &raw, std::vector<CanBlackBoxEntry> &frames) {
+    frames.clear();
+    if (available < CAN_BB_BLOCK_HEADER_SIZE) return 0;
+    const uint32_t payloadSize = getU32(block + 8);
+    const uint32_t rawSize = getU32(block + 12);
+    const uint32_t count = getU32(block + 16);
+    if (getU32(block) != CAN_BB_BLOCK_MAGIC || getU32(block + 4) != sequence ||
+        CAN_BB_BLOCK_HEADER_SIZE + uint64_t(payloadSize) > available ||
+        rawSize == 0 || rawSize > CAN_BB_RAW_MAX || count > CAN_BB_BLOCK_FRAMES) {
+        return 0;
+    }
+
+    raw.resize(rawSize);
+    uLongf inflated = rawSize;
+    if (uncompress(raw.data(), &inflated, block + CAN_BB_BLOCK_HEADER_SIZE, payloadSize) != Z_OK ||
+        inflated != rawSize) {
+        return 0;
+    }
+
+    const uint8_t *p = raw.data();
+    const uint32_t idCount = p[0];
+    if (1U + 4U * idCount > rawSize) return 0;
+    uint32_t ids[CAN_BB_ID_ESCAPE];
+    for (uint32_t i = 0; i < idCount; i++) {
+        ids[i] = getU32(p + 1 + 4 * i);
+    }
+
+    size_t pos = 1 + 4 * idCount;
+    int64_t timestampNs = int64_t(getU64(block + 24));
+    frames.resize(count);
+    for (uint32_t n = 0; n < count; n++) {
+        uint64_t zigzag = 0;
+        for (unsigned shift = 0; pos < rawSize && shift < 64; shift += 7) {
+            const uint8_t byte = p[pos++];
+            zigzag |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        timestampNs += int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+
+        CanBlackBoxEntry &entry = frames[n];
+        memset(&entry.frame, 0, sizeof(entry.frame));
+        entry.timestampNs = timestampNs;
+        if (pos >= rawSize) return 0;
+        const uint8_t index = p[pos++];
+        if (index == CAN_BB_ID_ESCAPE) {
+            if (pos + 4 > rawSize) return 0;
+            entry.frame.can_id = getU32(p + pos);
+            pos += 4;
+        } else if (index < idCount) {
+            entry.frame.can_id = ids[index];
+        } else {
+            return 0;
+        }
+        if (pos >= rawSize) return 0;
+        entry.frame.can_dlc = std::min<uint8_t>(p[pos++], CAN_MAX_DLEN);
+        if (pos + entry.frame.can_dlc > rawSize) return 0;
+        memcpy(entry.frame.data, p + pos, entry.frame.can_dlc);
+        pos += entry.frame.can_dlc;
+    }
+    return std::min<size_t>(padded(CAN_BB_BLOCK_HEADER_SIZE + payloadSize), available);
+}
+
+bool CanBlackBoxReader::readBlock() {
+    uint8_t header[CAN_BB_BLOCK_HEADER_SIZE];
+    const long offset = ftell(m_file);
+    if (offset < 0 || uint64_t(offset) + sizeof(header) > m_fileSize ||
+        fread(header, 1, sizeof(header), m_file) != sizeof(header)) {
+        return false;
+    }
+    const uint64_t size = padded(CAN_BB_BLOCK_HEADER_SIZE + uint64_t(getU32(header + 8)));
+    if (uint64_t(offset) + size > m_fileSize) return false;
+
+    m_block.resize(size);
+    memcpy(m_block.data(), header, sizeof(header));
+    if (fread(m_block.data() + sizeof(header), 1, size - sizeof(header), m_file) != size - sizeof(header) ||
+        decodeBlock(m_block.data(), m_block.size(), m_sequence, m_raw, m_frames) == 0) {
+        return false;
+    }
+    m_index = 0;
+    return true;
+}
+
+bool CanBlackBoxReader::next(struct can_frame &frame, int64_t &timestampNs) {
+    if (!m_file) return false;
+    while (m_index == m_frames.size()) {
+        if (!readBlock()) return false;
+    }
+    frame = m_frames[m_index].frame;
+    timestampNs = m_frames[m_index].timestampNs;
+    m_index++;
+    return true;
+}
+
+CanBlackBox::~CanBlackBox() {
+    stop();
+}
+
+bool CanBlackBox::start(const Config &config) {
+    m_config = config;
+    m_config.files = std::max(2U, m_config.files);
+    m_config.fileMb = std::max(1U, m_config.fileMb);
+    m_fileSize = size_t(m_config.fileMb) << 20;
+    if (m_config.eventDir.empty()) m_config.eventDir = m_config.dir;
+
+    for (const std::string &dir : { m_config.dir, m_config.eventDir }) {
+        if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+            fprintf(stderr, "BLACKBOX: %s: %s\n", dir.c_str(), strerror(errno));
+            return false;
+        }
+    }
+
+    // Power of two, so the ring index is a mask
+    uint64_t capacity = 1024;
+    while (capacity < m_config.ringFrames) capacity <<= 1;
+    m_ring.assign(capacity, CanBlackBoxEntry());
+    m_ringMask = capacity - 1;
+
+    // Continue after the most recent rotating file, keeping what the previous run recorded
+    uint32_t lastSequence = 0;
+    for (unsigned i = 0; i < m_config.files; i++) {
+        const std::string path = m_config.dir + "/blackbox-" + std::to_string(i) + ".cbb";
+        m_paths.push_back(path);
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        uint32_t sequence;
+        uint64_t fileSize;
+        if (fd >= 0 && readFileHeader(fd, sequence, fileSize)) {
+            lastSequence = std::max(lastSequence, sequence);
+        }
+        if (fd >= 0) ::close(fd);
+    }
+    if (DIR *dir = opendir(m_config.eventDir.c_str())) {
+        while (struct dirent *entry = readdir(dir)) {
+            unsigned n;
+            if (sscanf(entry->d_name, "event-%u.cbb", &n) == 1) m_eventSequence = std::max(m_eventSequence, n);
+        }
+        closedir(dir);
+    }
+    if (!openFile(lastSequence + 1)) return false;
+
+    if (pipe(m_wakePipe) < 0) {
+        fprintf(stderr, "BLACKBOX: cannot create the wake pipe: %s\n", strerror(errno));
+        closeFile();
+        return false;
+    }
+    signalTarget = this;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onMarkSignal;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &sa, nullptr);
+
+    m_writer = std::thread(&CanBlackBox::writerLoop, this);
+    pthread_setname_np(m_writer.native_handle(), "BlackBox");
+    return true;
+}
+
+void CanBlackBox::stop() {
+    if (!m_writer.joinable()) return;
+    const char cmd = 'q';
+    if (write(m_wakePipe[1], &cmd, 1) == 1) {
+        m_writer.join();
+    } else {
+        m_writer.detach();
+        return;
+    }
+    signal(SIGUSR2, SIG_DFL);
+    signalTarget = nullptr;
+    ::close(m_wakePipe[0]);
+    ::close(m_wakePipe[1]);
+    m_wakePipe[0] = m_wakePipe[1] = -1;
+}
+
+void CanBlackBox::mark() {
+    const char cmd = 'm';
+    if (m_wakePipe[1] >= 0 && write(m_wakePipe[1], &cmd, 1) < 0) {
+        // Nothing to do in a signal handler; the mark is lost
+    }
+}
+
+/*
+ * @brief Create or reuse the rotating file of a sequence and map it.
+ */
+bool CanBlackBox::openFile(uint32_t sequence) {
+    const std::string &path = m_paths[sequence % m_config.files];
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, off_t(m_fileSize)) < 0) {
+        fprintf(stderr, "BLACKBOX: %s: %s\n", path.c_str(), strerror(errno));
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    void *map = mmap(nullptr, m_fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "BLACKBOX: cannot map %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    m_map = static_cast<uint8_t *>(map);
+    m_sequence = sequence;
+    m_offset = CAN_BB_HEADER_SIZE;
+    writeFileHeader(m_map, sequence, m_fileSize, 0, 0);
+    return true;
+}
+
+void CanBlackBox::closeFile() {
+    if (!m_map) return;
+    msync(m_map, m_fileSize, MS_SYNC);
+    munmap(m_map, m_fileSize);
+    m_map = nullptr;
+}
+
+void CanBlackBox::writerLoop() {
+    // Below everything else of the cluster; the ring absorbs the delay
+    setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), CAN_BB_WRITER_NICE);
+
+    struct pollfd pfd = { m_wakePipe[0], POLLIN, 0 };
+    bool running = true;
+    while (running) {
+        bool marked = false;
+        if (poll(&pfd, 1, CAN_BB_POLL_MS) > 0) {
+            char cmds[16];
+            const ssize_t n = read(m_wakePipe[0], cmds, sizeof(cmds));
+            for (ssize_t i = 0; i < n; i++) {
+                if (cmds[i] == 'q') running = false;
+                if (cmds[i] == 'm') marked = true;
+            }
+        }
+
+        drain();
+        if (!running || marked ||
+            (m_encoder.frames() && monotonicNs() - m_blockStartedNs >= int64_t(m_config.flushMs) * 1000000LL)) {
+            writeBlock();
+        }
+        if (marked) freeze();
+    }
+    closeFile();
+}
+
+/*
+ * @brief Move the frames committed by the RX thread into blocks.
+ */
+void CanBlackBox::drain() {
+    const uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    while (tail != head) {
+        const CanBlackBoxEntry &entry = m_ring[tail & m_ringMask];
+        if (!m_encoder.add(entry.frame, entry.timestampNs)) {
+            writeBlock();
+            m_encoder.add(entry.frame, entry.timestampNs);
+        }
+        if (m_encoder.frames() == 1) m_blockStartedNs = monotonicNs();
+        tail++;
+        // Hand slots back in batches so the RX thread does not wait for the whole drain
+        if ((tail & 255U) == 0) m_tail.store(tail, std::memory_order_release);
+    }
+    m_tail.store(tail, std::memory_order_release);
+}
+
+/*
+ * @brief Append the current block to the current file, rotating to the next
+ *        file when it does not fit.
+ */
+void CanBlackBox::writeBlock() {
+    const uint32_t frames = m_encoder.frames();
+    if (!m_map || !m_encoder.flush(m_sequence, m_block)) return;
+
+    if (m_offset + m_block.size() > m_fileSize) {
+        closeFile();
+        if (!openFile(m_sequence + 1)) return;
+        putU32(m_block.data() + 4, m_sequence);
+    }
+    // Payload first, so a block is only valid once complete
+    memcpy(m_map + m_offset + 4, m_block.data() + 4, m_block.size() - 4);
+    __atomic_store_n(reinterpret_cast<uint32_t *>(m_map + m_offset), CAN_BB_BLOCK_MAGIC, __ATOMIC_RELEASE);
+    m_offset += m_block.size();
+    m_written.fetch_add(frames, std::memory_order_relaxed);
+}
+
+/*
+ * @brief Copy the blocks of the pre-trigger window from the rotating files
+ *        into a new event file and drop the oldest event files over the limit.
+ */
+void CanBlackBox::freeze() {
+    const int64_t markerNs = realtimeNs();
+    const int64_t cutoffNs = markerNs - int64_t(m_config.preTriggerS) * 1000000000LL;
+
+    // Rotating files oldest first
+    std::vector<std::pair<uint32_t, int>> files;
+    for (const std::string &path : m_paths) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        uint32_t sequence;
+        uint64_t fileSize;
+        if (fd >= 0 && readFileHeader(fd, sequence, fileSize)) {
+            files.emplace_back(sequence, fd);
+        } else if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    std::sort(files.begin(), files.end());
+    std::vector<BlockRef> blocks;
+    for (const auto &file : files) scanBlocks(file.second, blocks);
+
+    // A block holds frames up to the start of the next one
+    size_t first = 0;
+    while (first + 1 < blocks.size() && blocks[first + 1].firstNs < cutoffNs) first++;
+
+    const uint32_t event = ++m_eventSequence;
+    const std::string path = m_config.eventDir + "/event-" + std::to_string(event) + ".cbb";
+    FILE *out = fopen(path.c_str(), "wb");
+    if (out) {
+        uint64_t fileSize = CAN_BB_HEADER_SIZE;
+        for (size_t i = first; i < blocks.size(); i++) fileSize += blocks[i].size;
+        uint8_t header[CAN_BB_HEADER_SIZE];
+        writeFileHeader(header, 1, fileSize, markerNs, CAN_BB_FLAG_EVENT);
+        bool ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+
+        std::vector<uint8_t> block;
+        for (size_t i = first; ok && i < blocks.size(); i++) {
+            block.resize(blocks[i].size);
+            ok = pread(blocks[i].fd, block.data(), block.size(), off_t(blocks[i].offset)) == ssize_t(block.size());
+            putU32(block.data() + 4, 1);
+            ok = ok && fwrite(block.data(), 1, block.size(), out) == block.size();
+        }
+        ok = fflush(out) == 0 && fsync(fileno(out)) == 0 && ok;
+        fclose(out);
+        fprintf(stderr, "BLACKBOX: %s %s (%zu blocks)\n", ok ? "froze" : "failed to write",
+                path.c_str(), blocks.size() - first);
+    } else {
+        fprintf(stderr, "BLACKBOX: %s: %s\n", path.c_str(), strerror(errno));
+    }
+    for (const auto &file : files) ::close(file.second);
+
+    if (event > m_config.events) {
+        const std::string old = m_config.eventDir + "/event-" + std::to_string(event - m_config.events) + ".cbb";
+        unlink(old.c_str());
+    }
+}
@@ -0,0 +1,248 @@
+#ifndef CANBLACKBOX_H
+#define CANBLACKBOX_H
+
+#include <linux/can.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Black box file (.cbb), little endian:
+ *   file header (64 bytes):
+ *     char magic[8] "CANBBX01", uint32 header size, uint32 sequence,
+ *     uint64 file size, int64 created (CLOCK_REALTIME ns), int64 marker (ns, event files),
+ *     uint32 flags, reserved
+ *   blocks, each 8-byte aligned:
+ *     block header (32 bytes): uint32 magic "BBLK", uint32 sequence (of the file),
+ *       uint32 payload size (deflated), uint32 raw size, uint32 frames, uint32 reserved,
+ *       int64 first timestamp (ns)
+ *     zlib payload, inflating to:
+ *       uint8 ID count, uint32 can_id[count]          dictionary of the block
+ *       per frame: varint timestamp delta (ns, from the previous frame or the block's first),
+ *                  uint8 ID index (CAN_BB_ID_ESCAPE: uint32 can_id follows),
+ *                  uint8 dlc, uint8 data[dlc]
+ * A block belongs to the file only if its sequence matches the header, so the
+ * blocks left over from the previous use of a rotated file are never read.
+ */
+#define CAN_BB_MAGIC                "CANBBX01"
+#define CAN_BB_MAGIC_SIZE           8U
+#define CAN_BB_HEADER_SIZE          64U
+#define CAN_BB_BLOCK_MAGIC          0x4B4C4242U     // "BBLK"
+#define CAN_BB_BLOCK_HEADER_SIZE    32U
+#define CAN_BB_BLOCK_FRAMES         4096U           // Frames per block at most
+#define CAN_BB_ID_ESCAPE            0xFFU           // Dictionary full, ID stored inline
+#define CAN_BB_RAW_MAX              (1U + 4U * CAN_BB_ID_ESCAPE + CAN_BB_BLOCK_FRAMES * (10U + 1U + 4U + 1U + CAN_MAX_DLEN))
+#define CAN_BB_FLAG_EVENT           0x1U            // Frozen pre-trigger window
+
+#define CAN_BB_DEFAULT_DIR          "/run/qtapp/blackbox"       // Rotating files, tmpfs
+#define CAN_BB_DEFAULT_EVENT_DIR    "/var/lib/qtapp/blackbox"   // Event files, persistent
+
+/*
+ * @brief One frame in the recorder ring, with its kernel receive time
+ *        (CLOCK_REALTIME, SO_TIMESTAMPNS).
+ */
+struct CanBlackBoxEntry {
+    struct can_frame frame;
+    int64_t timestampNs;
+};
+
+/*
+ * @brief Builds one block of frames: delta timestamps, ID dictionary, deflate.
+ */
+class CanBlackBoxEncoder {
+public:
+    CanBlackBoxEncoder();
+
+    /*
+     * @brief Add a frame.
+     * @return false if the block is full; flush it and add the frame again.
+     */
+    bool add(const struct can_frame &frame, int64_t timestampNs);
+
+    /*
+     * @brief Compress the frames added so far into a complete block and start
+     *        a new one.
+     * @param sequence: The sequence of the file the block is written to.
+     * @param out: Receives the block header and payload, padded to 8 bytes.
+     * @return false if the block is empty or cannot be compressed.
+     */
+    bool flush(uint32_t sequence, std::vector<uint8_t> &out);
+
+    uint32_t frames() const { return m_frames; }
+
+private:
+    std::vector<uint8_t> m_records;
+    std::vector<uint8_t> m_raw;
+    uint32_t m_ids[CAN_BB_ID_ESCAPE];
+    uint32_t m_idCount = 0;
+    uint32_t m_frames = 0;
+    int64_t m_firstNs = 0;
+    int64_t m_lastNs = 0;
+};
+
+/*
+ * @brief Sequential reader of a black box file.
+ */
+class CanBlackBoxReader {
+public:
+    CanBlackBoxReader() = default;
+    ~CanBlackBoxReader();
+    CanBlackBoxReader(const CanBlackBoxReader &) = delete;
+    CanBlackBoxReader &operator=(const CanBlackBoxReader &) = delete;
+
+    /*
+     * @brief Open a file.
+     * @return false if it is not a black box file.
+     */
+    bool open(const std::string &path);
+    void close();
+    void rewind();
+
+    /*
+     * @brief Read the next frame.
+     * @return false after the last valid block.
+     */
+    bool next(struct can_frame &frame, int64_t &timestampNs);
+
+    uint32_t sequence() const { return m_sequence; }
+    uint32_t flags() const { return m_flags; }
+    int64_t markerNs() const { return m_markerNs; }
+    const std::string &error() const { return m_error; }
+
+    /*
+     * @brief Decode one block held in memory.
+     * @param block: Start of the block header.
+     * @param available: Bytes readable from block.
+     * @param sequence: Sequence of the file holding the block.
+     * @param raw: Scratch buffer for the inflated payload.
+     * @param frames: Receives the frames of the block.
+     * @return Size of the block including padding, 0 if there is no valid block.
+     */
+    static size_t decodeBlock(const uint8_t *block, size_t available, uint32_t sequence,
+                              std::vector<uint8_t> &raw, std::vector<CanBlackBoxEntry> &frames);
+
+private:
+    bool readBlock();
+
+    FILE *m_file = nullptr;
+    uint32_t m_sequence = 0;
+    uint32_t m_flags = 0;
+    int64_t m_markerNs = 0;
+    uint64_t m_fileSize = 0;
+    std::vector<uint8_t> m_block;
+    std::vector<uint8_t> m_raw;
+    std::vector<CanBlackBoxEntry> m_frames;
+    size_t m_index = 0;
+    std::string m_error;
+};
+
+/*
+ * @brief In-process black box recorder of the received CAN frames.
+ *
+ * The RX thread receives each frame directly into a slot of a single
+ * producer ring (rxSlot() / commit()), so recording costs it no copy and no
+ * system call. A low-priority writer thread drains the ring into blocks and
+ * appends them to a fixed set of rotating memory-mapped files, which bounds
+ * the space used. mark() freezes the last pre-trigger seconds into an event
+ * file that rotation does not touch; SIGUSR2 does the same. The rotating
+ * files are meant for a tmpfs and only the event files for flash, so the
+ * continuous recording does not wear the storage.
+ */
+class CanBlackBox {
+public:
+    struct Config {
+        std::string dir;                    // Rotating files
+        std::string eventDir;               // Event files, dir if empty
+        unsigned files = 4;                 // Rotating files
+        unsigned fileMb = 1;                // Size of each file
+        unsigned ringFrames = 65536;        // RX ring, rounded up to a power of two
+        unsigned preTriggerS = 60;          // Window frozen by mark()
+        unsigned events = 10;               // Event files kept
+        unsigned flushMs = 1000;            // Longest time a frame waits for its block
+    };
+
+    CanBlackBox() = default;
+    ~CanBlackBox();
+    CanBlackBox(const CanBlackBox &) = delete;
+    CanBlackBox &operator=(const CanBlackBox &) = delete;
+
+    /*
+     * @brief Open the rotating files in config.dir, continuing after the most
+     *        recent one, and start the writer thread. Event files are numbered
+     *        on from the newest one in config.eventDir.
+     * @return false if the directory or the files cannot be used.
+     */
+    bool start(const Config &config);
+
+    /*
+     * @brief Write the pending frames and stop the writer thread.
+     */
+    void stop();
+
+    /*
+     * @brief Freeze the pre-trigger window into an event file. Async-signal-safe.
+     */
+    void mark();
+
+    /*
+     * @brief The frame buffer the RX thread receives the next frame into.
+     *        When the ring is full it is a scratch buffer and the frame is
+     *        counted as dropped on commit().
+     */
+    struct can_frame *rxSlot() {
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        m_slotInRing = head - m_tail.load(std::memory_order_acquire) < m_ringMask + 1;
+        return m_slotInRing ? &m_ring[head & m_ringMask].frame : &m_scratch.frame;
+    }
+
+    /*
+     * @brief Publish the frame received into rxSlot().
+     */
+    void commit(int64_t timestampNs) {
+        if (!m_slotInRing) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        m_ring[head & m_ringMask].timestampNs = timestampNs;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    uint64_t frames() const { return m_written.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    bool openFile(uint32_t sequence);
+    void closeFile();
+    void writerLoop();
+    void drain();
+    void writeBlock();
+    void freeze();
+
+    Config m_config;
+    std::vector<CanBlackBoxEntry> m_ring;
+    uint64_t m_ringMask = 0;
+    std::atomic<uint64_t> m_head{0};                // Written by the RX thread
+    std::atomic<uint64_t> m_tail{0};                // Written by the writer thread
+    CanBlackBoxEntry m_scratch;
+    bool m_slotInRing = false;
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_written{0};
+
+    std::vector<std::string> m_paths;               // Rotating files, sequence % files
+    size_t m_fileSize = 0;
+    uint8_t *m_map = nullptr;                       // File being written
+    uint32_t m_sequence = 0;
+    size_t m_offset = 0;
+    uint32_t m_eventSequence = 0;
+    CanBlackBoxEncoder m_encoder;
+    std::vector<uint8_t> m_block;
+    int64_t m_blockStartedNs = 0;
+    int m_wakePipe[2] = { -1, -1 };
+    std::thread m_writer;
+};
+
+#endif // CANBLACKBOX_H
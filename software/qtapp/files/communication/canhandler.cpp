@@ -1,12 +1,24 @@
 #include "canhandler.h"
+#include "canblackbox.h"
+#include "canlog.h"
+#include "../diagnostics/boottrace.h"
+#include "../diagnostics/log.h"
+#include "../diagnostics/metrics.h"
+#include "../diagnostics/trace.h"
 #include <linux/can.h>
 #include <linux/can/raw.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <net/if.h>
 #include <unistd.h>
 #include <cstring>
+#include <cerrno>
+#include <time.h>
 #include <QDebug>
+#include <algorithm>
+#include <cstdlib>
 
 digInSignal digInput;
 digOutSignal digOutput;
@@ -14,6 +26,13 @@ analogInSignal analogInput;
 uint64_t softTimer = 0;
 uint16_t tick500ms = 0;
 uint16_t prevTick500ms = 0xFFFF;
+
+static inline int64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
 /*
  * @brief Load the IO configuration from a JSON file.
  * @param path: The path to the JSON file containing the IO configuration.
@@ -66,6 +85,22 @@ IOConfig loadIOConfig(const QString& path) {
     return config;
 }
 
+/*
+ * @brief Resolve the input names of an IO configuration for canDecodeFrame().
+ * @param config: The IO configuration.
+ * @return The signal map, in configuration order.
+ */
+CanSignalMap buildSignalMap(const IOConfig &config) {
+    CanSignalMap map;
+    for (auto it = config.digInputs.constBegin(); it != config.digInputs.constEnd(); ++it) {
+        map.digInputs.push_back({ canSignalFromName(it.key().toLatin1().constData()), static_cast<uint8_t>(it.value()) });
+    }
+    for (auto it = config.analogInputs.constBegin(); it != config.analogInputs.constEnd(); ++it) {
+        map.analogInputs.push_back({ canSignalFromName(it.key().toLatin1().constData()), static_cast<uint8_t>(it.value()) });
+    }
+    return map;
+}
+
 CanTxThread::CanTxThread(QObject *parent)
         : QThread(parent), m_socket(-1), m_running(false) {}
 
@@ -74,6 +109,8 @@ CanTxThread::~CanTxThread() { stop(); }
 void CanTxThread::enqueueMessage(const struct can_frame &frame) {
     QMutexLocker locker(&m_mutex);
     m_queue.enqueue(frame);
+    m_stats.queueDepth.store(m_queue.size(), std::memory_order_relaxed);
+    Trace::counter(TRACE_TX_QUEUE, m_queue.size());
 }
 
 void CanTxThread::stop() {
@@ -92,16 +129,13 @@ void CanTxThread::stop() {
 void CanTxThread::run() {
     struct sockaddr_can addr;
     struct ifreq ifr;
-    struct can_frame txFrame;
 
-    txFrame.can_dlc = BYTES_PER_CAN_FRAME;
-    
     m_socket = socket(PF_CAN, SOCK_RAW, CAN_RAW);
     if (m_socket < 0) {
         qWarning() << "TX: Error opening CAN socket";
         return;
     }
-    strcpy(ifr.ifr_name, "can0");
+    strcpy(ifr.ifr_name, m_stats.interfaceName);
     if (ioctl(m_socket, SIOCGIFINDEX, &ifr) < 0) {
         qWarning() << "TX: Fail to specify CAN interface";
         return;
@@ -111,87 +145,61 @@ void CanTxThread::run() {
     if (bind(m_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
         qWarning() << "TX: Error binding CAN socket";
         close(m_socket);
+        m_socket = -1;
         return;
     }
 
+    int64_t lastPhaseNs = 0;
+    uint16_t lastPhaseTick = 0;
+
     m_running = true;
     while (m_running) {
         if (tick500ms != prevTick500ms) {
-            if (digOutput.left_front_light && digOutput.left_rear_light) {
-                bool on = (tick500ms % 2 == 0);
-                uint8_t left_front_val = on ? (0xC8 | digOutput.left_front_light) : 0xC8;
-                uint8_t left_rear_val  = on ? (0xC8 | digOutput.left_rear_light)  : 0xC8;
-
-                // Left front light frame
-                txFrame.can_id = DIGITAL_OUTPUT_CMD_ID(digOutput.left_front_light_pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
-                memset(txFrame.data, 0, sizeof(txFrame.data));
-                txFrame.data[digOutput.left_front_light_pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] = left_front_val;
-                enqueueMessage(txFrame);
-
-                // Left rear light frame
-                txFrame.can_id = DIGITAL_OUTPUT_CMD_ID(digOutput.left_rear_light_pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
-                memset(txFrame.data, 0, sizeof(txFrame.data));
-                txFrame.data[digOutput.left_rear_light_pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] = left_rear_val;
-                enqueueMessage(txFrame);
+            Trace::Scope lamps(TRACE_TX_LAMPS);
+            bool on = (tick500ms % 2 == 0);
+            if (Metrics::enabled) {
+                // Only consecutive phases; an input edge restarts the blink
+                const int64_t now = monotonicNs();
+                if (lastPhaseNs && tick500ms == uint16_t(lastPhaseTick + 1)) {
+                    Metrics::txBlinkJitter.record(std::llabs(now - lastPhaseNs - 500000000LL));
+                }
+                lastPhaseNs = now;
+                lastPhaseTick = tick500ms;
+            }
+            struct can_frame frames[LAMP_FRAMES_MAX];
+            const int count = canEncodeLampFrames(digOutput, on, frames);
+            lamps.setArgs(count, on);
+            for (int i = 0; i < count; i++) {
+                enqueueMessage(frames[i]);
+            }
 
+            if (digOutput.left_front_light && digOutput.left_rear_light) {
                 if (digInput.hazard_switch) {
+                    Trace::flowOut(TRACE_SIG_HAZARD_LIGHTS);
                     emit hazardLightsChanged(on);
                 } else if (digInput.turn_left_switch) {
+                    Trace::flowOut(TRACE_SIG_LEFT_LIGHT);
                     emit leftLightChanged(on);
                 }
             } else if (digOutput.left_front_light == false && digOutput.left_rear_light == false) {
-                // Left front light frame
-                txFrame.can_id = DIGITAL_OUTPUT_CMD_ID(digOutput.left_front_light_pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
-                memset(txFrame.data, 0, sizeof(txFrame.data));
-                txFrame.data[digOutput.left_front_light_pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] = 0xC8;
-                enqueueMessage(txFrame);
-
-                // Left rear light frame
-                txFrame.can_id = DIGITAL_OUTPUT_CMD_ID(digOutput.left_rear_light_pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
-                memset(txFrame.data, 0, sizeof(txFrame.data));
-                txFrame.data[digOutput.left_rear_light_pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] = 0xC8;
-                enqueueMessage(txFrame);
-
+                Trace::flowOut(TRACE_SIG_HAZARD_LIGHTS);
                 emit hazardLightsChanged(false);
+                Trace::flowOut(TRACE_SIG_LEFT_LIGHT);
                 emit leftLightChanged(false);
             }
-            
-            if (digOutput.right_front_light && digOutput.right_rear_light) {
-                bool on = (tick500ms % 2 == 0);
-                uint8_t right_front_val = on ? (0xC8 | digOutput.right_front_light) : 0xC8;
-                uint8_t right_rear_val  = on ? (0xC8 | digOutput.right_rear_light)  : 0xC8;
-
-                // Right front light frame
-                txFrame.can_id = DIGITAL_OUTPUT_CMD_ID(digOutput.right_front_light_pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
-                memset(txFrame.data, 0, sizeof(txFrame.data));
-                txFrame.data[digOutput.right_front_light_pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] = right_front_val;
-                enqueueMessage(txFrame);
-
-                // Right rear light frame
-                txFrame.can_id = DIGITAL_OUTPUT_CMD_ID(digOutput.right_rear_light_pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
-                memset(txFrame.data, 0, sizeof(txFrame.data));
-                txFrame.data[digOutput.right_rear_light_pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] = right_rear_val;
-                enqueueMessage(txFrame);
 
+            if (digOutput.right_front_light && digOutput.right_rear_light) {
                 if (digInput.hazard_switch) {
+                    Trace::flowOut(TRACE_SIG_HAZARD_LIGHTS);
                     emit hazardLightsChanged(on);
                 } else if (digInput.turn_right_switch) {
+                    Trace::flowOut(TRACE_SIG_RIGHT_LIGHT);
                     emit rightLightChanged(on);
                 }
             } else if (digOutput.right_front_light == false && digOutput.right_rear_light == false) {
-                // Right front light frame
-                txFrame.can_id = DIGITAL_OUTPUT_CMD_ID(digOutput.right_front_light_pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
-                memset(txFrame.data, 0, sizeof(txFrame.data));
-                txFrame.data[digOutput.right_front_light_pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] = 0xC8;
-                enqueueMessage(txFrame);
-
-                // Right rear light frame
-                txFrame.can_id = DIGITAL_OUTPUT_CMD_ID(digOutput.right_rear_light_pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
-                memset(txFrame.data, 0, sizeof(txFrame.data));
-                txFrame.data[digOutput.right_rear_light_pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] = 0xC8;
-                enqueueMessage(txFrame);
-
+                Trace::flowOut(TRACE_SIG_HAZARD_LIGHTS);
                 emit hazardLightsChanged(false);
+                Trace::flowOut(TRACE_SIG_RIGHT_LIGHT);
                 emit rightLightChanged(false);
             }
 
@@ -202,11 +210,23 @@ void CanTxThread::run() {
         m_mutex.lock();
         while (!m_queue.isEmpty()) {
             struct can_frame frame = m_queue.dequeue();
+            m_stats.queueDepth.store(m_queue.size(), std::memory_order_relaxed);
+            Trace::counter(TRACE_TX_QUEUE, m_queue.size());
             m_mutex.unlock();
 
-            int nbytes = write(m_socket, &frame, sizeof(frame));
+            int nbytes;
+            {
+                Trace::Scope writeSpan(TRACE_TX_WRITE);
+                writeSpan.setArgs(frame.can_id);
+                nbytes = write(m_socket, &frame, sizeof(frame));
+            }
             if (nbytes < 0) {
-                qWarning() << "TX: Error writing CAN frame:" << strerror(errno);
+                m_stats.errors.fetch_add(1, std::memory_order_relaxed);
+                // Rate limited: a bus-off fails every write
+                QTAPP_LOG_WARNING(LOG_CAT_CAN_TX, "TX: Error writing CAN frame: %s", strerror(errno));
+            } else {
+                m_stats.frames.fetch_add(1, std::memory_order_relaxed);
+                if (Metrics::enabled) Metrics::txFrames.add(frame.can_id);
             }
 
             m_mutex.lock();
@@ -214,17 +234,26 @@ void CanTxThread::run() {
         m_mutex.unlock();
     }
     close(m_socket);
+    m_socket = -1;
 }
 
 CanRxThread::CanRxThread(QObject *parent)
-        : QThread(parent), m_socket(-1), m_running(false) {}
+        : QThread(parent), m_socket(-1), m_wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)), m_running(false) {}
 
 CanRxThread::~CanRxThread() {
     stop();
+    if (m_wakeFd >= 0) {
+        close(m_wakeFd);
+    }
 }
 
 void CanRxThread::stop() {
     m_running = false;
+    // The thread may be waiting for a frame on a quiet bus
+    const uint64_t one = 1;
+    if (m_wakeFd >= 0 && write(m_wakeFd, &one, sizeof(one)) < 0) {
+        qWarning("RX: cannot wake the receive thread: %s", strerror(errno));
+    }
     wait();
 
     if (m_socket >= 0) {
@@ -233,21 +262,66 @@ void CanRxThread::stop() {
     }
 }
 
+/*
+ * @brief Decode one received frame into the input state, update the lamp
+ *        selection and emit the changed signals.
+ * @param map: The resolved IO configuration.
+ * @param rx_frame: The received CAN frame.
+ * @param prevInput: The input state after the previous frame, for edge detection.
+ * @return Number of signals emitted towards the UI.
+ */
+int CanRxThread::decodeFrame(const CanSignalMap &map, const struct can_frame &rx_frame, const digInSignal &prevInput) {
+    Trace::Scope decode(TRACE_RX_DECODE);
+    const uint32_t changed = canDecodeFrame(map, rx_frame, digInput, analogInput);
+    int updates = 0;
+    decode.setArgs(rx_frame.can_id, changed);
+
+    if (changed & CAN_SIGNAL_BIT(CAN_SIGNAL_IGNITION)) {
+        QTAPP_LOG_DEBUG(LOG_CAT_CAN_RX, "Ignition status changed: %d", digInput.ignition);
+    }
+    if (changed & CAN_SIGNAL_BIT(CAN_SIGNAL_HIGH_BEAM)) {
+        Trace::flowOut(TRACE_SIG_HIGH_BEAM);
+        emit highBeamChanged(digInput.high_beam_switch);
+        updates++;
+    }
+    if (changed & CAN_SIGNAL_BIT(CAN_SIGNAL_LOW_BEAM)) {
+        Trace::flowOut(TRACE_SIG_LOW_BEAM);
+        emit lowBeamChanged(digInput.low_beam_switch);
+        updates++;
+    }
+    if (changed & CAN_SIGNAL_BIT(CAN_SIGNAL_PARKING_LIGHTS)) {
+        Trace::flowOut(TRACE_SIG_PARKING_LIGHTS);
+        emit parkingLightsChanged(digInput.parking_lights_switch);
+        updates++;
+    }
+    if (changed & CAN_SIGNAL_BIT(CAN_SIGNAL_SPEED)) {
+        Trace::flowOut(TRACE_SIG_SPEED);
+        emit speedSampled(analogInput.speed, monotonicNs());
+        updates++;
+    }
+
+    if (canUpdateLighting(digInput, prevInput, digOutput)) {
+        softTimer = 0;
+        tick500ms = 0;
+        prevTick500ms = 0xFFFF;
+    }
+
+    return updates;
+}
+
 void CanRxThread::run() {
     struct sockaddr_can addr;
     struct ifreq ifr;
     struct can_frame rx_frame;
     digInSignal prevInput;
     uint8_t signalIdx = 0xFF;
-    uint32_t signalCANID = 0;
-    uint8_t signal_value = 0;
-    int analogValue = 0;
 
     IOConfig config = loadIOConfig("io_configs/io_config.json"); // Load the IO configuration from a JSON file
     if (config.digInputs.isEmpty() || config.analogInputs.isEmpty() || config.digOutputs.isEmpty()) {
         qWarning() << "Failed to load IO configuration.";
         return; // Exit if configuration loading fails
     }
+    BootTrace::mark("IO configuration loaded");
 
     for (auto it = config.digOutputs.constBegin(); it != config.digOutputs.constEnd(); ++it) {
         signalIdx = static_cast<uint8_t>(it.value());
@@ -266,12 +340,19 @@ void CanRxThread::run() {
         }
     }
 
+    const CanSignalMap signalMap = buildSignalMap(config);
+
+    if (!m_replayPath.isEmpty()) {
+        runReplay(signalMap);
+        return;
+    }
+
     m_socket = socket(PF_CAN, SOCK_RAW, CAN_RAW);
     if (m_socket < 0) {
         qWarning() << "RX: Error opening CAN socket";
         return;
     }
-    strcpy(ifr.ifr_name, "can0");
+    strcpy(ifr.ifr_name, m_stats.interfaceName);
     if (ioctl(m_socket, SIOCGIFINDEX, &ifr) < 0) {
         qWarning() << "RX: Fail to specify CAN interface";
         return;
@@ -281,140 +362,145 @@ void CanRxThread::run() {
     if (bind(m_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
         qWarning() << "RX: Error binding CAN socket";
         close(m_socket);
+        m_socket = -1;
         return;
     }
+    BootTrace::mark("CAN RX socket bound");
+
+    // Ask the kernel for the socket drop counter with every frame, and for the
+    // receive time when recording
+    int enable = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+    if (m_blackBox) {
+        setsockopt(m_socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+    }
+
+    struct iovec iov;
+    struct msghdr msg;
+    char ctrl[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct timespec))];
+    struct pollfd fds[2] = {
+        { m_socket, POLLIN, 0 },
+        { m_wakeFd, POLLIN, 0 },
+    };
 
     m_running = true;
     while (m_running) {
-        int nbytes = read(m_socket, &rx_frame, sizeof(struct can_frame));
+        // Sleep until a frame arrives or stop() signals the wake eventfd
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            QTAPP_LOG_WARNING(LOG_CAT_CAN_RX, "RX: Error waiting for CAN frames: %s", strerror(errno));
+            break;
+        }
+        if (fds[1].revents) break;
+        if (!fds[0].revents) continue;
+
+        // Recorded frames are received into the black box ring and decoded there
+        struct can_frame *frame = m_blackBox ? m_blackBox->rxSlot() : &rx_frame;
+        iov.iov_base = frame;
+        iov.iov_len = sizeof(struct can_frame);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        int nbytes;
+        {
+            Trace::Scope read(TRACE_RX_READ);
+            nbytes = recvmsg(m_socket, &msg, 0);
+            if (nbytes > 0) read.setArgs(frame->can_id);
+        }
         if (nbytes > 0) {
-            // Check for input responses
-            for (auto it = config.digInputs.constBegin(); it != config.digInputs.constEnd(); ++it) {
-                signalIdx = static_cast<uint8_t>(it.value());
-                if (it.key() == "ignition") {
-                    signalCANID = DIGITAL_INPUT_RES_ID(signalIdx / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
-                    signal_value = rx_frame.data[signalIdx % DIGITAL_IN_RESP_SIGNAL_PER_FRAME] & 0x01;
-                    if (rx_frame.can_id == signalCANID) {
-                        if (digInput.ignition != signal_value) {
-                            digInput.ignition = signal_value;
-                            qDebug() << "Ignition status changed:" << digInput.ignition;
-                        }
-                    }
-                }
-                else if (it.key() == "turn_left_switch") {
-                    if (digInput.ignition == false) continue;
-                    signalCANID = DIGITAL_INPUT_RES_ID(signalIdx / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
-                    signal_value = rx_frame.data[signalIdx % DIGITAL_IN_RESP_SIGNAL_PER_FRAME] & 0x01;
-                    if (rx_frame.can_id == signalCANID) {
-                        if (digInput.turn_left_switch != signal_value) {
-                            digInput.turn_left_switch = signal_value;
-                        }
-                    }
-                } else if (it.key() == "turn_right_switch") {
-                    if (digInput.ignition == false) continue;
-                    signalCANID = DIGITAL_INPUT_RES_ID(signalIdx / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
-                    signal_value = rx_frame.data[signalIdx % DIGITAL_IN_RESP_SIGNAL_PER_FRAME] & 0x01;
-                    if (rx_frame.can_id == signalCANID) {
-                        if (digInput.turn_right_switch != signal_value) {
-                            digInput.turn_right_switch = signal_value;
-                        }
-                    }
-                } else if (it.key() == "hazard_switch") {
-                    if (digInput.ignition == false) continue;
-                    signalCANID = DIGITAL_INPUT_RES_ID(signalIdx / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
-                    signal_value = rx_frame.data[signalIdx % DIGITAL_IN_RESP_SIGNAL_PER_FRAME] & 0x01;
-                    if (rx_frame.can_id == signalCANID) {
-                        if (digInput.hazard_switch != signal_value) {
-                            digInput.hazard_switch = signal_value;
-                        }
-                    }
-                } else if (it.key() == "high_beam_switch") {
-                    if (digInput.ignition == false) continue;
-                    signalCANID = DIGITAL_INPUT_RES_ID(signalIdx / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
-                    signal_value = rx_frame.data[signalIdx % DIGITAL_IN_RESP_SIGNAL_PER_FRAME] & 0x01;
-                    if (rx_frame.can_id == signalCANID) {
-                        if (digInput.high_beam_switch != signal_value) {
-                            digInput.high_beam_switch = signal_value;
-                            emit highBeamChanged(digInput.high_beam_switch);
-                        }
-                    }
-                } else if (it.key() == "low_beam_switch") {
-                    if (digInput.ignition == false) continue;
-                    signalCANID = DIGITAL_INPUT_RES_ID(signalIdx / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
-                    signal_value = rx_frame.data[signalIdx % DIGITAL_IN_RESP_SIGNAL_PER_FRAME] & 0x01;
-                    if (rx_frame.can_id == signalCANID) {
-                        if (digInput.low_beam_switch != signal_value) {
-                            digInput.low_beam_switch = signal_value;
-                            emit lowBeamChanged(digInput.low_beam_switch);
-                        }
-                    }
-                } else if (it.key() == "parking_lights_switch") {
-                    if (digInput.ignition == false) continue;
-                    signalCANID = DIGITAL_INPUT_RES_ID(signalIdx / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
-                    signal_value = rx_frame.data[signalIdx % DIGITAL_IN_RESP_SIGNAL_PER_FRAME] & 0x01;
-                    if (rx_frame.can_id == signalCANID) {
-                        if (digInput.parking_lights_switch != signal_value) {
-                            digInput.parking_lights_switch = signal_value;
-                            emit parkingLightsChanged(digInput.parking_lights_switch);
-                        }
-                    }
-                }
-
-                if (digInput.hazard_switch && digInput.hazard_switch != prevInput.hazard_switch) {
-                    softTimer = 0;
-                    tick500ms = 0;
-                    prevTick500ms = 0xFFFF;
-                    digOutput.left_front_light = true;
-                    digOutput.left_rear_light = true;
-                    digOutput.right_front_light = true;
-                    digOutput.right_rear_light = true;
-                } else if (digInput.turn_left_switch && digInput.turn_left_switch != prevInput.turn_left_switch) {
-                    softTimer = 0;
-                    tick500ms = 0;
-                    prevTick500ms = 0xFFFF;
-                    digOutput.left_front_light = true;
-                    digOutput.left_rear_light = true;
-                    digOutput.right_front_light = false;
-                    digOutput.right_rear_light = false;
-                } else if (digInput.turn_right_switch && digInput.turn_right_switch != prevInput.turn_right_switch) {
-                    softTimer = 0;
-                    tick500ms = 0;
-                    prevTick500ms = 0xFFFF;
-                    digOutput.left_front_light = false;
-                    digOutput.left_rear_light = false;
-                    digOutput.right_front_light = true;
-                    digOutput.right_rear_light = true;
-                } else if ((digInput.hazard_switch == false && digInput.turn_left_switch == false && digInput.turn_right_switch == false) && 
-                           (prevInput.hazard_switch || prevInput.turn_left_switch || prevInput.turn_right_switch)) {
-                    softTimer = 0;
-                    tick500ms = 0;
-                    prevTick500ms = 0xFFFF;
-                    digOutput.left_front_light = false;
-                    digOutput.left_rear_light = false;
-                    digOutput.right_front_light = false;
-                    digOutput.right_rear_light = false;
+            const int64_t decodeStart = m_stats.timing ? monotonicNs() : 0;
+            m_stats.frames.fetch_add(1, std::memory_order_relaxed);
+            int64_t receivedNs = 0;
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+                    uint32_t drops;
+                    memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                    m_stats.overflows.store(drops, std::memory_order_relaxed);
+                } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                    struct timespec ts;
+                    memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                    receivedNs = int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
                 }
             }
 
-            for (auto it = config.analogInputs.constBegin(); it != config.analogInputs.constEnd(); ++it) {
-                signalIdx = static_cast<uint8_t>(it.value()) * 2;
-                if (it.key() == "speed") {
-                    signalCANID = ANALOG_INPUT_RES_ID(signalIdx / ANALOG_IN_RESP_SIGNAL_PER_FRAME);
-                    analogValue = ((rx_frame.data[(signalIdx % ANALOG_IN_RESP_SIGNAL_PER_FRAME) + 1] & 0xCF) << 8) | (rx_frame.data[signalIdx % ANALOG_IN_RESP_SIGNAL_PER_FRAME] & 0xFF);
-                    if (rx_frame.can_id == signalCANID) {
-                        if (analogInput.speed != analogValue) {
-                            analogInput.speed = analogValue;
-                            // qDebug() << "Speed status changed:" << analogInput.speed;
-                            emit speedChanged(analogInput.speed);
-                        }
-                    }
+            const int updates = decodeFrame(signalMap, *frame, prevInput);
+
+            if (m_stats.timing) {
+                const int64_t decodeNs = monotonicNs() - decodeStart;
+                m_stats.decodeNs.fetch_add(decodeNs, std::memory_order_relaxed);
+                if (Metrics::enabled) Metrics::rxDecode.record(decodeNs);
+            }
+            if (Metrics::enabled) {
+                Metrics::rxFrames.add(frame->can_id);
+                if (updates > 0) Metrics::inputChanged(decodeStart);
+            }
+            if (m_blackBox) {
+                if (receivedNs == 0) {
+                    struct timespec ts;
+                    clock_gettime(CLOCK_REALTIME, &ts);
+                    receivedNs = int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
                 }
+                m_blackBox->commit(receivedNs);
             }
+        } else if (nbytes < 0 && errno != EINTR) {
+            QTAPP_LOG_WARNING(LOG_CAT_CAN_RX, "RX: Error reading CAN frame: %s", strerror(errno));
         }
 
         memcpy(&prevInput, &digInput, sizeof(digInSignal));
     }
     close(m_socket);
+    m_socket = -1;
+}
+
+/*
+ * @brief Feed the frames of a recorded log through the decode path instead of
+ *        the socket, paced by their original timestamps and the replay speed.
+ * @param map: The resolved IO configuration.
+ */
+void CanRxThread::runReplay(const CanSignalMap &map) {
+    CanLogReader reader;
+    if (!reader.open(m_replayPath.toStdString())) {
+        qWarning() << "RX: Cannot open replay log:" << QString::fromStdString(reader.error());
+        emit replayFinished(0, 0, 0);
+        return;
+    }
+    qInfo() << "RX: Replaying" << m_replayPath << "at speed" << m_replaySpeed;
+
+    CanReplayPacer pacer(m_replaySpeed);
+    CanLogRecord record;
+    digInSignal prevInput = digInput;
+    quint64 frames = 0;
+    qint64 maxLateNs = 0;
+    const int64_t startNs = monotonicNs();
+
+    m_running = true;
+    while (m_running && reader.next(record)) {
+        maxLateNs = qMax<qint64>(maxLateNs, pacer.waitFor(record.timestampUs));
+
+        const int64_t releaseNs = monotonicNs();
+        m_stats.frames.fetch_add(1, std::memory_order_relaxed);
+        const int updates = decodeFrame(map, record.frame, prevInput);
+        const int64_t decodeNs = monotonicNs() - releaseNs;
+        m_stats.decodeNs.fetch_add(decodeNs, std::memory_order_relaxed);
+        if (Metrics::enabled) {
+            Metrics::rxDecode.record(decodeNs);
+            Metrics::rxFrames.add(record.frame.can_id);
+            if (updates > 0) Metrics::inputChanged(releaseNs);
+        }
+
+        // Queued behind the signals above, so it is handled once the UI has seen them
+        if (updates > 0) {
+            emit replayFrameDelivered(releaseNs, updates);
+        }
+
+        memcpy(&prevInput, &digInput, sizeof(digInSignal));
+        frames++;
+    }
+
+    emit replayFinished(frames, monotonicNs() - startNs, maxLateNs);
 }
 
 DataProcessing::DataProcessing() {
@@ -424,10 +510,30 @@ DataProcessing::DataProcessing() {
 }
 
 void DataProcessing::DataProcessingTask() {
+    Trace::Scope tick(TRACE_DATA_TICK);
+    tick.setArgs(tick500ms);
     tick500ms = softTimer / 500;
     softTimer++;
 }
 
+/*
+ * @brief Re-emit a signal of a CAN thread from the GUI thread inside a trace
+ *        span, so the QML handlers it runs show up on the timeline, linked to
+ *        the emitting thread by a flow. Also marks the change as handled for
+ *        the frame-to-pixel latency metric.
+ */
+template <typename Sender, typename T>
+static void relaySignal(Sender *sender, void (Sender::*from)(T), CanHandler *handler,
+                        void (CanHandler::*to)(T), TraceEventId id) {
+    QObject::connect(sender, from, handler, [handler, to, id](T value) {
+        Trace::Scope span(id);
+        span.flowIn();
+        span.setArgs(uint64_t(value));
+        (handler->*to)(value);
+        if (Metrics::enabled) Metrics::inputHandled();
+    });
+}
+
 CanHandler::CanHandler(QObject *parent)
     : QObject(parent)
 {
@@ -435,19 +541,96 @@ CanHandler::CanHandler(QObject *parent)
     m_rxThread = new CanRxThread(this);
     m_dataProcessing = new DataProcessing();
 
-    connect(m_txThread, &CanTxThread::leftLightChanged, this, &CanHandler::leftLightChanged);
-    connect(m_txThread, &CanTxThread::rightLightChanged, this, &CanHandler::rightLightChanged);
-    connect(m_txThread, &CanTxThread::hazardLightsChanged, this, &CanHandler::hazardLightsChanged);
-    connect(m_rxThread, &CanRxThread::highBeamChanged, this, &CanHandler::highBeamChanged);
-    connect(m_rxThread, &CanRxThread::lowBeamChanged, this, &CanHandler::lowBeamChanged);
-    connect(m_rxThread, &CanRxThread::parkingLightsChanged, this, &CanHandler::parkingLightsChanged);
-    connect(m_rxThread, &CanRxThread::speedChanged, this, &CanHandler::speedChanged);
+    relaySignal(m_txThread, &CanTxThread::leftLightChanged, this, &CanHandler::leftLightChanged, TRACE_SIG_LEFT_LIGHT);
+    relaySignal(m_txThread, &CanTxThread::rightLightChanged, this, &CanHandler::rightLightChanged, TRACE_SIG_RIGHT_LIGHT);
+    relaySignal(m_txThread, &CanTxThread::hazardLightsChanged, this, &CanHandler::hazardLightsChanged, TRACE_SIG_HAZARD_LIGHTS);
+    relaySignal(m_rxThread, &CanRxThread::highBeamChanged, this, &CanHandler::highBeamChanged, TRACE_SIG_HIGH_BEAM);
+    relaySignal(m_rxThread, &CanRxThread::lowBeamChanged, this, &CanHandler::lowBeamChanged, TRACE_SIG_LOW_BEAM);
+    relaySignal(m_rxThread, &CanRxThread::parkingLightsChanged, this, &CanHandler::parkingLightsChanged, TRACE_SIG_PARKING_LIGHTS);
+    connect(m_rxThread, &CanRxThread::speedSampled, this, &CanHandler::onSpeedSampled);
+    connect(m_rxThread, &CanRxThread::replayFrameDelivered, this, &CanHandler::onReplayFrameDelivered);
+    connect(m_rxThread, &CanRxThread::replayFinished, this, &CanHandler::onReplayFinished);
+}
+
+void CanHandler::setInterface(const QByteArray &name) {
+    qstrncpy(m_rxThread->stats().interfaceName, name.constData(), IFNAMSIZ);
+    qstrncpy(m_txThread->stats().interfaceName, name.constData(), IFNAMSIZ);
+}
+
+void CanHandler::setReplay(const QString &path, double speed) {
+    m_rxThread->setReplay(path, speed);
+}
+
+void CanHandler::setBlackBox(CanBlackBox *blackBox) {
+    m_rxThread->setBlackBox(blackBox);
+}
+
+/*
+ * @brief Smooth and scale a speed sample for the gauge. Stamped with its
+ *        decode time, so the gauge paces the needle by sample arrival rather
+ *        than by when the queued signal got through to the GUI thread.
+ */
+void CanHandler::onSpeedSampled(int analogVal, qint64 sampleNs) {
+    Trace::Scope span(TRACE_SIG_SPEED);
+    span.flowIn();
+    span.setArgs(uint64_t(analogVal));
+
+    m_speed = canFilterSpeed(m_speedFilter, analogVal);
+    m_speedTimestamp = sampleNs / 1e6;
+    emit speedChanged();
+    if (Metrics::enabled) Metrics::inputHandled();
+}
+
+void CanHandler::onReplayFrameDelivered(qint64 releaseNs, int updates) {
+    m_replayLatencyNs.append(monotonicNs() - releaseNs);
+    m_replayUpdates += updates;
+}
+
+/*
+ * @brief Log the replay report: pacing, decode throughput and the latency from
+ *        frame release to the UI having handled the resulting signals.
+ */
+void CanHandler::onReplayFinished(quint64 frames, qint64 wallNs, qint64 maxLateNs) {
+    const CanStats &stats = m_rxThread->stats();
+    const quint64 decodeNs = stats.decodeNs.load(std::memory_order_relaxed);
+
+    qInfo("REPLAY: %llu frames in %.1f ms (%.0f frames/s), max release lateness %.1f us",
+          frames, wallNs / 1e6, wallNs > 0 ? frames * 1e9 / wallNs : 0.0, maxLateNs / 1e3);
+    qInfo("REPLAY: decode %.2f us/frame, throughput %.0f frames/s",
+          frames ? decodeNs / 1e3 / frames : 0.0, decodeNs ? frames * 1e9 / decodeNs : 0.0);
+
+    if (m_replayLatencyNs.isEmpty()) {
+        qInfo("REPLAY: no UI updates");
+    } else {
+        std::sort(m_replayLatencyNs.begin(), m_replayLatencyNs.end());
+        const int n = m_replayLatencyNs.size();
+        qInfo("REPLAY: %llu UI updates from %d frames, latency p50 %.1f us, p99 %.1f us, max %.1f us",
+              m_replayUpdates, n, m_replayLatencyNs[n / 2] / 1e3,
+              m_replayLatencyNs[qMin(n - 1, n * 99 / 100)] / 1e3, m_replayLatencyNs.last() / 1e3);
+    }
+
+    emit replayFinished();
+}
+
+void CanHandler::restoreInputs(bool highBeam, bool lowBeam, bool parkingLights, qreal speed) {
+    digInput.high_beam_switch = highBeam;
+    digInput.low_beam_switch = lowBeam;
+    digInput.parking_lights_switch = parkingLights;
+    // The restored speed is a display value, force the first live sample through
+    analogInput.speed = -1;
+    m_speed = speed;
+}
 
+void CanHandler::start() {
     m_txThread->start();
     m_rxThread->start();
 }
 
-CanHandler::~CanHandler() {
+void CanHandler::stop() {
     m_txThread->stop();
     m_rxThread->stop();
 }
+
+CanHandler::~CanHandler() {
+    stop();
+}
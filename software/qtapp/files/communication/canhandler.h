@@ -6,6 +6,7 @@
 #include <QString>
 #include <QMutex>
 #include <QQueue>
+#include <QVector>
 #include <linux/can.h>
 #include <cstdint>
 #include <QFile>
@@ -14,42 +15,11 @@
 #include <QJsonValue>
 #include <QTimer>
 #include <QTimer>
+#include <atomic>
+#include <net/if.h>
+#include "canprotocol.h"
 
-// CAN IDs
-#define DIGITAL_OUTPUT_CMD_ID(n)          (0x94FF0000UL + ((n) * 0x20UL))
-#define DIGITAL_OUTPUT_RES_ID(n)          (0x94FF0800UL + ((n) * 0x20UL))
-#define DIGITAL_INPUT_RES_ID(n)           (0x94FF0A00UL + ((n) * 0x20UL))
-#define ANALOG_INPUT_RES_ID(n)            (0x94FF0D00UL + ((n) * 0x20UL))
-
-#define NUMBER_OF_DIG_OUT_CMD_FRAME       4U
-#define NUMBER_OF_DIG_OUT_RES_FRAME       8U
-#define NUMBER_OF_DIG_IN_RES_FRAME        4U
-#define NUMBER_OF_ANALOG_IN_RES_FRAME     8U
-
-// CAN Frame Signal Per Frame
-#define DIGITAL_OUT_CMD_SIGNAL_PER_FRAME  8U
-#define DIGITAL_OUT_RESP_SIGNAL_PER_FRAME 4U
-#define DIGITAL_IN_RESP_SIGNAL_PER_FRAME  8U
-#define ANALOG_IN_RESP_SIGNAL_PER_FRAME   4U
-
-#define BYTES_PER_CAN_FRAME               8U
-
-#define ANALOG_VALUE_BITS                 14U
-#define ANALOG_EL_DIAGNOSIS_BITS          2U
-
-/*
- * @brief Analog Input Response (ECU -> VCU)
- */
-typedef struct
-{
-  uint16_t analogValue   : ANALOG_VALUE_BITS;
-  uint8_t elDiagnosis    : ANALOG_EL_DIAGNOSIS_BITS;
-} AnalogInput_Resp;
-
-typedef union {
-  uint64_t sdu;
-  AnalogInput_Resp signal[ANALOG_IN_RESP_SIGNAL_PER_FRAME];
-} AnalogInput_Resp_Frame;
+class CanBlackBox;
 
 struct IOConfig {
     QMap<QString, uint8_t> digInputs;
@@ -57,29 +27,18 @@ struct IOConfig {
     QMap<QString, uint8_t> digOutputs;
 };
 
-struct digInSignal {
-    bool ignition = false;
-    bool turn_left_switch = false;
-    bool turn_right_switch = false;
-    bool hazard_switch = false;
-    bool high_beam_switch = false;
-    bool low_beam_switch = false;
-    bool parking_lights_switch = false;
-};
-
-struct digOutSignal {
-    bool left_front_light = false;
-    bool left_rear_light = false;
-    bool right_front_light = false;
-    bool right_rear_light = false;
-    uint8_t left_front_light_pos = 0;
-    uint8_t left_rear_light_pos = 0;
-    uint8_t right_front_light_pos = 0;
-    uint8_t right_rear_light_pos = 0;
-};
-
-struct analogInSignal {
-    int speed = 0; 
+/*
+ * @brief Per-bus counters exported by the CAN threads.
+ *        Written by the owning thread with relaxed atomics, readable from any thread.
+ */
+struct CanStats {
+    char interfaceName[IFNAMSIZ] = "can0";
+    std::atomic<uint64_t> frames{0};        // Frames received / written
+    std::atomic<uint64_t> errors{0};        // Failed writes (TX)
+    std::atomic<uint32_t> overflows{0};     // Frames dropped by the socket queue (RX, SO_RXQ_OVFL)
+    std::atomic<uint32_t> queueDepth{0};    // Frames waiting to be written (TX)
+    std::atomic<uint64_t> decodeNs{0};      // Total time spent decoding frames (RX, if timing)
+    bool timing = false;                    // Measure decode time; set before the thread starts
 };
 
 /*
@@ -89,6 +48,11 @@ struct analogInSignal {
  */
 IOConfig loadIOConfig(const QString& path);
 
+/*
+ * @brief Resolve the input names of an IO configuration for canDecodeFrame().
+ */
+CanSignalMap buildSignalMap(const IOConfig &config);
+
 class CanTxThread : public QThread {
     Q_OBJECT
 public:
@@ -98,6 +62,8 @@ public:
     void enqueueMessage(const struct can_frame &frame);
     void stop();
 
+    CanStats &stats() { return m_stats; }
+
 protected:
     void run() override;
 
@@ -106,6 +72,7 @@ private:
     bool m_running;
     QMutex m_mutex;
     QQueue<struct can_frame> m_queue;
+    CanStats m_stats;
 
 signals:
     void leftLightChanged(bool leftLight);
@@ -119,8 +86,27 @@ public:
     CanRxThread(QObject *parent = nullptr);
     ~CanRxThread();
 
+    /*
+     * @brief Wake the thread if it is waiting for a frame and wait for it to end.
+     */
     void stop();
 
+    /*
+     * @brief Read frames from a candump or .clog file instead of the socket.
+     *        Must be called before start().
+     * @param path: The log file to replay.
+     * @param speed: Time scale of the original timing, 0 for as fast as possible.
+     */
+    void setReplay(const QString &path, double speed) { m_replayPath = path; m_replaySpeed = speed; }
+
+    /*
+     * @brief Receive frames straight into the ring of a black box recorder.
+     *        Must be called before start().
+     */
+    void setBlackBox(CanBlackBox *blackBox) { m_blackBox = blackBox; }
+
+    CanStats &stats() { return m_stats; }
+
 protected:
     void run() override;
 
@@ -128,11 +114,21 @@ signals:
     void highBeamChanged(bool highBeam);
     void lowBeamChanged(bool lowBeam);
     void parkingLightsChanged(bool parkingLights);
-    void speedChanged(int analogVal);
+    void speedSampled(int analogVal, qint64 sampleNs);
+    void replayFrameDelivered(qint64 releaseNs, int updates);
+    void replayFinished(quint64 frames, qint64 wallNs, qint64 maxLateNs);
 
 private:
+    int decodeFrame(const CanSignalMap &map, const struct can_frame &rx_frame, const digInSignal &prevInput);
+    void runReplay(const CanSignalMap &map);
+
     int m_socket;
-    bool m_running;
+    int m_wakeFd;       // eventfd signalled by stop()
+    std::atomic<bool> m_running;
+    CanStats m_stats;
+    QString m_replayPath;
+    double m_replaySpeed = 1.0;
+    CanBlackBox *m_blackBox = nullptr;
 };
 
 class DataProcessing : public QObject {
@@ -146,10 +142,57 @@ public slots:
 
 class CanHandler : public QObject {
     Q_OBJECT
+    // Smoothed vehicle speed in km/h, and the CLOCK_MONOTONIC time in ms at
+    // which the sample behind it was decoded (QElapsedTimer reference clock)
+    Q_PROPERTY(qreal speed READ speed NOTIFY speedChanged)
+    Q_PROPERTY(qreal speedTimestamp READ speedTimestamp NOTIFY speedChanged)
 public:
     explicit CanHandler(QObject *parent = nullptr);
     ~CanHandler();
 
+    /*
+     * @brief Seed RX change detection with the state shown at boot, so the
+     *        first live frame that disagrees with it is emitted, and show the
+     *        restored speed until the first live sample.
+     *        Must be called before start().
+     */
+    void restoreInputs(bool highBeam, bool lowBeam, bool parkingLights, qreal speed);
+
+    /*
+     * @brief Select the SocketCAN interface of both threads. Must be called before start().
+     */
+    void setInterface(const QByteArray &name);
+
+    /*
+     * @brief Drive the decode path from a recorded log instead of the bus.
+     *        A report is logged with a REPLAY: prefix when the log ends.
+     *        Must be called before start().
+     */
+    void setReplay(const QString &path, double speed);
+
+    /*
+     * @brief Record every received frame into a black box. The recorder must
+     *        outlive the handler. Must be called before start().
+     */
+    void setBlackBox(CanBlackBox *blackBox);
+
+    /*
+     * @brief Start the CAN RX and TX threads.
+     */
+    void start();
+
+    /*
+     * @brief Stop the CAN RX and TX threads and close their sockets. Also
+     *        done by the destructor.
+     */
+    void stop();
+
+    CanStats &rxStats() { return m_rxThread->stats(); }
+    CanStats &txStats() { return m_txThread->stats(); }
+
+    qreal speed() const { return m_speed; }
+    qreal speedTimestamp() const { return m_speedTimestamp; }
+
 signals:
     void leftLightChanged(bool leftLight);
     void rightLightChanged(bool rightLight);
@@ -157,12 +200,23 @@ signals:
     void highBeamChanged(bool highBeam);
     void lowBeamChanged(bool lowBeam);
     void parkingLightsChanged(bool parkingLights);
-    void speedChanged(int analogVal);
+    void speedChanged();
+    void replayFinished();
+
+private slots:
+    void onSpeedSampled(int analogVal, qint64 sampleNs);
+    void onReplayFrameDelivered(qint64 releaseNs, int updates);
+    void onReplayFinished(quint64 frames, qint64 wallNs, qint64 maxLateNs);
 
 private:
     CanTxThread *m_txThread;
     CanRxThread *m_rxThread;
     DataProcessing *m_dataProcessing;
+    SpeedFilter m_speedFilter;
+    qreal m_speed = 0;
+    qreal m_speedTimestamp = 0;
+    QVector<qint64> m_replayLatencyNs;
+    quint64 m_replayUpdates = 0;
 };
 
 #endif // CANHANDLER_H
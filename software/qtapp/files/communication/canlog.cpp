@@ -0,0 +1,175 @@
+#include "canlog.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+int64_t canLogMonotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+CanLogReader::~CanLogReader() { close(); }
+
+bool CanLogReader::open(const std::string &path) {
+    close();
+    m_file = fopen(path.c_str(), "rb");
+    if (!m_file) {
+        m_error = path + ": " + strerror(errno);
+        return false;
+    }
+
+    char magic[CAN_LOG_MAGIC_SIZE];
+    const bool hasMagic = fread(magic, 1, sizeof(magic), m_file) == sizeof(magic);
+    m_binary = hasMagic && memcmp(magic, CAN_LOG_MAGIC, CAN_LOG_MAGIC_SIZE) == 0;
+    m_blackBox = hasMagic && memcmp(magic, CAN_BB_MAGIC, CAN_BB_MAGIC_SIZE) == 0;
+    if (m_blackBox) {
+        close();
+        if (!m_blackBoxReader.open(path)) {
+            m_error = m_blackBoxReader.error();
+            return false;
+        }
+        return true;
+    }
+    rewind();
+    return true;
+}
+
+void CanLogReader::close() {
+    m_blackBoxReader.close();
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+void CanLogReader::rewind() {
+    if (m_blackBox) {
+        m_blackBoxReader.rewind();
+        return;
+    }
+    if (!m_file) return;
+    fseek(m_file, m_binary ? CAN_LOG_HEADER_SIZE : 0, SEEK_SET);
+}
+
+bool CanLogReader::next(CanLogRecord &record) {
+    if (m_blackBox) {
+        int64_t timestampNs;
+        if (!m_blackBoxReader.next(record.frame, timestampNs)) return false;
+        record.timestampUs = uint64_t(timestampNs / 1000);
+        return true;
+    }
+    if (!m_file) return false;
+    return m_binary ? nextBinary(record) : nextText(record);
+}
+
+bool CanLogReader::nextText(CanLogRecord &record) {
+    char line[256];
+    while (fgets(line, sizeof(line), m_file)) {
+        // (seconds.micros) interface ID#DATA
+        unsigned long long sec = 0, usec = 0;
+        char iface[IFNAMSIZ + 1];
+        char frame[128];
+        if (sscanf(line, " (%llu.%llu) %16s %127s", &sec, &usec, iface, frame) != 4) continue;
+
+        char *hash = strchr(frame, '#');
+        if (!hash || hash[1] == '#') continue;  // Not a frame, or CAN FD
+
+        const size_t idLen = size_t(hash - frame);
+        char *end = nullptr;
+        unsigned long id = strtoul(frame, &end, 16);
+        if (end != hash) continue;
+
+        memset(&record.frame, 0, sizeof(record.frame));
+        record.frame.can_id = idLen > 3 ? (id & CAN_EFF_MASK) | CAN_EFF_FLAG : (id & CAN_SFF_MASK);
+
+        const char *data = hash + 1;
+        if (*data == 'R') {
+            record.frame.can_id |= CAN_RTR_FLAG;
+        } else {
+            uint8_t dlc = 0;
+            while (dlc < CAN_MAX_DLEN && data[0] && data[1] && data[0] != '\n') {
+                char byte[3] = { data[0], data[1], 0 };
+                record.frame.data[dlc++] = uint8_t(strtoul(byte, nullptr, 16));
+                data += 2;
+                if (*data == '.') data++;
+            }
+            record.frame.can_dlc = dlc;
+        }
+
+        record.timestampUs = uint64_t(sec) * 1000000ULL + usec;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Record layout (little endian):
+ *   uint64 timestamp_us, uint32 can_id (with CAN_*_FLAG bits), uint8 dlc,
+ *   uint8 reserved[3], uint8 data[8]
+ */
+bool CanLogReader::nextBinary(CanLogRecord &record) {
+    uint8_t raw[CAN_LOG_RECORD_SIZE];
+    if (fread(raw, 1, sizeof(raw), m_file) != sizeof(raw)) return false;
+
+    memset(&record.frame, 0, sizeof(record.frame));
+    memcpy(&record.timestampUs, raw, 8);
+    memcpy(&record.frame.can_id, raw + 8, 4);
+    record.frame.can_dlc = raw[12] > CAN_MAX_DLEN ? CAN_MAX_DLEN : raw[12];
+    memcpy(record.frame.data, raw + 16, 8);
+    return true;
+}
+
+CanLogWriter::~CanLogWriter() { close(); }
+
+bool CanLogWriter::open(const std::string &path) {
+    close();
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file) return false;
+
+    uint8_t header[CAN_LOG_HEADER_SIZE] = {};
+    memcpy(header, CAN_LOG_MAGIC, CAN_LOG_MAGIC_SIZE);
+    return fwrite(header, 1, sizeof(header), m_file) == sizeof(header);
+}
+
+bool CanLogWriter::write(const CanLogRecord &record) {
+    if (!m_file) return false;
+
+    uint8_t raw[CAN_LOG_RECORD_SIZE] = {};
+    memcpy(raw, &record.timestampUs, 8);
+    memcpy(raw + 8, &record.frame.can_id, 4);
+    raw[12] = record.frame.can_dlc;
+    memcpy(raw + 16, record.frame.data, 8);
+    return fwrite(raw, 1, sizeof(raw), m_file) == sizeof(raw);
+}
+
+void CanLogWriter::close() {
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+int64_t CanReplayPacer::waitFor(uint64_t timestampUs) {
+    const int64_t now = canLogMonotonicNs();
+    if (!m_started) {
+        m_started = true;
+        m_firstTimestampUs = timestampUs;
+        m_startNs = now;
+        return 0;
+    }
+    if (m_speed <= 0) return 0;
+
+    const uint64_t offsetUs = timestampUs > m_firstTimestampUs ? timestampUs - m_firstTimestampUs : 0;
+    const int64_t due = m_startNs + int64_t(offsetUs * 1000.0 / m_speed);
+    if (due > now) {
+        struct timespec ts;
+        ts.tv_sec = due / 1000000000LL;
+        ts.tv_nsec = due % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+        return 0;
+    }
+    return now - due;
+}
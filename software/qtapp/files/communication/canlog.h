@@ -0,0 +1,124 @@
+#ifndef CANLOG_H
+#define CANLOG_H
+
+#include "canblackbox.h"
+#include <linux/can.h>
+#include <net/if.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Binary CAN log (.clog): 16-byte header followed by fixed-size records
+#define CAN_LOG_MAGIC               "CANLOG01"
+#define CAN_LOG_MAGIC_SIZE          8U
+#define CAN_LOG_HEADER_SIZE         16U
+#define CAN_LOG_RECORD_SIZE         24U
+
+/*
+ * @brief One logged frame with its capture time in microseconds.
+ */
+struct CanLogRecord {
+    uint64_t timestampUs = 0;
+    struct can_frame frame;
+};
+
+/*
+ * @brief Sequential reader for candump text logs (`candump -l`, lines like
+ *        "(1436509052.249713) can0 94FF0A00#0100000000000000"), for the
+ *        binary .clog format written by CanLogWriter and for black box files
+ *        (.cbb). The format is detected from the file content.
+ */
+class CanLogReader {
+public:
+    CanLogReader() = default;
+    ~CanLogReader();
+    CanLogReader(const CanLogReader &) = delete;
+    CanLogReader &operator=(const CanLogReader &) = delete;
+
+    /*
+     * @brief Open a log file.
+     * @return false if the file cannot be opened or has an unknown format.
+     */
+    bool open(const std::string &path);
+    void close();
+
+    /*
+     * @brief Read the next frame. Lines that are not classic CAN frames are skipped.
+     * @return false at the end of the log.
+     */
+    bool next(CanLogRecord &record);
+
+    /*
+     * @brief Restart reading from the first frame.
+     */
+    void rewind();
+
+    bool isBinary() const { return m_binary || m_blackBox; }
+    const std::string &error() const { return m_error; }
+
+private:
+    bool nextText(CanLogRecord &record);
+    bool nextBinary(CanLogRecord &record);
+
+    FILE *m_file = nullptr;
+    bool m_binary = false;
+    bool m_blackBox = false;
+    CanBlackBoxReader m_blackBoxReader;
+    std::string m_error;
+};
+
+/*
+ * @brief Writer for the binary .clog format.
+ */
+class CanLogWriter {
+public:
+    CanLogWriter() = default;
+    ~CanLogWriter();
+    CanLogWriter(const CanLogWriter &) = delete;
+    CanLogWriter &operator=(const CanLogWriter &) = delete;
+
+    bool open(const std::string &path);
+    bool write(const CanLogRecord &record);
+    void close();
+
+private:
+    FILE *m_file = nullptr;
+};
+
+/*
+ * @brief Paces replayed frames against the monotonic clock.
+ *
+ * The first frame defines time zero; every following frame is due at its
+ * log time offset divided by the speed factor. A speed of 0 replays as fast
+ * as possible.
+ */
+class CanReplayPacer {
+public:
+    explicit CanReplayPacer(double speed = 1.0) : m_speed(speed) {}
+
+    /*
+     * @brief Sleep until the frame logged at timestampUs is due.
+     * @return How late the frame is released, in nanoseconds.
+     */
+    int64_t waitFor(uint64_t timestampUs);
+
+    /*
+     * @brief Forget the time origin, e.g. when a log is looped.
+     */
+    void reset() { m_started = false; }
+
+    double speed() const { return m_speed; }
+
+private:
+    double m_speed;
+    bool m_started = false;
+    uint64_t m_firstTimestampUs = 0;
+    int64_t m_startNs = 0;
+};
+
+/*
+ * @brief Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+int64_t canLogMonotonicNs();
+
+#endif // CANLOG_H
@@ -0,0 +1,151 @@
+#include "canprotocol.h"
+#include <cstring>
+
+namespace {
+
+const char *const digInputNames[] = {
+    "ignition",
+    "turn_left_switch",
+    "turn_right_switch",
+    "hazard_switch",
+    "high_beam_switch",
+    "low_beam_switch",
+    "parking_lights_switch",
+};
+
+// Indexed by CanSignal
+bool digInSignal::*const digInputFields[] = {
+    &digInSignal::ignition,
+    &digInSignal::turn_left_switch,
+    &digInSignal::turn_right_switch,
+    &digInSignal::hazard_switch,
+    &digInSignal::high_beam_switch,
+    &digInSignal::low_beam_switch,
+    &digInSignal::parking_lights_switch,
+};
+
+void setLamps(digOutSignal &output, bool left, bool right) {
+    output.left_front_light = left;
+    output.left_rear_light = left;
+    output.right_front_light = right;
+    output.right_rear_light = right;
+}
+
+} // namespace
+
+uint8_t canSignalFromName(const char *name) {
+    for (uint8_t i = 0; i < sizeof(digInputNames) / sizeof(digInputNames[0]); i++) {
+        if (strcmp(name, digInputNames[i]) == 0) return i;
+    }
+    if (strcmp(name, "speed") == 0) return CAN_SIGNAL_SPEED;
+    return CAN_SIGNAL_UNKNOWN;
+}
+
+bool canDigitalInputValue(const digInSignal &input, uint8_t signal) {
+    if (signal > CAN_SIGNAL_PARKING_LIGHTS) return false;
+    return input.*digInputFields[signal];
+}
+
+uint32_t canDecodeFrame(const CanSignalMap &map, const struct can_frame &frame,
+                        digInSignal &input, analogInSignal &analog) {
+    uint32_t changed = 0;
+
+    for (const CanSignalEntry &entry : map.digInputs) {
+        if (entry.signal > CAN_SIGNAL_PARKING_LIGHTS) continue;
+        if (entry.signal != CAN_SIGNAL_IGNITION && input.ignition == false) continue;
+        if (frame.can_id != DIGITAL_INPUT_RES_ID(entry.pos / DIGITAL_IN_RESP_SIGNAL_PER_FRAME)) continue;
+
+        const bool value = frame.data[entry.pos % DIGITAL_IN_RESP_SIGNAL_PER_FRAME] & 0x01;
+        bool &field = input.*digInputFields[entry.signal];
+        if (field != value) {
+            field = value;
+            changed |= CAN_SIGNAL_BIT(entry.signal);
+        }
+    }
+
+    for (const CanSignalEntry &entry : map.analogInputs) {
+        if (entry.signal != CAN_SIGNAL_SPEED) continue;
+
+        // Two bytes per analog signal
+        const uint8_t signalIdx = entry.pos * 2;
+        if (frame.can_id != ANALOG_INPUT_RES_ID(signalIdx / ANALOG_IN_RESP_SIGNAL_PER_FRAME)) continue;
+
+        const uint8_t byte = signalIdx % ANALOG_IN_RESP_SIGNAL_PER_FRAME;
+        const int value = ((frame.data[byte + 1] & 0x3F) << 8) | (frame.data[byte] & 0xFF);
+        if (analog.speed != value) {
+            analog.speed = value;
+            changed |= CAN_SIGNAL_BIT(CAN_SIGNAL_SPEED);
+        }
+    }
+
+    return changed;
+}
+
+double canFilterSpeed(SpeedFilter &filter, int analogValue) {
+    if (filter.count == SPEED_FILTER_SAMPLES) {
+        filter.sum -= filter.samples[filter.next];
+    } else {
+        filter.count++;
+    }
+    filter.samples[filter.next] = analogValue;
+    filter.sum += analogValue;
+    filter.next = (filter.next + 1) % SPEED_FILTER_SAMPLES;
+
+    const double speed = double(filter.sum) / filter.count * SPEED_MAX_KMH / SPEED_ANALOG_FULL_SCALE;
+    return speed < 0 ? 0 : speed > SPEED_MAX_KMH ? SPEED_MAX_KMH : speed;
+}
+
+bool canUpdateLighting(const digInSignal &input, const digInSignal &prevInput, digOutSignal &output) {
+    if (input.hazard_switch && input.hazard_switch != prevInput.hazard_switch) {
+        setLamps(output, true, true);
+    } else if (input.turn_left_switch && input.turn_left_switch != prevInput.turn_left_switch) {
+        setLamps(output, true, false);
+    } else if (input.turn_right_switch && input.turn_right_switch != prevInput.turn_right_switch) {
+        setLamps(output, false, true);
+    } else if ((input.hazard_switch == false && input.turn_left_switch == false && input.turn_right_switch == false) &&
+               (prevInput.hazard_switch || prevInput.turn_left_switch || prevInput.turn_right_switch)) {
+        setLamps(output, false, false);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void canEncodeLampCommand(uint8_t pos, uint8_t value, struct can_frame &frame) {
+    frame.can_id = DIGITAL_OUTPUT_CMD_ID(pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
+    frame.can_dlc = BYTES_PER_CAN_FRAME;
+    memset(frame.data, 0, sizeof(frame.data));
+    frame.data[pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] = value;
+}
+
+bool canDecodeLampCommand(uint8_t pos, const struct can_frame &frame, bool &on) {
+    if (frame.can_id != DIGITAL_OUTPUT_CMD_ID(pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME)) return false;
+
+    const uint8_t value = frame.data[pos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME];
+    if (value != LAMP_CMD_ON && value != LAMP_CMD_OFF) return false;
+    on = value == LAMP_CMD_ON;
+    return true;
+}
+
+int canEncodeLampFrames(const digOutSignal &output, bool on, struct can_frame *frames) {
+    const uint8_t blinkValue = on ? LAMP_CMD_ON : LAMP_CMD_OFF;
+    int count = 0;
+
+    if (output.left_front_light && output.left_rear_light) {
+        canEncodeLampCommand(output.left_front_light_pos, blinkValue, frames[count++]);
+        canEncodeLampCommand(output.left_rear_light_pos, blinkValue, frames[count++]);
+    } else if (output.left_front_light == false && output.left_rear_light == false) {
+        canEncodeLampCommand(output.left_front_light_pos, LAMP_CMD_OFF, frames[count++]);
+        canEncodeLampCommand(output.left_rear_light_pos, LAMP_CMD_OFF, frames[count++]);
+    }
+
+    if (output.right_front_light && output.right_rear_light) {
+        canEncodeLampCommand(output.right_front_light_pos, blinkValue, frames[count++]);
+        canEncodeLampCommand(output.right_rear_light_pos, blinkValue, frames[count++]);
+    } else if (output.right_front_light == false && output.right_rear_light == false) {
+        canEncodeLampCommand(output.right_front_light_pos, LAMP_CMD_OFF, frames[count++]);
+        canEncodeLampCommand(output.right_rear_light_pos, LAMP_CMD_OFF, frames[count++]);
+    }
+
+    return count;
+}
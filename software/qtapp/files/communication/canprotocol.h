@@ -0,0 +1,193 @@
+#ifndef CANPROTOCOL_H
+#define CANPROTOCOL_H
+
+#include <linux/can.h>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Qt-free CAN protocol of the cluster: frame decoding, lamp command encoding
+ * and the turn/hazard lighting logic, as pure functions over explicit state so
+ * they can be benchmarked and reused by host tools.
+ */
+
+// CAN IDs
+#define DIGITAL_OUTPUT_CMD_ID(n)          (0x94FF0000UL + ((n) * 0x20UL))
+#define DIGITAL_OUTPUT_RES_ID(n)          (0x94FF0800UL + ((n) * 0x20UL))
+#define DIGITAL_INPUT_RES_ID(n)           (0x94FF0A00UL + ((n) * 0x20UL))
+#define ANALOG_INPUT_RES_ID(n)            (0x94FF0D00UL + ((n) * 0x20UL))
+
+#define NUMBER_OF_DIG_OUT_CMD_FRAME       4U
+#define NUMBER_OF_DIG_OUT_RES_FRAME       8U
+#define NUMBER_OF_DIG_IN_RES_FRAME        4U
+#define NUMBER_OF_ANALOG_IN_RES_FRAME     8U
+
+// CAN Frame Signal Per Frame
+#define DIGITAL_OUT_CMD_SIGNAL_PER_FRAME  8U
+#define DIGITAL_OUT_RESP_SIGNAL_PER_FRAME 4U
+#define DIGITAL_IN_RESP_SIGNAL_PER_FRAME  8U
+#define ANALOG_IN_RESP_SIGNAL_PER_FRAME   4U
+
+#define BYTES_PER_CAN_FRAME               8U
+
+#define ANALOG_VALUE_BITS                 14U
+#define ANALOG_EL_DIAGNOSIS_BITS          2U
+
+// Lamp command values (ECU digital output command byte)
+#define LAMP_CMD_OFF                      0xC8U
+#define LAMP_CMD_ON                       0xC9U
+#define LAMP_FRAMES_MAX                   4U
+
+// Speed dial: the 14-bit ECU value SPEED_ANALOG_FULL_SCALE is SPEED_MAX_KMH
+#define SPEED_ANALOG_FULL_SCALE           16000
+#define SPEED_MAX_KMH                     180
+#define SPEED_FILTER_SAMPLES              10U
+
+/*
+ * @brief Analog Input Response (ECU -> VCU)
+ */
+typedef struct
+{
+  uint16_t analogValue   : ANALOG_VALUE_BITS;
+  uint8_t elDiagnosis    : ANALOG_EL_DIAGNOSIS_BITS;
+} AnalogInput_Resp;
+
+typedef union {
+  uint64_t sdu;
+  AnalogInput_Resp signal[ANALOG_IN_RESP_SIGNAL_PER_FRAME];
+} AnalogInput_Resp_Frame;
+
+struct digInSignal {
+    bool ignition = false;
+    bool turn_left_switch = false;
+    bool turn_right_switch = false;
+    bool hazard_switch = false;
+    bool high_beam_switch = false;
+    bool low_beam_switch = false;
+    bool parking_lights_switch = false;
+};
+
+struct digOutSignal {
+    bool left_front_light = false;
+    bool left_rear_light = false;
+    bool right_front_light = false;
+    bool right_rear_light = false;
+    uint8_t left_front_light_pos = 0;
+    uint8_t left_rear_light_pos = 0;
+    uint8_t right_front_light_pos = 0;
+    uint8_t right_rear_light_pos = 0;
+};
+
+struct analogInSignal {
+    int speed = 0; 
+};
+
+/*
+ * @brief Moving average over the last SPEED_FILTER_SAMPLES speed samples.
+ */
+struct SpeedFilter {
+    int samples[SPEED_FILTER_SAMPLES] = {};
+    uint32_t count = 0;
+    uint32_t next = 0;
+    int sum = 0;
+};
+
+/*
+ * @brief Input signals known to the decoder. The digital ones follow the
+ *        field order of digInSignal.
+ */
+enum CanSignal : uint8_t {
+    CAN_SIGNAL_IGNITION = 0,
+    CAN_SIGNAL_TURN_LEFT,
+    CAN_SIGNAL_TURN_RIGHT,
+    CAN_SIGNAL_HAZARD,
+    CAN_SIGNAL_HIGH_BEAM,
+    CAN_SIGNAL_LOW_BEAM,
+    CAN_SIGNAL_PARKING_LIGHTS,
+    CAN_SIGNAL_SPEED,
+    CAN_SIGNAL_UNKNOWN = 0xFF
+};
+
+// Bit of a signal in the mask returned by canDecodeFrame()
+#define CAN_SIGNAL_BIT(signal)            (1U << (signal))
+
+struct CanSignalEntry {
+    uint8_t signal;     // CanSignal
+    uint8_t pos;        // Position in the IO configuration
+};
+
+/*
+ * @brief IO configuration resolved for decoding, in configuration order.
+ *        Unknown names are kept as CAN_SIGNAL_UNKNOWN entries.
+ */
+struct CanSignalMap {
+    std::vector<CanSignalEntry> digInputs;
+    std::vector<CanSignalEntry> analogInputs;
+};
+
+/*
+ * @brief Resolve an io_config.json input name ("ignition", "speed", ...).
+ * @return The signal, or CAN_SIGNAL_UNKNOWN.
+ */
+uint8_t canSignalFromName(const char *name);
+
+/*
+ * @brief Current value of a digital input signal (CAN_SIGNAL_IGNITION .. CAN_SIGNAL_PARKING_LIGHTS).
+ */
+bool canDigitalInputValue(const digInSignal &input, uint8_t signal);
+
+/*
+ * @brief Decode one received frame into the input state.
+ *        Switches other than the ignition are ignored while the ignition is off.
+ * @param map: The resolved IO configuration.
+ * @param frame: The received CAN frame.
+ * @param input: Digital input state, updated in place.
+ * @param analog: Analog input state, updated in place.
+ * @return Mask of CAN_SIGNAL_BIT() of the signals whose value changed.
+ */
+uint32_t canDecodeFrame(const CanSignalMap &map, const struct can_frame &frame,
+                        digInSignal &input, analogInSignal &analog);
+
+/*
+ * @brief Add an analog speed sample to the moving average.
+ * @param filter: The filter state, updated in place.
+ * @param analogValue: The 14-bit ECU value of the speed input.
+ * @return The smoothed speed in km/h, clamped to 0..SPEED_MAX_KMH.
+ */
+double canFilterSpeed(SpeedFilter &filter, int analogValue);
+
+/*
+ * @brief Select the lamps driven by the hazard and turn switches on a switch edge.
+ * @param input: Current digital inputs.
+ * @param prevInput: Digital inputs before the last decoded frame.
+ * @param output: Lamp outputs, updated in place.
+ * @return true if the lamp pattern was changed and the blink phase must restart.
+ */
+bool canUpdateLighting(const digInSignal &input, const digInSignal &prevInput, digOutSignal &output);
+
+/*
+ * @brief Build a digital output command frame setting one lamp.
+ */
+void canEncodeLampCommand(uint8_t pos, uint8_t value, struct can_frame &frame);
+
+/*
+ * @brief Read the command of one lamp from a digital output command frame.
+ * @param pos: Position of the lamp in the IO configuration.
+ * @param frame: A frame sent by the cluster.
+ * @param on: Receives the commanded state.
+ * @return false if the frame does not command this lamp.
+ */
+bool canDecodeLampCommand(uint8_t pos, const struct can_frame &frame, bool &on);
+
+/*
+ * @brief Build the lamp command frames of one blink phase. A side whose front
+ *        and rear lamps are both selected blinks, a side with both deselected
+ *        is switched off, a side in between is left alone.
+ * @param output: Lamp outputs and their positions.
+ * @param on: Blink phase.
+ * @param frames: Receives up to LAMP_FRAMES_MAX frames.
+ * @return Number of frames built.
+ */
+int canEncodeLampFrames(const digOutSignal &output, bool on, struct can_frame *frames);
+
+#endif // CANPROTOCOL_H
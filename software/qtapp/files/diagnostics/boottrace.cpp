@@ -0,0 +1,42 @@
+#include "boottrace.h"
+#include <QQuickWindow>
+#include <QDebug>
+#include <atomic>
+#include <memory>
+#include <time.h>
+
+namespace {
+
+int64_t startNs = 0;
+
+int64_t clockNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+} // namespace
+
+void BootTrace::start() {
+    startNs = clockNs(CLOCK_MONOTONIC);
+    mark("main() entered");
+}
+
+void BootTrace::mark(const char *event) {
+    const double sinceMain = (clockNs(CLOCK_MONOTONIC) - startNs) / 1e6;
+    // CLOCK_BOOTTIME also counts the time spent before the service started
+    const double sinceBoot = clockNs(CLOCK_BOOTTIME) / 1e6;
+    qInfo("BOOT: %-28s +%9.3f ms since main(), %10.3f ms since kernel boot", event, sinceMain, sinceBoot);
+}
+
+void BootTrace::markFirstFrame(QQuickWindow *window) {
+    if (!window) return;
+
+    auto done = std::make_shared<std::atomic_bool>(false);
+    // Direct connection: logged on the render thread right after the swap
+    QObject::connect(window, &QQuickWindow::frameSwapped, window, [done]() {
+        if (!done->exchange(true)) {
+            mark("first frame swapped");
+        }
+    }, Qt::DirectConnection);
+}
@@ -0,0 +1,35 @@
+#ifndef BOOTTRACE_H
+#define BOOTTRACE_H
+
+class QQuickWindow;
+
+/*
+ * @brief Startup timing markers.
+ *
+ * Each marker is logged with the time since BootTrace::start() (called first
+ * thing in main()) and the time since the kernel booted, so the log shows both
+ * the application's own startup cost and the full boot-to-first-frame time.
+ * Markers may be emitted from any thread.
+ */
+namespace BootTrace {
+
+/*
+ * @brief Set the reference point for all following markers.
+ */
+void start();
+
+/*
+ * @brief Log a named startup marker.
+ * @param event: Static description of the point reached.
+ */
+void mark(const char *event);
+
+/*
+ * @brief Log a marker when the first frame of window has been swapped.
+ * @param window: The window whose first frame ends the startup.
+ */
+void markFirstFrame(QQuickWindow *window);
+
+} // namespace BootTrace
+
+#endif // BOOTTRACE_H
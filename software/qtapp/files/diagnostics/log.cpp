@@ -0,0 +1,382 @@
+#include "log.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+#define LOG_RING_RECORDS        1024U           // Per thread, a power of two
+#define LOG_FLUSH_MS            100U
+#define LOG_BUDGET_MS           1000U           // Interval of the per-site budget
+
+// Indexed by LogCategory
+const char *const categoryNames[LOG_CATEGORY_COUNT] = {
+    "app",
+    "can.rx",
+    "can.tx",
+};
+
+const char *const levelNames[LOG_LEVEL_OFF + 1] = { "debug", "info", "warning", "error", "off" };
+
+// sd-daemon priority prefixes understood by journald on stderr
+const char *const levelPriorities[LOG_LEVEL_OFF] = { "<7>", "<6>", "<4>", "<3>" };
+
+/*
+ * @brief Record ring of one thread: the thread is the only producer, the
+ *        flusher the only consumer.
+ */
+struct LogRing {
+    std::unique_ptr<Log::detail::Record[]> records{new Log::detail::Record[LOG_RING_RECORDS]};
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    uint64_t reportedDrops = 0;                 // Flusher
+};
+
+std::mutex ringsMutex;
+std::vector<LogRing *> rings;                   // Never freed, records of finished threads are still written
+thread_local LogRing *threadRing = nullptr;
+
+std::atomic<Log::Site *> sites{nullptr};        // Sites that logged at least once
+
+bool journal = false;
+int wakePipe[2] = { -1, -1 };
+std::thread flushThread;
+
+LogRing *registerThread() {
+    LogRing *ring = new LogRing();
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    rings.push_back(ring);
+    threadRing = ring;
+    return ring;
+}
+
+void registerSite(Log::Site &site) {
+    bool expected = false;
+    if (!site.registered.compare_exchange_strong(expected, true)) return;
+    Log::Site *head = sites.load(std::memory_order_relaxed);
+    do {
+        site.next = head;
+    } while (!sites.compare_exchange_weak(head, &site, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/*
+ * @brief Append one conversion of a printf format with a stored argument.
+ *        The length modifiers of the format are replaced by the ones of the
+ *        stored type.
+ */
+void formatArg(std::string &out, const char *spec, size_t specLength, char conversion,
+               Log::detail::ArgType type, const uint8_t *&arg) {
+    char format[32];
+    const size_t length = std::min(specLength, sizeof(format) - 4);
+    memcpy(format, spec, length);
+    char text[128];
+
+    if (type == Log::detail::ARG_STRING) {
+        const size_t size = *arg++;
+        const std::string value(reinterpret_cast<const char *>(arg), size);
+        arg += size;
+        if (conversion == 's') {
+            format[length] = 's';
+            format[length + 1] = 0;
+            snprintf(text, sizeof(text), format, value.c_str());
+            out += text;
+        } else {
+            out += value;
+        }
+        return;
+    }
+
+    uint64_t raw;
+    memcpy(&raw, arg, 8);
+    arg += 8;
+    if (strchr("feEgGaA", conversion)) {
+        double value;
+        if (type == Log::detail::ARG_DOUBLE) memcpy(&value, &raw, 8);
+        else value = type == Log::detail::ARG_INT ? double(int64_t(raw)) : double(raw);
+        format[length] = conversion;
+        format[length + 1] = 0;
+        snprintf(text, sizeof(text), format, value);
+    } else if (strchr("diouxXc", conversion)) {
+        if (type == Log::detail::ARG_DOUBLE) {
+            double value;
+            memcpy(&value, &raw, 8);
+            raw = uint64_t(int64_t(value));
+        }
+        size_t n = length;
+        if (conversion != 'c') {
+            format[n++] = 'l';
+            format[n++] = 'l';
+        }
+        format[n++] = conversion;
+        format[n] = 0;
+        snprintf(text, sizeof(text), format, static_cast<long long>(raw));
+    } else {
+        // %s or %p of a number
+        if (type == Log::detail::ARG_DOUBLE) {
+            double value;
+            memcpy(&value, &raw, 8);
+            snprintf(text, sizeof(text), "%g", value);
+        } else if (conversion == 'p') {
+            snprintf(text, sizeof(text), "0x%llx", static_cast<unsigned long long>(raw));
+        } else {
+            snprintf(text, sizeof(text), type == Log::detail::ARG_INT ? "%lld" : "%llu",
+                     static_cast<long long>(raw));
+        }
+    }
+    out += text;
+}
+
+void formatMessage(std::string &out, const Log::detail::Record &record) {
+    const uint8_t *arg = record.payload;
+    unsigned index = 0;
+
+    for (const char *p = record.site->format; *p; p++) {
+        if (*p != '%') {
+            out += *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            out += '%';
+            p++;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        const char *spec = p++;
+        while (*p && strchr("-+ #0", *p)) p++;
+        while (*p >= '0' && *p <= '9') p++;
+        if (*p == '.') {
+            p++;
+            while (*p >= '0' && *p <= '9') p++;
+        }
+        const size_t specLength = size_t(p - spec);
+        while (*p && strchr("hlLqjzt", *p)) p++;
+        if (!*p) break;
+
+        if (index >= record.count) {
+            out += "<?>";
+            continue;
+        }
+        const auto type = Log::detail::ArgType((record.types >> (2 * index++)) & 0x3);
+        formatArg(out, spec, specLength, *p, type, arg);
+    }
+}
+
+void appendPrefix(std::string &out, uint8_t level, uint8_t category, int64_t timestampNs) {
+    if (journal) {
+        // journald adds its own time stamp
+        out += levelPriorities[level];
+    } else {
+        const time_t seconds = time_t(timestampNs / 1000000000LL);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char text[48];
+        const size_t n = strftime(text, sizeof(text), "%H:%M:%S", &local);
+        snprintf(text + n, sizeof(text) - n, ".%03d %s ", int(timestampNs / 1000000LL % 1000), levelNames[level]);
+        out += text;
+    }
+    out += categoryNames[category];
+    out += ": ";
+}
+
+void writeOut(const std::string &text) {
+    size_t done = 0;
+    while (done < text.size()) {
+        const ssize_t n = ::write(STDERR_FILENO, text.data() + done, text.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        done += size_t(n);
+    }
+}
+
+/*
+ * @brief Write the pending records of all threads in time order.
+ */
+void flush() {
+    std::vector<LogRing *> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        snapshot = rings;
+    }
+
+    std::vector<Log::detail::Record> records;
+    std::string text;
+    for (LogRing *ring : snapshot) {
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        for (; tail < head; tail++) {
+            records.push_back(ring->records[tail & (LOG_RING_RECORDS - 1)]);
+        }
+        ring->tail.store(tail, std::memory_order_release);
+
+        const uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+        if (dropped != ring->reportedDrops) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            appendPrefix(text, LOG_LEVEL_WARNING, LOG_CAT_APP, int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec);
+            text += "LOG: " + std::to_string(dropped - ring->reportedDrops) + " records dropped, buffer full\n";
+            ring->reportedDrops = dropped;
+        }
+    }
+
+    std::stable_sort(records.begin(), records.end(), [](const Log::detail::Record &a, const Log::detail::Record &b) {
+        return a.timestampNs < b.timestampNs;
+    });
+    for (const Log::detail::Record &record : records) {
+        appendPrefix(text, record.site->level, record.site->category, record.timestampNs);
+        formatMessage(text, record);
+        text += '\n';
+    }
+    if (!text.empty()) writeOut(text);
+}
+
+/*
+ * @brief Refill the budget of every site and report what it suppressed.
+ */
+void refillBudgets() {
+    std::string text;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const int64_t now = int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+
+    for (Log::Site *site = sites.load(std::memory_order_acquire); site; site = site->next) {
+        const uint32_t suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+        site->budget.store(site->burst, std::memory_order_relaxed);
+        if (suppressed == 0) continue;
+
+        const char *file = strrchr(site->file, '/');
+        appendPrefix(text, site->level, site->category, now);
+        text += std::to_string(suppressed) + " more of \"" + site->format + "\" suppressed (" +
+                (file ? file + 1 : site->file) + ":" + std::to_string(site->line) + ")\n";
+    }
+    if (!text.empty()) writeOut(text);
+}
+
+void flushLoop() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t nextBudgetMs = int64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000 + LOG_BUDGET_MS;
+
+    for (;;) {
+        struct pollfd pfd = { wakePipe[0], POLLIN, 0 };
+        const int ready = poll(&pfd, 1, LOG_FLUSH_MS);
+        flush();
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        if (int64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000 >= nextBudgetMs) {
+            refillBudgets();
+            nextBudgetMs += LOG_BUDGET_MS;
+        }
+
+        char cmd;
+        if (ready > 0 && read(wakePipe[0], &cmd, 1) == 1 && cmd == 'q') {
+            refillBudgets();
+            return;
+        }
+    }
+}
+
+uint8_t parseLevel(const std::string &name) {
+    for (uint8_t level = 0; level <= LOG_LEVEL_OFF; level++) {
+        if (name == levelNames[level]) return level;
+    }
+    return LOG_LEVEL_OFF + 1;
+}
+
+} // namespace
+
+uint8_t Log::detail::levels[LOG_CATEGORY_COUNT] = { LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO };
+static_assert(LOG_CATEGORY_COUNT == 3, "every category needs its default level");
+
+Log::detail::Record *Log::detail::begin(Site &site) {
+    if (!site.registered.load(std::memory_order_relaxed)) registerSite(site);
+    LogRing *ring = threadRing ? threadRing : registerThread();
+
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_RECORDS) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Record &record = ring->records[head & (LOG_RING_RECORDS - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    record.site = &site;
+    record.timestampNs = int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    record.types = 0;
+    record.count = 0;
+    record.size = 0;
+    return &record;
+}
+
+void Log::detail::commit() {
+    LogRing *ring = threadRing;
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Log::setLevel(uint8_t category, uint8_t level) {
+    if (category >= LOG_CATEGORY_COUNT) {
+        std::fill(detail::levels, detail::levels + LOG_CATEGORY_COUNT, level);
+    } else {
+        detail::levels[category] = level;
+    }
+}
+
+void Log::init() {
+    // systemd connects stderr to the journal and says so in JOURNAL_STREAM
+    journal = getenv("JOURNAL_STREAM") != nullptr;
+
+    // QTAPP_LOG=LEVEL[,CATEGORY=LEVEL...]
+    const char *config = getenv("QTAPP_LOG");
+    std::string item;
+    for (const char *p = config ? config : ""; ; p++) {
+        if (*p && *p != ',') {
+            item += *p;
+            continue;
+        }
+        if (!item.empty()) {
+            const size_t equals = item.find('=');
+            const std::string name = equals == std::string::npos ? std::string() : item.substr(0, equals);
+            const uint8_t level = parseLevel(equals == std::string::npos ? item : item.substr(equals + 1));
+            uint8_t category = name.empty() ? uint8_t(LOG_CATEGORY_COUNT) : uint8_t(LOG_CATEGORY_COUNT + 1);
+            for (uint8_t i = 0; i < LOG_CATEGORY_COUNT && !name.empty(); i++) {
+                if (name == categoryNames[i]) category = i;
+            }
+            if (level > LOG_LEVEL_OFF || category > LOG_CATEGORY_COUNT) {
+                fprintf(stderr, "LOG: ignoring \"%s\" in QTAPP_LOG\n", item.c_str());
+            } else {
+                setLevel(category, level);
+            }
+            item.clear();
+        }
+        if (!*p) break;
+    }
+
+    if (pipe(wakePipe) < 0) {
+        fprintf(stderr, "LOG: cannot create the wake pipe: %s\n", strerror(errno));
+        return;
+    }
+    flushThread = std::thread(flushLoop);
+    pthread_setname_np(flushThread.native_handle(), "LogFlush");
+}
+
+void Log::shutdown() {
+    if (!flushThread.joinable()) return;
+    const char cmd = 'q';
+    if (::write(wakePipe[1], &cmd, 1) == 1) {
+        flushThread.join();
+    } else {
+        flushThread.detach();
+    }
+}
@@ -0,0 +1,207 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+enum LogLevel : uint8_t {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF
+};
+
+/*
+ * @brief Log categories. Names ("can.rx", ...) are in the table in log.cpp,
+ *        indexed by this enum.
+ */
+enum LogCategory : uint8_t {
+    LOG_CAT_APP = 0,            // Startup, configuration
+    LOG_CAT_CAN_RX,             // RX thread
+    LOG_CAT_CAN_TX,             // TX thread
+    LOG_CATEGORY_COUNT
+};
+
+#define LOG_DEFAULT_BURST       10U     // Records per call site and second
+#define LOG_PAYLOAD_SIZE        40U     // Argument bytes of a record
+#define LOG_MAX_ARGS            4U
+
+/*
+ * @brief Asynchronous logger for the real-time threads.
+ *
+ * A log statement stores its call site and its arguments in binary form into
+ * a lock-free ring of the calling thread; a flusher thread formats the
+ * records and writes them to stderr (journald under systemd) in batches, so
+ * the caller never waits for I/O. Each call site has its own budget of
+ * records per second, refilled by the flusher, which writes a summary of the
+ * records suppressed meanwhile. A suppressed record costs a level check and
+ * one atomic increment; its arguments are not even evaluated. Levels are set
+ * per category with QTAPP_LOG=LEVEL[,CATEGORY=LEVEL...], e.g.
+ * QTAPP_LOG=warning,can.rx=debug; the default is info.
+ *
+ * Usage: QTAPP_LOG_WARNING(LOG_CAT_CAN_TX, "TX: Error writing CAN frame: %s", strerror(errno));
+ * Arguments are integers, floating point numbers and C strings, which are
+ * copied (truncated to the free bytes of the record). The format follows
+ * printf, length modifiers are not needed.
+ */
+namespace Log {
+
+/*
+ * @brief A log statement. Created once per call site by the QTAPP_LOG_* macros.
+ */
+struct Site {
+    constexpr Site(uint8_t category, uint8_t level, uint16_t burst, const char *format, const char *file, int line)
+        : category(category), level(level), burst(burst), format(format), file(file), line(line),
+          budget(burst) {}
+
+    const uint8_t category;
+    const uint8_t level;
+    const uint16_t burst;                           // Records per second, 0 = unlimited
+    const char *const format;
+    const char *const file;
+    const int line;
+    std::atomic<int32_t> budget;                    // Refilled by the flusher
+    std::atomic<uint32_t> suppressed{0};
+    std::atomic<bool> registered{false};
+    Site *next = nullptr;                           // Registered sites
+};
+
+/*
+ * @brief Read QTAPP_LOG and start the flusher thread. Records logged before
+ *        are kept and written then.
+ */
+void init();
+
+/*
+ * @brief Write the pending records and stop the flusher thread.
+ */
+void shutdown();
+
+/*
+ * @brief Set the level of a category; LOG_CATEGORY_COUNT sets all.
+ */
+void setLevel(uint8_t category, uint8_t level);
+
+namespace detail {
+
+enum ArgType : uint8_t { ARG_INT = 0, ARG_UINT, ARG_DOUBLE, ARG_STRING };
+
+/*
+ * @brief One record in a thread ring.
+ */
+struct Record {
+    const Site *site;
+    int64_t timestampNs;                            // CLOCK_REALTIME
+    uint16_t types;                                 // ArgType, 2 bits per argument
+    uint8_t count;
+    uint8_t size;                                   // Payload bytes used
+    uint8_t reserved[4];
+    uint8_t payload[LOG_PAYLOAD_SIZE];
+};
+static_assert(sizeof(Record) == 64, "log records are expected to be 64 bytes");
+
+extern uint8_t levels[LOG_CATEGORY_COUNT];
+
+/*
+ * @brief Claim the next record of the calling thread's ring.
+ * @return nullptr if the ring is full; the record is counted as dropped.
+ */
+Record *begin(Site &site);
+
+/*
+ * @brief Publish the record claimed by begin().
+ */
+void commit();
+
+inline void put(Record &r, ArgType type, const void *value) {
+    if (r.count >= LOG_MAX_ARGS || r.size + 8U > LOG_PAYLOAD_SIZE) return;
+    memcpy(r.payload + r.size, value, 8);
+    r.types |= uint16_t(type << (2 * r.count++));
+    r.size += 8;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type encode(Record &r, T v) {
+    const int64_t value = v;
+    put(r, ARG_INT, &value);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type encode(Record &r, T v) {
+    const uint64_t value = v;
+    put(r, ARG_UINT, &value);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type encode(Record &r, T v) {
+    const int64_t value = int64_t(v);
+    put(r, ARG_INT, &value);
+}
+
+inline void encode(Record &r, double v) { put(r, ARG_DOUBLE, &v); }
+
+inline void encode(Record &r, const char *s) {
+    // Length byte and the characters, without the terminator
+    if (r.count >= LOG_MAX_ARGS || r.size >= LOG_PAYLOAD_SIZE) return;
+    const size_t room = LOG_PAYLOAD_SIZE - r.size - 1U;
+    const size_t length = s ? strnlen(s, room) : 0;
+    r.payload[r.size] = uint8_t(length);
+    if (length) memcpy(r.payload + r.size + 1, s, length);
+    r.types |= uint16_t(ARG_STRING << (2 * r.count++));
+    r.size += uint8_t(1 + length);
+}
+
+inline void encodeAll(Record &) {}
+
+template <typename T, typename... Rest>
+inline void encodeAll(Record &r, const T &first, const Rest &... rest) {
+    encode(r, first);
+    encodeAll(r, rest...);
+}
+
+} // namespace detail
+
+inline bool enabled(const Site &site) {
+    return site.level >= detail::levels[site.category];
+}
+
+/*
+ * @brief Level check and rate limit of a call site, before its arguments are
+ *        evaluated. The flusher refills the budget, no clock is read here.
+ */
+inline bool admit(Site &site) {
+    if (!enabled(site)) return false;
+    if (site.burst && (site.budget.load(std::memory_order_relaxed) <= 0 ||
+                       site.budget.fetch_sub(1, std::memory_order_relaxed) <= 0)) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+template <typename... Args>
+inline void write(Site &site, const Args &... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+    detail::Record *record = detail::begin(site);
+    if (!record) return;
+    detail::encodeAll(*record, args...);
+    detail::commit();
+}
+
+} // namespace Log
+
+#define QTAPP_LOG(category, level, burst, format, ...)                                     \
+    do {                                                                                    \
+        static Log::Site logSite_(category, level, burst, format, __FILE__, __LINE__);     \
+        if (Log::admit(logSite_)) Log::write(logSite_, ##__VA_ARGS__);                     \
+    } while (0)
+
+#define QTAPP_LOG_DEBUG(category, format, ...)   QTAPP_LOG(category, LOG_LEVEL_DEBUG, LOG_DEFAULT_BURST, format, ##__VA_ARGS__)
+#define QTAPP_LOG_INFO(category, format, ...)    QTAPP_LOG(category, LOG_LEVEL_INFO, LOG_DEFAULT_BURST, format, ##__VA_ARGS__)
+#define QTAPP_LOG_WARNING(category, format, ...) QTAPP_LOG(category, LOG_LEVEL_WARNING, LOG_DEFAULT_BURST, format, ##__VA_ARGS__)
+#define QTAPP_LOG_ERROR(category, format, ...)   QTAPP_LOG(category, LOG_LEVEL_ERROR, LOG_DEFAULT_BURST, format, ##__VA_ARGS__)
+
+#endif // LOG_H
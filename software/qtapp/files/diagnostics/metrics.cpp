@@ -0,0 +1,355 @@
+#include "metrics.h"
+#include "../communication/canhandler.h"
+#include <QQuickWindow>
+#include <QDebug>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+#define METRICS_REQUEST_TIMEOUT_MS  1000
+#define METRICS_REQUEST_MAX         4096U
+
+// Upper bounds of the exported histogram buckets, in ns
+const uint64_t bucketBoundsNs[] = {
+    1000ULL, 2000ULL, 5000ULL,
+    10000ULL, 20000ULL, 50000ULL,
+    100000ULL, 200000ULL, 500000ULL,
+    1000000ULL, 2000000ULL, 5000000ULL,
+    10000000ULL, 20000000ULL, 50000000ULL,
+    100000000ULL, 200000000ULL, 500000000ULL,
+    1000000000ULL, 2000000000ULL, 5000000000ULL,
+};
+
+const double quantiles[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+
+const CanStats *rxStats = nullptr;
+const CanStats *txStats = nullptr;
+
+int listenFd = -1;
+int wakePipe[2] = { -1, -1 };
+std::string unixPath;
+std::thread serveThread;
+
+// Frame-to-pixel hand-off: RX thread -> GUI thread -> render thread sync -> swap
+std::atomic<int64_t> receivedNs{0};
+std::atomic<int64_t> handledNs{0};
+std::atomic<int64_t> syncedNs{0};
+int64_t lastSwapNs = 0;
+
+int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * @brief Move the time in from to to unless to already holds an earlier one,
+ *        so the oldest change of a coalesced frame is the one measured.
+ */
+void passOn(std::atomic<int64_t> &from, std::atomic<int64_t> &to) {
+    const int64_t t = from.exchange(0, std::memory_order_acq_rel);
+    if (t == 0) return;
+    int64_t expected = 0;
+    to.compare_exchange_strong(expected, t, std::memory_order_acq_rel);
+}
+
+void appendf(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string &out, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list retry;
+    va_copy(retry, args);
+    char buf[256];
+    const int n = vsnprintf(buf, sizeof(buf), format, args);
+    if (n > 0 && size_t(n) < sizeof(buf)) {
+        out.append(buf, size_t(n));
+    } else if (n > 0) {
+        const size_t length = out.size();
+        out.resize(length + size_t(n) + 1);
+        vsnprintf(&out[length], size_t(n) + 1, format, retry);
+        out.resize(length + size_t(n));
+    }
+    va_end(retry);
+    va_end(args);
+}
+
+void appendHeader(std::string &out, const char *name, const char *type, const char *help) {
+    appendf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void appendFrames(std::string &out, const char *direction, const CanIdCounters &counters) {
+    for (unsigned i = 0; i < CAN_ID_COUNTER_SLOTS; i++) {
+        uint32_t canId;
+        uint64_t count;
+        if (counters.slot(i, canId, count)) {
+            if (canId & CAN_EFF_FLAG) {
+                appendf(out, "qtapp_can_frames_total{direction=\"%s\",id=\"0x%08" PRIX32 "\"} %" PRIu64 "\n",
+                        direction, canId & CAN_EFF_MASK, count);
+            } else {
+                appendf(out, "qtapp_can_frames_total{direction=\"%s\",id=\"0x%03" PRIX32 "\"} %" PRIu64 "\n",
+                        direction, canId & CAN_SFF_MASK, count);
+            }
+        }
+    }
+    appendf(out, "qtapp_can_frames_total{direction=\"%s\",id=\"other\"} %" PRIu64 "\n",
+            direction, counters.other());
+}
+
+/*
+ * @brief Export a histogram as a Prometheus histogram with fixed bucket
+ *        bounds, which aggregates across clusters, and its quantiles at full
+ *        resolution as a summary named <name>_hdr.
+ */
+void appendHistogram(std::string &out, const char *name, const char *help, const HdrHistogram &histogram) {
+    std::vector<uint64_t> counts(HDR_COUNTS);
+    uint64_t total = 0;
+    for (unsigned i = 0; i < HDR_COUNTS; i++) {
+        counts[i] = histogram.count(i);
+        total += counts[i];
+    }
+    const double sum = histogram.sum() / 1e9;
+
+    appendHeader(out, name, "histogram", help);
+    unsigned index = 0;
+    uint64_t cumulative = 0;
+    for (const uint64_t bound : bucketBoundsNs) {
+        // HDR buckets are assigned by their upper value; one straddling a bound counts below it
+        for (; index < HDR_COUNTS && HdrHistogram::highestValueAt(index) <= bound; index++) {
+            cumulative += counts[index];
+        }
+        appendf(out, "%s_bucket{le=\"%g\"} %" PRIu64 "\n", name, bound / 1e9, cumulative);
+    }
+    appendf(out, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", name, total);
+    appendf(out, "%s_sum %.9f\n%s_count %" PRIu64 "\n", name, sum, name, total);
+
+    const std::string hdrName = std::string(name) + "_hdr";
+    appendHeader(out, hdrName.c_str(), "summary", help);
+    for (const double q : quantiles) {
+        uint64_t value = 0;
+        if (total > 0) {
+            const uint64_t rank = std::max<uint64_t>(1, uint64_t(q * total + 0.5));
+            uint64_t seen = 0;
+            for (unsigned i = 0; i < HDR_COUNTS; i++) {
+                seen += counts[i];
+                if (seen >= rank) {
+                    value = HdrHistogram::highestValueAt(i);
+                    break;
+                }
+            }
+            value = std::min(value, histogram.max());
+        }
+        appendf(out, "%s{quantile=\"%g\"} %.9f\n", hdrName.c_str(), q, value / 1e9);
+    }
+    appendf(out, "%s_sum %.9f\n%s_count %" PRIu64 "\n", hdrName.c_str(), sum, hdrName.c_str(), total);
+}
+
+/*
+ * @brief Answer one HTTP request with the metrics. Any path is accepted; the
+ *        request is read only to its end so clients do not see a reset.
+ */
+void serveClient(int fd) {
+    char request[METRICS_REQUEST_MAX];
+    size_t length = 0;
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (length < sizeof(request) - 1 && poll(&pfd, 1, METRICS_REQUEST_TIMEOUT_MS) > 0) {
+        const ssize_t n = read(fd, request + length, sizeof(request) - 1 - length);
+        if (n <= 0) break;
+        length += size_t(n);
+        request[length] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+    }
+
+    const std::string body = Metrics::render();
+    std::string response;
+    appendf(response, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: %zu\r\nConnection: close\r\n\r\n", body.size());
+    response += body;
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+        const ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) break;
+        sent += size_t(n);
+    }
+}
+
+void serveLoop() {
+    struct pollfd fds[2] = { { listenFd, POLLIN, 0 }, { wakePipe[0], POLLIN, 0 } };
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept(listenFd, nullptr, nullptr);
+            if (fd >= 0) {
+                serveClient(fd);
+                close(fd);
+            }
+        }
+    }
+}
+
+int listenUnix(const std::string &path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int listenTcp(unsigned port) {
+    if (port == 0 || port > 65535) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(uint16_t(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+bool Metrics::enabled = false;
+
+CanIdCounters Metrics::rxFrames;
+CanIdCounters Metrics::txFrames;
+HdrHistogram Metrics::rxDecode;
+HdrHistogram Metrics::txBlinkJitter;
+HdrHistogram Metrics::frameToPixel;
+HdrHistogram Metrics::frameInterval;
+
+bool Metrics::start(const std::string &address, const CanStats &rx, const CanStats &tx) {
+    if (address.compare(0, 5, "unix:") == 0) {
+        unixPath = address.substr(5);
+        listenFd = listenUnix(unixPath);
+    } else if (address.compare(0, 4, "tcp:") == 0) {
+        char *end = nullptr;
+        const unsigned long port = strtoul(address.c_str() + 4, &end, 10);
+        listenFd = (end && *end == '\0') ? listenTcp(unsigned(port)) : -1;
+    } else {
+        qWarning("METRICS: invalid address \"%s\", expected unix:/path or tcp:PORT", address.c_str());
+        return false;
+    }
+    if (listenFd < 0) {
+        qWarning("METRICS: cannot listen on %s: %s", address.c_str(), strerror(errno));
+        unixPath.clear();
+        return false;
+    }
+    if (pipe(wakePipe) < 0) {
+        qWarning("METRICS: cannot create the wake pipe: %s", strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    rxStats = &rx;
+    txStats = &tx;
+    enabled = true;
+    serveThread = std::thread(serveLoop);
+    pthread_setname_np(serveThread.native_handle(), "Metrics");
+
+    qInfo("METRICS: serving on %s", address.c_str());
+    return true;
+}
+
+void Metrics::stop() {
+    if (!serveThread.joinable()) return;
+    const char cmd = 'q';
+    if (write(wakePipe[1], &cmd, 1) == 1) {
+        serveThread.join();
+    } else {
+        serveThread.detach();
+    }
+    close(listenFd);
+    listenFd = -1;
+    if (!unixPath.empty()) unlink(unixPath.c_str());
+}
+
+void Metrics::attachWindow(QQuickWindow *window) {
+    if (!window || !enabled) return;
+
+    // Changes handled by the GUI thread so far are in the frame being synchronized
+    QObject::connect(window, &QQuickWindow::beforeSynchronizing, window, []() {
+        passOn(handledNs, syncedNs);
+    }, Qt::DirectConnection);
+    QObject::connect(window, &QQuickWindow::frameSwapped, window, []() {
+        const int64_t now = nowNs();
+        if (lastSwapNs) frameInterval.record(now - lastSwapNs);
+        lastSwapNs = now;
+        const int64_t received = syncedNs.exchange(0, std::memory_order_acq_rel);
+        if (received) frameToPixel.record(now - received);
+    }, Qt::DirectConnection);
+}
+
+void Metrics::inputChanged(int64_t frameNs) {
+    int64_t expected = 0;
+    receivedNs.compare_exchange_strong(expected, frameNs, std::memory_order_acq_rel);
+}
+
+void Metrics::inputHandled() {
+    passOn(receivedNs, handledNs);
+}
+
+std::string Metrics::render() {
+    std::string out;
+    out.reserve(16384);
+
+    appendHeader(out, "qtapp_can_frames_total", "counter", "CAN frames received and written, per CAN ID.");
+    appendFrames(out, "rx", rxFrames);
+    appendFrames(out, "tx", txFrames);
+
+    if (rxStats && txStats) {
+        appendHeader(out, "qtapp_can_rx_overflows_total", "counter",
+                     "Frames dropped by the RX socket queue (SO_RXQ_OVFL).");
+        appendf(out, "qtapp_can_rx_overflows_total %" PRIu32 "\n", rxStats->overflows.load(std::memory_order_relaxed));
+        appendHeader(out, "qtapp_can_tx_errors_total", "counter", "Failed CAN frame writes.");
+        appendf(out, "qtapp_can_tx_errors_total %" PRIu64 "\n", txStats->errors.load(std::memory_order_relaxed));
+        appendHeader(out, "qtapp_can_tx_queue_depth", "gauge", "Frames waiting to be written.");
+        appendf(out, "qtapp_can_tx_queue_depth %" PRIu32 "\n", txStats->queueDepth.load(std::memory_order_relaxed));
+    }
+
+    appendHistogram(out, "qtapp_can_rx_decode_seconds", "Decode time of one received CAN frame.", rxDecode);
+    appendHistogram(out, "qtapp_can_tx_blink_jitter_seconds",
+                    "Deviation of the lamp command blink phases from 500 ms.", txBlinkJitter);
+    appendHistogram(out, "qtapp_frame_to_pixel_seconds",
+                    "Time from reading a CAN frame to swapping the first frame showing its change.", frameToPixel);
+    appendHistogram(out, "qtapp_frame_interval_seconds", "Time between swapped frames.", frameInterval);
+    return out;
+}
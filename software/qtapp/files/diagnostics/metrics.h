@@ -0,0 +1,173 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+class QQuickWindow;
+struct CanStats;
+
+#define HDR_SUB_BUCKET_BITS       7U      // 2^7 sub-buckets: values within 1/64 (1.6%)
+#define HDR_MAX_VALUE_BITS        40U     // Values up to 2^40 ns (18 min); larger ones are clamped
+#define HDR_SUB_BUCKET_HALF       (1U << (HDR_SUB_BUCKET_BITS - 1))
+#define HDR_BUCKETS               (HDR_MAX_VALUE_BITS - HDR_SUB_BUCKET_BITS + 1)
+#define HDR_COUNTS                ((HDR_BUCKETS + 1) * HDR_SUB_BUCKET_HALF)
+
+#define CAN_ID_COUNTER_SLOTS      256U    // Distinct CAN IDs counted; further ones go to "other"
+
+/*
+ * @brief High dynamic range histogram of nanosecond values with a fixed
+ *        relative precision, in the layout of HdrHistogram: each power of two
+ *        range is split into HDR_SUB_BUCKET_HALF linear sub-buckets.
+ *        Recording is a few relaxed atomic adds, from any thread.
+ */
+class HdrHistogram {
+public:
+    void record(int64_t valueNs) {
+        const uint64_t value = valueNs < 0 ? 0 : uint64_t(valueNs);
+        m_counts[countsIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    static unsigned countsIndex(uint64_t value) {
+        const uint64_t maxValue = (1ULL << HDR_MAX_VALUE_BITS) - 1;
+        if (value > maxValue) value = maxValue;
+        const unsigned bucket = 63U - unsigned(__builtin_clzll(value | ((1ULL << HDR_SUB_BUCKET_BITS) - 1))) -
+                                (HDR_SUB_BUCKET_BITS - 1);
+        const unsigned subBucket = unsigned(value >> bucket);
+        return bucket * HDR_SUB_BUCKET_HALF + subBucket;
+    }
+
+    /*
+     * @brief Highest value that falls into a counts index.
+     */
+    static uint64_t highestValueAt(unsigned index) {
+        unsigned bucket = index / HDR_SUB_BUCKET_HALF;
+        unsigned subBucket = index % HDR_SUB_BUCKET_HALF + HDR_SUB_BUCKET_HALF;
+        if (bucket == 0) {
+            subBucket -= HDR_SUB_BUCKET_HALF;
+        } else {
+            bucket -= 1;
+        }
+        return (uint64_t(subBucket + 1) << bucket) - 1;
+    }
+
+    uint64_t count(unsigned index) const { return m_counts[index].load(std::memory_order_relaxed); }
+    uint64_t totalCount() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_counts[HDR_COUNTS] = {};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+/*
+ * @brief Frame counters per CAN ID in a fixed open-addressing table.
+ *        A new ID claims a slot with a compare-and-swap, so counting never
+ *        allocates or locks.
+ */
+class CanIdCounters {
+public:
+    void add(uint32_t canId) {
+        const uint64_t key = uint64_t(canId) + 1;      // 0 marks a free slot
+        unsigned slot = (canId * 2654435761U) % CAN_ID_COUNTER_SLOTS;
+        for (unsigned probe = 0; probe < CAN_ID_COUNTER_SLOTS; probe++) {
+            uint64_t current = m_keys[slot].load(std::memory_order_acquire);
+            if (current == 0 &&
+                m_keys[slot].compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                current = key;
+            }
+            if (current == key) {
+                m_counts[slot].fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            slot = (slot + 1) % CAN_ID_COUNTER_SLOTS;
+        }
+        m_other.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*
+     * @brief The ID in a slot, or false if the slot is free.
+     */
+    bool slot(unsigned index, uint32_t &canId, uint64_t &count) const {
+        const uint64_t key = m_keys[index].load(std::memory_order_acquire);
+        if (key == 0) return false;
+        canId = uint32_t(key - 1);
+        count = m_counts[index].load(std::memory_order_relaxed);
+        return true;
+    }
+
+    uint64_t other() const { return m_other.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_keys[CAN_ID_COUNTER_SLOTS] = {};
+    std::atomic<uint64_t> m_counts[CAN_ID_COUNTER_SLOTS] = {};
+    std::atomic<uint64_t> m_other{0};
+};
+
+/*
+ * @brief Cluster metrics served in the Prometheus text format.
+ *
+ * The CAN threads and the render loop update the instruments below; the
+ * counters of the CAN threads' CanStats (queue depth, drops, errors) are read
+ * at scrape time. The endpoint is selected with QTAPP_METRICS:
+ *   unix:/path      HTTP on a Unix domain socket
+ *   tcp:PORT        HTTP on 127.0.0.1:PORT
+ * Nothing is recorded while it is not set.
+ */
+namespace Metrics {
+
+extern bool enabled;
+
+extern CanIdCounters rxFrames;
+extern CanIdCounters txFrames;
+extern HdrHistogram rxDecode;           // Decode time of one frame
+extern HdrHistogram txBlinkJitter;      // Deviation of the lamp blink phases from 500 ms
+extern HdrHistogram frameToPixel;       // Frame received until the frame showing it was swapped
+extern HdrHistogram frameInterval;      // Time between swapped frames
+
+/*
+ * @brief Start serving. Must be called before the CAN threads start.
+ * @param address: "unix:/path" or "tcp:PORT".
+ * @return false if the address is invalid or cannot be bound.
+ */
+bool start(const std::string &address, const CanStats &rxStats, const CanStats &txStats);
+
+/*
+ * @brief Stop serving and remove the Unix socket.
+ */
+void stop();
+
+/*
+ * @brief Record the frame interval and the frame-to-pixel latency of window.
+ */
+void attachWindow(QQuickWindow *window);
+
+/*
+ * @brief A received frame changed a value shown by the UI.
+ * @param receivedNs: CLOCK_MONOTONIC time the frame was read.
+ */
+void inputChanged(int64_t receivedNs);
+
+/*
+ * @brief The UI has handled the changes reported by inputChanged(); they are
+ *        shown by the next frame that is synchronized.
+ */
+void inputHandled();
+
+/*
+ * @brief The current metrics in the Prometheus text format.
+ */
+std::string render();
+
+} // namespace Metrics
+
+#endif // METRICS_H
@@ -0,0 +1,422 @@
+#include "trace.h"
+#include <QQuickWindow>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef QTAPP_NO_TRACE
+
+namespace {
+
+#define TRACE_DEFAULT_EVENTS      16384U
+#define TRACE_DEFAULT_FILES       10U
+
+struct TraceEventInfo {
+    const char *name;
+    const char *category;
+    const char *arg0;           // nullptr: no argument
+    const char *arg1;
+    bool hexArg0;               // Shown as a hex string (CAN IDs)
+};
+
+// Indexed by TraceEventId
+const TraceEventInfo eventInfo[TRACE_EVENT_COUNT] = {
+    { "CAN RX read",          "can",    "can_id",    nullptr,   true },
+    { "CAN RX decode",        "can",    "can_id",    "changed", true },
+    { "CAN TX lamps",         "can",    "frames",    "on",      false },
+    { "CAN TX write",         "can",    "can_id",    nullptr,   true },
+    { "TX queue depth",       "can",    "frames",    nullptr,   false },
+    { "DataProcessing",       "timer",  "tick500ms", nullptr,   false },
+    { "highBeamChanged",      "signal", "value",     nullptr,   false },
+    { "lowBeamChanged",       "signal", "value",     nullptr,   false },
+    { "parkingLightsChanged", "signal", "value",     nullptr,   false },
+    { "speedChanged",         "signal", "value",     nullptr,   false },
+    { "leftLightChanged",     "signal", "value",     nullptr,   false },
+    { "rightLightChanged",    "signal", "value",     nullptr,   false },
+    { "hazardLightsChanged",  "signal", "value",     nullptr,   false },
+    { "afterAnimating",       "render", nullptr,     nullptr,   false },
+    { "sync",                 "render", nullptr,     nullptr,   false },
+    { "render",               "render", nullptr,     nullptr,   false },
+    { "frameSwapped",         "render", nullptr,     nullptr,   false },
+};
+
+/*
+ * @brief One event slot. seq is 0 while the slot is being written and the
+ *        event index + 1 once it is complete, so a reader can detect slots
+ *        overwritten while it copies them.
+ */
+struct TraceEvent {
+    int64_t ts;
+    uint64_t arg0;
+    uint32_t dur;
+    uint32_t arg1;
+    uint16_t id;
+    char phase;
+    std::atomic<uint32_t> seq;
+};
+static_assert(sizeof(TraceEvent) == 32, "trace events are expected to be 32 bytes");
+
+struct TraceRecord {
+    int64_t ts;
+    uint64_t arg0;
+    uint32_t dur;
+    uint32_t arg1;
+    uint16_t id;
+    char phase;
+};
+
+/*
+ * @brief Event ring of one thread. Only the owning thread writes; the dump
+ *        thread reads concurrently.
+ */
+struct TraceRing {
+    explicit TraceRing(uint64_t capacity) : events(new TraceEvent[capacity]), mask(capacity - 1) {
+        for (uint64_t i = 0; i < capacity; i++) {
+            events[i].seq.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::unique_ptr<TraceEvent[]> events;
+    const uint64_t mask;
+    std::atomic<uint64_t> head{0};
+    uint64_t rolled = 0;            // Dump thread: first event not written to a rolling file yet
+    int tid = 0;
+    char name[16] = {};
+};
+
+uint64_t ringCapacity = TRACE_DEFAULT_EVENTS;
+std::mutex ringsMutex;
+std::vector<TraceRing *> rings;     // Never freed, so events of finished threads can still be dumped
+thread_local TraceRing *threadRing = nullptr;
+
+std::atomic<uint32_t> flowSeq[2][TRACE_EVENT_COUNT];
+
+std::string traceDir = "/tmp";
+unsigned rollMs = 0;
+unsigned rollFiles = TRACE_DEFAULT_FILES;
+unsigned rollIndex = 0;
+unsigned snapshotIndex = 0;
+int wakePipe[2] = { -1, -1 };
+std::thread dumpThread;
+
+TraceRing *registerThread() {
+    TraceRing *ring = new TraceRing(ringCapacity);
+    ring->tid = int(syscall(SYS_gettid));
+    pthread_getname_np(pthread_self(), ring->name, sizeof(ring->name));
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    rings.push_back(ring);
+    threadRing = ring;
+    return ring;
+}
+
+/*
+ * @brief Copy the complete events of a ring from index from on.
+ * @return The ring head at the time of the copy.
+ */
+uint64_t readRing(const TraceRing &ring, uint64_t from, std::vector<TraceRecord> &out) {
+    const uint64_t head = ring.head.load(std::memory_order_acquire);
+    const uint64_t capacity = ring.mask + 1;
+    const uint64_t start = std::max(from, head > capacity ? head - capacity : 0);
+
+    for (uint64_t i = start; i < head; i++) {
+        const TraceEvent &e = ring.events[i & ring.mask];
+        const uint32_t seq = e.seq.load(std::memory_order_acquire);
+        if (seq != uint32_t(i + 1)) continue;
+
+        const TraceRecord record = { e.ts, e.arg0, e.dur, e.arg1, e.id, e.phase };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (e.seq.load(std::memory_order_relaxed) != seq) continue;     // Overwritten meanwhile
+        out.push_back(record);
+    }
+    return head;
+}
+
+void writeArgs(FILE *file, const TraceEventInfo &info, const TraceRecord &r) {
+    if (!info.arg0) return;
+    if (info.hexArg0) {
+        fprintf(file, ",\"args\":{\"%s\":\"0x%llX\"", info.arg0, (unsigned long long)(r.arg0 & 0x1FFFFFFFULL));
+    } else {
+        fprintf(file, ",\"args\":{\"%s\":%llu", info.arg0, (unsigned long long)r.arg0);
+    }
+    if (info.arg1) {
+        fprintf(file, ",\"%s\":%u", info.arg1, r.arg1);
+    }
+    fputc('}', file);
+}
+
+void writeEvent(FILE *file, int pid, int tid, const TraceRecord &r) {
+    if (r.id >= TRACE_EVENT_COUNT) return;
+    const TraceEventInfo &info = eventInfo[r.id];
+
+    fprintf(file, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+            r.phase, info.name, info.category, pid, tid, r.ts / 1e3);
+    switch (r.phase) {
+    case 'X':
+        fprintf(file, ",\"dur\":%.3f", r.dur / 1e3);
+        writeArgs(file, info, r);
+        break;
+    case 'i':
+        fputs(",\"s\":\"t\"", file);
+        writeArgs(file, info, r);
+        break;
+    case 'C':
+        fprintf(file, ",\"args\":{\"%s\":%llu}", info.arg0 ? info.arg0 : "value", (unsigned long long)r.arg0);
+        break;
+    case 's':
+    case 'f':
+        // Flows bind to the enclosing slices: the emitter's span and the UI handler
+        fprintf(file, ",\"id\":%llu%s", (unsigned long long)r.arg0, r.phase == 'f' ? ",\"bp\":\"e\"" : "");
+        break;
+    }
+    fputc('}', file);
+}
+
+/*
+ * @brief Write the events of all rings as Chrome trace JSON.
+ * @param rolling: Only the events not yet written to a rolling file.
+ * @return Number of events written, or -1 if the file cannot be created.
+ */
+long writeTrace(const char *path, bool rolling) {
+    FILE *file = fopen(path, "w");
+    if (!file) return -1;
+
+    const int pid = int(getpid());
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+                  "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"qtapp\"}}",
+            pid, pid);
+
+    std::vector<TraceRing *> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        snapshot = rings;
+    }
+
+    long count = 0;
+    std::vector<TraceRecord> records;
+    records.reserve(ringCapacity);
+    for (TraceRing *ring : snapshot) {
+        records.clear();
+        const uint64_t head = readRing(*ring, rolling ? ring->rolled : 0, records);
+        if (rolling) ring->rolled = head;
+
+        fprintf(file, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                pid, ring->tid, ring->name);
+        for (const TraceRecord &r : records) {
+            writeEvent(file, pid, ring->tid, r);
+        }
+        count += long(records.size());
+    }
+
+    fputs("\n]}\n", file);
+    if (fclose(file) != 0) return -1;
+    return count;
+}
+
+std::string tracePath(const char *kind, unsigned index) {
+    char name[64];
+    snprintf(name, sizeof(name), "/qtapp-trace-%d-%s%u.json", int(getpid()), kind, index);
+    return traceDir + name;
+}
+
+void writeRollingFile() {
+    const std::string path = tracePath("", rollIndex);
+    const long count = writeTrace(path.c_str(), true);
+    if (count < 0) {
+        qWarning("TRACE: cannot write %s: %s", path.c_str(), strerror(errno));
+        return;
+    }
+    if (rollIndex >= rollFiles) {
+        unlink(tracePath("", rollIndex - rollFiles).c_str());
+    }
+    rollIndex++;
+}
+
+void writeSnapshot() {
+    const std::string path = tracePath("snapshot-", snapshotIndex++);
+    const long count = writeTrace(path.c_str(), false);
+    if (count < 0) {
+        qWarning("TRACE: cannot write %s: %s", path.c_str(), strerror(errno));
+    } else {
+        qInfo("TRACE: %ld events written to %s", count, path.c_str());
+    }
+}
+
+void onDumpSignal(int) {
+    const char cmd = 'd';
+    if (write(wakePipe[1], &cmd, 1) < 0) {
+        // Nothing to do in a signal handler; the dump is skipped
+    }
+}
+
+/*
+ * @brief Writes snapshots on request and the rolling files on their interval.
+ */
+void dumpLoop() {
+    int64_t nextRollNs = rollMs ? Trace::detail::nowNs() + int64_t(rollMs) * 1000000LL : 0;
+
+    for (;;) {
+        int timeout = -1;
+        if (rollMs) {
+            timeout = int(std::max<int64_t>(0, (nextRollNs - Trace::detail::nowNs()) / 1000000LL));
+        }
+
+        struct pollfd pfd = { wakePipe[0], POLLIN, 0 };
+        const int ready = poll(&pfd, 1, timeout);
+        if (ready > 0) {
+            char cmd;
+            if (read(wakePipe[0], &cmd, 1) != 1) continue;
+            if (cmd == 'q') {
+                if (rollMs) writeRollingFile();
+                return;
+            }
+            writeSnapshot();
+        } else if (ready == 0 && rollMs) {
+            writeRollingFile();
+            nextRollNs += int64_t(rollMs) * 1000000LL;
+        }
+    }
+}
+
+unsigned envUnsigned(const char *name, unsigned fallback) {
+    const char *value = getenv(name);
+    return (value && *value) ? unsigned(strtoul(value, nullptr, 10)) : fallback;
+}
+
+} // namespace
+
+bool Trace::detail::enabled = false;
+
+int64_t Trace::detail::nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+void Trace::detail::record(uint16_t id, char phase, int64_t ts, uint32_t dur, uint64_t arg0, uint32_t arg1) {
+    TraceRing *ring = threadRing ? threadRing : registerThread();
+    const uint64_t index = ring->head.load(std::memory_order_relaxed);
+    TraceEvent &e = ring->events[index & ring->mask];
+
+    e.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.ts = ts;
+    e.arg0 = arg0;
+    e.dur = dur;
+    e.arg1 = arg1;
+    e.id = id;
+    e.phase = phase;
+    e.seq.store(uint32_t(index + 1), std::memory_order_release);
+    ring->head.store(index + 1, std::memory_order_release);
+}
+
+uint64_t Trace::detail::nextFlowId(uint16_t id, bool incoming) {
+    return (uint64_t(id) << 32) | flowSeq[incoming][id].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Trace::init(bool enable) {
+    if (!enable) return;
+
+    // Power of two, so the ring index is a mask
+    const unsigned events = std::max(64U, envUnsigned("QTAPP_TRACE_EVENTS", TRACE_DEFAULT_EVENTS));
+    ringCapacity = 1;
+    while (ringCapacity < events) ringCapacity <<= 1;
+
+    if (qEnvironmentVariableIsSet("QTAPP_TRACE_DIR")) {
+        traceDir = qEnvironmentVariable("QTAPP_TRACE_DIR").toStdString();
+    }
+    rollMs = envUnsigned("QTAPP_TRACE_ROLL_MS", 0);
+    rollFiles = std::max(1U, envUnsigned("QTAPP_TRACE_FILES", TRACE_DEFAULT_FILES));
+
+    if (pipe(wakePipe) < 0) {
+        qWarning("TRACE: cannot create the dump pipe: %s", strerror(errno));
+        return;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onDumpSignal;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, nullptr);
+
+    detail::enabled = true;
+    dumpThread = std::thread(dumpLoop);
+    pthread_setname_np(dumpThread.native_handle(), "TraceDump");
+
+    qInfo("TRACE: %llu events per thread, kill -USR1 %d writes %s/qtapp-trace-%d-snapshot-N.json%s",
+          (unsigned long long)ringCapacity, int(getpid()), traceDir.c_str(), int(getpid()),
+          rollMs ? ", rolling files enabled" : "");
+}
+
+void Trace::shutdown() {
+    if (!dumpThread.joinable()) return;
+    const char cmd = 'q';
+    if (write(wakePipe[1], &cmd, 1) == 1) {
+        dumpThread.join();
+    } else {
+        dumpThread.detach();
+    }
+}
+
+void Trace::attachWindow(QQuickWindow *window) {
+    if (!window || !detail::enabled) return;
+
+    // Sync and render follow each other on the render thread, one start time each is enough
+    auto syncStart = std::make_shared<int64_t>(0);
+    auto renderStart = std::make_shared<int64_t>(0);
+
+    QObject::connect(window, &QQuickWindow::beforeSynchronizing, window, [syncStart]() {
+        *syncStart = detail::nowNs();
+    }, Qt::DirectConnection);
+    QObject::connect(window, &QQuickWindow::afterSynchronizing, window, [syncStart]() {
+        const int64_t now = detail::nowNs();
+        detail::record(TRACE_SCENE_SYNC, 'X', *syncStart, uint32_t(now - *syncStart), 0, 0);
+    }, Qt::DirectConnection);
+    QObject::connect(window, &QQuickWindow::beforeRendering, window, [renderStart]() {
+        *renderStart = detail::nowNs();
+    }, Qt::DirectConnection);
+    QObject::connect(window, &QQuickWindow::afterRendering, window, [renderStart]() {
+        const int64_t now = detail::nowNs();
+        detail::record(TRACE_SCENE_RENDER, 'X', *renderStart, uint32_t(now - *renderStart), 0, 0);
+    }, Qt::DirectConnection);
+    QObject::connect(window, &QQuickWindow::frameSwapped, window, []() {
+        instant(TRACE_FRAME_SWAP);
+    }, Qt::DirectConnection);
+    QObject::connect(window, &QQuickWindow::afterAnimating, window, []() {
+        instant(TRACE_ANIMATE);
+    }, Qt::DirectConnection);
+}
+
+bool Trace::dump(const char *path) {
+    return writeTrace(path, false) >= 0;
+}
+
+#else
+
+void Trace::init(bool enable) {
+    if (enable) qWarning("TRACE: tracing was compiled out (CONFIG+=notrace)");
+}
+
+void Trace::shutdown() {}
+
+void Trace::attachWindow(QQuickWindow *) {}
+
+bool Trace::dump(const char *) {
+    return false;
+}
+
+#endif // QTAPP_NO_TRACE
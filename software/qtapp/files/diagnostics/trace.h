@@ -0,0 +1,154 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+
+class QQuickWindow;
+
+/*
+ * @brief Trace events. Names, categories and argument names are in the
+ *        table in trace.cpp, indexed by this enum.
+ */
+enum TraceEventId : uint16_t {
+    TRACE_RX_READ = 0,          // recvmsg() of the RX thread
+    TRACE_RX_DECODE,            // Decode of one frame
+    TRACE_TX_LAMPS,             // Lamp command frames of a blink phase
+    TRACE_TX_WRITE,             // write() of one frame
+    TRACE_TX_QUEUE,             // Counter: TX queue depth
+    TRACE_DATA_TICK,            // DataProcessing timer
+    // Cross-thread signals: flow from the emitting thread to the UI handler
+    TRACE_SIG_HIGH_BEAM,
+    TRACE_SIG_LOW_BEAM,
+    TRACE_SIG_PARKING_LIGHTS,
+    TRACE_SIG_SPEED,
+    TRACE_SIG_LEFT_LIGHT,
+    TRACE_SIG_RIGHT_LIGHT,
+    TRACE_SIG_HAZARD_LIGHTS,
+    // Render loop
+    TRACE_ANIMATE,              // GUI thread: animations advanced
+    TRACE_SCENE_SYNC,           // Render thread: scene graph sync
+    TRACE_SCENE_RENDER,         // Render thread: scene graph render
+    TRACE_FRAME_SWAP,           // Render thread: frame swapped
+    TRACE_EVENT_COUNT
+};
+
+/*
+ * @brief Low-overhead event tracing exported as Chrome trace JSON, which
+ *        chrome://tracing and ui.perfetto.dev open directly.
+ *
+ * Each thread records fixed-size events (timestamp, event id, two arguments)
+ * into its own lock-free ring, overwriting the oldest ones. The rings are
+ * written out on SIGUSR1 and, with a rolling interval, periodically into a
+ * bounded set of files. Recording is enabled at startup (QTAPP_TRACE=1 or
+ * --trace); while disabled an event costs one predictable branch. Building
+ * with CONFIG+=notrace (QTAPP_NO_TRACE) compiles all recording out.
+ */
+namespace Trace {
+
+/*
+ * @brief Read the configuration and start the dump thread when tracing is
+ *        enabled. Must be called before any traced thread starts.
+ *
+ * QTAPP_TRACE_DIR       directory of the dump files (default /tmp)
+ * QTAPP_TRACE_EVENTS    events per thread ring (default 16384)
+ * QTAPP_TRACE_ROLL_MS   write the new events every this many ms (default 0, off)
+ * QTAPP_TRACE_FILES     rolling files kept (default 10)
+ *
+ * @param enable: Record events.
+ */
+void init(bool enable);
+
+/*
+ * @brief Write the last rolling file and stop the dump thread.
+ */
+void shutdown();
+
+/*
+ * @brief Record the sync, render and swap of every frame of window and the
+ *        animation ticks of the GUI thread.
+ */
+void attachWindow(QQuickWindow *window);
+
+/*
+ * @brief Write the current content of all rings to a file.
+ * @return true on success.
+ */
+bool dump(const char *path);
+
+#ifndef QTAPP_NO_TRACE
+
+namespace detail {
+extern bool enabled;
+int64_t nowNs();
+void record(uint16_t id, char phase, int64_t ts, uint32_t dur, uint64_t arg0, uint32_t arg1);
+uint64_t nextFlowId(uint16_t id, bool incoming);
+} // namespace detail
+
+inline bool enabled() { return detail::enabled; }
+
+inline void instant(TraceEventId id, uint64_t arg0 = 0, uint32_t arg1 = 0) {
+    if (detail::enabled) detail::record(id, 'i', detail::nowNs(), 0, arg0, arg1);
+}
+
+inline void counter(TraceEventId id, uint64_t value) {
+    if (detail::enabled) detail::record(id, 'C', detail::nowNs(), 0, value, 0);
+}
+
+/*
+ * @brief Start a flow at a queued signal emission. The n-th emission of a
+ *        signal is connected to the n-th Scope::flowIn() of the same id.
+ */
+inline void flowOut(TraceEventId id) {
+    if (detail::enabled) detail::record(id, 's', detail::nowNs(), 0, detail::nextFlowId(id, false), 0);
+}
+
+/*
+ * @brief A span recorded as one complete event when it goes out of scope.
+ */
+class Scope {
+public:
+    explicit Scope(TraceEventId id) : m_id(id), m_start(detail::enabled ? detail::nowNs() : 0) {}
+    ~Scope() {
+        if (m_start) detail::record(m_id, 'X', m_start, uint32_t(detail::nowNs() - m_start), m_arg0, m_arg1);
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    void setArgs(uint64_t arg0, uint32_t arg1 = 0) {
+        m_arg0 = arg0;
+        m_arg1 = arg1;
+    }
+
+    /*
+     * @brief End the flow of the signal this span handles.
+     */
+    void flowIn() {
+        if (m_start) detail::record(m_id, 'f', m_start, 0, detail::nextFlowId(m_id, true), 0);
+    }
+
+private:
+    uint16_t m_id;
+    int64_t m_start;
+    uint64_t m_arg0 = 0;
+    uint32_t m_arg1 = 0;
+};
+
+#else
+
+inline bool enabled() { return false; }
+inline void instant(TraceEventId, uint64_t = 0, uint32_t = 0) {}
+inline void counter(TraceEventId, uint64_t) {}
+inline void flowOut(TraceEventId) {}
+
+class Scope {
+public:
+    explicit Scope(TraceEventId) {}
+    void setArgs(uint64_t, uint32_t = 0) {}
+    void flowIn() {}
+};
+
+#endif // QTAPP_NO_TRACE
+
+} // namespace Trace
+
+#endif // TRACE_H
@@ -1,26 +1,196 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include "communication/canhandler.h"
+#include "communication/canblackbox.h"
+#include "ui/gaugeitem.h"
+#include "ui/perfhud.h"
+#include "diagnostics/boottrace.h"
+#include "diagnostics/log.h"
+#include "diagnostics/trace.h"
+#include "diagnostics/metrics.h"
+#include "state/vehiclestate.h"
 #include <QQmlContext>
+#include <qqml.h>
 #include <QDir>
+#include <QFile>
+#include <QQuickWindow>
+#include <QSocketNotifier>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Self-pipe of the termination signals, read by the event loop
+static int terminationPipe[2] = { -1, -1 };
+
+static void onTerminationSignal(int) {
+    const int savedErrno = errno;
+    const char cmd = 't';
+    if (write(terminationPipe[1], &cmd, 1) < 0) {
+        // Nothing to do in a signal handler, the pipe is only full if a quit is already pending
+    }
+    errno = savedErrno;
+}
+
+/*
+ * @brief Quit the event loop on SIGTERM (systemctl stop) and SIGINT, so the
+ *        shutdown after app.exec() runs: vehicle state flush, black box and
+ *        trace shutdown. A second signal terminates immediately.
+ */
+static void installTerminationHandler(QCoreApplication *app) {
+    if (pipe2(terminationPipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        qWarning("Cannot create the termination pipe: %s", strerror(errno));
+        return;
+    }
+    QSocketNotifier *notifier = new QSocketNotifier(terminationPipe[0], QSocketNotifier::Read, app);
+    auto onSignal = [notifier]() {
+        char cmd;
+        while (read(terminationPipe[0], &cmd, 1) == 1) {}
+        notifier->setEnabled(false);
+        qInfo("Termination signal received, shutting down");
+        QCoreApplication::quit();
+    };
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    QObject::connect(notifier, QOverload<int>::of(&QSocketNotifier::activated), app, onSignal);
+#else
+    QObject::connect(notifier, &QSocketNotifier::activated, app, onSignal);
+#endif
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onTerminationSignal;
+    sa.sa_flags = SA_RESTART | SA_RESETHAND;
+    sigaction(SIGTERM, &sa, nullptr);
+    sigaction(SIGINT, &sa, nullptr);
+}
 
 int main(int argc, char *argv[])
 {
+    BootTrace::start();
+
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 #endif
     QGuiApplication app(argc, argv);
+    installTerminationHandler(&app);
+    BootTrace::mark("application created");
+
+    // Last known state, applied before the first frame and reconciled by live CAN data
+    const QString statePath = qEnvironmentVariable("QTAPP_STATE_FILE", QStringLiteral(VEHICLE_STATE_DEFAULT_PATH));
+    VehicleStateStore vehicleState(statePath);
+    vehicleState.open();
+    BootTrace::mark("vehicle state restored");
+
+    // Asynchronous logger of the CAN threads, levels from QTAPP_LOG
+    Log::init();
+
+    // Event tracing of the CAN threads and the render loop, dumped on SIGUSR1;
+    // must be enabled before any traced thread starts
+    Trace::init(app.arguments().contains(QStringLiteral("--trace")) ||
+                qEnvironmentVariableIntValue("QTAPP_TRACE") == 1);
+
+    // Black box of the received frames in rotating files on tmpfs, kill -USR2 freezes
+    // the pre-trigger window into an event file on flash. Declared first, it outlives
+    // the RX thread. QTAPP_BLACKBOX=0 disables it; not used while replaying.
+    CanBlackBox blackBox;
+    bool blackBoxEnabled = qEnvironmentVariable("QTAPP_BLACKBOX") != QLatin1String("0") &&
+                           !qEnvironmentVariableIsSet("QTAPP_CAN_REPLAY");
+    if (blackBoxEnabled) {
+        auto envUnsigned = [](const char *name, unsigned fallback) {
+            bool ok = false;
+            const int value = qEnvironmentVariableIntValue(name, &ok);
+            return ok && value > 0 ? unsigned(value) : fallback;
+        };
+        CanBlackBox::Config config;
+        config.dir = qEnvironmentVariable("QTAPP_BLACKBOX_DIR", QStringLiteral(CAN_BB_DEFAULT_DIR)).toStdString();
+        config.eventDir = qEnvironmentVariable("QTAPP_BLACKBOX_EVENT_DIR", QStringLiteral(CAN_BB_DEFAULT_EVENT_DIR)).toStdString();
+        config.files = envUnsigned("QTAPP_BLACKBOX_FILES", config.files);
+        config.fileMb = envUnsigned("QTAPP_BLACKBOX_FILE_MB", config.fileMb);
+        config.preTriggerS = envUnsigned("QTAPP_BLACKBOX_PRETRIGGER_S", config.preTriggerS);
+        config.events = envUnsigned("QTAPP_BLACKBOX_EVENTS", config.events);
+        blackBoxEnabled = blackBox.start(config);
+        if (blackBoxEnabled) {
+            qInfo("BLACKBOX: recording to %s, %u x %u MB, events to %s", config.dir.c_str(), config.files, config.fileMb,
+                  config.eventDir.c_str());
+        }
+    }
 
     // qDebug() << "Current working dir:" << QDir::currentPath();
+    // CAN threads come up (config parse, socket bind) in parallel with the QML engine load below
     CanHandler canHandler; // Create an instance of CanHandler
 
+    // Performance HUD; nothing of it exists unless enabled
+    const bool perfHudEnabled = app.arguments().contains(QStringLiteral("--perf-hud")) ||
+                                qEnvironmentVariableIntValue("QTAPP_PERF_HUD") == 1;
+
+    // Metrics endpoint in the Prometheus text format: QTAPP_METRICS=unix:/path or tcp:PORT (loopback)
+    const QString metricsAddress = qEnvironmentVariable("QTAPP_METRICS");
+    const bool metricsEnabled = !metricsAddress.isEmpty() &&
+                                Metrics::start(metricsAddress.toStdString(), canHandler.rxStats(), canHandler.txStats());
+    canHandler.rxStats().timing = perfHudEnabled || metricsEnabled;
+
+    if (blackBoxEnabled) {
+        canHandler.setBlackBox(&blackBox);
+    }
+
+    if (qEnvironmentVariableIsSet("QTAPP_CAN_IF")) {
+        canHandler.setInterface(qgetenv("QTAPP_CAN_IF"));
+    }
+
+    // Offline reproduction: feed a recorded drive through the decode path.
+    // QTAPP_CAN_REPLAY_SPEED scales the original timing (0 = as fast as possible).
+    const QString replayPath = qEnvironmentVariable("QTAPP_CAN_REPLAY");
+    if (!replayPath.isEmpty()) {
+        bool ok = false;
+        const double speed = qEnvironmentVariable("QTAPP_CAN_REPLAY_SPEED").toDouble(&ok);
+        canHandler.setReplay(replayPath, ok ? speed : 1.0);
+        if (qEnvironmentVariableIntValue("QTAPP_CAN_REPLAY_EXIT") == 1) {
+            QObject::connect(&canHandler, &CanHandler::replayFinished, &app, &QCoreApplication::quit, Qt::QueuedConnection);
+        }
+    }
+
+    if (vehicleState.hasSnapshot()) {
+        const VehicleState &last = vehicleState.state();
+        canHandler.restoreInputs(last.lights & VEHICLE_STATE_LIGHT_HIGH_BEAM,
+                                 last.lights & VEHICLE_STATE_LIGHT_LOW_BEAM,
+                                 last.lights & VEHICLE_STATE_LIGHT_PARKING,
+                                 last.speed);
+    }
+    QObject::connect(&canHandler, &CanHandler::highBeamChanged, &vehicleState, &VehicleStateStore::setHighBeam);
+    QObject::connect(&canHandler, &CanHandler::lowBeamChanged, &vehicleState, &VehicleStateStore::setLowBeam);
+    QObject::connect(&canHandler, &CanHandler::parkingLightsChanged, &vehicleState, &VehicleStateStore::setParkingLights);
+    canHandler.start();
+    BootTrace::mark("CAN threads started");
+
     QObject::connect(&app, &QCoreApplication::aboutToQuit, [](){
         return 0; // Ensure the application exits cleanly
     });
+    QObject::connect(&app, &QCoreApplication::aboutToQuit, &vehicleState, &VehicleStateStore::flush);
+
+    qmlRegisterType<GaugeItem>("Cluster", 1, 0, "Gauge");
+    qmlRegisterType<FrameTimeGraph>("Cluster", 1, 0, "FrameTimeGraph");
+    qmlRegisterUncreatableType<PerfMonitor>("Cluster", 1, 0, "PerfMonitor", "Provided by the application");
+
+    PerfMonitor *perfMonitor = perfHudEnabled ? new PerfMonitor(canHandler.rxStats(), canHandler.txStats(), &app) : nullptr;
 
     QQmlApplicationEngine engine;
+    BootTrace::mark("QML engine created");
 
     engine.rootContext()->setContextProperty("canHandler", &canHandler); // Expose CanHandler to QML
+    engine.rootContext()->setContextProperty("vehicleState", &vehicleState);
+    engine.rootContext()->setContextProperty("perfHudEnabled", perfHudEnabled);
+    engine.rootContext()->setContextProperty("perfMonitor", perfMonitor);
+
+    // Prefer the GPU-compressed textures from the asset pipeline, fall back to PNG
+    // when none were built or QTAPP_ASSET_FORMAT=png is set
+    const bool useKtx = QFile::exists(":/assets/background.ktx") &&
+                        qEnvironmentVariable("QTAPP_ASSET_FORMAT") != QLatin1String("png");
+    engine.rootContext()->setContextProperty("assetExt", useKtx ? QStringLiteral("ktx") : QStringLiteral("png"));
+
+    // Fast boot: secondary widgets are loaded asynchronously after the first frame.
+    // QTAPP_FAST_BOOT=0 loads everything synchronously to compare startup times.
+    engine.rootContext()->setContextProperty("fastBoot", qEnvironmentVariable("QTAPP_FAST_BOOT") != QLatin1String("0"));
 
     const QUrl url(QStringLiteral("qrc:/main.qml"));
     QObject::connect(&engine, &QQmlApplicationEngine::objectCreated,
@@ -29,6 +199,25 @@ int main(int argc, char *argv[])
             QCoreApplication::exit(-1);
     }, Qt::QueuedConnection);
     engine.load(url);
+    BootTrace::mark("main.qml loaded");
+
+    if (!engine.rootObjects().isEmpty()) {
+        QQuickWindow *window = qobject_cast<QQuickWindow *>(engine.rootObjects().first());
+        BootTrace::markFirstFrame(window);
+        Trace::attachWindow(window);
+        Metrics::attachWindow(window);
+        if (perfMonitor) {
+            perfMonitor->attach(window);
+        }
+    }
+
+    const int ret = app.exec();
 
-    return app.exec();
+    // No frame may reach the black box, the logger or the tracer once they are shut down
+    canHandler.stop();
+    blackBox.stop();
+    Metrics::stop();
+    Trace::shutdown();
+    Log::shutdown();
+    return ret;
 }
@@ -3,6 +3,7 @@ import QtQuick.Controls 2.15
 import QtQuick.Layouts 1.15
 import QtQuick.Window 2.15
 import QtGraphicalEffects 1.15
+import Cluster 1.0
 
 ApplicationWindow {
     id: window
@@ -17,6 +18,9 @@ ApplicationWindow {
     Component.onCompleted: {
         console.log("Window size:", width, height)
         console.log("Screen size:", Screen.width, Screen.height)
+
+        // Fill the derived trip values from the restored snapshot before the first frame
+        updateTrip(0)
     }
 
     property real minSpeed: 0
@@ -25,25 +29,22 @@ ApplicationWindow {
     readonly property real minRot:  -108
     readonly property real maxRot:   108
 
-    property int speed: 0
+    property int speed: canHandler.speed
     property string gear: "D"
     property real delta_distance_km: 0
-    property real trip: 0
+    property real trip: vehicleState.restored.trip
     property real blendingFactor: 0
-    property real avg_consumption_short_term: 0
+    property real avg_consumption_short_term: vehicleState.restored.avgConsumption
     property real final_avg_consumption: 0
     property real dte_km: 0
 
     property int battery: 0
     property real instant_consumption_kWh_per_100km: 0
     property real energy_used_kWh_this_tick: 0
-    property real cumulative_energy_used_kWh: 0
-    property real energy_remaining_kWh: 0
+    property real cumulative_energy_used_kWh: vehicleState.restored.energyUsed
+    property real energy_remaining_kWh: battery_capacity_kWh * (initial_SoC_percent / 100.0) - cumulative_energy_used_kWh
     readonly property int battery_capacity_kWh: 75
     readonly property int initial_SoC_percent: 100
-    
-    property var analogBuffer: []      // Buffer for recent analog values
-    property int analogBufferSize: 10  // Number of samples for smoothing
 
     property string time: {
         var now = new Date()
@@ -56,44 +57,18 @@ ApplicationWindow {
         return Qt.formatDate(now, "dd/MM/yyyy")
     }
     property string temp: "28°C"
-    property real odometer: 38923
+    property real odometer: vehicleState.hasSnapshot ? vehicleState.restored.odometer : 38923
+
+    property bool highBeamOn: vehicleState.restored.highBeam
+    property bool lowBeamOn: vehicleState.restored.lowBeam
+    property bool parkingLightsOn: vehicleState.restored.parkingLights
+    property bool hazardLightsOn: false
+    property bool turnLeftOn: false
+    property bool turnRightOn: false
 
     Timer {
         interval: 100; running: true; repeat: true
-        onTriggered: {
-            time = Qt.formatTime(new Date(), "hh:mm")
-            date = Qt.formatDate(new Date(), "dd/MM/yyyy")
-
-            delta_distance_km = speed * (0.1 / 3600)
-
-            trip += delta_distance_km
-            odometer += delta_distance_km
-
-            // Calculate DTE (Distance to Empty)
-            blendingFactor = Math.min(trip / 50.0, 1.0)
-            if (trip > 0.0) {
-                avg_consumption_short_term =
-                    0.9 * avg_consumption_short_term +
-                    0.1 * consumptionFromSpeed(speed)
-            }
-            // Calculate avg_consumption_long_term
-            var avg_consumption_long_term = 0.0
-            if (trip > 0.0) {
-                avg_consumption_long_term = (cumulative_energy_used_kWh / trip) * 100
-            }
-            final_avg_consumption = Math.max((blendingFactor * avg_consumption_short_term) +
-                        ((1.0 - blendingFactor) * avg_consumption_long_term), 0.5); // kWh/100km
-            dte_km = (energy_remaining_kWh / final_avg_consumption) * 100.0;
-
-            // Calculate battery
-            instant_consumption_kWh_per_100km = consumptionFromSpeed(speed)
-            energy_used_kWh_this_tick = instant_consumption_kWh_per_100km * delta_distance_km / 100.0
-
-            cumulative_energy_used_kWh += energy_used_kWh_this_tick
-            energy_remaining_kWh = battery_capacity_kWh * (initial_SoC_percent / 100.0) - cumulative_energy_used_kWh
-
-            battery = Math.max(0, Math.min(100, (energy_remaining_kWh / battery_capacity_kWh) * 100))
-        }
+        onTriggered: updateTrip(0.1)
     }
 
     FontLoader {
@@ -103,7 +78,7 @@ ApplicationWindow {
 
     Image {
         id: backgroundImage
-        source: "qrc:/images/background.png"
+        source: "qrc:/assets/background." + assetExt
         anchors.fill: parent
         fillMode: Image.PreserveAspectFit
         z: 0
@@ -111,187 +86,28 @@ ApplicationWindow {
 
     Image {
         id: centreArrowImage
-        source: "qrc:/images/centre.png"
+        source: "qrc:/assets/centre.png"
         x: (window.width - centreArrowImage.width) / 2
         y: (window.height - centreArrowImage.height) / 2 + 6
         fillMode: Image.PreserveAspectFit
         z: 2
     }
 
-    Image {
+    Gauge {
         id: arrowImage
-        source: "qrc:/images/arrow.png"
+        needleSource: "qrc:/assets/arrow.png"
         x: (window.width - arrowImage.width) / 2
         y: (window.height - arrowImage.height) / 2 - 1
-        rotation : speedToRotation(speed)
+        minimumValue: minSpeed
+        maximumValue: maxSpeed
+        minimumAngle: minRot
+        maximumAngle: maxRot
+        extrapolate: false
+        value: canHandler.speed
+        valueTimestamp: canHandler.speedTimestamp
         z: 1
     }
 
-    Rectangle {
-        id: highBeamRec
-        width: 40
-        height: 40
-        x: 293
-        y: 6
-        color: "transparent"
-
-        Image {
-            id: highBeamImage
-            source: "qrc:/images/high_beam.png"
-            visible: false
-            anchors.fill: parent
-            fillMode: Image.PreserveAspectFit
-        }
-    }
-
-    Rectangle {
-        id: lowBeamRec
-        width: 40
-        height: 40
-        x: 376
-        y: 9
-        color: "transparent"
-
-        Image {
-            id: lowBeamImage
-            source: "qrc:/images/low_beam.png"
-            visible: false
-            anchors.fill: parent
-            fillMode: Image.PreserveAspectFit
-        }
-    }
-
-    Rectangle {
-        id: parkingLightsRec
-        width: 40
-        height: 40
-        x: 612
-        y: 7
-        color: "transparent"
-
-        Image {
-            id: parkingLightsImage
-            source: "qrc:/images/parking_lights.png"
-            visible: false
-            anchors.fill: parent
-            fillMode: Image.PreserveAspectFit
-        }
-    }
-
-    Rectangle {
-        id: hazardLightsRec
-        width: 40
-        height: 40
-        x: 692
-        y: 7
-        color: "transparent"
-
-        Image {
-            id: hazardLightsImage
-            source: "qrc:/images/hazard.png"
-            visible: false
-            anchors.fill: parent
-            fillMode: Image.PreserveAspectFit
-        }
-    }
-
-    Rectangle {
-        id: turnLeftRec
-        width: 40
-        height: 40
-        x: 39
-        y: 77
-        color: "transparent"
-
-        Image {
-            id: turnLeftImage
-            source: "qrc:/images/left_arrow.png"
-            visible: false
-            anchors.fill: parent
-            fillMode: Image.PreserveAspectFit
-        }
-    }
-
-    Rectangle {
-        id: turnRightRec
-        width: 40
-        height: 40
-        x: 945
-        y: 77
-        color: "transparent"
-
-        Image {
-            id: turnRightImage
-            source: "qrc:/images/right_arrow.png"
-            visible: false
-            anchors.fill: parent
-            fillMode: Image.PreserveAspectFit
-        }
-    }
-
-    Text {
-        id: tripText
-        text: "Trip"
-        x: 775
-        y: 190
-        color: "#EF4D7D"
-        font.family: myFont.name
-        font.pixelSize: 28
-        horizontalAlignment: Text.AlignLeft
-    }
-
-    Text {
-        text: trip.toFixed(1) + " KM"
-        x: 775
-        y: tripText.y + 38
-        color: "white"
-        font.family: myFont.name
-        font.pixelSize: 28
-        horizontalAlignment: Text.AlignLeft
-    }
-
-    Text {
-        id: distanceText
-        text: "Distance"
-        x: 775
-        y: 270
-        color: "#EF4D7D"
-        font.family: myFont.name
-        font.pixelSize: 28
-        horizontalAlignment: Text.AlignLeft
-    }
-
-    Text {
-        text: dte_km.toFixed(1) + " KM"
-        x: 775
-        y: distanceText.y + 38
-        color: "white"
-        font.family: myFont.name
-        font.pixelSize: 28
-        horizontalAlignment: Text.AlignLeft
-    }
-
-    Text {
-        id: tempText
-        text: "Temperature"
-        x: 775
-        y: 350
-        color: "#EF4D7D"
-        font.family: myFont.name
-        font.pixelSize: 28
-        horizontalAlignment: Text.AlignLeft
-    }
-
-    Text {
-        text: temp
-        x: 775
-        y: tempText.y + 38
-        color: "white"
-        font.family: myFont.name
-        font.pixelSize: 28
-        horizontalAlignment: Text.AlignLeft
-    }
-
     Rectangle {
         id: speedRec
         width: 128
@@ -325,152 +141,77 @@ ApplicationWindow {
         }
     }
 
-    Rectangle {
-        id: batRec
-        width: 64 * (battery / 100)
-        height: 24
-        x: 773
-        y: 557
-        radius: 3
-
-        color: {
-            if (battery > 50) return "#36c75b"
-            else if (battery > 20) return "#fbca0a"
-            else return "#f70e02"
-        }
-
-        Behavior on color {
-            ColorAnimation {
-                duration: 500
-            }
-        }
+    // Telltales and trip widgets are not needed for the first frame, they are
+    // incubated after it so the dial and needle show up as early as possible.
+    // A restored snapshot must be visible in the first frame, so they are then
+    // created synchronously with it
+    Loader {
+        anchors.fill: parent
+        asynchronous: fastBoot && !vehicleState.hasSnapshot
+        source: "qrc:/Telltales.qml"
+        onLoaded: console.log("Telltales loaded")
     }
 
-    Rectangle {
-        id: batTextRec
-        width: 100
-        height: 45
-        x: 850
-        y: 556
-        color: "transparent"
-
-        Text {
-            id: batText
-            text: battery + "%"
-            color: "white"
-            font.family: myFont.name
-            font.pixelSize: 32
-            anchors.right: parent.right
-            horizontalAlignment: Text.AlignLeft
-        }
+    Loader {
+        anchors.fill: parent
+        asynchronous: fastBoot && !vehicleState.hasSnapshot
+        source: "qrc:/TripInfo.qml"
+        onLoaded: console.log("Trip widgets loaded")
     }
 
-    Text {
-        id: timeText
-        text: time
-        x: (window.width - timeText.width) / 2
-        y: 15
-        color: "white"
-        font.family: myFont.name
-        font.pixelSize: 32
-        horizontalAlignment: Text.AlignHCenter
+    Loader {
+        x: 8
+        y: 90
+        z: 100
+        active: perfHudEnabled
+        source: "qrc:/PerfHud.qml"
     }
 
-    Text {
-        id: dateText
-        text: date
-        x: 780
-        y: 21
-        color: "white"
-        font.family: myFont.name
-        font.pixelSize: 32
-        horizontalAlignment: Text.AlignHCenter
+    Connections {
+        target: canHandler
+        onLeftLightChanged: turnLeftOn = leftLight
+        onRightLightChanged: turnRightOn = rightLight
+        onHazardLightsChanged: hazardLightsOn = hazardLights
+        onHighBeamChanged: highBeamOn = highBeam
+        onLowBeamChanged: lowBeamOn = lowBeam
+        onParkingLightsChanged: parkingLightsOn = parkingLights
     }
 
-    Text {
-        text: "ODO:"
-        x: 37
-        y: 21
-        color: "white"
-        font.family: myFont.name
-        font.pixelSize: 32
-        horizontalAlignment: Text.AlignHCenter
-    }
+    function updateTrip(seconds) {
+        time = Qt.formatTime(new Date(), "hh:mm")
+        date = Qt.formatDate(new Date(), "dd/MM/yyyy")
 
-    Rectangle {
-        id: odometerRec
-        width: 115
-        height: 50
-        x: 128
-        y: 21
-        color: "transparent"
+        delta_distance_km = speed * (seconds / 3600)
 
-        Text {
-            id: odometerText
-            text: odometer.toFixed(0)
-            color: "white"
-            font.family: myFont.name
-            font.pixelSize: 32
-            anchors.right: parent.right
-            horizontalAlignment: Text.AlignRight
+        trip += delta_distance_km
+        odometer += delta_distance_km
+
+        // Calculate DTE (Distance to Empty)
+        blendingFactor = Math.min(trip / 50.0, 1.0)
+        if (trip > 0.0 && seconds > 0) {
+            avg_consumption_short_term =
+                0.9 * avg_consumption_short_term +
+                0.1 * consumptionFromSpeed(speed)
         }
-    }
+        // Calculate avg_consumption_long_term
+        var avg_consumption_long_term = 0.0
+        if (trip > 0.0) {
+            avg_consumption_long_term = (cumulative_energy_used_kWh / trip) * 100
+        }
+        final_avg_consumption = Math.max((blendingFactor * avg_consumption_short_term) +
+                    ((1.0 - blendingFactor) * avg_consumption_long_term), 0.5); // kWh/100km
+        dte_km = (energy_remaining_kWh / final_avg_consumption) * 100.0;
 
-    Rectangle {
-        id: gearRec
-        width: 202
-        height: 50
-        x: 65
-        y: 547
-        color: "transparent"
+        // Calculate battery
+        instant_consumption_kWh_per_100km = consumptionFromSpeed(speed)
+        energy_used_kWh_this_tick = instant_consumption_kWh_per_100km * delta_distance_km / 100.0
 
-        // Gear selector
-        RowLayout {
-            anchors.centerIn: parent
-            spacing: 20
-
-            Repeater {
-                model: ["P", "R", "N", "D"]
-                delegate: Text {
-                    text: modelData
-                    font.pixelSize: 32
-                    font.family: myFont.name
-                    color: gear === modelData ? "white" : "#AAAAAA"
-                    horizontalAlignment: Text.AlignRight
-                }
-            }
-        }
-    }
+        cumulative_energy_used_kWh += energy_used_kWh_this_tick
+        energy_remaining_kWh = battery_capacity_kWh * (initial_SoC_percent / 100.0) - cumulative_energy_used_kWh
 
-    Connections {
-        target: canHandler
-        onLeftLightChanged: turnLeftImage.visible = leftLight
-        onRightLightChanged: turnRightImage.visible = rightLight
-        onHazardLightsChanged: hazardLightsImage.visible = hazardLights
-        onHighBeamChanged: highBeamImage.visible = highBeam
-        onLowBeamChanged: lowBeamImage.visible = lowBeam
-        onParkingLightsChanged: parkingLightsImage.visible = parkingLights
-        onSpeedChanged: {
-            // Add new value to buffer
-            analogBuffer.push(analogVal)
-            if (analogBuffer.length > analogBufferSize)
-                analogBuffer.shift() // Remove oldest
-
-            // Calculate average
-            var sum = 0
-            for (var i = 0; i < analogBuffer.length; ++i)
-                sum += analogBuffer[i]
-            var avgAnalog = sum / analogBuffer.length
-
-            // Use average for speed calculation
-            speed = avgAnalog * maxSpeed / 4000;
-            speed = Math.max(minSpeed, Math.min(maxSpeed, speed));
-        }
-    }
+        battery = Math.max(0, Math.min(100, (energy_remaining_kWh / battery_capacity_kWh) * 100))
 
-    function speedToRotation(speed) {
-        var t = (speed - minSpeed) / (maxSpeed - minSpeed)
-        return minRot + (maxRot - minRot) * t
+        vehicleState.update(speed, trip, odometer, cumulative_energy_used_kWh, avg_consumption_short_term)
     }
 
     function consumptionFromSpeed(v) {
@@ -1,18 +1,66 @@
 QT += quick
 
+# Compile QML ahead of time so startup does not parse main.qml from source
+CONFIG += qtquickcompiler
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+        communication/canblackbox.cpp \
         communication/canhandler.cpp \
+        communication/canlog.cpp \
+        communication/canprotocol.cpp \
+        ui/gaugeitem.cpp \
+        ui/perfhud.cpp \
+        diagnostics/boottrace.cpp \
+        diagnostics/log.cpp \
+        diagnostics/metrics.cpp \
+        diagnostics/trace.cpp \
+        state/vehiclestate.cpp \
         main.cpp
 
-HEADERS += communication/canhandler.h
+HEADERS += communication/canblackbox.h \
+        communication/canhandler.h \
+        communication/canlog.h \
+        communication/canprotocol.h \
+        ui/gaugeitem.h \
+        ui/perfhud.h \
+        diagnostics/boottrace.h \
+        diagnostics/log.h \
+        diagnostics/metrics.h \
+        diagnostics/trace.h \
+        state/vehiclestate.h
+
+# Event tracing (QTAPP_TRACE=1) is compiled in; CONFIG+=notrace removes it entirely
+notrace: DEFINES += QTAPP_NO_TRACE
+
+# Block compression of the CAN black box
+LIBS += -lz
 
 RESOURCES += qml.qrc \
-    Fonts.qrc \
-    Images.qrc
+    Fonts.qrc
+
+# Build-time asset pipeline: scales the images to the display, packs the
+# telltales into one atlas and adds KTX textures when an encoder is installed.
+# Runs as a make rule on the source images, so editing one regenerates the
+# resource, and rcc compiles the generated assets.qrc in the same step.
+DISPLAY_WIDTH = 1024
+DISPLAY_HEIGHT = 600
+ASSETS_OUT = $$OUT_PWD/generated
+ASSET_IMAGES = $$files($$PWD/images/*.png)
+qtPrepareTool(ASSETS_RCC, rcc)
+
+assets.name = ASSETS
+assets.input = ASSET_IMAGES
+assets.output = $$ASSETS_OUT/qrc_assets.cpp
+assets.commands = sh $$shell_quote($$PWD/tools/build_assets.sh) $$shell_quote($$PWD/images) $$shell_quote($$ASSETS_OUT) $$DISPLAY_WIDTH $$DISPLAY_HEIGHT \
+    && $$ASSETS_RCC -name assets $$shell_quote($$ASSETS_OUT/assets.qrc) -o ${QMAKE_FILE_OUT}
+assets.depends = $$PWD/tools/build_assets.sh
+assets.variable_out = SOURCES
+assets.CONFIG += combine target_predeps
+QMAKE_EXTRA_COMPILERS += assets
 
 # Additional import path used to resolve QML modules in Qt Creator's code model
 QML_IMPORT_PATH =
@@ -28,7 +76,7 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 HEADERS += \
     communication/canhandler.h
 
-DISTFILES +=
+DISTFILES += tools/build_assets.sh
 
 json.path = $$OUT_PWD/configs
 json.files = $$PWD/configs/io_config.json
@@ -0,0 +1,166 @@
+#include "vehiclestate.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+#include <cstddef>
+#include <cstring>
+#include <sys/mman.h>
+
+#define VEHICLE_STATE_MAGIC   0x53554356UL  // "VCUS"
+#define VEHICLE_STATE_VERSION 1U
+#define VEHICLE_STATE_SLOTS   2
+
+namespace {
+
+/*
+ * @brief On-disk slot. The checksum covers everything from sequence onwards.
+ */
+struct VehicleStateSlot {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t checksum;
+    uint32_t sequence;
+    VehicleState state;
+};
+
+uint32_t slotChecksum(const VehicleStateSlot &slot) {
+    const char *begin = reinterpret_cast<const char *>(&slot) + offsetof(VehicleStateSlot, sequence);
+    return qChecksum(begin, sizeof(VehicleStateSlot) - offsetof(VehicleStateSlot, sequence));
+}
+
+bool slotIsValid(const VehicleStateSlot &slot) {
+    return slot.magic == VEHICLE_STATE_MAGIC &&
+           slot.version == VEHICLE_STATE_VERSION &&
+           slot.size == sizeof(VehicleStateSlot) &&
+           slot.checksum == slotChecksum(slot);
+}
+
+} // namespace
+
+VehicleStateStore::VehicleStateStore(const QString &path, int minFlushIntervalMs, QObject *parent)
+    : QObject(parent), m_file(path), m_minFlushIntervalMs(minFlushIntervalMs) {
+    m_flushTimer.setSingleShot(true);
+    connect(&m_flushTimer, &QTimer::timeout, this, &VehicleStateStore::flush);
+}
+
+VehicleStateStore::~VehicleStateStore() {
+    flush();
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+}
+
+bool VehicleStateStore::open() {
+    QDir().mkpath(QFileInfo(m_file).absolutePath());
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "State: cannot open" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+
+    const qint64 mapSize = VEHICLE_STATE_SLOTS * sizeof(VehicleStateSlot);
+    if (m_file.size() != mapSize && !m_file.resize(mapSize)) {
+        qWarning() << "State: cannot resize" << m_file.fileName();
+        return false;
+    }
+    m_map = m_file.map(0, mapSize);
+    if (!m_map) {
+        qWarning() << "State: cannot map" << m_file.fileName();
+        return false;
+    }
+
+    // Pick the valid slot with the newest sequence number
+    const VehicleStateSlot *slots = reinterpret_cast<const VehicleStateSlot *>(m_map);
+    int newest = -1;
+    for (int i = 0; i < VEHICLE_STATE_SLOTS; i++) {
+        if (slotIsValid(slots[i]) && (newest < 0 || int32_t(slots[i].sequence - slots[newest].sequence) > 0)) {
+            newest = i;
+        }
+    }
+    if (newest < 0) {
+        return false;
+    }
+
+    m_state = slots[newest].state;
+    m_restored = m_state;
+    m_sequence = slots[newest].sequence;
+    m_nextSlot = (newest + 1) % VEHICLE_STATE_SLOTS;
+    m_hasSnapshot = true;
+    qDebug() << "State: restored snapshot" << m_sequence << "trip" << m_state.trip << "odometer" << m_state.odometer;
+    return true;
+}
+
+QVariantMap VehicleStateStore::restored() const {
+    return {
+        { QStringLiteral("speed"), m_restored.speed },
+        { QStringLiteral("trip"), m_restored.trip },
+        { QStringLiteral("odometer"), m_restored.odometer },
+        { QStringLiteral("energyUsed"), m_restored.energyUsed },
+        { QStringLiteral("avgConsumption"), m_restored.avgConsumption },
+        { QStringLiteral("highBeam"), bool(m_restored.lights & VEHICLE_STATE_LIGHT_HIGH_BEAM) },
+        { QStringLiteral("lowBeam"), bool(m_restored.lights & VEHICLE_STATE_LIGHT_LOW_BEAM) },
+        { QStringLiteral("parkingLights"), bool(m_restored.lights & VEHICLE_STATE_LIGHT_PARKING) },
+    };
+}
+
+void VehicleStateStore::update(qreal speed, qreal trip, qreal odometer, qreal energyUsed, qreal avgConsumption) {
+    if (m_state.speed == float(speed) && m_state.trip == trip && m_state.odometer == odometer &&
+        m_state.energyUsed == energyUsed && m_state.avgConsumption == avgConsumption) {
+        return;
+    }
+    m_state.speed = float(speed);
+    m_state.trip = trip;
+    m_state.odometer = odometer;
+    m_state.energyUsed = energyUsed;
+    m_state.avgConsumption = avgConsumption;
+    markDirty();
+}
+
+void VehicleStateStore::setHighBeam(bool on) { setLight(VEHICLE_STATE_LIGHT_HIGH_BEAM, on); }
+void VehicleStateStore::setLowBeam(bool on) { setLight(VEHICLE_STATE_LIGHT_LOW_BEAM, on); }
+void VehicleStateStore::setParkingLights(bool on) { setLight(VEHICLE_STATE_LIGHT_PARKING, on); }
+
+void VehicleStateStore::setLight(uint32_t bit, bool on) {
+    const uint32_t lights = on ? (m_state.lights | bit) : (m_state.lights & ~bit);
+    if (lights == m_state.lights) return;
+    m_state.lights = lights;
+    markDirty();
+}
+
+/*
+ * @brief Schedule a write no sooner than the flush interval after the last one.
+ */
+void VehicleStateStore::markDirty() {
+    m_dirty = true;
+    if (m_flushTimer.isActive()) return;
+
+    const qint64 elapsed = m_sinceFlush.isValid() ? m_sinceFlush.elapsed() : m_minFlushIntervalMs;
+    m_flushTimer.start(int(qMax<qint64>(0, m_minFlushIntervalMs - elapsed)));
+}
+
+void VehicleStateStore::flush() {
+    m_flushTimer.stop();
+    if (!m_dirty || !m_map) return;
+
+    // Timer-driven writes are left to the kernel writeback; explicit
+    // flushes (shutdown) wait until the data is on disk
+    writeSlot(sender() == &m_flushTimer ? MS_ASYNC : MS_SYNC);
+    m_dirty = false;
+    m_sinceFlush.start();
+}
+
+void VehicleStateStore::writeSlot(int msyncFlags) {
+    VehicleStateSlot slot{};
+    slot.magic = VEHICLE_STATE_MAGIC;
+    slot.version = VEHICLE_STATE_VERSION;
+    slot.size = sizeof(VehicleStateSlot);
+    slot.sequence = ++m_sequence;
+    slot.state = m_state;
+    slot.checksum = slotChecksum(slot);
+
+    // Always overwrite the older slot so the newest valid one survives a torn write
+    uchar *target = m_map + m_nextSlot * sizeof(VehicleStateSlot);
+    memcpy(target, &slot, sizeof(slot));
+    msync(m_map, VEHICLE_STATE_SLOTS * sizeof(VehicleStateSlot), msyncFlags);
+    m_nextSlot = (m_nextSlot + 1) % VEHICLE_STATE_SLOTS;
+}
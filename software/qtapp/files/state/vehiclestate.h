@@ -0,0 +1,94 @@
+#ifndef VEHICLESTATE_H
+#define VEHICLESTATE_H
+
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVariantMap>
+#include <cstdint>
+
+#define VEHICLE_STATE_LIGHT_HIGH_BEAM       (1U << 0)
+#define VEHICLE_STATE_LIGHT_LOW_BEAM        (1U << 1)
+#define VEHICLE_STATE_LIGHT_PARKING         (1U << 2)
+
+#define VEHICLE_STATE_DEFAULT_PATH          "/var/lib/qtapp/vehicle_state.bin"
+#define VEHICLE_STATE_MIN_FLUSH_INTERVAL_MS 1000
+
+/*
+ * @brief Last displayed vehicle state, as persisted across restarts.
+ */
+struct VehicleState {
+    float speed = 0;            // km/h
+    uint32_t lights = 0;        // VEHICLE_STATE_LIGHT_* bits
+    double trip = 0;            // km
+    double odometer = 0;        // km
+    double energyUsed = 0;      // kWh since trip start
+    double avgConsumption = 0;  // short-term average, kWh/100km
+};
+
+/*
+ * @brief Memory-mapped binary snapshot of the VehicleState.
+ *
+ * The file holds two checksummed slots written alternately, so a power loss
+ * in the middle of a write always leaves the previous snapshot intact. The
+ * snapshot is read in open(), before the QML engine loads, and exposed as the
+ * constant `restored` map so the first frame shows the last known values.
+ * Updates are kept in memory and written to the mapping at most once per
+ * flush interval, plus once more on flush() at shutdown.
+ */
+class VehicleStateStore : public QObject {
+    Q_OBJECT
+    Q_PROPERTY(bool hasSnapshot READ hasSnapshot CONSTANT)
+    Q_PROPERTY(QVariantMap restored READ restored CONSTANT)
+
+public:
+    explicit VehicleStateStore(const QString &path,
+                               int minFlushIntervalMs = VEHICLE_STATE_MIN_FLUSH_INTERVAL_MS,
+                               QObject *parent = nullptr);
+    ~VehicleStateStore();
+
+    /*
+     * @brief Map the snapshot file, creating it if needed, and load the newest valid slot.
+     * @return true if a previous snapshot was restored.
+     */
+    bool open();
+
+    bool hasSnapshot() const { return m_hasSnapshot; }
+    QVariantMap restored() const;
+    const VehicleState &state() const { return m_state; }
+
+    /*
+     * @brief Record the trip values shown by the UI.
+     */
+    Q_INVOKABLE void update(qreal speed, qreal trip, qreal odometer, qreal energyUsed, qreal avgConsumption);
+
+public slots:
+    void setHighBeam(bool on);
+    void setLowBeam(bool on);
+    void setParkingLights(bool on);
+
+    /*
+     * @brief Write the current state to the mapping and sync it to disk.
+     */
+    void flush();
+
+private:
+    void setLight(uint32_t bit, bool on);
+    void markDirty();
+    void writeSlot(int msyncFlags);
+
+    QFile m_file;
+    uchar *m_map = nullptr;
+    VehicleState m_state;
+    VehicleState m_restored;
+    bool m_hasSnapshot = false;
+    bool m_dirty = false;
+    uint32_t m_sequence = 0;
+    int m_nextSlot = 0;
+    int m_minFlushIntervalMs;
+    QTimer m_flushTimer;
+    QElapsedTimer m_sinceFlush;
+};
+
+#endif // VEHICLESTATE_H
@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+# Build-time asset pipeline for the cluster images.
+#
+# Pre-scales the images in <image dir> to the display, packs the telltale
+# icons into a single atlas and, when an encoder is available, emits
+# GPU-compressed KTX textures next to the PNG fallbacks. A Qt resource file
+# listing everything is written to <output dir>/assets.qrc (prefix /assets).
+#
+# Usage: build_assets.sh <image dir> <output dir> <display width> <display height>
+#
+# Environment:
+#   TELLTALE_SIZE         edge length of a telltale icon in pixels (default 40)
+#   ASSET_TEXTURE_FORMAT  etc2 (EtcTool), astc (astcenc) or none (default etc2)
+#
+
+set -e
+
+if [ $# -ne 4 ]; then
+    echo "usage: $0 <image dir> <output dir> <display width> <display height>" >&2
+    exit 1
+fi
+
+SRC_DIR=$1
+OUT_DIR=$2
+DISPLAY_W=$3
+DISPLAY_H=$4
+TELLTALE_SIZE=${TELLTALE_SIZE:-40}
+TEXTURE_FORMAT=${ASSET_TEXTURE_FORMAT:-etc2}
+
+# Atlas order, left to right. Must match the indices used in Telltale.qml.
+TELLTALES="high_beam low_beam parking_lights hazard left_arrow right_arrow"
+
+if ! command -v convert >/dev/null 2>&1; then
+    echo "build_assets: ImageMagick 'convert' not found" >&2
+    exit 1
+fi
+
+mkdir -p "$OUT_DIR/assets"
+
+# Background is shown full screen, scale it to the display once here
+convert "$SRC_DIR/background.png" -resize "${DISPLAY_W}x${DISPLAY_H}!" -strip "$OUT_DIR/assets/background.png"
+
+# Needle and centre cap are drawn at their native size
+convert "$SRC_DIR/arrow.png" -strip "$OUT_DIR/assets/arrow.png"
+convert "$SRC_DIR/centre.png" -strip "$OUT_DIR/assets/centre.png"
+
+# Telltale atlas: one row of TELLTALE_SIZE x TELLTALE_SIZE cells
+set --
+for name in $TELLTALES; do
+    set -- "$@" "$SRC_DIR/$name.png"
+done
+convert -background none "$@" -resize "${TELLTALE_SIZE}x${TELLTALE_SIZE}!" +append -strip "$OUT_DIR/assets/telltales.png"
+
+#
+# Encode <png> into the KTX container <ktx>. Leaves no output if the
+# encoder for TEXTURE_FORMAT is not installed, so the PNG is used instead.
+#
+compress_texture() {
+    case "$TEXTURE_FORMAT" in
+        etc2)
+            command -v EtcTool >/dev/null 2>&1 || return 0
+            format=RGBA8
+            case "$(identify -format '%[opaque]' "$1")" in
+                [Tt]rue) format=RGB8 ;;
+            esac
+            EtcTool "$1" -format "$format" -output "$2" >/dev/null
+            ;;
+        astc)
+            command -v astcenc >/dev/null 2>&1 || return 0
+            astcenc -cl "$1" "$2" 6x6 -medium >/dev/null
+            ;;
+        none)
+            ;;
+        *)
+            echo "build_assets: unknown ASSET_TEXTURE_FORMAT '$TEXTURE_FORMAT'" >&2
+            exit 1
+            ;;
+    esac
+}
+
+rm -f "$OUT_DIR/assets/"*.ktx
+compress_texture "$OUT_DIR/assets/background.png" "$OUT_DIR/assets/background.ktx"
+compress_texture "$OUT_DIR/assets/telltales.png" "$OUT_DIR/assets/telltales.ktx"
+
+if [ ! -f "$OUT_DIR/assets/background.ktx" ] && [ "$TEXTURE_FORMAT" != none ]; then
+    echo "build_assets: no $TEXTURE_FORMAT encoder found, shipping PNG textures only"
+fi
+
+{
+    echo "<RCC>"
+    echo "    <qresource prefix=\"/assets\">"
+    for file in "$OUT_DIR/assets/"*; do
+        name=$(basename "$file")
+        echo "        <file alias=\"$name\">assets/$name</file>"
+    done
+    echo "    </qresource>"
+    echo "</RCC>"
+} > "$OUT_DIR/assets.qrc"
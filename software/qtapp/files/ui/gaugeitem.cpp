@@ -0,0 +1,271 @@
+#include "gaugeitem.h"
+#include <QQuickWindow>
+#include <QSGNode>
+#include <QSGSimpleTextureNode>
+#include <QMatrix4x4>
+#include <QDebug>
+
+// Bounds for the measured inter-sample period used as interpolation span (ms)
+#define GAUGE_MIN_SAMPLE_PERIOD_MS  10.0
+#define GAUGE_MAX_SAMPLE_PERIOD_MS  200.0
+
+namespace {
+
+class GaugeNode : public QSGNode {
+public:
+    QSGSimpleTextureNode *dial = nullptr;
+    QSGTransformNode *needleTransform = nullptr;
+    QSGSimpleTextureNode *needle = nullptr;
+};
+
+/*
+ * @brief Create, retexture or drop a texture node under parent so that it
+ *        shows image. The node owns its texture, so setTexture() releases
+ *        the previous one.
+ */
+QSGSimpleTextureNode *syncTextureNode(QQuickWindow *window, QSGNode *parent,
+                                      QSGSimpleTextureNode *node, const QImage &image) {
+    if (image.isNull()) {
+        if (node) {
+            parent->removeChildNode(node);
+            delete node;
+        }
+        return nullptr;
+    }
+
+    if (!node) {
+        node = new QSGSimpleTextureNode;
+        node->setOwnsTexture(true);
+        parent->prependChildNode(node);
+    }
+    node->setTexture(window->createTextureFromImage(image));
+    return node;
+}
+
+} // namespace
+
+GaugeItem::GaugeItem(QQuickItem *parent)
+    : QQuickItem(parent) {
+    setFlag(ItemHasContents, true);
+    m_clock.start();
+}
+
+void GaugeItem::setValue(qreal value) {
+    // The segment starts in updatePolish(), once the timestamp bound to the
+    // same notification has been written too
+    m_samplePending = true;
+    polish();
+
+    if (!qFuzzyCompare(m_value, value)) {
+        m_value = value;
+        emit valueChanged();
+    }
+}
+
+void GaugeItem::setValueTimestamp(qreal timestamp) {
+    if (qFuzzyCompare(m_valueTimestamp, timestamp)) return;
+    m_valueTimestamp = timestamp;
+    m_samplePending = true;
+    polish();
+    emit valueTimestampChanged();
+}
+
+void GaugeItem::updatePolish() {
+    if (!m_samplePending) return;
+    m_samplePending = false;
+
+    // Place the sample at its arrival time, never in the future of this clock
+    const qreal now = nowMs();
+    const qreal t = m_valueTimestamp > 0 ? qMin(m_valueTimestamp - m_clock.msecsSinceReference(), now) : now;
+    const bool firstSample = m_lastSampleTime < 0;
+
+    if (!firstSample) {
+        const qreal period = qBound(GAUGE_MIN_SAMPLE_PERIOD_MS, t - m_lastSampleTime, GAUGE_MAX_SAMPLE_PERIOD_MS);
+        m_samplePeriod = 0.8 * m_samplePeriod + 0.2 * period;
+    }
+    m_lastSampleTime = t;
+
+    // Start a new segment from wherever the needle is at the sample time; the
+    // very first sample (initial binding) is shown as-is so the first frame is exact
+    m_segmentStartValue = firstSample ? m_value : displayedValueAt(t);
+    m_segmentEndValue = m_value;
+    m_segmentStartTime = t;
+    m_segmentDuration = m_samplePeriod;
+    m_animating = true;
+    update();
+}
+
+void GaugeItem::setMinimumValue(qreal value) {
+    if (qFuzzyCompare(m_minimumValue, value)) return;
+    m_minimumValue = value;
+    emit minimumValueChanged();
+    update();
+}
+
+void GaugeItem::setMaximumValue(qreal value) {
+    if (qFuzzyCompare(m_maximumValue, value)) return;
+    m_maximumValue = value;
+    emit maximumValueChanged();
+    update();
+}
+
+void GaugeItem::setMinimumAngle(qreal angle) {
+    if (qFuzzyCompare(m_minimumAngle, angle)) return;
+    m_minimumAngle = angle;
+    emit minimumAngleChanged();
+    update();
+}
+
+void GaugeItem::setMaximumAngle(qreal angle) {
+    if (qFuzzyCompare(m_maximumAngle, angle)) return;
+    m_maximumAngle = angle;
+    emit maximumAngleChanged();
+    update();
+}
+
+void GaugeItem::setNeedleSource(const QUrl &source) {
+    if (m_needleSource == source) return;
+    m_needleSource = source;
+    m_needleImage = loadImage(source);
+    m_needleDirty = true;
+    updateImplicitSize();
+    emit needleSourceChanged();
+    update();
+}
+
+void GaugeItem::setDialSource(const QUrl &source) {
+    if (m_dialSource == source) return;
+    m_dialSource = source;
+    m_dialImage = loadImage(source);
+    m_dialDirty = true;
+    updateImplicitSize();
+    emit dialSourceChanged();
+    update();
+}
+
+void GaugeItem::setExtrapolate(bool extrapolate) {
+    if (m_extrapolate == extrapolate) return;
+    m_extrapolate = extrapolate;
+    emit extrapolateChanged();
+}
+
+void GaugeItem::setExtrapolationLimit(int ms) {
+    if (m_extrapolationLimit == ms) return;
+    m_extrapolationLimit = qMax(0, ms);
+    emit extrapolationLimitChanged();
+}
+
+QSGNode *GaugeItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *) {
+    GaugeNode *node = static_cast<GaugeNode *>(oldNode);
+    if (!node) {
+        node = new GaugeNode;
+        node->needleTransform = new QSGTransformNode;
+        node->appendChildNode(node->needleTransform);
+
+        m_dialDirty = true;
+        m_needleDirty = true;
+    }
+
+    // The dial is prepended so it always stays below the needle
+    if (m_dialDirty) {
+        node->dial = syncTextureNode(window(), node, node->dial, m_dialImage);
+        m_dialDirty = false;
+    }
+    if (m_needleDirty) {
+        node->needle = syncTextureNode(window(), node->needleTransform, node->needle, m_needleImage);
+        m_needleDirty = false;
+    }
+
+    const QRectF rect = boundingRect();
+    if (node->dial) node->dial->setRect(rect);
+    if (node->needle) node->needle->setRect(rect);
+
+    const qreal t = nowMs();
+    const qreal angle = valueToAngle(displayedValueAt(t));
+
+    QMatrix4x4 matrix;
+    matrix.translate(rect.width() / 2, rect.height() / 2);
+    matrix.rotate(angle, 0, 0, 1);
+    matrix.translate(-rect.width() / 2, -rect.height() / 2);
+    node->needleTransform->setMatrix(matrix);
+    node->needleTransform->markDirty(QSGNode::DirtyMatrix);
+
+    // Keep requesting frames until the segment (and any extrapolation) is over
+    qreal end = m_segmentStartTime + m_segmentDuration;
+    if (m_extrapolate) end += m_extrapolationLimit;
+    m_animating = t < end;
+
+    return node;
+}
+
+void GaugeItem::itemChange(ItemChange change, const ItemChangeData &data) {
+    if (change == ItemSceneChange) {
+        if (window()) {
+            disconnect(window(), &QQuickWindow::frameSwapped, this, &GaugeItem::onFrameSwapped);
+        }
+        if (data.window) {
+            // frameSwapped comes from the render thread, so this is queued to the GUI thread
+            connect(data.window, &QQuickWindow::frameSwapped, this, &GaugeItem::onFrameSwapped, Qt::UniqueConnection);
+        }
+    }
+    QQuickItem::itemChange(change, data);
+}
+
+void GaugeItem::onFrameSwapped() {
+    if (m_animating) {
+        update();
+    }
+}
+
+qreal GaugeItem::nowMs() const {
+    return m_clock.nsecsElapsed() / 1000000.0;
+}
+
+/*
+ * @brief Value shown at time t: interpolated within the current segment and,
+ *        when enabled, extrapolated along its slope for a bounded time after.
+ */
+qreal GaugeItem::displayedValueAt(qreal t) const {
+    const qreal dt = t - m_segmentStartTime;
+    if (dt <= 0 || m_segmentDuration <= 0) {
+        return dt <= 0 ? m_segmentStartValue : m_segmentEndValue;
+    }
+
+    const qreal slope = (m_segmentEndValue - m_segmentStartValue) / m_segmentDuration;
+    if (dt < m_segmentDuration) {
+        return m_segmentStartValue + slope * dt;
+    }
+    if (!m_extrapolate) {
+        return m_segmentEndValue;
+    }
+
+    const qreal over = qMin(dt - m_segmentDuration, qreal(m_extrapolationLimit));
+    return qBound(m_minimumValue, m_segmentEndValue + slope * over, m_maximumValue);
+}
+
+qreal GaugeItem::valueToAngle(qreal value) const {
+    if (qFuzzyCompare(m_maximumValue, m_minimumValue)) return m_minimumAngle;
+    const qreal t = (qBound(m_minimumValue, value, m_maximumValue) - m_minimumValue) / (m_maximumValue - m_minimumValue);
+    return m_minimumAngle + (m_maximumAngle - m_minimumAngle) * t;
+}
+
+void GaugeItem::updateImplicitSize() {
+    const QSize size = m_dialImage.isNull() ? m_needleImage.size() : m_dialImage.size();
+    setImplicitSize(size.width(), size.height());
+}
+
+/*
+ * @brief Load an image from a qrc:/ or file URL.
+ */
+QImage GaugeItem::loadImage(const QUrl &source) {
+    if (source.isEmpty()) return QImage();
+
+    const QString path = source.scheme() == QLatin1String("qrc")
+            ? QLatin1Char(':') + source.path()
+            : source.toLocalFile();
+    QImage image(path);
+    if (image.isNull()) {
+        qWarning() << "Gauge: cannot load image" << source;
+    }
+    return image;
+}
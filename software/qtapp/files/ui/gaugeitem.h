@@ -0,0 +1,128 @@
+#ifndef GAUGEITEM_H
+#define GAUGEITEM_H
+
+#include <QQuickItem>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QUrl>
+
+/*
+ * @brief Scene-graph gauge rendering an optional dial and a rotating needle.
+ *
+ * Every write to `value` is stored as a sample, stamped with `valueTimestamp`
+ * when the source provides its arrival time (milliseconds of the monotonic
+ * clock, as QElapsedTimer::msecsSinceReference()) or with the write time
+ * otherwise. On each frame the needle angle is interpolated from the displayed
+ * value to the newest sample over the measured sample period, and optionally
+ * extrapolated along the last slope while no new sample has arrived. The whole
+ * motion is computed in updatePaintNode(), so no JS runs per frame.
+ */
+class GaugeItem : public QQuickItem {
+    Q_OBJECT
+    Q_PROPERTY(qreal value READ value WRITE setValue NOTIFY valueChanged)
+    Q_PROPERTY(qreal valueTimestamp READ valueTimestamp WRITE setValueTimestamp NOTIFY valueTimestampChanged)
+    Q_PROPERTY(qreal minimumValue READ minimumValue WRITE setMinimumValue NOTIFY minimumValueChanged)
+    Q_PROPERTY(qreal maximumValue READ maximumValue WRITE setMaximumValue NOTIFY maximumValueChanged)
+    Q_PROPERTY(qreal minimumAngle READ minimumAngle WRITE setMinimumAngle NOTIFY minimumAngleChanged)
+    Q_PROPERTY(qreal maximumAngle READ maximumAngle WRITE setMaximumAngle NOTIFY maximumAngleChanged)
+    Q_PROPERTY(QUrl needleSource READ needleSource WRITE setNeedleSource NOTIFY needleSourceChanged)
+    Q_PROPERTY(QUrl dialSource READ dialSource WRITE setDialSource NOTIFY dialSourceChanged)
+    Q_PROPERTY(bool extrapolate READ extrapolate WRITE setExtrapolate NOTIFY extrapolateChanged)
+    Q_PROPERTY(int extrapolationLimit READ extrapolationLimit WRITE setExtrapolationLimit NOTIFY extrapolationLimitChanged)
+
+public:
+    explicit GaugeItem(QQuickItem *parent = nullptr);
+
+    qreal value() const { return m_value; }
+    void setValue(qreal value);
+
+    qreal valueTimestamp() const { return m_valueTimestamp; }
+    void setValueTimestamp(qreal timestamp);
+
+    qreal minimumValue() const { return m_minimumValue; }
+    void setMinimumValue(qreal value);
+
+    qreal maximumValue() const { return m_maximumValue; }
+    void setMaximumValue(qreal value);
+
+    qreal minimumAngle() const { return m_minimumAngle; }
+    void setMinimumAngle(qreal angle);
+
+    qreal maximumAngle() const { return m_maximumAngle; }
+    void setMaximumAngle(qreal angle);
+
+    QUrl needleSource() const { return m_needleSource; }
+    void setNeedleSource(const QUrl &source);
+
+    QUrl dialSource() const { return m_dialSource; }
+    void setDialSource(const QUrl &source);
+
+    bool extrapolate() const { return m_extrapolate; }
+    void setExtrapolate(bool extrapolate);
+
+    int extrapolationLimit() const { return m_extrapolationLimit; }
+    void setExtrapolationLimit(int ms);
+
+    /*
+     * @brief Whether the needle is still moving, so the next frame is already requested.
+     *        Only valid on the GUI thread or while the scene graph is synchronized.
+     */
+    bool isAnimating() const { return m_animating; }
+
+signals:
+    void valueChanged();
+    void valueTimestampChanged();
+    void minimumValueChanged();
+    void maximumValueChanged();
+    void minimumAngleChanged();
+    void maximumAngleChanged();
+    void needleSourceChanged();
+    void dialSourceChanged();
+    void extrapolateChanged();
+    void extrapolationLimitChanged();
+
+protected:
+    void updatePolish() override;
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void itemChange(ItemChange change, const ItemChangeData &data) override;
+
+private slots:
+    void onFrameSwapped();
+
+private:
+    qreal nowMs() const;
+    qreal displayedValueAt(qreal t) const;
+    qreal valueToAngle(qreal value) const;
+    void updateImplicitSize();
+
+    static QImage loadImage(const QUrl &source);
+
+    qreal m_value = 0;
+    qreal m_valueTimestamp = 0;
+    qreal m_minimumValue = 0;
+    qreal m_maximumValue = 100;
+    qreal m_minimumAngle = -90;
+    qreal m_maximumAngle = 90;
+    QUrl m_needleSource;
+    QUrl m_dialSource;
+    bool m_extrapolate = false;
+    int m_extrapolationLimit = 100;
+
+    // Current motion segment, in milliseconds of m_clock
+    QElapsedTimer m_clock;
+    qreal m_segmentStartValue = 0;
+    qreal m_segmentEndValue = 0;
+    qreal m_segmentStartTime = 0;
+    qreal m_segmentDuration = 0;
+    qreal m_lastSampleTime = -1;
+    qreal m_samplePeriod = 50;
+    bool m_samplePending = false;
+    bool m_animating = false;
+
+    QImage m_needleImage;
+    QImage m_dialImage;
+    bool m_needleDirty = false;
+    bool m_dialDirty = false;
+};
+
+#endif // GAUGEITEM_H
@@ -0,0 +1,179 @@
+#include "perfhud.h"
+#include "gaugeitem.h"
+#include "../communication/canhandler.h"
+#include <QQuickWindow>
+#include <QSGGeometryNode>
+#include <QSGFlatColorMaterial>
+
+PerfMonitor::PerfMonitor(CanStats &rxStats, CanStats &txStats, QObject *parent)
+    : QObject(parent), m_rxStats(rxStats), m_txStats(txStats) {
+    connect(&m_refreshTimer, &QTimer::timeout, this, &PerfMonitor::refresh);
+    m_refreshTimer.start(PERF_HUD_REFRESH_MS);
+    m_sinceRefresh.start();
+}
+
+void PerfMonitor::attach(QQuickWindow *window) {
+    if (!window) return;
+    for (GaugeItem *gauge : window->findChildren<GaugeItem *>()) {
+        m_gauges.append(gauge);
+    }
+    // Direct connections: measured on the render thread around each sync and swap
+    connect(window, &QQuickWindow::beforeSynchronizing, this, [this]() { onBeforeSynchronizing(); }, Qt::DirectConnection);
+    connect(window, &QQuickWindow::afterSynchronizing, this, [this]() { onAfterSynchronizing(); }, Qt::DirectConnection);
+    connect(window, &QQuickWindow::frameSwapped, this, [this]() { onFrameSwapped(); }, Qt::DirectConnection);
+}
+
+QString PerfMonitor::busName() const {
+    return QString::fromLatin1(m_rxStats.interfaceName);
+}
+
+int PerfMonitor::frameTimes(float *out) const {
+    const int start = (m_graphHead - m_graphCount + PERF_HUD_GRAPH_SAMPLES) % PERF_HUD_GRAPH_SAMPLES;
+    for (int i = 0; i < m_graphCount; i++) {
+        out[i] = m_graph[(start + i) % PERF_HUD_GRAPH_SAMPLES];
+    }
+    return m_graphCount;
+}
+
+void PerfMonitor::onBeforeSynchronizing() {
+    m_frameClock.start();
+}
+
+void PerfMonitor::onAfterSynchronizing() {
+    // The GUI thread is blocked, so the gauges can be read. A gauge that is
+    // still animating requests the next frame as soon as this one is swapped
+    bool animating = false;
+    for (const QPointer<GaugeItem> &gauge : m_gauges) {
+        if (gauge && gauge->isAnimating()) {
+            animating = true;
+            break;
+        }
+    }
+    m_nextFrameDue = animating;
+}
+
+void PerfMonitor::onFrameSwapped() {
+    if (!m_frameClock.isValid()) return;
+
+    // Cost of this frame: sync, render and swap on the render thread
+    const uint64_t ns = m_frameClock.nsecsElapsed();
+
+    m_graph[m_graphHead] = float(ns / 1e6);
+    m_graphHead = (m_graphHead + 1) % PERF_HUD_GRAPH_SAMPLES;
+    m_graphCount = qMin(m_graphCount + 1, PERF_HUD_GRAPH_SAMPLES);
+
+    m_frames.fetch_add(1, std::memory_order_relaxed);
+    m_frameNsSum.fetch_add(ns, std::memory_order_relaxed);
+    if (ns > m_frameNsMax.load(std::memory_order_relaxed)) {
+        m_frameNsMax.store(ns, std::memory_order_relaxed);
+    }
+
+    // Idle gaps of the on-demand scene are not misses; only a frame that was
+    // due one vsync after the previous swap can miss vsync periods
+    if (m_frameDue && m_swapClock.isValid()) {
+        const uint64_t periods = uint64_t(m_swapClock.nsecsElapsed() / 1e6 / PERF_HUD_VSYNC_MS + 0.5);
+        if (periods > 1) {
+            m_missed.fetch_add(periods - 1, std::memory_order_relaxed);
+        }
+    }
+    m_swapClock.start();
+    m_frameDue = m_nextFrameDue;
+}
+
+void PerfMonitor::refresh() {
+    const qreal seconds = m_sinceRefresh.restart() / 1000.0;
+    if (seconds <= 0) return;
+
+    const uint32_t frames = m_frames.exchange(0, std::memory_order_relaxed);
+    const uint64_t frameNs = m_frameNsSum.exchange(0, std::memory_order_relaxed);
+    m_fps = frames / seconds;
+    m_frameTimeMs = frames ? frameNs / 1e6 / frames : 0;
+    m_maxFrameTimeMs = m_frameNsMax.exchange(0, std::memory_order_relaxed) / 1e6;
+    m_missedFrames = m_missed.load(std::memory_order_relaxed);
+
+    const uint64_t rxFrames = m_rxStats.frames.load(std::memory_order_relaxed);
+    const uint64_t txFrames = m_txStats.frames.load(std::memory_order_relaxed);
+    const uint64_t decodeNs = m_rxStats.decodeNs.load(std::memory_order_relaxed);
+    m_rxRate = (rxFrames - m_lastRxFrames) / seconds;
+    m_txRate = (txFrames - m_lastTxFrames) / seconds;
+    m_rxDecodeUs = rxFrames != m_lastRxFrames ? (decodeNs - m_lastDecodeNs) / 1e3 / (rxFrames - m_lastRxFrames) : 0;
+    m_lastRxFrames = rxFrames;
+    m_lastTxFrames = txFrames;
+    m_lastDecodeNs = decodeNs;
+
+    m_txQueueDepth = m_txStats.queueDepth.load(std::memory_order_relaxed);
+    m_rxOverflows = m_rxStats.overflows.load(std::memory_order_relaxed);
+    m_txErrors = m_txStats.errors.load(std::memory_order_relaxed);
+
+    emit updated();
+}
+
+FrameTimeGraph::FrameTimeGraph(QQuickItem *parent)
+    : QQuickItem(parent) {
+    setFlag(ItemHasContents, true);
+}
+
+void FrameTimeGraph::setMonitor(PerfMonitor *monitor) {
+    if (m_monitor == monitor) return;
+    if (m_monitor) {
+        disconnect(m_monitor, nullptr, this, nullptr);
+    }
+    m_monitor = monitor;
+    if (m_monitor) {
+        // Redraw at the HUD refresh rate only, so the graph does not keep the scene busy
+        connect(m_monitor, &PerfMonitor::updated, this, &QQuickItem::update);
+    }
+    emit monitorChanged();
+    update();
+}
+
+void FrameTimeGraph::setColor(const QColor &color) {
+    if (m_color == color) return;
+    m_color = color;
+    emit colorChanged();
+    update();
+}
+
+QSGNode *FrameTimeGraph::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *) {
+    QSGGeometryNode *node = static_cast<QSGGeometryNode *>(oldNode);
+    if (!node) {
+        node = new QSGGeometryNode;
+        QSGGeometry *geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+        geometry->setDrawingMode(QSGGeometry::DrawLines);
+        geometry->setLineWidth(1);
+        node->setGeometry(geometry);
+        node->setFlag(QSGNode::OwnsGeometry);
+
+        node->setMaterial(new QSGFlatColorMaterial);
+        node->setFlag(QSGNode::OwnsMaterial);
+    }
+
+    static_cast<QSGFlatColorMaterial *>(node->material())->setColor(m_color);
+
+    float samples[PERF_HUD_GRAPH_SAMPLES];
+    const int count = m_monitor ? m_monitor->frameTimes(samples) : 0;
+
+    // Reference line at one vsync period plus one segment per pair of samples
+    const int segments = 1 + qMax(0, count - 1);
+    QSGGeometry *geometry = node->geometry();
+    geometry->allocate(segments * 2);
+    QSGGeometry::Point2D *v = geometry->vertexDataAsPoint2D();
+
+    const float w = float(width());
+    const float h = float(height());
+    const float rangeMs = float(2 * PERF_HUD_VSYNC_MS);
+    auto yFor = [h, rangeMs](float ms) { return h - qMin(ms, rangeMs) / rangeMs * h; };
+
+    v[0].set(0, yFor(float(PERF_HUD_VSYNC_MS)));
+    v[1].set(w, yFor(float(PERF_HUD_VSYNC_MS)));
+
+    const float step = w / (PERF_HUD_GRAPH_SAMPLES - 1);
+    for (int i = 1; i < count; i++) {
+        QSGGeometry::Point2D *seg = v + 2 * i;
+        seg[0].set((i - 1) * step, yFor(samples[i - 1]));
+        seg[1].set(i * step, yFor(samples[i]));
+    }
+
+    node->markDirty(QSGNode::DirtyGeometry | QSGNode::DirtyMaterial);
+    return node;
+}
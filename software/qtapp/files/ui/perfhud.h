@@ -0,0 +1,150 @@
+#ifndef PERFHUD_H
+#define PERFHUD_H
+
+#include <QObject>
+#include <QQuickItem>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QColor>
+#include <QList>
+#include <QPointer>
+#include <atomic>
+
+class QQuickWindow;
+class GaugeItem;
+struct CanStats;
+
+#define PERF_HUD_REFRESH_MS       500
+#define PERF_HUD_GRAPH_SAMPLES    120
+#define PERF_HUD_VSYNC_MS         (1000.0 / 60.0)
+
+/*
+ * @brief Frame and CAN statistics shown by the performance HUD.
+ *
+ * The scene is rendered on demand, so the interval between two swaps says
+ * nothing by itself. The render thread records the cost of each frame, from
+ * beforeSynchronizing to frameSwapped, and counts missed vsyncs only when the
+ * previous frame left a gauge animating, i.e. the next frame was due one vsync
+ * later. The CAN counters come from the CanStats of the RX and TX threads.
+ * Rates and averages are published as properties every PERF_HUD_REFRESH_MS.
+ * Only created when the HUD is enabled.
+ */
+class PerfMonitor : public QObject {
+    Q_OBJECT
+    Q_PROPERTY(qreal fps READ fps NOTIFY updated)
+    Q_PROPERTY(qreal frameTimeMs READ frameTimeMs NOTIFY updated)
+    Q_PROPERTY(qreal maxFrameTimeMs READ maxFrameTimeMs NOTIFY updated)
+    Q_PROPERTY(quint64 missedFrames READ missedFrames NOTIFY updated)
+    Q_PROPERTY(QString busName READ busName CONSTANT)
+    Q_PROPERTY(qreal rxRate READ rxRate NOTIFY updated)
+    Q_PROPERTY(qreal txRate READ txRate NOTIFY updated)
+    Q_PROPERTY(qreal rxDecodeUs READ rxDecodeUs NOTIFY updated)
+    Q_PROPERTY(int txQueueDepth READ txQueueDepth NOTIFY updated)
+    Q_PROPERTY(int rxOverflows READ rxOverflows NOTIFY updated)
+    Q_PROPERTY(quint64 txErrors READ txErrors NOTIFY updated)
+
+public:
+    PerfMonitor(CanStats &rxStats, CanStats &txStats, QObject *parent = nullptr);
+
+    /*
+     * @brief Start recording the frame times of window and watch its gauges.
+     */
+    void attach(QQuickWindow *window);
+
+    qreal fps() const { return m_fps; }
+    qreal frameTimeMs() const { return m_frameTimeMs; }
+    qreal maxFrameTimeMs() const { return m_maxFrameTimeMs; }
+    quint64 missedFrames() const { return m_missedFrames; }
+    QString busName() const;
+    qreal rxRate() const { return m_rxRate; }
+    qreal txRate() const { return m_txRate; }
+    qreal rxDecodeUs() const { return m_rxDecodeUs; }
+    int txQueueDepth() const { return m_txQueueDepth; }
+    int rxOverflows() const { return m_rxOverflows; }
+    quint64 txErrors() const { return m_txErrors; }
+
+    /*
+     * @brief Copy the most recent frame times, oldest first. Render thread only.
+     * @return Number of samples written to out (at most PERF_HUD_GRAPH_SAMPLES).
+     */
+    int frameTimes(float *out) const;
+
+signals:
+    void updated();
+
+private slots:
+    void refresh();
+
+private:
+    void onBeforeSynchronizing();
+    void onAfterSynchronizing();
+    void onFrameSwapped();
+
+    CanStats &m_rxStats;
+    CanStats &m_txStats;
+    QTimer m_refreshTimer;
+    QElapsedTimer m_sinceRefresh;
+
+    // Render thread; the gauges are only read while the GUI thread is blocked in sync
+    QList<QPointer<GaugeItem>> m_gauges;
+    QElapsedTimer m_frameClock;
+    QElapsedTimer m_swapClock;
+    bool m_frameDue = false;
+    bool m_nextFrameDue = false;
+    float m_graph[PERF_HUD_GRAPH_SAMPLES] = {};
+    int m_graphHead = 0;
+    int m_graphCount = 0;
+
+    // Render thread -> GUI thread accumulators
+    std::atomic<uint32_t> m_frames{0};
+    std::atomic<uint64_t> m_frameNsSum{0};
+    std::atomic<uint64_t> m_frameNsMax{0};
+    std::atomic<uint64_t> m_missed{0};
+
+    uint64_t m_lastRxFrames = 0;
+    uint64_t m_lastTxFrames = 0;
+    uint64_t m_lastDecodeNs = 0;
+
+    qreal m_fps = 0;
+    qreal m_frameTimeMs = 0;
+    qreal m_maxFrameTimeMs = 0;
+    quint64 m_missedFrames = 0;
+    qreal m_rxRate = 0;
+    qreal m_txRate = 0;
+    qreal m_rxDecodeUs = 0;
+    int m_txQueueDepth = 0;
+    int m_rxOverflows = 0;
+    quint64 m_txErrors = 0;
+};
+
+/*
+ * @brief Line graph of the recent frame times of a PerfMonitor.
+ *        The vertical range is two vsync periods; a reference line marks one.
+ */
+class FrameTimeGraph : public QQuickItem {
+    Q_OBJECT
+    Q_PROPERTY(PerfMonitor *monitor READ monitor WRITE setMonitor NOTIFY monitorChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+
+public:
+    explicit FrameTimeGraph(QQuickItem *parent = nullptr);
+
+    PerfMonitor *monitor() const { return m_monitor; }
+    void setMonitor(PerfMonitor *monitor);
+
+    QColor color() const { return m_color; }
+    void setColor(const QColor &color);
+
+signals:
+    void monitorChanged();
+    void colorChanged();
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+
+private:
+    PerfMonitor *m_monitor = nullptr;
+    QColor m_color = Qt::green;
+};
+
+#endif // PERFHUD_H
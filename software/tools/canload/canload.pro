@@ -0,0 +1,17 @@
+# Simulates N ECU nodes plus background traffic on a SocketCAN interface and
+# measures the cluster's CPU and lamp command latency as the load is ramped up.
+# Plain C++, shares the protocol definitions with the cluster application.
+TEMPLATE = app
+TARGET = canload
+CONFIG += console c++17 thread
+CONFIG -= qt app_bundle
+
+APP_DIR = $$PWD/../../qtapp/files
+INCLUDEPATH += $$APP_DIR/communication
+
+SOURCES += main.cpp
+
+HEADERS += $$APP_DIR/communication/canprotocol.h
+
+target.path = /usr/bin
+INSTALLS += target
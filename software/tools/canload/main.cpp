@@ -0,0 +1,948 @@
+#include "canprotocol.h"
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <net/if.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Load generator for the cluster's CAN stack.
+ *
+ * Node k sends the frames of the ECU firmware (8 DO responses, 4 DI and 8 AI
+ * frames per cycle) with k added to the source address byte, below the 0x20
+ * frame stride of the protocol IDs; node 0 is the node the cluster decodes.
+ * Background noise is J1939 powertrain traffic at a given bus utilisation.
+ *
+ * The load is ramped in steps. In each step a hazard switch edge is sent by
+ * node 0 every probe period; the time until the cluster's lamp ON command is
+ * seen on the bus is the end-to-end latency, and no command before the
+ * switch is released after the deadline counts as a miss. Both are taken from
+ * kernel receive timestamps. With --pid the cluster's CPU time is sampled
+ * from /proc, in total and for its busiest thread.
+ */
+
+#define MAX_NODES               32U     // Source address offsets below the 0x20 ID stride
+#define DIG_INPUTS_PER_NODE     (NUMBER_OF_DIG_IN_RES_FRAME * DIGITAL_IN_RESP_SIGNAL_PER_FRAME)
+#define ANALOG_INPUTS_PER_NODE  (NUMBER_OF_ANALOG_IN_RES_FRAME * ANALOG_IN_RESP_SIGNAL_PER_FRAME)
+#define ANALOG_MAX              16383U  // 14-bit oversampled ADC value of the ECU
+#define MAX_IDLE_NS             1000000LL   // Longest sleep of the generator loop
+#define MAX_NOISE_BACKLOG_NS    100000000LL // Noise further behind than this is skipped
+
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int) { running = 0; }
+
+static inline int64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * @brief Nominal length of a data frame on the wire, without stuff bits.
+ */
+static inline unsigned frameBits(bool extended, unsigned dlc) {
+    return (extended ? 67U : 47U) + 8U * dlc;
+}
+
+struct Options {
+    const char *interface = "vcan0";
+    unsigned nodes = 8;
+    std::vector<unsigned> cyclesMs{50};
+    double toggleHz = 1.0;
+    unsigned analogPeriodMs = 2000;
+    double noisePct = 50.0;
+    unsigned bitrate = 500000;
+    unsigned steps = 8;
+    double stepTimeS = 10.0;
+    enum { RampBoth, RampNodes, RampNoise } ramp = RampBoth;
+    int pid = 0;
+    unsigned deadlineMs = 50;
+    unsigned probePeriodMs = 200;
+    const char *csvPath = nullptr;
+
+    // Positions from io_config.json
+    int ignitionPos = 0;
+    int hazardPos = 27;
+    int lampPos = 0;                // left_front_light
+    std::vector<int> uiSwitchPos{1, 10, 19};
+};
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "Simulate ECU nodes and background traffic on a SocketCAN interface, ramp the\n"
+            "load in steps and report the cluster's CPU and lamp command latency per step.\n"
+            "\n"
+            "  -i, --interface IF      SocketCAN interface (default vcan0)\n"
+            "  -n, --nodes N           ECU nodes at full load, 1..%u (default 8)\n"
+            "  -c, --cycle MS[,MS..]   node cycle times, assigned to the nodes in turn (default 50)\n"
+            "      --toggle HZ         switch changes per node and second (default 1)\n"
+            "      --analog-period MS  period of the analog input ramps, 0 = constant (default 2000)\n"
+            "  -u, --noise PCT         background bus utilisation at full load (default 50)\n"
+            "  -b, --bitrate BPS       bit rate used to convert utilisation to frames (default 500000)\n"
+            "  -s, --steps N           load steps (default 8)\n"
+            "  -t, --step-time S       duration of a step (default 10)\n"
+            "  -r, --ramp WHAT         ramp nodes, noise or both (default both)\n"
+            "  -p, --pid PID           cluster process to sample CPU time from\n"
+            "  -d, --deadline MS       lamp command deadline after a switch edge (default 50)\n"
+            "      --probe-period MS   time between hazard switch probes (default 200)\n"
+            "      --io-config FILE    read the switch and lamp positions from io_config.json\n"
+            "  -o, --csv FILE          write the capacity curve as CSV\n",
+            name, MAX_NODES);
+}
+
+/*
+ * @brief Parse a comma separated list of positive numbers.
+ */
+static bool parseList(const char *text, std::vector<unsigned> &values) {
+    values.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const long value = atol(item.c_str());
+        if (value <= 0) return false;
+        values.push_back(unsigned(value));
+    }
+    return !values.empty();
+}
+
+/*
+ * @brief Position of a signal in io_config.json. The file is a flat map of
+ *        names to numbers, which a key search is enough for.
+ */
+static int configPosition(const std::string &json, const char *name, int fallback) {
+    const std::string key = std::string("\"") + name + "\"";
+    size_t at = json.find(key);
+    if (at == std::string::npos) return fallback;
+    at = json.find(':', at + key.size());
+    if (at == std::string::npos) return fallback;
+    return atoi(json.c_str() + at + 1);
+}
+
+static bool loadPositions(const char *path, Options &options) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::stringstream text;
+    text << file.rdbuf();
+    const std::string json = text.str();
+
+    options.ignitionPos = configPosition(json, "ignition", options.ignitionPos);
+    options.hazardPos = configPosition(json, "hazard_switch", options.hazardPos);
+    options.lampPos = configPosition(json, "left_front_light", options.lampPos);
+    options.uiSwitchPos = {
+        configPosition(json, "high_beam_switch", options.uiSwitchPos[0]),
+        configPosition(json, "low_beam_switch", options.uiSwitchPos[1]),
+        configPosition(json, "parking_lights_switch", options.uiSwitchPos[2]),
+    };
+    return true;
+}
+
+/*
+ * @brief Open a raw CAN socket bound to an interface.
+ * @return The socket, or -1 on error.
+ */
+static int openSocket(const char *interface) {
+    int sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, interface, IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0) {
+        fprintf(stderr, "%s: %s\n", interface, strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* Generator ------------------------------------------------------------------*/
+
+struct Node {
+    unsigned address = 0;
+    int64_t periodNs = 0;
+    int64_t nextCycleNs = 0;
+    int64_t nextToggleNs = 0;
+    uint8_t inputs[DIG_INPUTS_PER_NODE] = {};
+};
+
+struct GeneratorStats {
+    uint64_t offered = 0;           // Frames due by the schedule
+    uint64_t sent = 0;
+    uint64_t bits = 0;              // Nominal wire bits of the sent frames
+    uint64_t errors = 0;
+    int64_t maxLagNs = 0;           // Worst delay of a node cycle behind its schedule
+    uint64_t probes = 0;
+};
+
+class Generator {
+public:
+    Generator(int sock, const Options &options) : m_sock(sock), m_options(options) {}
+
+    /*
+     * @brief Send the load of one step until the given time.
+     * @param nodes: Active nodes.
+     * @param noiseFps: Background frames per second.
+     * @param measureFromNs: Statistics are reset when this time is reached.
+     */
+    GeneratorStats run(unsigned nodes, double noiseFps, int64_t measureFromNs, int64_t endNs);
+
+private:
+    bool send(struct can_frame &frame);
+    void sendDigitalInputs(const Node &node, unsigned frameIdx);
+    void sendCycle(const Node &node, int64_t nowNs);
+    void toggleSwitch(Node &node);
+    void sendNoise();
+    uint32_t random() {
+        m_rng ^= m_rng << 13;
+        m_rng ^= m_rng >> 17;
+        m_rng ^= m_rng << 5;
+        return m_rng;
+    }
+
+    int m_sock;
+    const Options &m_options;
+    GeneratorStats m_stats;
+    uint32_t m_rng = 0x2545F491U;
+    uint32_t m_noiseSeq = 0;
+    int64_t m_startNs = 0;
+};
+
+/*
+ * @brief Write a frame, waiting for room in the device queue (ENOBUFS) instead of dropping it.
+ */
+bool Generator::send(struct can_frame &frame) {
+    m_stats.offered++;
+    while (running) {
+        if (write(m_sock, &frame, sizeof(frame)) == sizeof(frame)) {
+            m_stats.sent++;
+            m_stats.bits += frameBits(frame.can_id & CAN_EFF_FLAG, frame.can_dlc);
+            return true;
+        }
+        if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR) break;
+
+        struct pollfd pfd = { m_sock, POLLOUT, 0 };
+        poll(&pfd, 1, 10);
+    }
+    m_stats.errors++;
+    return false;
+}
+
+void Generator::sendDigitalInputs(const Node &node, unsigned frameIdx) {
+    struct can_frame frame;
+    frame.can_id = (DIGITAL_INPUT_RES_ID(frameIdx) + node.address) | CAN_EFF_FLAG;
+    frame.can_dlc = BYTES_PER_CAN_FRAME;
+    for (unsigned i = 0; i < DIGITAL_IN_RESP_SIGNAL_PER_FRAME; i++) {
+        frame.data[i] = node.inputs[frameIdx * DIGITAL_IN_RESP_SIGNAL_PER_FRAME + i];
+    }
+    send(frame);
+}
+
+/*
+ * @brief One CANTxHandler cycle of the firmware: digital output responses,
+ *        digital inputs, then analog inputs.
+ */
+void Generator::sendCycle(const Node &node, int64_t nowNs) {
+    struct can_frame frame;
+    frame.can_dlc = BYTES_PER_CAN_FRAME;
+
+    memset(frame.data, 0, sizeof(frame.data));
+    for (unsigned n = 0; n < NUMBER_OF_DIG_OUT_RES_FRAME; n++) {
+        frame.can_id = (DIGITAL_OUTPUT_RES_ID(n) + node.address) | CAN_EFF_FLAG;
+        send(frame);
+    }
+
+    for (unsigned n = 0; n < NUMBER_OF_DIG_IN_RES_FRAME; n++) {
+        sendDigitalInputs(node, n);
+    }
+
+    // Triangle ramps, each input a little out of phase with the previous one
+    const int64_t periodNs = int64_t(m_options.analogPeriodMs) * 1000000LL;
+    for (unsigned n = 0; n < NUMBER_OF_ANALOG_IN_RES_FRAME; n++) {
+        AnalogInput_Resp_Frame data;
+        data.sdu = 0;
+        for (unsigned i = 0; i < ANALOG_IN_RESP_SIGNAL_PER_FRAME; i++) {
+            uint16_t value = 0;
+            if (periodNs > 0) {
+                const unsigned input = n * ANALOG_IN_RESP_SIGNAL_PER_FRAME + i;
+                const int64_t shifted = nowNs - m_startNs + periodNs * (input + node.address) / ANALOG_INPUTS_PER_NODE;
+                const int64_t phase = shifted % periodNs;
+                const int64_t ramp = phase < periodNs / 2 ? phase : periodNs - phase;
+                value = uint16_t(ramp * 2 * ANALOG_MAX / periodNs);
+            }
+            data.signal[i].analogValue = value;
+        }
+        frame.can_id = (ANALOG_INPUT_RES_ID(n) + node.address) | CAN_EFF_FLAG;
+        memcpy(frame.data, &data.sdu, sizeof(frame.data));
+        send(frame);
+    }
+}
+
+/*
+ * @brief Flip one switch and send its frame at once. Node 0 only flips the
+ *        switches that do not drive the lamps, which are left to the probe.
+ */
+void Generator::toggleSwitch(Node &node) {
+    unsigned pos;
+    if (node.address == 0) {
+        pos = unsigned(m_options.uiSwitchPos[random() % m_options.uiSwitchPos.size()]);
+    } else {
+        pos = random() % DIG_INPUTS_PER_NODE;
+    }
+    if (pos >= DIG_INPUTS_PER_NODE) return;
+
+    node.inputs[pos] ^= 0x01;
+    sendDigitalInputs(node, pos / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
+}
+
+/*
+ * @brief One frame of powertrain traffic (EEC1, ETC1, engine temperature,
+ *        vehicle speed) from one of several source addresses.
+ */
+void Generator::sendNoise() {
+    static const uint32_t pgnIds[] = { 0x0CF00400U, 0x0CF00300U, 0x18FEEE00U, 0x18FEF100U };
+
+    const uint32_t seq = m_noiseSeq++;
+    struct can_frame frame;
+    frame.can_id = (pgnIds[seq % 4U] + ((seq / 4U) % 8U)) | CAN_EFF_FLAG;
+    frame.can_dlc = BYTES_PER_CAN_FRAME;
+    const uint32_t a = random(), b = random();
+    memcpy(frame.data, &a, sizeof(a));
+    memcpy(frame.data + 4, &b, sizeof(b));
+    send(frame);
+}
+
+GeneratorStats Generator::run(unsigned nodeCount, double noiseFps, int64_t measureFromNs, int64_t endNs) {
+    const Options &opt = m_options;
+    m_startNs = monotonicNs();
+    m_stats = GeneratorStats();
+    bool measuring = false;
+
+    const int64_t toggleNs = opt.toggleHz > 0 ? int64_t(1e9 / opt.toggleHz) : 0;
+    std::vector<Node> nodes(nodeCount);
+    for (unsigned k = 0; k < nodeCount; k++) {
+        Node &node = nodes[k];
+        node.address = k;
+        node.periodNs = int64_t(opt.cyclesMs[k % opt.cyclesMs.size()]) * 1000000LL;
+        // Spread the cycles so the nodes do not all burst at the same time
+        node.nextCycleNs = m_startNs + node.periodNs * k / nodeCount;
+        node.nextToggleNs = toggleNs ? m_startNs + toggleNs * k / nodeCount + toggleNs : INT64_MAX;
+    }
+    Node &probeNode = nodes[0];
+    probeNode.inputs[opt.ignitionPos] = 0x01;
+    // Make sure the hazard switch starts released on the cluster's side
+    sendDigitalInputs(probeNode, unsigned(opt.hazardPos) / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
+
+    const int64_t probePeriodNs = int64_t(opt.probePeriodMs) * 1000000LL;
+    const int64_t deadlineNs = int64_t(opt.deadlineMs) * 1000000LL;
+    int64_t probeNs = m_startNs + probePeriodNs;
+    bool probeHeld = false;
+    int64_t noiseStartNs = m_startNs;
+    uint64_t noiseSent = 0;
+
+    while (running) {
+        const int64_t now = monotonicNs();
+        if (now >= endNs) break;
+        if (!measuring && now >= measureFromNs) {
+            m_stats = GeneratorStats();
+            noiseStartNs = now;
+            noiseSent = 0;
+            measuring = true;
+        }
+
+        int64_t nextNs = now + MAX_IDLE_NS;
+
+        for (Node &node : nodes) {
+            if (node.nextCycleNs <= now) {
+                m_stats.maxLagNs = std::max(m_stats.maxLagNs, now - node.nextCycleNs);
+                sendCycle(node, now);
+                node.nextCycleNs += node.periodNs;
+                // Fell more than a cycle behind: resume from now rather than bursting
+                if (node.nextCycleNs <= now) node.nextCycleNs = now + node.periodNs;
+            }
+            if (node.nextToggleNs <= now) {
+                toggleSwitch(node);
+                node.nextToggleNs += toggleNs;
+            }
+            nextNs = std::min(nextNs, std::min(node.nextCycleNs, node.nextToggleNs));
+        }
+
+        // Hazard switch probe: press, release after the deadline
+        if (!probeHeld && now >= probeNs) {
+            probeNode.inputs[opt.hazardPos] = 0x01;
+            sendDigitalInputs(probeNode, unsigned(opt.hazardPos) / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
+            m_stats.probes++;
+            probeHeld = true;
+        } else if (probeHeld && now >= probeNs + deadlineNs) {
+            probeNode.inputs[opt.hazardPos] = 0x00;
+            sendDigitalInputs(probeNode, unsigned(opt.hazardPos) / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
+            probeHeld = false;
+            probeNs += probePeriodNs;
+        }
+        nextNs = std::min(nextNs, probeHeld ? probeNs + deadlineNs : probeNs);
+
+        if (noiseFps > 0) {
+            uint64_t due = uint64_t((now - noiseStartNs) * noiseFps / 1e9);
+            const uint64_t backlog = uint64_t(MAX_NOISE_BACKLOG_NS * noiseFps / 1e9);
+            if (due > noiseSent + backlog) {
+                m_stats.offered += due - backlog - noiseSent;
+                noiseSent = due - backlog;
+            }
+            while (running && noiseSent < due) {
+                sendNoise();
+                noiseSent++;
+            }
+            nextNs = std::min(nextNs, noiseStartNs + int64_t((noiseSent + 1) * 1e9 / noiseFps));
+        }
+
+        if (nextNs > monotonicNs()) {
+            const struct timespec until = { time_t(nextNs / 1000000000LL), long(nextNs % 1000000000LL) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr);
+        }
+    }
+
+    // Leave the cluster with the hazard switch released
+    if (probeHeld) {
+        probeNode.inputs[opt.hazardPos] = 0x00;
+        sendDigitalInputs(probeNode, unsigned(opt.hazardPos) / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
+    }
+    return m_stats;
+}
+
+/* Monitor --------------------------------------------------------------------*/
+
+struct MonitorStats {
+    std::vector<int64_t> latencyNs;
+    uint64_t missed = 0;
+    uint64_t lampFrames = 0;        // Lamp commands sent by the cluster
+    uint32_t overflows = 0;         // Frames dropped by our own socket queue
+};
+
+/*
+ * @brief Watches node 0's hazard switch frame and the cluster's lamp commands.
+ */
+class Monitor {
+public:
+    Monitor(int sock, const Options &options) : m_sock(sock), m_options(options) {}
+
+    void start() { m_thread = std::thread(&Monitor::run, this); }
+    void stop() {
+        m_running = false;
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    /*
+     * @brief Statistics since the previous call.
+     */
+    MonitorStats take() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        MonitorStats stats = m_stats;
+        stats.overflows = m_overflows - m_overflowsTaken;
+        m_overflowsTaken = m_overflows;
+        m_stats = MonitorStats();
+        return stats;
+    }
+
+private:
+    void run();
+    void handle(const struct can_frame &frame, int64_t timeNs);
+
+    int m_sock;
+    const Options &m_options;
+    std::thread m_thread;
+    std::atomic<bool> m_running{true};
+    std::mutex m_mutex;
+    MonitorStats m_stats;
+    uint32_t m_overflows = 0;          // SO_RXQ_OVFL, cumulative
+    uint32_t m_overflowsTaken = 0;
+    bool m_hazard = false;
+    bool m_awaiting = false;
+    int64_t m_pressNs = 0;
+};
+
+void Monitor::handle(const struct can_frame &frame, int64_t timeNs) {
+    const canid_t hazardId = DIGITAL_INPUT_RES_ID(m_options.hazardPos / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
+    const canid_t lampId = DIGITAL_OUTPUT_CMD_ID(m_options.lampPos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (frame.can_id == hazardId) {
+        const bool hazard = frame.data[m_options.hazardPos % DIGITAL_IN_RESP_SIGNAL_PER_FRAME] & 0x01;
+        if (hazard && !m_hazard) {
+            m_awaiting = true;
+            m_pressNs = timeNs;
+        } else if (!hazard && m_hazard && m_awaiting) {
+            m_stats.missed++;
+            m_awaiting = false;
+        }
+        m_hazard = hazard;
+    } else if (frame.can_id == lampId) {
+        m_stats.lampFrames++;
+        if (m_awaiting && frame.data[m_options.lampPos % DIGITAL_OUT_CMD_SIGNAL_PER_FRAME] == LAMP_CMD_ON) {
+            m_stats.latencyNs.push_back(timeNs - m_pressNs);
+            m_awaiting = false;
+        }
+    }
+}
+
+void Monitor::run() {
+    struct can_filter filters[2];
+    filters[0].can_id = DIGITAL_INPUT_RES_ID(m_options.hazardPos / DIGITAL_IN_RESP_SIGNAL_PER_FRAME);
+    filters[0].can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK;
+    filters[1].can_id = DIGITAL_OUTPUT_CMD_ID(m_options.lampPos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME);
+    filters[1].can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK;
+    setsockopt(m_sock, SOL_CAN_RAW, CAN_RAW_FILTER, filters, sizeof(filters));
+
+    // Kernel receive timestamps, so the latency does not include our own scheduling delay
+    int enable = 1;
+    setsockopt(m_sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+    setsockopt(m_sock, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+    struct timeval timeout = { 0, 100000 };
+    setsockopt(m_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct can_frame frame;
+    struct iovec iov = { &frame, sizeof(frame) };
+    char ctrl[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+
+    while (m_running) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        if (recvmsg(m_sock, &msg, 0) != sizeof(frame)) continue;
+
+        int64_t timeNs = 0;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET) continue;
+            if (cmsg->cmsg_type == SO_TIMESTAMPNS) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                timeNs = int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+            } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t drops;
+                memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_overflows = drops;
+            }
+        }
+        if (timeNs == 0) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            timeNs = int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+        }
+        handle(frame, timeNs);
+    }
+}
+
+/* CPU sampling ---------------------------------------------------------------*/
+
+struct CpuSample {
+    int64_t wallNs = 0;
+    uint64_t processTicks = 0;
+    std::map<int, std::pair<uint64_t, std::string>> threads;   // tid -> ticks, name
+    uint64_t selfUs = 0;
+    uint64_t ifDrops = 0;
+};
+
+/*
+ * @brief Read utime + stime and the name from a /proc stat file.
+ */
+static bool readStat(const std::string &path, uint64_t &ticks, std::string &name) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line)) return false;
+
+    const size_t open = line.find('('), close = line.rfind(')');
+    if (open == std::string::npos || close == std::string::npos) return false;
+    name = line.substr(open + 1, close - open - 1);
+
+    // Fields after the name start at field 3 (state); utime and stime are fields 14 and 15
+    std::istringstream fields(line.substr(close + 2));
+    std::string field;
+    uint64_t utime = 0, stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; i++) {
+        if (i == 14) utime = strtoull(field.c_str(), nullptr, 10);
+        if (i == 15) stime = strtoull(field.c_str(), nullptr, 10);
+    }
+    ticks = utime + stime;
+    return true;
+}
+
+static uint64_t readCounter(const std::string &path) {
+    std::ifstream file(path);
+    uint64_t value = 0;
+    file >> value;
+    return value;
+}
+
+static CpuSample sampleCpu(int pid, const char *interface) {
+    CpuSample sample;
+    sample.wallNs = monotonicNs();
+
+    if (pid > 0) {
+        const std::string base = "/proc/" + std::to_string(pid);
+        std::string name;
+        readStat(base + "/stat", sample.processTicks, name);
+
+        if (DIR *dir = opendir((base + "/task").c_str())) {
+            while (struct dirent *entry = readdir(dir)) {
+                if (entry->d_name[0] == '.') continue;
+                uint64_t ticks;
+                if (readStat(base + "/task/" + entry->d_name + "/stat", ticks, name)) {
+                    sample.threads[atoi(entry->d_name)] = { ticks, name };
+                }
+            }
+            closedir(dir);
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    sample.selfUs = uint64_t(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+                    usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+
+    const std::string stats = std::string("/sys/class/net/") + interface + "/statistics/";
+    sample.ifDrops = readCounter(stats + "rx_dropped") + readCounter(stats + "tx_dropped");
+    return sample;
+}
+
+/* Capacity curve -------------------------------------------------------------*/
+
+struct StepResult {
+    unsigned step = 0;
+    unsigned nodes = 0;
+    double noisePct = 0;
+    double offeredFps = 0;
+    double sentFps = 0;
+    double busLoadPct = 0;
+    double lampFps = 0;
+    double cpuPct = -1;             // Cluster process, -1 without --pid
+    double threadPct = -1;          // Busiest cluster thread
+    std::string threadName;
+    uint64_t probes = 0;
+    uint64_t answered = 0;
+    uint64_t missed = 0;
+    double p50Us = 0, p99Us = 0, maxUs = 0;
+    double lagUs = 0;
+    double selfCpuPct = 0;
+    uint64_t ifDrops = 0;
+    uint32_t monitorDrops = 0;
+
+    bool keepsUp() const { return missed == 0 && answered > 0; }
+};
+
+static StepResult evaluate(unsigned step, unsigned nodes, double noisePct, const Options &opt,
+                           const GeneratorStats &gen, MonitorStats &mon,
+                           const CpuSample &before, const CpuSample &after) {
+    StepResult r;
+    r.step = step;
+    r.nodes = nodes;
+    r.noisePct = noisePct;
+
+    const double seconds = (after.wallNs - before.wallNs) / 1e9;
+    r.offeredFps = gen.offered / seconds;
+    r.sentFps = gen.sent / seconds;
+    r.busLoadPct = 100.0 * gen.bits / seconds / opt.bitrate;
+    r.lampFps = mon.lampFrames / seconds;
+    r.probes = gen.probes;
+    r.answered = mon.latencyNs.size();
+    r.missed = mon.missed;
+    r.lagUs = gen.maxLagNs / 1e3;
+    r.selfCpuPct = 100.0 * (after.selfUs - before.selfUs) / 1e6 / seconds;
+    r.ifDrops = after.ifDrops - before.ifDrops;
+    r.monitorDrops = mon.overflows;
+
+    if (!mon.latencyNs.empty()) {
+        std::vector<int64_t> &lat = mon.latencyNs;
+        std::sort(lat.begin(), lat.end());
+        const size_t n = lat.size();
+        r.p50Us = lat[n / 2] / 1e3;
+        r.p99Us = lat[std::min(n - 1, n * 99 / 100)] / 1e3;
+        r.maxUs = lat.back() / 1e3;
+    }
+
+    if (opt.pid > 0 && after.processTicks >= before.processTicks) {
+        const double tickS = 1.0 / sysconf(_SC_CLK_TCK);
+        r.cpuPct = 100.0 * (after.processTicks - before.processTicks) * tickS / seconds;
+        r.threadPct = 0;
+        for (const auto &thread : after.threads) {
+            const auto prev = before.threads.find(thread.first);
+            const uint64_t ticks = thread.second.first - (prev != before.threads.end() ? prev->second.first : 0);
+            const double pct = 100.0 * ticks * tickS / seconds;
+            if (pct > r.threadPct) {
+                r.threadPct = pct;
+                r.threadName = thread.second.second + "/" + std::to_string(thread.first);
+            }
+        }
+    }
+    return r;
+}
+
+static void printHeader() {
+    printf("%4s %5s %6s %9s %9s %6s %6s %6s %-18s %9s %9s %9s %7s %9s %5s\n",
+           "step", "nodes", "noise%", "offer/s", "sent/s", "bus%", "cpu%", "thrd%", "busiest thread",
+           "p50 us", "p99 us", "max us", "missed", "lag us", "drops");
+}
+
+static void printStep(const StepResult &r) {
+    char cpu[16] = "-", thread[16] = "-";
+    if (r.cpuPct >= 0) {
+        snprintf(cpu, sizeof(cpu), "%.1f", r.cpuPct);
+        snprintf(thread, sizeof(thread), "%.1f", r.threadPct);
+    }
+    printf("%4u %5u %6.1f %9.0f %9.0f %6.1f %6s %6s %-18.18s %9.1f %9.1f %9.1f %3llu/%-3llu %9.0f %5llu\n",
+           r.step, r.nodes, r.noisePct, r.offeredFps, r.sentFps, r.busLoadPct, cpu, thread,
+           r.threadName.empty() ? "-" : r.threadName.c_str(), r.p50Us, r.p99Us, r.maxUs,
+           (unsigned long long)r.missed, (unsigned long long)(r.missed + r.answered),
+           r.lagUs, (unsigned long long)r.ifDrops);
+    fflush(stdout);
+}
+
+static void writeCsv(const char *path, const std::vector<StepResult> &results) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return;
+    }
+    fprintf(file, "step,nodes,noise_pct,offered_fps,sent_fps,bus_load_pct,lamp_fps,cpu_pct,thread_pct,thread,"
+                  "probes,answered,missed,latency_p50_us,latency_p99_us,latency_max_us,generator_lag_us,"
+                  "generator_cpu_pct,interface_drops,monitor_drops\n");
+    for (const StepResult &r : results) {
+        fprintf(file, "%u,%u,%.2f,%.1f,%.1f,%.2f,%.2f,%.2f,%.2f,%s,%llu,%llu,%llu,%.1f,%.1f,%.1f,%.1f,%.2f,%llu,%u\n",
+                r.step, r.nodes, r.noisePct, r.offeredFps, r.sentFps, r.busLoadPct, r.lampFps,
+                r.cpuPct, r.threadPct, r.threadName.c_str(), (unsigned long long)r.probes,
+                (unsigned long long)r.answered, (unsigned long long)r.missed, r.p50Us, r.p99Us, r.maxUs,
+                r.lagUs, r.selfCpuPct, (unsigned long long)r.ifDrops, r.monitorDrops);
+    }
+    fclose(file);
+}
+
+/*
+ * @brief Report the last step at which every probe was answered in time.
+ */
+static void printCapacity(const std::vector<StepResult> &results, const Options &opt) {
+    const StepResult *lastGood = nullptr;
+    const StepResult *firstBad = nullptr;
+    for (const StepResult &r : results) {
+        if (!r.keepsUp()) {
+            firstBad = &r;
+            break;
+        }
+        lastGood = &r;
+    }
+
+    printf("\n");
+    if (lastGood) {
+        printf("capacity: %.0f frames/s (%.1f%% bus load at %u bit/s), step %u, p99 %.1f us\n",
+               lastGood->sentFps, lastGood->busLoadPct, opt.bitrate, lastGood->step, lastGood->p99Us);
+    }
+    if (firstBad) {
+        printf("step %u (%.0f frames/s): %llu of %llu lamp commands missed the %u ms deadline\n",
+               firstBad->step, firstBad->sentFps, (unsigned long long)firstBad->missed,
+               (unsigned long long)(firstBad->missed + firstBad->answered), opt.deadlineMs);
+    } else if (!results.empty()) {
+        printf("no deadline missed up to the full load\n");
+    }
+
+    for (const StepResult &r : results) {
+        if (r.lagUs > 1000.0 * opt.cyclesMs[0] || r.sentFps < 0.99 * r.offeredFps) {
+            printf("warning: the generator fell behind at step %u (lag %.0f us, %.0f of %.0f frames/s sent); "
+                   "later steps measure the generator, not the cluster\n",
+                   r.step, r.lagUs, r.sentFps, r.offeredFps);
+            break;
+        }
+    }
+    for (const StepResult &r : results) {
+        if (r.monitorDrops) {
+            printf("warning: the monitor socket dropped %u frames at step %u, latencies may be incomplete\n",
+                   r.monitorDrops, r.step);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option longOptions[] = {
+        { "interface",     required_argument, nullptr, 'i' },
+        { "nodes",         required_argument, nullptr, 'n' },
+        { "cycle",         required_argument, nullptr, 'c' },
+        { "toggle",        required_argument, nullptr, 'T' },
+        { "analog-period", required_argument, nullptr, 'A' },
+        { "noise",         required_argument, nullptr, 'u' },
+        { "bitrate",       required_argument, nullptr, 'b' },
+        { "steps",         required_argument, nullptr, 's' },
+        { "step-time",     required_argument, nullptr, 't' },
+        { "ramp",          required_argument, nullptr, 'r' },
+        { "pid",           required_argument, nullptr, 'p' },
+        { "deadline",      required_argument, nullptr, 'd' },
+        { "probe-period",  required_argument, nullptr, 'P' },
+        { "io-config",     required_argument, nullptr, 'C' },
+        { "csv",           required_argument, nullptr, 'o' },
+        { "help",          no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+    Options opt;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "i:n:c:u:b:s:t:r:p:d:o:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+        case 'i': opt.interface = optarg; break;
+        case 'n': opt.nodes = unsigned(atoi(optarg)); break;
+        case 'c':
+            if (!parseList(optarg, opt.cyclesMs)) {
+                fprintf(stderr, "bad cycle list: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'T': opt.toggleHz = atof(optarg); break;
+        case 'A': opt.analogPeriodMs = unsigned(atoi(optarg)); break;
+        case 'u': opt.noisePct = atof(optarg); break;
+        case 'b': opt.bitrate = unsigned(atoi(optarg)); break;
+        case 's': opt.steps = unsigned(atoi(optarg)); break;
+        case 't': opt.stepTimeS = atof(optarg); break;
+        case 'r':
+            if (!strcmp(optarg, "both")) opt.ramp = Options::RampBoth;
+            else if (!strcmp(optarg, "nodes")) opt.ramp = Options::RampNodes;
+            else if (!strcmp(optarg, "noise")) opt.ramp = Options::RampNoise;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'p': opt.pid = atoi(optarg); break;
+        case 'd': opt.deadlineMs = unsigned(atoi(optarg)); break;
+        case 'P': opt.probePeriodMs = unsigned(atoi(optarg)); break;
+        case 'C':
+            if (!loadPositions(optarg, opt)) {
+                fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+                return 1;
+            }
+            break;
+        case 'o': opt.csvPath = optarg; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opt.nodes < 1 || opt.nodes > MAX_NODES || opt.steps < 1 || opt.stepTimeS < 1.0 ||
+        opt.bitrate == 0 || opt.noisePct < 0 || opt.deadlineMs == 0 ||
+        opt.probePeriodMs < 2 * opt.deadlineMs) {
+        fprintf(stderr, "invalid options (the probe period must be at least twice the deadline)\n");
+        usage(argv[0]);
+        return 1;
+    }
+    if (opt.ignitionPos < 0 || opt.ignitionPos >= int(DIG_INPUTS_PER_NODE) ||
+        opt.hazardPos < 0 || opt.hazardPos >= int(DIG_INPUTS_PER_NODE) ||
+        opt.lampPos < 0 || opt.lampPos >= int(NUMBER_OF_DIG_OUT_CMD_FRAME * DIGITAL_OUT_CMD_SIGNAL_PER_FRAME)) {
+        fprintf(stderr, "switch or lamp position out of range\n");
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    const int txSock = openSocket(opt.interface);
+    const int rxSock = openSocket(opt.interface);
+    if (txSock < 0 || rxSock < 0) return 1;
+    // Only the monitor socket reads; keep the generator's receive queue from filling up
+    setsockopt(txSock, SOL_CAN_RAW, CAN_RAW_FILTER, nullptr, 0);
+
+    Monitor monitor(rxSock, opt);
+    monitor.start();
+    Generator generator(txSock, opt);
+
+    const double noiseFpsPerPct = opt.bitrate / 100.0 / frameBits(true, BYTES_PER_CAN_FRAME);
+    const int64_t stepNs = int64_t(opt.stepTimeS * 1e9);
+    const int64_t settleNs = std::min<int64_t>(1000000000LL, stepNs / 5);
+
+    printf("%s: up to %u nodes, cycles", opt.interface, opt.nodes);
+    for (unsigned ms : opt.cyclesMs) printf(" %u", ms);
+    printf(" ms, %.1f%% noise at %u bit/s, %u steps of %.1f s, deadline %u ms\n\n",
+           opt.noisePct, opt.bitrate, opt.steps, opt.stepTimeS, opt.deadlineMs);
+    printHeader();
+
+    std::vector<StepResult> results;
+    for (unsigned step = 1; running && step <= opt.steps; step++) {
+        const double fraction = double(step) / opt.steps;
+        unsigned nodes = opt.nodes;
+        double noisePct = opt.noisePct;
+        if (opt.ramp != Options::RampNoise) {
+            nodes = std::max(1U, unsigned(std::lround(opt.nodes * fraction)));
+        }
+        if (opt.ramp != Options::RampNodes) {
+            noisePct = opt.noisePct * fraction;
+        }
+
+        const int64_t startNs = monotonicNs();
+        const int64_t measureNs = startNs + settleNs;
+        CpuSample before;
+
+        // The settle phase is not measured; sample just as it ends
+        std::thread sampler([&] {
+            const struct timespec until = { time_t(measureNs / 1000000000LL), long(measureNs % 1000000000LL) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr);
+            monitor.take();
+            before = sampleCpu(opt.pid, opt.interface);
+        });
+        const GeneratorStats gen = generator.run(nodes, noisePct * noiseFpsPerPct, measureNs, startNs + stepNs);
+        sampler.join();
+        if (!running) break;
+
+        const CpuSample after = sampleCpu(opt.pid, opt.interface);
+        MonitorStats mon = monitor.take();
+        results.push_back(evaluate(step, nodes, noisePct, opt, gen, mon, before, after));
+        printStep(results.back());
+    }
+
+    monitor.stop();
+    close(txSock);
+    close(rxSock);
+
+    printCapacity(results, opt);
+    if (opt.csvPath) {
+        writeCsv(opt.csvPath, results);
+    }
+    return 0;
+}
@@ -0,0 +1,393 @@
+#include "canindex.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+uint32_t getU32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+uint64_t getU64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+void putU32(uint8_t *p, uint32_t v) { memcpy(p, &v, 4); }
+void putU64(uint8_t *p, uint64_t v) { memcpy(p, &v, 8); }
+
+uint64_t padded(uint64_t size) { return (size + 7) & ~uint64_t(7); }
+
+// Bit of the bloom filter for hash k of an ID
+unsigned bloomBit(uint32_t canId, unsigned k) {
+    static const uint32_t seeds[CAN_INDEX_BLOOM_HASHES] = { 0x9E3779B1U, 0x85EBCA77U };
+    return (canId * seeds[k]) >> 24;
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*
+ * @brief Parse one candump line with the semantics of CanLogReader::nextText(),
+ *        without the copy and the sscanf() of the line.
+ * @return false if the line is not a classic CAN frame.
+ */
+bool parseTextLine(const char *p, const char *end, CanLogRecord &record) {
+    auto skipSpace = [&]() { while (p < end && (*p == ' ' || *p == '\t')) p++; };
+    auto number = [&](unsigned long long &value) {
+        const char *start = p;
+        value = 0;
+        while (p < end && *p >= '0' && *p <= '9') value = value * 10 + unsigned(*p++ - '0');
+        return p != start;
+    };
+
+    // (seconds.micros) interface ID#DATA
+    unsigned long long sec, usec;
+    skipSpace();
+    if (p == end || *p++ != '(' || !number(sec) || p == end || *p++ != '.' || !number(usec) ||
+        p == end || *p++ != ')') {
+        return false;
+    }
+    skipSpace();
+    const char *iface = p;
+    while (p < end && *p != ' ' && *p != '\t') p++;
+    if (p == iface) return false;
+    skipSpace();
+
+    const char *id = p;
+    uint32_t value = 0;
+    while (p < end && hexDigit(*p) >= 0) value = (value << 4) | uint32_t(hexDigit(*p++));
+    if (p == id || p == end || *p != '#') return false;
+    const size_t idLen = size_t(p - id);
+    p++;
+    if (p < end && *p == '#') return false;     // CAN FD
+
+    memset(&record.frame, 0, sizeof(record.frame));
+    record.frame.can_id = idLen > 3 ? (value & CAN_EFF_MASK) | CAN_EFF_FLAG : (value & CAN_SFF_MASK);
+    if (p < end && *p == 'R') {
+        record.frame.can_id |= CAN_RTR_FLAG;
+    } else {
+        uint8_t dlc = 0;
+        while (dlc < CAN_MAX_DLEN && end - p >= 2 && hexDigit(p[0]) >= 0 && hexDigit(p[1]) >= 0) {
+            record.frame.data[dlc++] = uint8_t((hexDigit(p[0]) << 4) | hexDigit(p[1]));
+            p += 2;
+            if (p < end && *p == '.') p++;
+        }
+        record.frame.can_dlc = dlc;
+    }
+    record.timestampUs = sec * 1000000ULL + usec;
+    return true;
+}
+
+} // namespace
+
+CanLogIndex::~CanLogIndex() { close(); }
+
+bool CanLogIndex::open(const std::string &path, unsigned jobs, bool rebuild) {
+    close();
+    m_path = path;
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        m_error = path + ": " + strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    m_size = uint64_t(st.st_size);
+    m_mtimeNs = int64_t(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    if (m_size > 0) {
+        void *map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            m_error = path + ": " + strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        m_data = static_cast<const uint8_t *>(map);
+        madvise(map, m_size, MADV_WILLNEED);
+    }
+    ::close(fd);
+
+    if (m_size >= CAN_BB_HEADER_SIZE && memcmp(m_data, CAN_BB_MAGIC, CAN_BB_MAGIC_SIZE) == 0) {
+        if (getU32(m_data + 8) != CAN_BB_HEADER_SIZE) {
+            m_error = path + ": not a black box file";
+            return false;
+        }
+        m_format = CAN_LOG_FORMAT_BLACKBOX;
+        m_sequence = getU32(m_data + 12);
+    } else if (m_size >= CAN_LOG_HEADER_SIZE && memcmp(m_data, CAN_LOG_MAGIC, CAN_LOG_MAGIC_SIZE) == 0) {
+        m_format = CAN_LOG_FORMAT_CLOG;
+    } else {
+        m_format = CAN_LOG_FORMAT_TEXT;
+    }
+
+    if (!rebuild && load()) return true;
+
+    if (!split()) return false;
+    build(jobs);
+    m_rebuilt = true;
+    if (!save()) {
+        // A read-only log directory still allows queries, just without the sidecar
+        fprintf(stderr, "CANINDEX: %s%s: %s, index kept in memory\n", path.c_str(), CAN_INDEX_SUFFIX,
+                strerror(errno));
+    }
+    return true;
+}
+
+void CanLogIndex::close() {
+    if (m_data) {
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+        m_data = nullptr;
+    }
+    m_size = 0;
+    m_blocks.clear();
+    m_frames = 0;
+    m_firstUs = m_lastUs = 0;
+    m_rebuilt = false;
+}
+
+bool CanLogIndex::mayContain(const CanIndexBlock &block, uint32_t canId) {
+    for (unsigned k = 0; k < CAN_INDEX_BLOOM_HASHES; k++) {
+        const unsigned bit = bloomBit(canId, k);
+        if (!(block.bloom[bit / 64] & (uint64_t(1) << (bit % 64)))) return false;
+    }
+    return true;
+}
+
+/*
+ * @brief Cut the log into blocks. Only the boundaries are found here, the
+ *        frames and the bloom filters are filled in by build().
+ */
+bool CanLogIndex::split() {
+    m_blocks.clear();
+    CanIndexBlock block;
+
+    switch (m_format) {
+    case CAN_LOG_FORMAT_TEXT: {
+        uint64_t offset = 0;
+        while (offset < m_size) {
+            uint64_t end = std::min<uint64_t>(offset + CAN_INDEX_TEXT_BLOCK, m_size);
+            if (end < m_size) {
+                const void *newline = memchr(m_data + end, '\n', m_size - end);
+                end = newline ? uint64_t(static_cast<const uint8_t *>(newline) - m_data) + 1 : m_size;
+            }
+            block.offset = offset;
+            block.length = uint32_t(end - offset);
+            m_blocks.push_back(block);
+            offset = end;
+        }
+        break;
+    }
+    case CAN_LOG_FORMAT_CLOG: {
+        const uint64_t records = (m_size - CAN_LOG_HEADER_SIZE) / CAN_LOG_RECORD_SIZE;
+        for (uint64_t first = 0; first < records; first += CAN_INDEX_CLOG_BLOCK) {
+            block.offset = CAN_LOG_HEADER_SIZE + first * CAN_LOG_RECORD_SIZE;
+            block.length = uint32_t(std::min<uint64_t>(CAN_INDEX_CLOG_BLOCK, records - first) * CAN_LOG_RECORD_SIZE);
+            m_blocks.push_back(block);
+        }
+        break;
+    }
+    case CAN_LOG_FORMAT_BLACKBOX: {
+        // Walk the block headers; the first one of another sequence ends the file
+        const uint64_t fileSize = std::min<uint64_t>(getU64(m_data + 16), m_size);
+        uint64_t offset = CAN_BB_HEADER_SIZE;
+        while (offset + CAN_BB_BLOCK_HEADER_SIZE <= fileSize) {
+            const uint8_t *header = m_data + offset;
+            if (getU32(header) != CAN_BB_BLOCK_MAGIC || getU32(header + 4) != m_sequence) break;
+            const uint64_t size = padded(CAN_BB_BLOCK_HEADER_SIZE + uint64_t(getU32(header + 8)));
+            if (offset + size > fileSize) break;
+            block.offset = offset;
+            block.length = uint32_t(size);
+            m_blocks.push_back(block);
+            offset += size;
+        }
+        break;
+    }
+    }
+    return true;
+}
+
+size_t CanLogIndex::decode(const CanIndexBlock &block, std::vector<CanLogRecord> &records) const {
+    records.clear();
+    const uint8_t *data = m_data + block.offset;
+    CanLogRecord record;
+
+    switch (m_format) {
+    case CAN_LOG_FORMAT_TEXT: {
+        const char *p = reinterpret_cast<const char *>(data);
+        const char *end = p + block.length;
+        while (p < end) {
+            const char *newline = static_cast<const char *>(memchr(p, '\n', size_t(end - p)));
+            const char *lineEnd = newline ? newline : end;
+            if (parseTextLine(p, lineEnd, record)) records.push_back(record);
+            p = lineEnd + 1;
+        }
+        break;
+    }
+    case CAN_LOG_FORMAT_CLOG: {
+        // Same record layout as CanLogReader::nextBinary()
+        records.resize(block.length / CAN_LOG_RECORD_SIZE);
+        for (CanLogRecord &out : records) {
+            memset(&out.frame, 0, sizeof(out.frame));
+            out.timestampUs = getU64(data);
+            out.frame.can_id = getU32(data + 8);
+            out.frame.can_dlc = std::min<uint8_t>(data[12], CAN_MAX_DLEN);
+            memcpy(out.frame.data, data + 16, 8);
+            data += CAN_LOG_RECORD_SIZE;
+        }
+        break;
+    }
+    case CAN_LOG_FORMAT_BLACKBOX: {
+        thread_local std::vector<uint8_t> raw;
+        thread_local std::vector<CanBlackBoxEntry> frames;
+        if (CanBlackBoxReader::decodeBlock(data, block.length, m_sequence, raw, frames) == 0) break;
+        records.resize(frames.size());
+        for (size_t i = 0; i < frames.size(); i++) {
+            records[i].timestampUs = uint64_t(frames[i].timestampNs / 1000);
+            records[i].frame = frames[i].frame;
+        }
+        break;
+    }
+    }
+    return records.size();
+}
+
+void CanLogIndex::build(unsigned jobs) {
+    canIndexParallel(m_blocks.size(), jobs, [this](size_t i) {
+        thread_local std::vector<CanLogRecord> records;
+        CanIndexBlock &block = m_blocks[i];
+        decode(block, records);
+
+        block.frames = uint32_t(records.size());
+        memset(block.bloom, 0, sizeof(block.bloom));
+        if (records.empty()) return;
+        block.firstUs = block.lastUs = int64_t(records.front().timestampUs);
+        uint32_t lastId = ~0U;
+        for (const CanLogRecord &record : records) {
+            const int64_t us = int64_t(record.timestampUs);
+            block.firstUs = std::min(block.firstUs, us);
+            block.lastUs = std::max(block.lastUs, us);
+            if (record.frame.can_id == lastId) continue;
+            lastId = record.frame.can_id;
+            for (unsigned k = 0; k < CAN_INDEX_BLOOM_HASHES; k++) {
+                const unsigned bit = bloomBit(lastId, k);
+                block.bloom[bit / 64] |= uint64_t(1) << (bit % 64);
+            }
+        }
+    });
+
+    m_frames = 0;
+    bool first = true;
+    for (const CanIndexBlock &block : m_blocks) {
+        if (block.frames == 0) continue;
+        m_frames += block.frames;
+        m_firstUs = first ? block.firstUs : std::min(m_firstUs, block.firstUs);
+        m_lastUs = first ? block.lastUs : std::max(m_lastUs, block.lastUs);
+        first = false;
+    }
+}
+
+bool CanLogIndex::load() {
+    const std::string path = m_path + CAN_INDEX_SUFFIX;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    uint8_t header[CAN_INDEX_HEADER_SIZE];
+    bool valid = fread(header, 1, sizeof(header), file) == sizeof(header) &&
+                 memcmp(header, CAN_INDEX_MAGIC, CAN_INDEX_MAGIC_SIZE) == 0 &&
+                 getU32(header + 8) == CAN_INDEX_HEADER_SIZE && getU32(header + 12) == m_format &&
+                 getU64(header + 16) == m_size && int64_t(getU64(header + 24)) == m_mtimeNs;
+    if (valid) {
+        const uint64_t count = getU64(header + 32);
+        std::vector<uint8_t> entries(count * CAN_INDEX_ENTRY_SIZE);
+        valid = fread(entries.data(), 1, entries.size(), file) == entries.size();
+        m_blocks.resize(valid ? count : 0);
+        for (size_t i = 0; i < m_blocks.size(); i++) {
+            const uint8_t *entry = entries.data() + i * CAN_INDEX_ENTRY_SIZE;
+            CanIndexBlock &block = m_blocks[i];
+            block.offset = getU64(entry);
+            block.length = getU32(entry + 8);
+            block.frames = getU32(entry + 12);
+            block.firstUs = int64_t(getU64(entry + 16));
+            block.lastUs = int64_t(getU64(entry + 24));
+            for (unsigned w = 0; w < CAN_INDEX_BLOOM_WORDS; w++) block.bloom[w] = getU64(entry + 32 + 8 * w);
+            valid = valid && block.offset + block.length <= m_size;
+        }
+        m_frames = getU64(header + 40);
+        m_firstUs = int64_t(getU64(header + 48));
+        m_lastUs = int64_t(getU64(header + 56));
+    }
+    fclose(file);
+    if (!valid) m_blocks.clear();
+    return valid;
+}
+
+bool CanLogIndex::save() const {
+    const std::string path = m_path + CAN_INDEX_SUFFIX;
+    const std::string temp = path + ".tmp";
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (!file) return false;
+
+    uint8_t header[CAN_INDEX_HEADER_SIZE] = {};
+    memcpy(header, CAN_INDEX_MAGIC, CAN_INDEX_MAGIC_SIZE);
+    putU32(header + 8, CAN_INDEX_HEADER_SIZE);
+    putU32(header + 12, m_format);
+    putU64(header + 16, m_size);
+    putU64(header + 24, uint64_t(m_mtimeNs));
+    putU64(header + 32, m_blocks.size());
+    putU64(header + 40, m_frames);
+    putU64(header + 48, uint64_t(m_firstUs));
+    putU64(header + 56, uint64_t(m_lastUs));
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    for (const CanIndexBlock &block : m_blocks) {
+        uint8_t entry[CAN_INDEX_ENTRY_SIZE];
+        putU64(entry, block.offset);
+        putU32(entry + 8, block.length);
+        putU32(entry + 12, block.frames);
+        putU64(entry + 16, uint64_t(block.firstUs));
+        putU64(entry + 24, uint64_t(block.lastUs));
+        for (unsigned w = 0; w < CAN_INDEX_BLOOM_WORDS; w++) putU64(entry + 32 + 8 * w, block.bloom[w]);
+        ok = ok && fwrite(entry, 1, sizeof(entry), file) == sizeof(entry);
+    }
+    ok = fclose(file) == 0 && ok;
+    // Replace the old index atomically, a concurrent query never sees half of it
+    if (!ok || rename(temp.c_str(), path.c_str()) < 0) {
+        const int error = errno;
+        unlink(temp.c_str());
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+size_t CanLogIndex::query(int64_t fromUs, int64_t toUs, const std::vector<uint32_t> &ids, unsigned jobs,
+                          std::vector<CanLogRecord> &records) const {
+    std::vector<size_t> selected;
+    for (size_t i = 0; i < m_blocks.size(); i++) {
+        const CanIndexBlock &block = m_blocks[i];
+        if (block.frames == 0 || block.lastUs < fromUs || block.firstUs > toUs) continue;
+        bool wanted = ids.empty();
+        for (size_t n = 0; n < ids.size() && !wanted; n++) wanted = mayContain(block, ids[n]);
+        if (wanted) selected.push_back(i);
+    }
+
+    std::vector<std::vector<CanLogRecord>> results(selected.size());
+    canIndexParallel(selected.size(), jobs, [&](size_t n) {
+        thread_local std::vector<CanLogRecord> frames;
+        decode(m_blocks[selected[n]], frames);
+        std::vector<CanLogRecord> &out = results[n];
+        for (const CanLogRecord &record : frames) {
+            const int64_t us = int64_t(record.timestampUs);
+            if (us < fromUs || us > toUs) continue;
+            if (!ids.empty() && !std::binary_search(ids.begin(), ids.end(), record.frame.can_id)) continue;
+            out.push_back(record);
+        }
+    });
+
+    for (std::vector<CanLogRecord> &result : results) {
+        records.insert(records.end(), result.begin(), result.end());
+    }
+    return selected.size();
+}
@@ -0,0 +1,142 @@
+#ifndef CANINDEX_H
+#define CANINDEX_H
+
+#include "canlog.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Sidecar index of a CAN log (<log>.cidx), little endian:
+ *   header (64 bytes):
+ *     char magic[8] "CANIDX01", uint32 header size, uint32 log format,
+ *     uint64 log size, int64 log mtime (ns), uint64 block count, uint64 frames,
+ *     int64 first timestamp (us), int64 last timestamp (us)
+ *   per block (64 bytes):
+ *     uint64 offset, uint32 length, uint32 frames,
+ *     int64 first timestamp (us), int64 last timestamp (us),
+ *     uint64 ID bloom[4]                   256 bits, CAN_INDEX_BLOOM_HASHES per ID
+ * The index is rebuilt when the size or the modification time of the log changes.
+ */
+#define CAN_INDEX_MAGIC             "CANIDX01"
+#define CAN_INDEX_MAGIC_SIZE        8U
+#define CAN_INDEX_HEADER_SIZE       64U
+#define CAN_INDEX_ENTRY_SIZE        64U
+#define CAN_INDEX_SUFFIX            ".cidx"
+#define CAN_INDEX_TEXT_BLOCK        (4U << 20)      // Bytes of a candump block, cut at a line end
+#define CAN_INDEX_CLOG_BLOCK        131072U         // Records of a .clog block
+#define CAN_INDEX_BLOOM_WORDS       4U
+#define CAN_INDEX_BLOOM_HASHES      2U
+
+enum CanLogFormat : uint32_t {
+    CAN_LOG_FORMAT_TEXT = 0,                        // candump -l
+    CAN_LOG_FORMAT_CLOG,                            // CanLogWriter
+    CAN_LOG_FORMAT_BLACKBOX,                        // CanBlackBox
+};
+
+/*
+ * @brief Independently decodable byte range of a log.
+ */
+struct CanIndexBlock {
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    uint32_t frames = 0;
+    int64_t firstUs = 0;
+    int64_t lastUs = 0;
+    uint64_t bloom[CAN_INDEX_BLOOM_WORDS] = {};
+};
+
+/*
+ * @brief Memory-mapped CAN log with a time and CAN ID index over its blocks.
+ *
+ * The log is split into blocks that decode on their own: candump text at line
+ * ends, .clog at record boundaries and black box files at their compressed
+ * blocks. Building the index and querying it decode the blocks in parallel;
+ * a query only touches the blocks whose time range overlaps and whose bloom
+ * filter may hold one of the wanted IDs.
+ */
+class CanLogIndex {
+public:
+    CanLogIndex() = default;
+    ~CanLogIndex();
+    CanLogIndex(const CanLogIndex &) = delete;
+    CanLogIndex &operator=(const CanLogIndex &) = delete;
+
+    /*
+     * @brief Map a log and load its index, building it if it is missing or stale.
+     * @param path: The log file.
+     * @param jobs: Threads decoding blocks.
+     * @param rebuild: Build the index even if a valid one exists.
+     * @return false if the log cannot be read or has an unknown format.
+     */
+    bool open(const std::string &path, unsigned jobs, bool rebuild = false);
+    void close();
+
+    /*
+     * @brief Decode the frames of a time range.
+     * @param fromUs, toUs: Inclusive time range.
+     * @param ids: Wanted CAN IDs including the CAN_*_FLAG bits, sorted. Empty selects all.
+     * @param jobs: Threads decoding blocks.
+     * @param records: Receives the frames in log order.
+     * @return Number of blocks decoded.
+     */
+    size_t query(int64_t fromUs, int64_t toUs, const std::vector<uint32_t> &ids, unsigned jobs,
+                 std::vector<CanLogRecord> &records) const;
+
+    const std::string &path() const { return m_path; }
+    CanLogFormat format() const { return m_format; }
+    const std::vector<CanIndexBlock> &blocks() const { return m_blocks; }
+    uint64_t frames() const { return m_frames; }
+    int64_t firstUs() const { return m_firstUs; }
+    int64_t lastUs() const { return m_lastUs; }
+    uint64_t size() const { return m_size; }
+    bool rebuilt() const { return m_rebuilt; }
+    const std::string &error() const { return m_error; }
+
+    /*
+     * @brief Whether the bloom filter of a block may contain an ID.
+     */
+    static bool mayContain(const CanIndexBlock &block, uint32_t canId);
+
+private:
+    bool split();
+    void build(unsigned jobs);
+    bool load();
+    bool save() const;
+    size_t decode(const CanIndexBlock &block, std::vector<CanLogRecord> &records) const;
+
+    std::string m_path;
+    CanLogFormat m_format = CAN_LOG_FORMAT_TEXT;
+    const uint8_t *m_data = nullptr;
+    uint64_t m_size = 0;
+    int64_t m_mtimeNs = 0;
+    uint32_t m_sequence = 0;                        // Black box file sequence
+    std::vector<CanIndexBlock> m_blocks;
+    uint64_t m_frames = 0;
+    int64_t m_firstUs = 0;
+    int64_t m_lastUs = 0;
+    bool m_rebuilt = false;
+    std::string m_error;
+};
+
+/*
+ * @brief Run work(i) for i in [0, count) on up to jobs threads.
+ */
+template <typename Work>
+void canIndexParallel(size_t count, unsigned jobs, Work work) {
+    jobs = unsigned(std::max<size_t>(1, std::min<size_t>(jobs, count)));
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) work(i);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < jobs; i++) threads.emplace_back(worker);
+    worker();
+    for (std::thread &thread : threads) thread.join();
+}
+
+#endif // CANINDEX_H
@@ -0,0 +1,29 @@
+# Indexes recorded CAN logs (candump / .clog / black box) and extracts per-signal time series.
+# Plain C++, decodes with the protocol code of the cluster application.
+TEMPLATE = app
+TARGET = canquery
+CONFIG += console c++17 thread
+CONFIG -= qt app_bundle
+
+APP_DIR = $$PWD/../../qtapp/files
+INCLUDEPATH += $$APP_DIR/communication
+
+SOURCES += \
+        main.cpp \
+        canindex.cpp \
+        canseries.cpp \
+        $$APP_DIR/communication/canblackbox.cpp \
+        $$APP_DIR/communication/canlog.cpp \
+        $$APP_DIR/communication/canprotocol.cpp
+
+HEADERS += \
+        canindex.h \
+        canseries.h \
+        $$APP_DIR/communication/canblackbox.h \
+        $$APP_DIR/communication/canlog.h \
+        $$APP_DIR/communication/canprotocol.h
+
+LIBS += -lz -lpthread
+
+target.path = /usr/bin
+INSTALLS += target
@@ -0,0 +1,262 @@
+#include "canseries.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+/*
+ * @brief Reader of io_config.json: an object of sections, each an object of
+ *        names to numbers. That is all the file holds, so nothing more is parsed.
+ */
+class ConfigParser {
+public:
+    explicit ConfigParser(const std::string &text) : m_p(text.c_str()) {}
+
+    bool parse(std::vector<std::pair<std::string, std::vector<std::pair<std::string, long>>>> &sections) {
+        if (!accept('{')) return false;
+        if (peek() == '}') return accept('}');
+        do {
+            std::string section;
+            if (!string(section) || !accept(':') || !accept('{')) return false;
+            sections.emplace_back(section, std::vector<std::pair<std::string, long>>());
+            if (peek() == '}') {
+                m_p++;
+                continue;
+            }
+            do {
+                std::string name;
+                if (!string(name) || !accept(':')) return false;
+                char *end = nullptr;
+                const long value = strtol(m_p, &end, 10);
+                if (end == m_p) return false;
+                m_p = end;
+                sections.back().second.emplace_back(name, value);
+            } while (accept(','));
+            if (!accept('}')) return false;
+        } while (accept(','));
+        return accept('}');
+    }
+
+private:
+    char peek() {
+        while (isspace(static_cast<unsigned char>(*m_p))) m_p++;
+        return *m_p;
+    }
+    bool accept(char c) {
+        if (peek() != c) return false;
+        m_p++;
+        return true;
+    }
+    bool string(std::string &out) {
+        if (!accept('"')) return false;
+        const char *end = strchr(m_p, '"');
+        if (!end) return false;
+        out.assign(m_p, end);
+        m_p = end + 1;
+        return true;
+    }
+
+    const char *m_p;
+};
+
+} // namespace
+
+bool CanSeriesConfig::load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        m_error = path + ": " + strerror(errno);
+        return false;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+
+    std::vector<std::pair<std::string, std::vector<std::pair<std::string, long>>>> sections;
+    if (!ConfigParser(text.str()).parse(sections)) {
+        m_error = path + ": not an IO configuration";
+        return false;
+    }
+
+    m_signals.clear();
+    m_map = CanSignalMap();
+    for (const auto &section : sections) {
+        for (const auto &entry : section.second) {
+            CanSeriesSignal signal;
+            signal.name = entry.first;
+            signal.pos = uint8_t(entry.second);
+            if (section.first == "digital_inputs") {
+                signal.kind = CAN_SERIES_DIGITAL_INPUT;
+                signal.signal = canSignalFromName(entry.first.c_str());
+                m_map.digInputs.push_back({ signal.signal, signal.pos });
+                if (signal.signal > CAN_SIGNAL_PARKING_LIGHTS) continue;
+            } else if (section.first == "analog_inputs") {
+                signal.kind = CAN_SERIES_ANALOG_INPUT;
+                signal.signal = canSignalFromName(entry.first.c_str());
+                m_map.analogInputs.push_back({ signal.signal, signal.pos });
+                if (signal.signal != CAN_SIGNAL_SPEED) continue;
+            } else if (section.first == "digital_outputs") {
+                signal.kind = CAN_SERIES_DIGITAL_OUTPUT;
+            } else {
+                continue;
+            }
+            m_signals.push_back(signal);
+        }
+    }
+    if (m_signals.empty()) {
+        m_error = path + ": no known signals";
+        return false;
+    }
+    return true;
+}
+
+const CanSeriesSignal *CanSeriesConfig::find(const std::string &name) const {
+    for (const CanSeriesSignal &signal : m_signals) {
+        if (signal.name == name) return &signal;
+    }
+    return nullptr;
+}
+
+// Frame carrying a signal
+static uint32_t signalId(const CanSeriesSignal &signal) {
+    switch (signal.kind) {
+    case CAN_SERIES_DIGITAL_INPUT:
+        return uint32_t(DIGITAL_INPUT_RES_ID(signal.pos / DIGITAL_IN_RESP_SIGNAL_PER_FRAME));
+    case CAN_SERIES_ANALOG_INPUT:
+        return uint32_t(ANALOG_INPUT_RES_ID(signal.pos * 2 / ANALOG_IN_RESP_SIGNAL_PER_FRAME));
+    default:
+        return uint32_t(DIGITAL_OUTPUT_CMD_ID(signal.pos / DIGITAL_OUT_CMD_SIGNAL_PER_FRAME));
+    }
+}
+
+std::vector<uint32_t> CanSeriesConfig::ids(const std::vector<CanSeriesSignal> &signals) const {
+    std::vector<uint32_t> ids;
+    for (const CanSignalEntry &entry : m_map.digInputs) {
+        ids.push_back(uint32_t(DIGITAL_INPUT_RES_ID(entry.pos / DIGITAL_IN_RESP_SIGNAL_PER_FRAME)));
+    }
+    for (const CanSeriesSignal &signal : signals) ids.push_back(signalId(signal));
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+void canSeriesExtract(const CanSeriesConfig &config, const std::vector<CanSeriesSignal> &signals,
+                      const std::vector<CanLogRecord> &records, int64_t fromUs, int64_t toUs,
+                      std::vector<CanSeries> &series) {
+    series.assign(signals.size(), CanSeries());
+    std::vector<uint32_t> ids(signals.size());
+    std::vector<int32_t> values(signals.size(), 0);
+    std::vector<bool> known(signals.size(), false);
+    for (size_t i = 0; i < signals.size(); i++) {
+        series[i].name = signals[i].name;
+        ids[i] = signalId(signals[i]);
+    }
+
+    digInSignal input;
+    analogInSignal analog;
+    bool started = false;
+    auto start = [&]() {
+        started = true;
+        for (size_t i = 0; i < signals.size(); i++) {
+            if (!known[i]) continue;
+            series[i].timesUs.push_back(fromUs);
+            series[i].values.push_back(values[i]);
+        }
+    };
+
+    for (const CanLogRecord &record : records) {
+        const int64_t us = int64_t(record.timestampUs);
+        if (us > toUs) break;
+        if (!started && us >= fromUs) start();
+
+        canDecodeFrame(config.map(), record.frame, input, analog);
+        for (size_t i = 0; i < signals.size(); i++) {
+            if (record.frame.can_id != ids[i]) continue;
+
+            int32_t value;
+            switch (signals[i].kind) {
+            case CAN_SERIES_DIGITAL_INPUT:
+                value = canDigitalInputValue(input, signals[i].signal);
+                break;
+            case CAN_SERIES_ANALOG_INPUT:
+                value = analog.speed;
+                break;
+            default: {
+                bool on;
+                if (!canDecodeLampCommand(signals[i].pos, record.frame, on)) continue;
+                value = on;
+                break;
+            }
+            }
+
+            if (started && (!known[i] || value != values[i])) {
+                series[i].timesUs.push_back(us);
+                series[i].values.push_back(value);
+            }
+            known[i] = true;
+            values[i] = value;
+        }
+    }
+    if (!started && fromUs <= toUs) start();
+}
+
+bool canSeriesWriteCsv(FILE *file, const std::vector<CanSeries> &series) {
+    fputs("time", file);
+    for (const CanSeries &s : series) fprintf(file, ",%s", s.name.c_str());
+    fputc('\n', file);
+
+    // Merge the series by time, one row per distinct change time
+    std::vector<size_t> cursor(series.size(), 0);
+    std::string row;
+    char number[32];
+    for (;;) {
+        int64_t us = INT64_MAX;
+        for (size_t i = 0; i < series.size(); i++) {
+            if (cursor[i] < series[i].timesUs.size()) us = std::min(us, series[i].timesUs[cursor[i]]);
+        }
+        if (us == INT64_MAX) break;
+
+        snprintf(number, sizeof(number), "%lld.%06lld", static_cast<long long>(us / 1000000),
+                 static_cast<long long>(us % 1000000));
+        row = number;
+        for (size_t i = 0; i < series.size(); i++) {
+            size_t &n = cursor[i];
+            while (n < series[i].timesUs.size() && series[i].timesUs[n] == us) n++;
+            row += ',';
+            if (n > 0) row += std::to_string(series[i].values[n - 1]);
+        }
+        row += '\n';
+        if (fwrite(row.data(), 1, row.size(), file) != row.size()) return false;
+    }
+    return fflush(file) == 0;
+}
+
+bool canSeriesWriteBinary(FILE *file, const std::vector<CanSeries> &series) {
+    static const uint8_t zeros[8] = {};
+    auto pad = [&](size_t size) { return fwrite(zeros, 1, (8 - size % 8) % 8, file) == (8 - size % 8) % 8; };
+
+    uint8_t header[CAN_SERIES_HEADER_SIZE] = {};
+    memcpy(header, CAN_SERIES_MAGIC, CAN_SERIES_MAGIC_SIZE);
+    const uint32_t headerSize = CAN_SERIES_HEADER_SIZE;
+    const uint32_t count = uint32_t(series.size());
+    memcpy(header + 8, &headerSize, 4);
+    memcpy(header + 12, &count, 4);
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    for (const CanSeries &s : series) {
+        uint8_t entry[16] = {};
+        const uint32_t nameSize = uint32_t(s.name.size());
+        const uint64_t points = s.timesUs.size();
+        memcpy(entry, &nameSize, 4);
+        memcpy(entry + 8, &points, 8);
+        ok = ok && fwrite(entry, 1, sizeof(entry), file) == sizeof(entry) &&
+             fwrite(s.name.data(), 1, nameSize, file) == nameSize && pad(nameSize) &&
+             fwrite(s.timesUs.data(), sizeof(int64_t), points, file) == points &&
+             fwrite(s.values.data(), sizeof(int32_t), points, file) == points &&
+             pad(points * sizeof(int32_t));
+    }
+    return fflush(file) == 0 && ok;
+}
@@ -0,0 +1,105 @@
+#ifndef CANSERIES_H
+#define CANSERIES_H
+
+#include "canlog.h"
+#include "canprotocol.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Binary series file (.cqs), little endian, columnar:
+ *   header (16 bytes): char magic[8] "CANQRY01", uint32 header size, uint32 series count
+ *   per series:
+ *     uint32 name length, uint32 reserved, uint64 points, char name[], padding to 8 bytes,
+ *     int64 time_us[points], int32 value[points], padding to 8 bytes
+ */
+#define CAN_SERIES_MAGIC            "CANQRY01"
+#define CAN_SERIES_MAGIC_SIZE       8U
+#define CAN_SERIES_HEADER_SIZE      16U
+
+enum CanSeriesKind : uint8_t {
+    CAN_SERIES_DIGITAL_INPUT = 0,                   // Switch as the cluster decodes it
+    CAN_SERIES_ANALOG_INPUT,                        // Raw analog value
+    CAN_SERIES_DIGITAL_OUTPUT,                      // Lamp as commanded by the cluster, 1 = on
+};
+
+/*
+ * @brief A signal of io_config.json.
+ */
+struct CanSeriesSignal {
+    std::string name;
+    uint8_t kind = CAN_SERIES_DIGITAL_INPUT;
+    uint8_t signal = CAN_SIGNAL_UNKNOWN;            // CanSignal of inputs
+    uint8_t pos = 0;                                // Position in the IO configuration
+};
+
+/*
+ * @brief Value changes of one signal. The first point is the value at the
+ *        start of the range, or the first value seen after it.
+ */
+struct CanSeries {
+    std::string name;
+    std::vector<int64_t> timesUs;
+    std::vector<int32_t> values;
+};
+
+/*
+ * @brief The cluster's signal definitions, read from io_config.json.
+ */
+class CanSeriesConfig {
+public:
+    /*
+     * @brief Read the digital_inputs, analog_inputs and digital_outputs sections.
+     * @return false if the file cannot be read or is not an IO configuration.
+     */
+    bool load(const std::string &path);
+
+    const std::vector<CanSeriesSignal> &signals() const { return m_signals; }
+    const CanSignalMap &map() const { return m_map; }
+    const std::string &error() const { return m_error; }
+
+    /*
+     * @brief Find a signal by name.
+     * @return nullptr if there is none.
+     */
+    const CanSeriesSignal *find(const std::string &name) const;
+
+    /*
+     * @brief CAN IDs to read for a set of signals, sorted. The digital input
+     *        frames are always included, the ignition gates the switches.
+     */
+    std::vector<uint32_t> ids(const std::vector<CanSeriesSignal> &signals) const;
+
+private:
+    std::vector<CanSeriesSignal> m_signals;
+    CanSignalMap m_map;
+    std::string m_error;
+};
+
+/*
+ * @brief Decode the frames into per-signal series with canDecodeFrame(), the
+ *        decoder of the cluster, so the switches behave exactly as on the target.
+ * @param config: Signal definitions.
+ * @param signals: Signals to extract.
+ * @param records: Frames in time order, starting before fromUs to learn the initial state.
+ * @param fromUs, toUs: Range of the series.
+ * @param series: Receives one series per signal.
+ */
+void canSeriesExtract(const CanSeriesConfig &config, const std::vector<CanSeriesSignal> &signals,
+                      const std::vector<CanLogRecord> &records, int64_t fromUs, int64_t toUs,
+                      std::vector<CanSeries> &series);
+
+/*
+ * @brief Write the series as CSV: a time column in seconds and one column per
+ *        signal, one row per change with the other signals carried forward.
+ */
+bool canSeriesWriteCsv(FILE *file, const std::vector<CanSeries> &series);
+
+/*
+ * @brief Write the series in the columnar .cqs format.
+ */
+bool canSeriesWriteBinary(FILE *file, const std::vector<CanSeries> &series);
+
+#endif // CANSERIES_H
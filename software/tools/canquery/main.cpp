@@ -0,0 +1,284 @@
+#include "canindex.h"
+#include "canseries.h"
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Offline query of recorded CAN logs.
+ *
+ * Each log gets a sidecar index (<log>.cidx) of its blocks with their time
+ * range and a bloom filter of their CAN IDs, built once in parallel. A query
+ * maps the logs, decodes only the blocks that overlap the time range and may
+ * hold one of the frames of the wanted signals, in parallel, and then runs
+ * the frames through the cluster's own decoder in time order. Decoding starts
+ * a warm-up period before the range so the first rows hold the state the
+ * cluster had at its start.
+ */
+
+#define DEFAULT_IO_CONFIG       "/opt/qtapp/io_configs/io_config.json"
+#define DEFAULT_WARMUP_S        10.0
+
+struct Options {
+    std::string ioConfig = DEFAULT_IO_CONFIG;
+    std::string signalList;
+    const char *from = nullptr;
+    const char *to = nullptr;
+    double warmupS = DEFAULT_WARMUP_S;
+    const char *output = nullptr;
+    bool binary = false;
+    unsigned jobs = 0;
+    bool reindex = false;
+    bool info = false;
+};
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options] LOG...\n"
+            "\n"
+            "Extract the value changes of cluster signals from candump, .clog or black box\n"
+            "(.cbb) logs, decoded as the cluster decodes them.\n"
+            "\n"
+            "  -c, --io-config FILE    signal definitions (default %s)\n"
+            "  -s, --signals LIST      comma separated signal names (default all)\n"
+            "  -f, --from TIME         start of the range (default start of the logs)\n"
+            "  -t, --to TIME           end of the range (default end of the logs)\n"
+            "  -w, --warmup S          seconds decoded before the range for the initial state (default %.0f)\n"
+            "  -o, --output FILE       output file (default stdout)\n"
+            "  -F, --format FMT        csv or bin (default csv)\n"
+            "  -j, --jobs N            decoding threads (default all cores)\n"
+            "      --reindex           rebuild the indexes\n"
+            "      --info              print the indexes and the signals and exit\n"
+            "\n"
+            "TIME is HH:MM[:SS[.frac]] local time on the day the logs start, +SECONDS from\n"
+            "the start of the logs, or seconds since the epoch.\n",
+            name, DEFAULT_IO_CONFIG, DEFAULT_WARMUP_S);
+}
+
+/*
+ * @brief Parse a TIME argument.
+ * @param startUs: First timestamp of the logs.
+ * @return false if the text is not a time.
+ */
+static bool parseTime(const char *text, int64_t startUs, int64_t &us) {
+    char *end = nullptr;
+    if (text[0] == '+') {
+        const double seconds = strtod(text + 1, &end);
+        if (end == text + 1 || *end) return false;
+        us = startUs + llround(seconds * 1e6);
+        return true;
+    }
+
+    if (strchr(text, ':')) {
+        unsigned hour = 0, minute = 0;
+        double second = 0.0;
+        int consumed = 0;
+        const int fields = sscanf(text, "%u:%u%n:%lf%n", &hour, &minute, &consumed, &second, &consumed);
+        if (fields < 2 || text[consumed] || hour > 23 || minute > 59 || second < 0.0 || second >= 61.0) {
+            return false;
+        }
+        const time_t start = time_t(startUs / 1000000);
+        struct tm day;
+        localtime_r(&start, &day);
+        day.tm_hour = int(hour);
+        day.tm_min = int(minute);
+        day.tm_sec = 0;
+        day.tm_isdst = -1;
+        us = int64_t(mktime(&day)) * 1000000LL + llround(second * 1e6);
+        return true;
+    }
+
+    const double seconds = strtod(text, &end);
+    if (end == text || *end) return false;
+    us = llround(seconds * 1e6);
+    return true;
+}
+
+static void printTime(const char *label, int64_t us) {
+    const time_t seconds = time_t(us / 1000000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+    printf("%s%s.%06lld\n", label, text, static_cast<long long>(us % 1000000));
+}
+
+static const char *formatName(CanLogFormat format) {
+    switch (format) {
+    case CAN_LOG_FORMAT_CLOG: return "clog";
+    case CAN_LOG_FORMAT_BLACKBOX: return "black box";
+    default: return "candump";
+    }
+}
+
+int main(int argc, char **argv) {
+    static const struct option longOptions[] = {
+        { "io-config", required_argument, nullptr, 'c' },
+        { "signals",   required_argument, nullptr, 's' },
+        { "from",      required_argument, nullptr, 'f' },
+        { "to",        required_argument, nullptr, 't' },
+        { "warmup",    required_argument, nullptr, 'w' },
+        { "output",    required_argument, nullptr, 'o' },
+        { "format",    required_argument, nullptr, 'F' },
+        { "jobs",      required_argument, nullptr, 'j' },
+        { "reindex",   no_argument,       nullptr, 'R' },
+        { "info",      no_argument,       nullptr, 'I' },
+        { "help",      no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+    Options opt;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "c:s:f:t:w:o:F:j:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+        case 'c': opt.ioConfig = optarg; break;
+        case 's': opt.signalList = optarg; break;
+        case 'f': opt.from = optarg; break;
+        case 't': opt.to = optarg; break;
+        case 'w': opt.warmupS = std::max(0.0, atof(optarg)); break;
+        case 'o': opt.output = optarg; break;
+        case 'F':
+            if (!strcmp(optarg, "csv")) opt.binary = false;
+            else if (!strcmp(optarg, "bin")) opt.binary = true;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'j': opt.jobs = unsigned(std::max(1, atoi(optarg))); break;
+        case 'R': opt.reindex = true; break;
+        case 'I': opt.info = true; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (opt.jobs == 0) opt.jobs = std::max(1U, std::thread::hardware_concurrency());
+
+    CanSeriesConfig config;
+    if (!config.load(opt.ioConfig)) {
+        fprintf(stderr, "%s\n", config.error().c_str());
+        return 1;
+    }
+
+    std::vector<CanSeriesSignal> signals;
+    if (opt.signalList.empty()) {
+        signals = config.signals();
+    } else {
+        std::stringstream stream(opt.signalList);
+        std::string name;
+        while (std::getline(stream, name, ',')) {
+            const CanSeriesSignal *signal = config.find(name);
+            if (!signal) {
+                fprintf(stderr, "unknown signal: %s\n", name.c_str());
+                return 1;
+            }
+            signals.push_back(*signal);
+        }
+    }
+
+    // Index the logs
+    const int64_t indexStartNs = canLogMonotonicNs();
+    std::vector<std::unique_ptr<CanLogIndex>> logs;
+    int64_t startUs = INT64_MAX, endUs = INT64_MIN;
+    for (int i = optind; i < argc; i++) {
+        std::unique_ptr<CanLogIndex> log(new CanLogIndex());
+        if (!log->open(argv[i], opt.jobs, opt.reindex)) {
+            fprintf(stderr, "%s\n", log->error().c_str());
+            return 1;
+        }
+        if (log->frames() > 0) {
+            startUs = std::min(startUs, log->firstUs());
+            endUs = std::max(endUs, log->lastUs());
+        }
+        logs.push_back(std::move(log));
+    }
+    const double indexS = double(canLogMonotonicNs() - indexStartNs) / 1e9;
+
+    if (opt.info) {
+        for (const std::unique_ptr<CanLogIndex> &log : logs) {
+            printf("%s: %s, %llu bytes, %zu blocks, %llu frames%s\n", log->path().c_str(),
+                   formatName(log->format()), static_cast<unsigned long long>(log->size()),
+                   log->blocks().size(), static_cast<unsigned long long>(log->frames()),
+                   log->rebuilt() ? " (indexed now)" : "");
+            if (log->frames() > 0) {
+                printTime("  first ", log->firstUs());
+                printTime("  last  ", log->lastUs());
+            }
+        }
+        printf("signals:");
+        for (const CanSeriesSignal &signal : config.signals()) printf(" %s", signal.name.c_str());
+        printf("\n");
+        return 0;
+    }
+    if (startUs == INT64_MAX) {
+        fprintf(stderr, "no frames in the logs\n");
+        return 1;
+    }
+
+    int64_t fromUs = startUs, toUs = endUs;
+    if (opt.from && !parseTime(opt.from, startUs, fromUs)) {
+        fprintf(stderr, "bad time: %s\n", opt.from);
+        return 1;
+    }
+    if (opt.to && !parseTime(opt.to, startUs, toUs)) {
+        fprintf(stderr, "bad time: %s\n", opt.to);
+        return 1;
+    }
+    if (toUs < fromUs) {
+        fprintf(stderr, "empty time range\n");
+        return 1;
+    }
+
+    // Decode the candidate blocks in parallel, then the frames in time order
+    const int64_t queryStartNs = canLogMonotonicNs();
+    const std::vector<uint32_t> ids = config.ids(signals);
+    const int64_t warmupUs = llround(opt.warmupS * 1e6);
+    std::vector<CanLogRecord> records;
+    size_t blocks = 0, totalBlocks = 0;
+    for (const std::unique_ptr<CanLogIndex> &log : logs) {
+        blocks += log->query(fromUs - warmupUs, toUs, ids, opt.jobs, records);
+        totalBlocks += log->blocks().size();
+    }
+    if (!std::is_sorted(records.begin(), records.end(), [](const CanLogRecord &a, const CanLogRecord &b) {
+            return a.timestampUs < b.timestampUs;
+        })) {
+        std::stable_sort(records.begin(), records.end(), [](const CanLogRecord &a, const CanLogRecord &b) {
+            return a.timestampUs < b.timestampUs;
+        });
+    }
+
+    std::vector<CanSeries> series;
+    canSeriesExtract(config, signals, records, fromUs, toUs, series);
+
+    FILE *out = stdout;
+    if (opt.output && !(out = fopen(opt.output, "wb"))) {
+        perror(opt.output);
+        return 1;
+    }
+    const bool written = opt.binary ? canSeriesWriteBinary(out, series) : canSeriesWriteCsv(out, series);
+    if (out != stdout) fclose(out);
+    if (!written) {
+        fprintf(stderr, "error writing the output\n");
+        return 1;
+    }
+
+    size_t points = 0;
+    for (const CanSeries &s : series) points += s.timesUs.size();
+    fprintf(stderr, "%zu of %zu blocks, %zu frames, %zu points, index %.3f s, query %.3f s\n", blocks,
+            totalBlocks, records.size(), points, indexS, double(canLogMonotonicNs() - queryStartNs) / 1e9);
+    return 0;
+}
@@ -0,0 +1,23 @@
+# Replays candump / .clog / black box (.cbb) logs onto a SocketCAN interface and records .clog logs.
+# Plain C++, shares the log reader with the cluster application.
+TEMPLATE = app
+TARGET = canreplay
+CONFIG += console c++17
+CONFIG -= qt app_bundle
+
+APP_DIR = $$PWD/../../qtapp/files
+INCLUDEPATH += $$APP_DIR/communication
+
+SOURCES += \
+        main.cpp \
+        $$APP_DIR/communication/canblackbox.cpp \
+        $$APP_DIR/communication/canlog.cpp
+
+HEADERS += \
+        $$APP_DIR/communication/canblackbox.h \
+        $$APP_DIR/communication/canlog.h
+
+LIBS += -lz -lpthread
+
+target.path = /usr/bin
+INSTALLS += target
@@ -0,0 +1,216 @@
+#include "canlog.h"
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <poll.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int) { running = 0; }
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-i interface] [-s speed] [-l loops] <log>\n"
+            "       %s -r <out.clog> [-i interface] [-n frames]\n"
+            "\n"
+            "Replay a candump (.log), binary (.clog) or black box (.cbb) log onto a SocketCAN interface,\n"
+            "or record the interface into a binary log.\n"
+            "\n"
+            "  -i interface  SocketCAN interface (default vcan0)\n"
+            "  -s speed      time scale of the original timing, 0 = as fast as possible (default 1)\n"
+            "  -l loops      number of passes over the log, 0 = forever (default 1)\n"
+            "  -r file       record to a .clog file until interrupted\n"
+            "  -n frames     stop recording after this many frames\n",
+            name, name);
+}
+
+/*
+ * @brief Open a raw CAN socket bound to an interface.
+ * @return The socket, or -1 on error.
+ */
+static int openSocket(const char *interface) {
+    int sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, interface, IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0) {
+        fprintf(stderr, "%s: %s\n", interface, strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/*
+ * @brief Write a frame, waiting for room in the device queue (ENOBUFS) instead of dropping it.
+ */
+static bool sendFrame(int sock, const struct can_frame &frame) {
+    while (running) {
+        if (write(sock, &frame, sizeof(frame)) == sizeof(frame)) return true;
+        if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR) return false;
+
+        struct pollfd pfd = { sock, POLLOUT, 0 };
+        poll(&pfd, 1, 10);
+    }
+    return false;
+}
+
+static int replay(const char *interface, const char *path, double speed, long loops) {
+    CanLogReader reader;
+    if (!reader.open(path)) {
+        fprintf(stderr, "%s\n", reader.error().c_str());
+        return 1;
+    }
+
+    int sock = openSocket(interface);
+    if (sock < 0) return 1;
+
+    CanReplayPacer pacer(speed);
+    CanLogRecord record;
+    unsigned long long frames = 0, errors = 0;
+    int64_t lateSumNs = 0, maxLateNs = 0;
+    const int64_t startNs = canLogMonotonicNs();
+
+    for (long pass = 0; running && (loops == 0 || pass < loops); pass++) {
+        if (pass > 0) {
+            reader.rewind();
+            pacer.reset();
+        }
+        while (running && reader.next(record)) {
+            const int64_t late = pacer.waitFor(record.timestampUs);
+            lateSumNs += late;
+            maxLateNs = std::max(maxLateNs, late);
+
+            if (sendFrame(sock, record.frame)) {
+                frames++;
+            } else {
+                errors++;
+            }
+        }
+    }
+
+    const int64_t wallNs = canLogMonotonicNs() - startNs;
+    close(sock);
+
+    printf("%llu frames to %s in %.1f ms (%.0f frames/s, speed %g), %llu errors\n",
+           frames, interface, wallNs / 1e6, wallNs > 0 ? frames * 1e9 / wallNs : 0.0, speed, errors);
+    printf("release lateness: avg %.1f us, max %.1f us\n",
+           frames ? lateSumNs / 1e3 / frames : 0.0, maxLateNs / 1e3);
+    return errors ? 2 : 0;
+}
+
+static int record(const char *interface, const char *path, unsigned long long limit) {
+    int sock = openSocket(interface);
+    if (sock < 0) return 1;
+
+    CanLogWriter writer;
+    if (!writer.open(path)) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close(sock);
+        return 1;
+    }
+
+    // Kernel receive timestamps, so the log timing does not include our scheduling delay
+    int enable = 1;
+    setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+
+    CanLogRecord rec;
+    struct iovec iov = { &rec.frame, sizeof(rec.frame) };
+    char ctrl[CMSG_SPACE(sizeof(struct timeval))];
+    unsigned long long frames = 0;
+
+    while (running && (limit == 0 || frames < limit)) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        if (recvmsg(sock, &msg, 0) != sizeof(rec.frame)) continue;
+
+        rec.timestampUs = 0;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMP) {
+                struct timeval tv;
+                memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+                rec.timestampUs = uint64_t(tv.tv_sec) * 1000000ULL + tv.tv_usec;
+            }
+        }
+        if (rec.timestampUs == 0) {
+            rec.timestampUs = uint64_t(canLogMonotonicNs() / 1000);
+        }
+
+        writer.write(rec);
+        frames++;
+    }
+
+    writer.close();
+    close(sock);
+    printf("%llu frames from %s recorded to %s\n", frames, interface, path);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *interface = "vcan0";
+    const char *recordPath = nullptr;
+    double speed = 1.0;
+    long loops = 1;
+    unsigned long long limit = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:s:l:r:n:h")) != -1) {
+        switch (opt) {
+        case 'i': interface = optarg; break;
+        case 's': speed = atof(optarg); break;
+        case 'l': loops = atol(optarg); break;
+        case 'r': recordPath = optarg; break;
+        case 'n': limit = strtoull(optarg, nullptr, 10); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    // No SA_RESTART, so a blocking recvmsg() returns on Ctrl-C
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    if (recordPath) {
+        return record(interface, recordPath, limit);
+    }
+    if (optind >= argc || speed < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    return replay(interface, argv[optind], speed, loops);
+}